@@ -76,7 +76,7 @@ void init_user_files()
         .file_properties.action_file_id = ACTION_FILE_ID,
         .file_properties.action_condition = ALP_ACT_COND_WRITE,
         .file_properties.storage_class = FS_STORAGE_VOLATILE,
-        .file_properties.permissions = 0, // TODO
+        .file_properties.permissions = FS_PERMISSION_USER_READ | FS_PERMISSION_USER_WRITE | FS_PERMISSION_GUEST_READ,
         .length = SENSOR_FILE_SIZE
     };
 
@@ -84,18 +84,19 @@ void init_user_files()
 
     // configure file notification using D7AActP: write ALP command to broadcast changes made to file 0x40 in file 0x41
     // first generate ALP command consisting of ALP Control header, ALP File Data Request operand and D7ASP interface configuration
-    alp_control_t alp_ctrl = {
-        .group = false,
-        .response_requested = false,
-        .operation = ALP_OP_READ_FILE_DATA
-    };
-
-    alp_operand_file_data_request_t file_data_request_operand = {
-        .file_offset = {
-            .file_id = SENSOR_FILE_ID,
-            .offset = 0
+    alp_action_t alp_action = {
+        .ctrl = {
+            .group = false,
+            .response_requested = false,
+            .operation = ALP_OP_READ_FILE_DATA
         },
-        .requested_data_length = SENSOR_FILE_SIZE,
+        .file_data_request = {
+            .file_offset = {
+                .file_id = SENSOR_FILE_ID,
+                .offset = 0
+            },
+            .requested_data_length = SENSOR_FILE_SIZE,
+        }
     };
 
     d7asp_fifo_config_t d7asp_fifo_config = {
@@ -108,7 +109,7 @@ void init_user_files()
             .qos_ctrl_ack_not_void = false,
             .qos_ack_period = 1,
             .qos_retry_single = 3,
-            .qos_retry_total = 0
+            .qos_retry_total = 3
         },
         .dormant_timeout = 0,
         .start_id = 0, // TODO
@@ -121,7 +122,7 @@ void init_user_files()
     };
 
     // finally, register D7AActP file
-    fs_init_file_with_D7AActP(ACTION_FILE_ID, &d7asp_fifo_config, &alp_ctrl, (uint8_t*)&file_data_request_operand);
+    fs_init_file_with_D7AActP(ACTION_FILE_ID, &d7asp_fifo_config, &alp_action);
 }
 
 void on_d7asp_fifo_flush_completed(d7asp_fifo_config_t* fifo_config, uint8_t* progress_bitmap, uint8_t* success_bitmap, uint8_t bitmap_byte_count)
@@ -157,7 +158,7 @@ void bootstrap()
                 },
                 .channel_index_start = 0,
                 .channel_index_end = 0,
-                .eirp = 0,
+                .eirp = 10,
                 .ccao = 0
             }
         }
@@ -77,7 +77,9 @@ static void process_uart_rx_fifo()
             // and now ALP command
             uint8_t alp_command_length = length - D7ASP_FIFO_CONFIG_SIZE;
             fifo_pop(&uart_rx_fifo, alp_command, alp_command_length);
-            d7asp_queue_alp_actions(&fifo_config, alp_command, alp_command_length);
+            error_t err = d7asp_queue_alp_actions(&fifo_config, alp_command, alp_command_length);
+            if(err != SUCCESS)
+                log_print_string("Queuing ALP command failed: %d", err); // the command is dropped, the host can resend it
         }
 
         sched_post_task(&process_uart_rx_fifo);
@@ -125,7 +127,7 @@ void bootstrap()
                 },
                 .channel_index_start = 16,
                 .channel_index_end = 16,
-                .eirp = 0,
+                .eirp = 10,
                 .ccao = 0
             }
         }
@@ -41,6 +41,8 @@
 #include "hwradio.h"
 #include "hwsystem.h"
 #include "hwdebug.h"
+#include "scheduler.h"
+#include "timer.h"
 
 #include "cc1101.h"
 #include "cc1101_interface.h"
@@ -56,6 +58,14 @@
 
 #define RSSI_OFFSET 74
 
+// the time after the SRX strobe before the RSSI is valid, per channel class (in us), consisting of the
+// frequency synthesizer calibration and settling and the RSSI response time of the channel filter (see DN505)
+static const uint16_t rssi_valid_delay_us[] = {
+    [PHY_CLASS_LO_RATE] = 1100, // narrow channel filter, slow RSSI response
+    [PHY_CLASS_NORMAL_RATE] = 950,
+    [PHY_CLASS_HI_RATE] = 900,
+};
+
 #if DEBUG_PIN_NUM >= 2
     #define DEBUG_TX_START() hw_debug_set(0);
     #define DEBUG_TX_END() hw_debug_clr(0);
@@ -82,6 +92,7 @@ static release_packet_callback_t release_packet_callback;
 static rx_packet_callback_t rx_packet_callback;
 static tx_packet_callback_t tx_packet_callback;
 static rssi_valid_callback_t rssi_valid_callback;
+static rx_filter_callback_t rx_filter_callback;
 
 static hw_radio_state_t current_state;
 static hw_radio_packet_t* current_packet;
@@ -93,12 +104,15 @@ static channel_id_t current_channel_id = {
 };
 
 static syncword_class_t current_syncword_class = PHY_SYNCWORD_CLASS0;
-static syncword_class_t current_eirp = 0;
+static eirp_t current_eirp = 0;
+static phy_channel_band_t current_eirp_band = 0xFF; // the band for which the PATABLE is configured, invalid until configured
 
 static bool should_rx_after_tx_completed = false;
 static hw_rx_cfg_t pending_rx_cfg;
 
 static void start_rx(hw_rx_cfg_t const* rx_cfg);
+static void report_rssi();
+static void restart_rx();
 
 static RF_SETTINGS rf_settings = {
    RADIO_GDO2_VALUE,   			// IOCFG2    GDO2 output pin configuration.
@@ -148,6 +162,7 @@ static void switch_to_idle_mode()
     DPRINT("Switching to HW_RADIO_STATE_IDLE");
     //Flush FIFOs and go to sleep, ensure interrupts are disabled
     current_state = HW_RADIO_STATE_IDLE;
+    timer_cancel_task(&report_rssi);
     cc1101_interface_set_interrupts_enabled(false);
     cc1101_interface_strobe(RF_SFRX); // TODO cc1101 datasheet : Only issue SFRX in IDLE or RXFIFO_OVERFLOW states
     cc1101_interface_strobe(RF_SFTX); // TODO cc1101 datasheet : Only issue SFTX in IDLE or TXFIFO_UNDERFLOW states.
@@ -167,14 +182,56 @@ static inline int16_t convert_rssi(int8_t rssi_raw)
 }
 
 
-static void ensure_settling_and_calibration_done()
+static timer_tick_t get_rssi_valid_delay(phy_channel_class_t channel_class)
+{
+    // rounded up to timer ticks, the resolution of the timer is coarser than the delays so this is at least 1 tick
+    return (rssi_valid_delay_us[channel_class] * (uint32_t)TIMER_TICKS_PER_SEC + 999999) / 1000000;
+}
+
+static void report_rssi()
 {
-    uint8_t status = (cc1101_interface_strobe(RF_SNOP)) & 0x70;
-    while ((status == 0x40) || (status == 0x50))
+    // the RX configuration might have been changed in the meantime
+    if(current_state != HW_RADIO_STATE_RX || rssi_valid_callback == NULL)
+        return;
+
+    // the delay is a prediction, check the radio really is in RX and not still calibrating or settling
+    uint8_t status = cc1101_interface_strobe(RF_SNOP) & 0x70;
+    if(status != 0x10)
     {
-        hw_busy_wait(10);
-        status = cc1101_interface_strobe(RF_SNOP);
+        timer_post_task_delay(&report_rssi, 1);
+        return;
     }
+
+    rssi_valid_callback(hw_radio_get_rssi());
+}
+
+static void flush_rx_and_restart()
+{
+    // called from the ISR, so leave RX and flush and restart from a task instead of waiting for the state changes here.
+    // The RX FIFO can only be flushed in the IDLE or RX overflow state, an overflow is left as is.
+    if((cc1101_interface_strobe(RF_SNOP) & 0x70) != 0x60)
+        cc1101_interface_strobe(RF_SIDLE);
+
+    sched_post_task(&restart_rx);
+}
+
+static void restart_rx()
+{
+    // RX might have been stopped or restarted by the upper layer in the meantime
+    if(current_state != HW_RADIO_STATE_RX)
+        return;
+
+    uint8_t status = cc1101_interface_strobe(RF_SNOP) & 0x70;
+    if(status != 0x00 && status != 0x60)
+    {
+        // not yet in IDLE
+        sched_post_task(&restart_rx);
+        return;
+    }
+
+    cc1101_interface_strobe(RF_SFRX);
+    cc1101_interface_strobe(RF_SRX); // the radio calibrates and settles on its own, like in start_rx()
+    cc1101_interface_set_interrupts_enabled(true);
 }
 
 static void end_of_packet_isr()
@@ -184,35 +241,48 @@ static void end_of_packet_isr()
     switch(current_state)
     {
         case HW_RADIO_STATE_RX: ;
+            if((cc1101_interface_read_single_reg(RXBYTES) & 0x7F) == 0)
+            {
+                // packet dropped by the address filter, the radio restarted RX already
+                DPRINT("Packet dropped by address filter");
+                cc1101_interface_set_interrupts_enabled(true);
+                return;
+            }
+
             uint8_t packet_len = cc1101_interface_read_single_reg(RXFIFO);
             DPRINT("EOP ISR packetLength: %d", packet_len);
             if(packet_len >= 63)
             {
             	// long packets not yet supported or bit error in length byte, don't assert but flush rx
                 DPRINT("Packet size too big, flushing RX");
-                uint8_t status = (cc1101_interface_strobe(RF_SNOP) & 0xF0);
-                if(status == 0x60)
-                {
-                    // RX overflow
-                    cc1101_interface_strobe(RF_SFRX);
-                }
-                else if(status == 0x10)
-                {
-                    // still in RX, switch to idle first
-                    cc1101_interface_strobe(RF_SIDLE);
-                    cc1101_interface_strobe(RF_SFRX);
-                }
+                flush_rx_and_restart();
+                return;
+            }
 
-                while(cc1101_interface_strobe(RF_SNOP) != 0x0F); // wait until in idle state
-                cc1101_interface_strobe(RF_SRX);
-                while(cc1101_interface_strobe(RF_SNOP) != 0x1F); // wait until in RX state
-                cc1101_interface_set_interrupts_enabled(true);
+            // the packet is received completely by now, but read the first bytes only and let the upper layer decide
+            // if the packet is worth a buffer
+            uint8_t header[HW_RADIO_RX_FILTER_DATA_SIZE];
+            uint8_t header_len = packet_len < HW_RADIO_RX_FILTER_DATA_SIZE - 1? packet_len : HW_RADIO_RX_FILTER_DATA_SIZE - 1;
+            header[0] = packet_len;
+            cc1101_interface_read_burst_reg(RXFIFO, header + 1, header_len);
+            if(rx_filter_callback != NULL && !rx_filter_callback(header, header_len + 1))
+            {
+                DPRINT("Packet dropped by rx filter, flushing RX");
+                flush_rx_and_restart();
                 return;
             }
 
             hw_radio_packet_t* packet = alloc_packet_callback(packet_len);
-            packet->length = packet_len;
-            cc1101_interface_read_burst_reg(RXFIFO, packet->data + 1, packet->length);
+            if(packet == NULL)
+            {
+                // no buffer available in upper layer, drop the packet
+                DPRINT("Could not allocate packet, flushing RX");
+                flush_rx_and_restart();
+                return;
+            }
+
+            memcpy(packet->data, header, header_len + 1);
+            cc1101_interface_read_burst_reg(RXFIFO, packet->data + 1 + header_len, packet_len - header_len);
 
             // fill rx_meta
             packet->rx_meta.rssi = convert_rssi(cc1101_interface_read_single_reg(RXFIFO));
@@ -232,17 +302,17 @@ static void end_of_packet_isr()
 
             if(current_state == HW_RADIO_STATE_RX) // check still in RX, could be modified by upper layer while in callback
             {
-                uint8_t status = (cc1101_interface_strobe(RF_SNOP) & 0xF0);
+                uint8_t status = (cc1101_interface_strobe(RF_SNOP) & 0x70);
                 if(status == 0x60) // RX overflow
                 {
-                    cc1101_interface_strobe(RF_SFRX);
-                    while(cc1101_interface_strobe(RF_SNOP) != 0x0F); // wait until in idle state
-                    cc1101_interface_strobe(RF_SRX);
-                    while(cc1101_interface_strobe(RF_SNOP) != 0x1F); // wait until in RX state
+                    flush_rx_and_restart();
+                    break;
                 }
 
                 cc1101_interface_set_interrupts_enabled(true);
-                assert(cc1101_interface_strobe(RF_SNOP) == 0x1F); // expect to be in RX mode
+                // expect to be in RX mode, or still calibrating and settling when RX was restarted from the callback
+                uint8_t state = cc1101_interface_strobe(RF_SNOP) & 0x70;
+                assert(state == 0x10 || state == 0x40 || state == 0x50);
             }
             break;
         case HW_RADIO_STATE_TX:
@@ -367,15 +437,57 @@ static void configure_channel(const channel_id_t* channel_id)
     cc1101_interface_strobe(RF_SCAL); // TODO is this the right case?
 }
 
+#define EIRP_LEVELS_COUNT 8
+
+// the output power levels for which the datasheet specifies the optimum PATABLE settings
+static const eirp_t eirp_levels[EIRP_LEVELS_COUNT] = { -30, -20, -15, -10, 0, 5, 7, 10 };
+
+// PATABLE settings for the levels in eirp_levels, per frequency band
+static const uint8_t patable_433[EIRP_LEVELS_COUNT] = { 0x12, 0x0E, 0x1D, 0x34, 0x60, 0x84, 0xC8, 0xC0 };
+static const uint8_t patable_868[EIRP_LEVELS_COUNT] = { 0x03, 0x0F, 0x1E, 0x27, 0x50, 0x81, 0xCB, 0xC2 };
+static const uint8_t patable_915[EIRP_LEVELS_COUNT] = { 0x03, 0x0E, 0x1E, 0x27, 0x8E, 0xCD, 0xC7, 0xC0 };
+
+// returns the index of the lowest level at or above eirp, or the highest level when eirp is higher than supported
+static uint8_t get_eirp_level_index(eirp_t eirp)
+{
+    uint8_t i = 0;
+    while(i < EIRP_LEVELS_COUNT - 1 && eirp_levels[i] < eirp)
+        i++;
+
+    return i;
+}
+
 static void configure_eirp(const eirp_t eirp)
 {
-    if(eirp != current_eirp)
+    // the PATABLE value depends on the frequency band, so configure_channel() has to be called first
+    if(eirp != current_eirp || current_channel_id.channel_header.ch_freq_band != current_eirp_band)
     {
         current_eirp = eirp;
-        cc1101_interface_write_single_patable(0xC0); // TODO only 10 dBm supported for now
+        current_eirp_band = current_channel_id.channel_header.ch_freq_band;
+        uint8_t level_index = get_eirp_level_index(eirp);
+        DPRINT("Set EIRP: %d dBm (requested %d dBm)", eirp_levels[level_index], eirp);
+        switch(current_eirp_band)
+        {
+            case PHY_BAND_433:
+                cc1101_interface_write_single_patable(patable_433[level_index]);
+                break;
+            case PHY_BAND_868:
+                cc1101_interface_write_single_patable(patable_868[level_index]);
+                break;
+            case PHY_BAND_915:
+                cc1101_interface_write_single_patable(patable_915[level_index]);
+                break;
+            default:
+                assert(false);
+        }
     }
 }
 
+eirp_t hw_radio_get_supported_eirp(eirp_t eirp)
+{
+    return eirp_levels[get_eirp_level_index(eirp)];
+}
+
 static void configure_syncword_class(syncword_class_t syncword_class)
 {
     if(syncword_class != current_syncword_class)
@@ -392,6 +504,8 @@ error_t hw_radio_init(alloc_packet_callback_t alloc_packet_cb,
     release_packet_callback = release_packet_cb;
 
     current_state = HW_RADIO_STATE_IDLE;
+    sched_register_task(&report_rssi);
+    sched_register_task(&restart_rx);
 
     cc1101_interface_init(&end_of_packet_isr);
     cc1101_interface_reset_radio_core();
@@ -409,6 +523,27 @@ error_t hw_radio_init(alloc_packet_callback_t alloc_packet_cb,
     configure_channel(&current_channel_id);
     configure_eirp(current_eirp);
     configure_syncword_class(current_syncword_class);
+    return SUCCESS;
+}
+
+error_t hw_radio_set_rx_filter(rx_filter_callback_t rx_filter_cb, bool first_byte_filter_enabled, uint8_t first_byte)
+{
+    if(alloc_packet_callback == NULL)
+        return EOFF; // the registers can only be written after hw_radio_init()
+
+    rx_filter_callback = rx_filter_cb;
+
+    // the CC1101 address filter checks the first byte after the length byte, packets which do not match are
+    // discarded by the radio itself and RX is restarted (see end_of_packet_isr())
+    uint8_t pktctrl1 = RADIO_PKTCTRL1_PQT(3) | RADIO_PKTCTRL1_APPEND_STATUS;
+    if(first_byte_filter_enabled)
+    {
+        cc1101_interface_write_single_reg(ADDR, first_byte);
+        pktctrl1 |= RADIO_PKTCTRL1_ADR_CHK_ON;
+    }
+
+    cc1101_interface_write_single_reg(PKTCTRL1, pktctrl1);
+    return SUCCESS;
 }
 
 static void start_rx(hw_rx_cfg_t const* rx_cfg)
@@ -423,17 +558,21 @@ static void start_rx(hw_rx_cfg_t const* rx_cfg)
 //    	status = cc1101_interface_strobe(RF_SNOP) & 0x80;
 //    }
 
+    // a flush requested from the ISR is done here, the radio already left RX for it
+    if(sched_is_scheduled(&restart_rx))
+    {
+        sched_cancel_task(&restart_rx);
+        cc1101_interface_strobe(RF_SFRX);
+    }
+
     configure_channel(&(rx_cfg->channel_id));
     configure_syncword_class(rx_cfg->syncword_class);
     cc1101_interface_write_single_reg(PKTLEN, 0xFF);
 
     // cc1101_interface_strobe(RF_SFRX); TODO only when in idle or overflow state
 
-    uint8_t status;
-    do
-    {
-    	status = cc1101_interface_strobe(RF_SRX);
-    } while(status != 0x1F);
+    // the radio calibrates and settles on its own after the strobe, no need to wait for it here
+    cc1101_interface_strobe(RF_SRX);
 
     DEBUG_RX_START();
     if(rx_packet_callback != 0) // when rx callback not set we ignore received packets
@@ -441,15 +580,10 @@ static void start_rx(hw_rx_cfg_t const* rx_cfg)
 
 	// TODO when only rssi callback set the packet handler is still active and we enter in RXFIFOOVERFLOW, find a way to around this
 
+    // the RSSI is reported from a task when it is expected to be valid, so the caller is not blocked meanwhile
+    timer_cancel_task(&report_rssi);
     if(rssi_valid_callback != 0)
-    {
-        // TODO calculate/predict rssi response time (see DN505)
-        // and wait until valid. For now we wait 200 us.
-
-        hw_busy_wait(200);
-        ensure_settling_and_calibration_done();
-        rssi_valid_callback(hw_radio_get_rssi());
-    }
+        timer_post_task_delay(&report_rssi, get_rssi_valid_delay(rx_cfg->channel_id.channel_header.ch_class));
 }
 
 error_t hw_radio_set_rx(hw_rx_cfg_t const* rx_cfg, rx_packet_callback_t rx_cb, rssi_valid_callback_t rssi_valid_cb)
@@ -0,0 +1,44 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*! \file efm32hg_aes.c
+ *
+ *  Overrides the software AES framework component using the AES peripheral
+ */
+
+#include <string.h>
+
+#include "aes.h"
+#include "ng.h"
+#include "em_aes.h"
+#include "em_cmu.h"
+
+static uint8_t NGDEF(_key)[AES_KEY_SIZE];
+#define key NG(_key)
+
+__LINK_C void aes_set_key(const uint8_t* new_key)
+{
+    CMU_ClockEnable(cmuClock_AES, true);
+    memcpy(key, new_key, AES_KEY_SIZE);
+}
+
+__LINK_C void aes_encrypt_block(const uint8_t* in, uint8_t* out)
+{
+    // the peripheral loads the key for every block, the ECB mode of a single block is the raw block cipher
+    AES_ECB128(out, in, AES_BLOCK_SIZE, key, true);
+}
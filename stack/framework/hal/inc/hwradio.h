@@ -154,9 +154,10 @@ typedef struct
 {
     channel_id_t channel_id; 		/**< The channel_id of the D7A 'channel' on which to send the packet */
     syncword_class_t syncword_class;	/**< The 'syncword' class used */
-    eirp_t eirp;			/**< The transmission power level measured in dBm [-39,+10]. If the 
+    eirp_t eirp;			/**< The transmission power level measured in dBm [-39,+10]. 
 					 *   If the value specified is not supported by the driver, 
-                                         *   the nearest supported value is used instead
+                                         *   the lowest supported value above it is used instead, see
+					 *   hw_radio_get_supported_eirp()
 					 */    
 } hw_tx_cfg_t;
 
@@ -329,6 +330,31 @@ typedef void (*tx_packet_callback_t)(hw_radio_packet_t* packet);
  */
 typedef void (*rssi_valid_callback_t)(int16_t cur_rssi);
 
+/** \brief The maximum number of bytes (including the length byte) passed to the rx_filter_callback_t function
+ *
+ */
+#define HW_RADIO_RX_FILTER_DATA_SIZE 11
+
+/** \brief Type definition for the rx filter callback function.
+ *
+ * The rx_filter_callback_t function is called by the PHY driver for every received packet, *before* a buffer is
+ * allocated for the packet using the alloc_packet_callback_t function. This allows the upper layer to drop packets
+ * which are not meant for this node (for example because of a subnet or address mismatch) without allocating a
+ * packet buffer or posting a task. When the filter is called depends on the driver: the CC1101 driver calls it
+ * from the end of packet interrupt, so a dropped packet is still received completely.
+ *
+ * The data supplied contains the length byte (data[0]) followed by the first bytes of the packet, data_length
+ * is the total number of bytes available, which is at most HW_RADIO_RX_FILTER_DATA_SIZE and less for short packets.
+ *
+ * As with new_packet_callback_t, this function is called from an interrupt context and should therefore do
+ * as little processing as possible.
+ *
+ * \param data		The first bytes of the packet, starting with the length byte
+ * \param data_length	The number of bytes available in data
+ * \return bool		true if the packet should be received, false if the packet should be dropped
+ */
+typedef bool (*rx_filter_callback_t)(uint8_t const* data, uint8_t data_length);
+
 /** \brief Initialise the radio driver. 
  *
  * After initialisation, the radio is in IDLE state. The RX must be explicitly enabled by a call to
@@ -351,6 +377,33 @@ typedef void (*rssi_valid_callback_t)(int16_t cur_rssi);
  */
 __LINK_C error_t hw_radio_init(alloc_packet_callback_t p_alloc, release_packet_callback_t p_free);
 
+/** \brief Install a filter which is evaluated for every received packet before it is allocated.
+ *
+ * Besides the software filter (see rx_filter_callback_t) radios which support hardware packet filtering can
+ * also be instructed to only accept packets of which the first byte following the length byte equals
+ * first_byte. Radios which do not support this ignore first_byte_filter_enabled, the rx_filter_cb should
+ * therefore always implement the same check.
+ *
+ * \param rx_filter_cb			The filter to call for every received packet, or 0x0 to receive all packets
+ * \param first_byte_filter_enabled	true if the radio may drop packets of which the first byte does not match first_byte
+ * \param first_byte			The value of the first byte following the length byte of packets to receive
+ *
+ * \return error_t	SUCCESS if the filter was installed
+ *			EOFF if the radio is not yet initialised, the filter is not installed in that case.
+ */
+__LINK_C error_t hw_radio_set_rx_filter(rx_filter_callback_t rx_filter_cb, bool first_byte_filter_enabled, uint8_t first_byte);
+
+/** \brief Returns the transmission power level the radio uses when the specified eirp is requested in the hw_tx_cfg_t.
+ *
+ * This is the lowest supported level at or above eirp, or the highest supported level when eirp is higher
+ * than the radio supports. This allows the upper layers to advertise the actual transmission power.
+ *
+ * \param eirp			The requested transmission power level in dBm
+ *
+ * \return eirp_t	The transmission power level in dBm which will be used
+ */
+__LINK_C eirp_t hw_radio_get_supported_eirp(eirp_t eirp);
+
 /** \brief Set the radio in the IDLE mode.
  *
  * When the radio is IDLE, the tranceiver is disabled to reduce energy consumption. 
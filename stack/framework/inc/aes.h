@@ -0,0 +1,54 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*! \file aes.h
+ * \addtogroup aes
+ * \ingroup framework
+ * @{
+ * \brief Specifies the AES-128 block cipher facilities of the framework
+ *
+ * The framework provides a portable software implementation. Chips with an AES peripheral override this
+ * component to use the hardware instead. Only the encryption direction of the block cipher is provided, which is
+ * all that is needed by the CTR, CBC-MAC and CCM modes.
+ */
+#ifndef __AES_H_
+#define __AES_H_
+
+#include "types.h"
+#include "link_c.h"
+
+#define AES_BLOCK_SIZE 16
+#define AES_KEY_SIZE 16
+
+/*! \brief Set the 128 bit key used by all subsequent calls to aes_encrypt_block()
+ *
+ * \param	key	The key, AES_KEY_SIZE bytes
+ */
+__LINK_C void aes_set_key(const uint8_t* key);
+
+/*! \brief Encrypt a single block using the key set by aes_set_key()
+ *
+ * \param	in	The plaintext block, AES_BLOCK_SIZE bytes
+ * \param	out	The ciphertext block, AES_BLOCK_SIZE bytes. May be the same buffer as in
+ */
+__LINK_C void aes_encrypt_block(const uint8_t* in, uint8_t* out);
+
+
+#endif // __AES_H_
+
+/** @}*/
@@ -20,6 +20,7 @@
  *
  */
 
+#include "string.h"
 #include "debug.h"
 #include "ng.h"
 
@@ -27,14 +28,687 @@
 #include "packet.h"
 #include "fs.h"
 
+#define FILE_COPY_CHUNK_SIZE 16
+#define QUERY_COMPARE_LENGTH_MAX 16 // TODO define from cmake
+
+typedef enum {
+    ALP_OPERAND_UNKNOWN = 0, // operations which are not supported, all table entries which are not initialized
+    ALP_OPERAND_NONE,
+    ALP_OPERAND_FILE_ID,
+    ALP_OPERAND_FILE_DATA_REQUEST,
+    ALP_OPERAND_FILE_DATA,
+    ALP_OPERAND_FILE_HEADER,
+    ALP_OPERAND_FILE_COPY,
+    ALP_OPERAND_STATUS,
+    ALP_OPERAND_QUERY,
+    ALP_OPERAND_COUNT
+} alp_operand_type_t;
+
+typedef bool (*operand_parser_t)(const uint8_t** ptr, const uint8_t* end, alp_action_t* action);
+typedef bool (*operand_encoder_t)(uint8_t** ptr, uint8_t* end, const alp_action_t* action);
+
+typedef struct {
+    operand_parser_t parse;
+    operand_encoder_t encode;
+} operand_codec_t;
+
+/*! \brief Executes an action in the role of the requester and appends the response, if any, to the response buffer */
+typedef alp_status_code_t (*action_handler_t)(const alp_action_t* action, fs_role_t role, uint8_t** response_ptr, uint8_t* response_end);
+
+typedef struct {
+    alp_operand_type_t operand_type;
+    action_handler_t handler; // NULL when the action is vectored to the application layer
+} operation_t;
+
 static alp_unhandled_action_callback NGDEF(_unhandled_action_cb);
 #define unhandled_action_cb NG(_unhandled_action_cb)
 
-static alp_operation_t get_operation(uint8_t* alp_command)
+// the request is parsed from the payload of the packet which is reused for the response, so the response is built separately
+static uint8_t NGDEF(_response_buffer)[D7ASP_PAYLOAD_MAX_LENGTH];
+#define response_buffer NG(_response_buffer)
+
+static bool read_byte(const uint8_t** ptr, const uint8_t* end, uint8_t* value)
+{
+    if(*ptr >= end)
+        return false;
+
+    *value = **ptr; (*ptr)++;
+    return true;
+}
+
+static bool write_byte(uint8_t** ptr, uint8_t* end, uint8_t value)
+{
+    if(*ptr >= end)
+        return false;
+
+    **ptr = value; (*ptr)++;
+    return true;
+}
+
+static uint8_t get_length_operand_size(uint32_t length)
+{
+    if(length <= 0x3F)
+        return 1;
+    else if(length <= 0x3FFF)
+        return 2;
+    else if(length <= 0x3FFFFF)
+        return 3;
+
+    return 4;
+}
+
+// the 2 MSBs of the first byte hold the number of bytes following it, the value is stored in the remaining bits (BE)
+static bool read_length(const uint8_t** ptr, const uint8_t* end, uint32_t* length)
+{
+    if(*ptr >= end)
+        return false;
+
+    uint8_t size = ((**ptr) >> 6) + 1;
+    if(end - *ptr < size)
+        return false;
+
+    *length = (**ptr) & 0x3F; (*ptr)++;
+    for(uint8_t i = 1; i < size; i++)
+    {
+        *length = ((*length) << 8) | (**ptr); (*ptr)++;
+    }
+
+    return true;
+}
+
+static bool write_length(uint8_t** ptr, uint8_t* end, uint32_t length)
+{
+    uint8_t size = get_length_operand_size(length);
+    if(length > ALP_LENGTH_OPERAND_MAX || end - *ptr < size)
+        return false;
+
+    for(int8_t i = size - 1; i >= 0; i--)
+    {
+        **ptr = (uint8_t)(length >> (8 * i)); (*ptr)++;
+    }
+
+    (*ptr)[-size] |= (size - 1) << 6;
+    return true;
+}
+
+static bool read_uint32(const uint8_t** ptr, const uint8_t* end, uint32_t* value)
+{
+    if(end - *ptr < 4)
+        return false;
+
+    *value = ((uint32_t)(*ptr)[0] << 24) | ((uint32_t)(*ptr)[1] << 16) | ((uint32_t)(*ptr)[2] << 8) | (*ptr)[3];
+    (*ptr) += 4;
+    return true;
+}
+
+static bool write_uint32(uint8_t** ptr, uint8_t* end, uint32_t value)
+{
+    if(end - *ptr < 4)
+        return false;
+
+    (*ptr)[0] = value >> 24; (*ptr)[1] = value >> 16; (*ptr)[2] = value >> 8; (*ptr)[3] = value;
+    (*ptr) += 4;
+    return true;
+}
+
+static bool read_file_offset(const uint8_t** ptr, const uint8_t* end, alp_operand_file_offset_t* file_offset)
+{
+    return read_byte(ptr, end, &file_offset->file_id) && read_length(ptr, end, &file_offset->offset);
+}
+
+static bool write_file_offset(uint8_t** ptr, uint8_t* end, const alp_operand_file_offset_t* file_offset)
+{
+    return write_byte(ptr, end, file_offset->file_id) && write_length(ptr, end, file_offset->offset);
+}
+
+static bool parse_no_operand(const uint8_t** ptr, const uint8_t* end, alp_action_t* action)
+{
+    return true;
+}
+
+static bool encode_no_operand(uint8_t** ptr, uint8_t* end, const alp_action_t* action)
+{
+    return true;
+}
+
+static bool parse_file_id_operand(const uint8_t** ptr, const uint8_t* end, alp_action_t* action)
+{
+    return read_byte(ptr, end, &action->file_id);
+}
+
+static bool encode_file_id_operand(uint8_t** ptr, uint8_t* end, const alp_action_t* action)
+{
+    return write_byte(ptr, end, action->file_id);
+}
+
+static bool parse_file_data_request_operand(const uint8_t** ptr, const uint8_t* end, alp_action_t* action)
+{
+    return read_file_offset(ptr, end, &action->file_data_request.file_offset)
+            && read_length(ptr, end, &action->file_data_request.requested_data_length);
+}
+
+static bool encode_file_data_request_operand(uint8_t** ptr, uint8_t* end, const alp_action_t* action)
+{
+    return write_file_offset(ptr, end, &action->file_data_request.file_offset)
+            && write_length(ptr, end, action->file_data_request.requested_data_length);
+}
+
+static bool parse_file_data_operand(const uint8_t** ptr, const uint8_t* end, alp_action_t* action)
+{
+    alp_operand_file_data_t* file_data = &action->file_data;
+    if(!read_file_offset(ptr, end, &file_data->file_offset) || !read_length(ptr, end, &file_data->provided_data_length))
+        return false;
+
+    if(file_data->provided_data_length > end - *ptr)
+        return false;
+
+    file_data->data = *ptr;
+    (*ptr) += file_data->provided_data_length;
+    return true;
+}
+
+static bool encode_file_data_operand(uint8_t** ptr, uint8_t* end, const alp_action_t* action)
+{
+    const alp_operand_file_data_t* file_data = &action->file_data;
+    if(!write_file_offset(ptr, end, &file_data->file_offset) || !write_length(ptr, end, file_data->provided_data_length))
+        return false;
+
+    if(file_data->provided_data_length > end - *ptr)
+        return false;
+
+    memcpy(*ptr, file_data->data, file_data->provided_data_length);
+    (*ptr) += file_data->provided_data_length;
+    return true;
+}
+
+static bool parse_file_header_operand(const uint8_t** ptr, const uint8_t* end, alp_action_t* action)
+{
+    alp_operand_file_header_t* file_header = &action->file_header;
+    return read_byte(ptr, end, &file_header->file_id)
+            && read_byte(ptr, end, &file_header->permissions)
+            && read_byte(ptr, end, &file_header->properties)
+            && read_byte(ptr, end, &file_header->action_file_id)
+            && read_byte(ptr, end, &file_header->interface_file_id)
+            && read_uint32(ptr, end, &file_header->file_size)
+            && read_uint32(ptr, end, &file_header->allocated_size);
+}
+
+static bool encode_file_header_operand(uint8_t** ptr, uint8_t* end, const alp_action_t* action)
+{
+    const alp_operand_file_header_t* file_header = &action->file_header;
+    return write_byte(ptr, end, file_header->file_id)
+            && write_byte(ptr, end, file_header->permissions)
+            && write_byte(ptr, end, file_header->properties)
+            && write_byte(ptr, end, file_header->action_file_id)
+            && write_byte(ptr, end, file_header->interface_file_id)
+            && write_uint32(ptr, end, file_header->file_size)
+            && write_uint32(ptr, end, file_header->allocated_size);
+}
+
+static bool parse_file_copy_operand(const uint8_t** ptr, const uint8_t* end, alp_action_t* action)
+{
+    return read_byte(ptr, end, &action->file_copy.source_file_id)
+            && read_byte(ptr, end, &action->file_copy.destination_file_id);
+}
+
+static bool encode_file_copy_operand(uint8_t** ptr, uint8_t* end, const alp_action_t* action)
+{
+    return write_byte(ptr, end, action->file_copy.source_file_id)
+            && write_byte(ptr, end, action->file_copy.destination_file_id);
+}
+
+static bool parse_status_operand(const uint8_t** ptr, const uint8_t* end, alp_action_t* action)
+{
+    return read_byte(ptr, end, &action->status.action_index) && read_byte(ptr, end, &action->status.status_code);
+}
+
+static bool encode_status_operand(uint8_t** ptr, uint8_t* end, const alp_action_t* action)
+{
+    return write_byte(ptr, end, action->status.action_index) && write_byte(ptr, end, action->status.status_code);
+}
+
+static bool read_data_pointer(const uint8_t** ptr, const uint8_t* end, uint32_t length, const uint8_t** data)
+{
+    if(length > end - *ptr)
+        return false;
+
+    *data = *ptr;
+    (*ptr) += length;
+    return true;
+}
+
+static bool write_data(uint8_t** ptr, uint8_t* end, uint32_t length, const uint8_t* data)
+{
+    if(length > end - *ptr)
+        return false;
+
+    memcpy(*ptr, data, length);
+    (*ptr) += length;
+    return true;
+}
+
+static bool is_query_compared_with_value(const alp_operand_query_t* query)
+{
+    return query->type == ALP_QUERY_TYPE_ARITH_COMP_WITH_VALUE || query->type == ALP_QUERY_TYPE_STRING_TOKEN_SEARCH;
+}
+
+static bool parse_query_operand(const uint8_t** ptr, const uint8_t* end, alp_action_t* action)
+{
+    alp_operand_query_t* query = &action->query;
+    if(!read_byte(ptr, end, &query->code_raw) || !read_length(ptr, end, &query->compare_length))
+        return false;
+
+    switch(query->type)
+    {
+        case ALP_QUERY_TYPE_NON_VOID_CHECK:
+        case ALP_QUERY_TYPE_ARITH_COMP_WITH_ZERO:
+        case ALP_QUERY_TYPE_ARITH_COMP_WITH_VALUE:
+        case ALP_QUERY_TYPE_ARITH_COMP_BETWEEN_FILES:
+        case ALP_QUERY_TYPE_STRING_TOKEN_SEARCH:
+            break;
+        default:
+            return false; // the length of the operand of other query types is not known
+    }
+
+    query->mask = NULL;
+    if(query->mask_present && !read_data_pointer(ptr, end, query->compare_length, &query->mask))
+        return false;
+
+    query->compare_value = NULL;
+    if(is_query_compared_with_value(query) && !read_data_pointer(ptr, end, query->compare_length, &query->compare_value))
+        return false;
+
+    if(!read_file_offset(ptr, end, &query->file_offset))
+        return false;
+
+    if(query->type == ALP_QUERY_TYPE_ARITH_COMP_BETWEEN_FILES)
+        return read_file_offset(ptr, end, &query->compare_file_offset);
+
+    return true;
+}
+
+static bool encode_query_operand(uint8_t** ptr, uint8_t* end, const alp_action_t* action)
+{
+    const alp_operand_query_t* query = &action->query;
+    if(!write_byte(ptr, end, query->code_raw) || !write_length(ptr, end, query->compare_length))
+        return false;
+
+    if(query->mask_present && !write_data(ptr, end, query->compare_length, query->mask))
+        return false;
+
+    if(is_query_compared_with_value(query) && !write_data(ptr, end, query->compare_length, query->compare_value))
+        return false;
+
+    if(!write_file_offset(ptr, end, &query->file_offset))
+        return false;
+
+    if(query->type == ALP_QUERY_TYPE_ARITH_COMP_BETWEEN_FILES)
+        return write_file_offset(ptr, end, &query->compare_file_offset);
+
+    return true;
+}
+
+static const operand_codec_t operand_codecs[ALP_OPERAND_COUNT] = {
+    [ALP_OPERAND_NONE] = { &parse_no_operand, &encode_no_operand },
+    [ALP_OPERAND_FILE_ID] = { &parse_file_id_operand, &encode_file_id_operand },
+    [ALP_OPERAND_FILE_DATA_REQUEST] = { &parse_file_data_request_operand, &encode_file_data_request_operand },
+    [ALP_OPERAND_FILE_DATA] = { &parse_file_data_operand, &encode_file_data_operand },
+    [ALP_OPERAND_FILE_HEADER] = { &parse_file_header_operand, &encode_file_header_operand },
+    [ALP_OPERAND_FILE_COPY] = { &parse_file_copy_operand, &encode_file_copy_operand },
+    [ALP_OPERAND_STATUS] = { &parse_status_operand, &encode_status_operand },
+    [ALP_OPERAND_QUERY] = { &parse_query_operand, &encode_query_operand }
+};
+
+// reads the data a query is evaluated on, returns false when the data is not in the file or the requester is not allowed
+// to read it. A query on such a file is not satisfied, otherwise it reveals the data.
+static bool read_query_data(const alp_operand_file_offset_t* file_offset, fs_role_t role, uint8_t length, uint8_t* buffer)
 {
-    alp_control_t alp_ctrl;
-    alp_ctrl.raw = (*alp_command);
-    return alp_ctrl.operation;
+    if(!fs_is_read_allowed(file_offset->file_id, role))
+        return false;
+
+    fs_file_header_t file_header;
+    fs_read_file_header(file_offset->file_id, &file_header);
+    if(file_offset->offset > file_header.length || length > file_header.length - file_offset->offset
+            || file_offset->offset + length > UINT8_MAX)
+        return false;
+
+    fs_read_file(file_offset->file_id, file_offset->offset, buffer, length);
+    return true;
+}
+
+// compares the masked big endian values byte per byte. For signed values the sign bit is inverted, so the order of the
+// bytes matches the order of the values
+static int8_t compare_values(const uint8_t* value, const uint8_t* compare_value, uint8_t length, const uint8_t* mask,
+                             bool is_signed)
+{
+    for(uint8_t i = 0; i < length; i++)
+    {
+        uint8_t byte = value[i];
+        uint8_t compare_byte = compare_value[i];
+        if(mask != NULL)
+        {
+            byte &= mask[i];
+            compare_byte &= mask[i];
+        }
+
+        if(i == 0 && is_signed)
+        {
+            byte ^= 0x80;
+            compare_byte ^= 0x80;
+        }
+
+        if(byte != compare_byte)
+            return byte < compare_byte? -1 : 1;
+    }
+
+    return 0;
+}
+
+static bool is_comparison_satisfied(alp_query_comp_type_t comp_type, int8_t comparison)
+{
+    switch(comp_type)
+    {
+        case ALP_QUERY_COMP_TYPE_INEQUALITY: return comparison != 0;
+        case ALP_QUERY_COMP_TYPE_EQUALITY: return comparison == 0;
+        case ALP_QUERY_COMP_TYPE_LESS_THAN: return comparison < 0;
+        case ALP_QUERY_COMP_TYPE_LESS_THAN_OR_EQUAL_TO: return comparison <= 0;
+        case ALP_QUERY_COMP_TYPE_GREATER_THAN: return comparison > 0;
+        case ALP_QUERY_COMP_TYPE_GREATER_THAN_OR_EQUAL_TO: return comparison >= 0;
+        default: return false;
+    }
+}
+
+// searches the token from the file offset up to the end of the file, allowing max_errors bytes to differ
+static bool search_token(const alp_operand_query_t* query, fs_role_t role, uint8_t* data)
+{
+    alp_operand_file_offset_t file_offset = query->file_offset;
+    while(read_query_data(&file_offset, role, query->compare_length, data))
+    {
+        uint8_t errors = 0;
+        for(uint8_t i = 0; i < query->compare_length && errors <= query->max_errors; i++)
+        {
+            uint8_t mask = query->mask != NULL? query->mask[i] : 0xFF;
+            if((data[i] & mask) != (query->compare_value[i] & mask))
+                errors++;
+        }
+
+        if(errors <= query->max_errors)
+            return true;
+
+        file_offset.offset++;
+    }
+
+    return false;
+}
+
+// a query on data which is not available locally is not satisfied, this is not an error since the same request is
+// evaluated by all nodes addressed
+static alp_status_code_t evaluate_query(const alp_operand_query_t* query, fs_role_t role, bool* is_satisfied)
+{
+    if(query->compare_length == 0 || query->compare_length > QUERY_COMPARE_LENGTH_MAX)
+        return ALP_STATUS_OPERAND_WRONG_FORMAT;
+
+    uint8_t data[QUERY_COMPARE_LENGTH_MAX];
+    uint8_t compare_data[QUERY_COMPARE_LENGTH_MAX];
+    *is_satisfied = false;
+    switch(query->type)
+    {
+        case ALP_QUERY_TYPE_NON_VOID_CHECK:
+            *is_satisfied = read_query_data(&query->file_offset, role, query->compare_length, data);
+            break;
+        case ALP_QUERY_TYPE_ARITH_COMP_WITH_ZERO:
+            memset(compare_data, 0, query->compare_length);
+            if(read_query_data(&query->file_offset, role, query->compare_length, data))
+                *is_satisfied = is_comparison_satisfied(query->comp_type,
+                        compare_values(data, compare_data, query->compare_length, query->mask, query->signed_data_type));
+            break;
+        case ALP_QUERY_TYPE_ARITH_COMP_WITH_VALUE:
+            if(read_query_data(&query->file_offset, role, query->compare_length, data))
+                *is_satisfied = is_comparison_satisfied(query->comp_type,
+                        compare_values(data, query->compare_value, query->compare_length, query->mask, query->signed_data_type));
+            break;
+        case ALP_QUERY_TYPE_ARITH_COMP_BETWEEN_FILES:
+            if(read_query_data(&query->file_offset, role, query->compare_length, data)
+                    && read_query_data(&query->compare_file_offset, role, query->compare_length, compare_data))
+                *is_satisfied = is_comparison_satisfied(query->comp_type,
+                        compare_values(data, compare_data, query->compare_length, query->mask, query->signed_data_type));
+            break;
+        case ALP_QUERY_TYPE_STRING_TOKEN_SEARCH:
+            *is_satisfied = search_token(query, role, data);
+            break;
+        default:
+            return ALP_STATUS_UNKNOWN_OPERATION;
+    }
+
+    return ALP_STATUS_OK;
+}
+
+static bool is_query(alp_operation_t operation)
+{
+    return operation == ALP_OP_ACTION_QUERY || operation == ALP_OP_BREAK_QUERY;
+}
+
+// the file data is read straight into the response instead of being copied
+static alp_status_code_t process_op_read_file_data(const alp_action_t* action, fs_role_t role, uint8_t** response_ptr, uint8_t* response_end)
+{
+    const alp_operand_file_offset_t* file_offset = &action->file_data_request.file_offset;
+    if(!fs_is_file_defined(file_offset->file_id))
+        return ALP_STATUS_FILE_ID_NOT_EXISTS;
+
+    if(!fs_is_read_allowed(file_offset->file_id, role))
+        return ALP_STATUS_INSUFFICIENT_PERMISSIONS;
+
+    fs_file_header_t file_header;
+    fs_read_file_header(file_offset->file_id, &file_header);
+    if(file_offset->offset >= file_header.length || file_offset->offset > UINT8_MAX)
+        return ALP_STATUS_WRITE_OFFSET_OUT_OF_BOUNDS;
+
+    // less data than requested is returned when the file or the response ends before
+    uint32_t length = action->file_data_request.requested_data_length;
+    if(length > file_header.length - file_offset->offset)
+        length = file_header.length - file_offset->offset;
+
+    uint8_t* ptr = *response_ptr;
+    uint8_t header_size = 1 + 1 + get_length_operand_size(file_offset->offset) + get_length_operand_size(length);
+    if(response_end - ptr < header_size)
+        return ALP_STATUS_UNKNOWN_ERROR;
+
+    if(length > response_end - ptr - header_size)
+        length = response_end - ptr - header_size;
+
+    alp_control_t ctrl = { .operation = ALP_OP_RETURN_FILE_DATA };
+    write_byte(&ptr, response_end, ctrl.raw);
+    write_file_offset(&ptr, response_end, file_offset);
+    write_length(&ptr, response_end, length);
+    fs_read_file(file_offset->file_id, file_offset->offset, ptr, length);
+    *response_ptr = ptr + length;
+    return ALP_STATUS_OK;
+}
+
+static alp_status_code_t process_op_read_file_properties(const alp_action_t* action, fs_role_t role, uint8_t** response_ptr, uint8_t* response_end)
+{
+    if(!fs_is_file_defined(action->file_id))
+        return ALP_STATUS_FILE_ID_NOT_EXISTS;
+
+    fs_file_header_t file_header;
+    fs_read_file_header(action->file_id, &file_header);
+    alp_action_t response = {
+        .ctrl = { .operation = ALP_OP_RETURN_FILE_PROPERTIES },
+        .file_header = {
+            .file_id = action->file_id,
+            .permissions = file_header.file_properties.permissions,
+            .properties = file_header.file_properties._flags,
+            .action_file_id = file_header.file_properties.action_file_id,
+            .interface_file_id = 0xFF, // TODO interface files not supported yet
+            .file_size = file_header.length,
+            .allocated_size = file_header.length
+        }
+    };
+
+    uint8_t length = alp_encode_action(&response, *response_ptr, response_end - *response_ptr);
+    if(length == 0)
+        return ALP_STATUS_UNKNOWN_ERROR;
+
+    (*response_ptr) += length;
+    return ALP_STATUS_OK;
+}
+
+static alp_status_code_t process_op_write_file_data(const alp_action_t* action, fs_role_t role, uint8_t** response_ptr, uint8_t* response_end)
+{
+    const alp_operand_file_data_t* file_data = &action->file_data;
+    if(!fs_is_file_defined(file_data->file_offset.file_id))
+        return ALP_STATUS_FILE_ID_NOT_EXISTS;
+
+    if(!fs_is_write_allowed(file_data->file_offset.file_id, role))
+        return ALP_STATUS_INSUFFICIENT_PERMISSIONS;
+
+    fs_file_header_t file_header;
+    fs_read_file_header(file_data->file_offset.file_id, &file_header);
+    if(file_data->file_offset.offset >= file_header.length || file_data->file_offset.offset > UINT8_MAX)
+        return ALP_STATUS_WRITE_OFFSET_OUT_OF_BOUNDS;
+
+    if(file_data->provided_data_length > file_header.length - file_data->file_offset.offset)
+        return ALP_STATUS_WRITE_DATA_OVERFLOW;
+
+    // the data is written, the status of the action of the file is returned
+    return fs_write_file(file_data->file_offset.file_id, file_data->file_offset.offset, file_data->data, file_data->provided_data_length);
+}
+
+static alp_status_code_t process_op_write_file_properties(const alp_action_t* action, fs_role_t role, uint8_t** response_ptr, uint8_t* response_end)
+{
+    if(!fs_is_file_defined(action->file_header.file_id))
+        return ALP_STATUS_FILE_ID_NOT_EXISTS;
+
+    // the properties of system files are fixed, these would give access to the security files or make the stack execute
+    // actions
+    if(role != FS_ROLE_ROOT && (action->file_header.file_id < D7A_FILE_USER_FILE_ID_START
+                                || !fs_is_write_allowed(action->file_header.file_id, role)))
+        return ALP_STATUS_INSUFFICIENT_PERMISSIONS;
+
+    // the size of a file is fixed when the filesystem is initialized, only the properties can change
+    fs_file_header_t file_header;
+    fs_read_file_header(action->file_header.file_id, &file_header);
+    if(action->file_header.file_size != file_header.length)
+        return ALP_STATUS_CREATE_FILE_LENGTH_MISMATCH;
+
+    fs_file_properties_t file_properties = { ._flags = action->file_header.properties };
+    if(file_properties.action_protocol_enabled
+            && !fs_is_action_file_allowed(action->file_header.file_id, action->file_header.action_file_id, role))
+        return fs_is_file_defined(action->file_header.action_file_id)? ALP_STATUS_INSUFFICIENT_PERMISSIONS : ALP_STATUS_FILE_ID_NOT_EXISTS;
+
+    file_header.file_properties.permissions = action->file_header.permissions;
+    file_header.file_properties._flags = action->file_header.properties;
+    file_header.file_properties.action_file_id = action->file_header.action_file_id;
+    fs_write_file_properties(action->file_header.file_id, &file_header.file_properties);
+    return ALP_STATUS_OK;
+}
+
+// used for flush, open and close as well, there is nothing to do for these in a RAM filesystem
+static alp_status_code_t process_op_exist_file(const alp_action_t* action, fs_role_t role, uint8_t** response_ptr, uint8_t* response_end)
+{
+    return fs_is_file_defined(action->file_id)? ALP_STATUS_OK : ALP_STATUS_FILE_ID_NOT_EXISTS;
+}
+
+// files cannot be created, deleted or restored once the filesystem is initialized
+static alp_status_code_t process_op_create_file(const alp_action_t* action, fs_role_t role, uint8_t** response_ptr, uint8_t* response_end)
+{
+    if(fs_is_file_defined(action->file_header.file_id))
+        return ALP_STATUS_FILE_ID_ALREADY_EXISTS;
+
+    return ALP_STATUS_CREATE_FILE_ALLOCATION_EXCEEDS_AVAILABILITY;
+}
+
+static alp_status_code_t process_op_delete_file(const alp_action_t* action, fs_role_t role, uint8_t** response_ptr, uint8_t* response_end)
+{
+    if(!fs_is_file_defined(action->file_id))
+        return ALP_STATUS_FILE_ID_NOT_EXISTS;
+
+    return ALP_STATUS_INSUFFICIENT_PERMISSIONS;
+}
+
+static alp_status_code_t process_op_restore_file(const alp_action_t* action, fs_role_t role, uint8_t** response_ptr, uint8_t* response_end)
+{
+    if(!fs_is_file_defined(action->file_id))
+        return ALP_STATUS_FILE_ID_NOT_EXISTS;
+
+    return ALP_STATUS_FILE_NOT_RESTORABLE;
+}
+
+// copies the data of the source file to the destination file, as much as fits in the destination file
+static alp_status_code_t process_op_copy_file(const alp_action_t* action, fs_role_t role, uint8_t** response_ptr, uint8_t* response_end)
+{
+    uint8_t source_file_id = action->file_copy.source_file_id;
+    uint8_t destination_file_id = action->file_copy.destination_file_id;
+    if(!fs_is_file_defined(source_file_id) || !fs_is_file_defined(destination_file_id))
+        return ALP_STATUS_FILE_ID_NOT_EXISTS;
+
+    if(!fs_is_read_allowed(source_file_id, role) || !fs_is_write_allowed(destination_file_id, role))
+        return ALP_STATUS_INSUFFICIENT_PERMISSIONS;
+
+    fs_file_header_t source_file_header;
+    fs_file_header_t destination_file_header;
+    fs_read_file_header(source_file_id, &source_file_header);
+    fs_read_file_header(destination_file_id, &destination_file_header);
+    uint32_t length = source_file_header.length;
+    if(length > destination_file_header.length)
+        length = destination_file_header.length;
+
+    if(length > UINT8_MAX)
+        length = UINT8_MAX;
+
+    uint8_t chunk[FILE_COPY_CHUNK_SIZE];
+    for(uint8_t offset = 0; offset < length; )
+    {
+        uint8_t chunk_length = length - offset > sizeof(chunk)? sizeof(chunk) : length - offset;
+        fs_read_file(source_file_id, offset, chunk, chunk_length);
+        alp_status_code_t status = fs_write_file(destination_file_id, offset, chunk, chunk_length);
+        if(status != ALP_STATUS_OK)
+            return status;
+
+        offset += chunk_length;
+    }
+
+    return ALP_STATUS_OK;
+}
+
+static alp_status_code_t process_op_nop(const alp_action_t* action, fs_role_t role, uint8_t** response_ptr, uint8_t* response_end)
+{
+    return ALP_STATUS_OK;
+}
+
+// the operand of each operation and how the operation is handled, operations without an entry are not supported
+static const operation_t operations[ALP_OPERATION_COUNT] = {
+    [ALP_OP_NOP] = { ALP_OPERAND_NONE, &process_op_nop },
+    [ALP_OP_READ_FILE_DATA] = { ALP_OPERAND_FILE_DATA_REQUEST, &process_op_read_file_data },
+    [ALP_OP_READ_FILE_PROPERTIES] = { ALP_OPERAND_FILE_ID, &process_op_read_file_properties },
+    [ALP_OP_WRITE_FILE_DATA] = { ALP_OPERAND_FILE_DATA, &process_op_write_file_data },
+    [ALP_OP_WRITE_FILE_DATA_FLUSH] = { ALP_OPERAND_FILE_DATA, &process_op_write_file_data },
+    [ALP_OP_WRITE_FILE_PROPERTIES] = { ALP_OPERAND_FILE_HEADER, &process_op_write_file_properties },
+    [ALP_OP_ACTION_QUERY] = { ALP_OPERAND_QUERY, NULL }, // queries are evaluated by alp_process_received_request()
+    [ALP_OP_BREAK_QUERY] = { ALP_OPERAND_QUERY, NULL },
+    [ALP_OP_EXIST_FILE] = { ALP_OPERAND_FILE_ID, &process_op_exist_file },
+    [ALP_OP_CREATE_FILE] = { ALP_OPERAND_FILE_HEADER, &process_op_create_file },
+    [ALP_OP_DELETE_FILE] = { ALP_OPERAND_FILE_ID, &process_op_delete_file },
+    [ALP_OP_RESTORE_FILE] = { ALP_OPERAND_FILE_ID, &process_op_restore_file },
+    [ALP_OP_FLUSH_FILE] = { ALP_OPERAND_FILE_ID, &process_op_exist_file },
+    [ALP_OP_OPEN_FILE] = { ALP_OPERAND_FILE_ID, &process_op_exist_file },
+    [ALP_OP_CLOSE_FILE] = { ALP_OPERAND_FILE_ID, &process_op_exist_file },
+    [ALP_OP_COPY_FILE] = { ALP_OPERAND_FILE_COPY, &process_op_copy_file },
+    [ALP_OP_RETURN_FILE_DATA] = { ALP_OPERAND_FILE_DATA, NULL },
+    [ALP_OP_RETURN_FILE_PROPERTIES] = { ALP_OPERAND_FILE_HEADER, NULL },
+    [ALP_OP_RETURN_STATUS] = { ALP_OPERAND_STATUS, NULL },
+    [ALP_OP_CHUNK] = { ALP_OPERAND_NONE, &process_op_nop }, // TODO chunks and logic between groups not supported yet
+    [ALP_OP_LOGIC] = { ALP_OPERAND_NONE, &process_op_nop }
+};
+
+static void append_status(uint8_t action_index, alp_status_code_t status, uint8_t** response_ptr, uint8_t* response_end)
+{
+    alp_action_t status_action = {
+        .ctrl = { .operation = ALP_OP_RETURN_STATUS },
+        .status = { .action_index = action_index, .status_code = status }
+    };
+
+    (*response_ptr) += alp_encode_action(&status_action, *response_ptr, response_end - *response_ptr);
 }
 
 void alp_init(alp_unhandled_action_callback cb)
@@ -42,64 +716,152 @@ void alp_init(alp_unhandled_action_callback cb)
     unhandled_action_cb = cb;
 }
 
-void alp_process_command(const uint8_t* alp_command_ptr, packet_t* packet)
+alp_status_code_t alp_parse_action(const uint8_t* buffer, uint8_t length, alp_action_t* action, uint8_t* action_length)
+{
+    const uint8_t* ptr = buffer;
+    const uint8_t* end = buffer + length;
+    if(!read_byte(&ptr, end, &action->ctrl.raw))
+        return ALP_STATUS_OPERAND_INCOMPLETE;
+
+    alp_operand_type_t operand_type = operations[action->ctrl.operation].operand_type;
+    if(operand_type == ALP_OPERAND_UNKNOWN)
+        return ALP_STATUS_UNKNOWN_OPERATION;
+
+    if(!operand_codecs[operand_type].parse(&ptr, end, action))
+        return ALP_STATUS_OPERAND_INCOMPLETE;
+
+    *action_length = ptr - buffer;
+    return ALP_STATUS_OK;
+}
+
+uint8_t alp_encode_action(const alp_action_t* action, uint8_t* buffer, uint8_t max_length)
 {
-    alp_control_t alp_control = { .raw = (*alp_command_ptr) }; alp_command_ptr++;
+    uint8_t* ptr = buffer;
+    uint8_t* end = buffer + max_length;
+    alp_operand_type_t operand_type = operations[action->ctrl.operation].operand_type;
+    assert(operand_type != ALP_OPERAND_UNKNOWN);
+    if(!write_byte(&ptr, end, action->ctrl.raw) || !operand_codecs[operand_type].encode(&ptr, end, action))
+        return 0;
+
+    return ptr - buffer;
+}
 
-    switch(alp_control.operation)
+uint8_t alp_get_command_payload_length(const uint8_t* alp_command, uint8_t alp_command_length)
+{
+    uint16_t payload_length = 0;
+    bool is_query_found = false;
+    uint8_t offset = 0;
+    while(offset < alp_command_length)
     {
-        case ALP_OP_READ_FILE_DATA:
+        alp_action_t action;
+        uint8_t action_length;
+        if(alp_parse_action(alp_command + offset, alp_command_length - offset, &action, &action_length) != ALP_STATUS_OK)
+            return 0;
+
+        // a read file data action results in a return file data action with the requested data, others are sent as is
+        is_query_found = is_query_found || is_query(action.ctrl.operation);
+        if(action.ctrl.operation == ALP_OP_READ_FILE_DATA && !is_query_found)
         {
-            alp_operand_file_data_request_t operand;
-            operand.file_offset.file_id = (*alp_command_ptr); alp_command_ptr++;
-            operand.file_offset.offset = (*alp_command_ptr); alp_command_ptr++; // TODO can be 1-4 bytes, assume 1 for now
-            operand.requested_data_length = (*alp_command_ptr); alp_command_ptr++;
-
-            // fill response
-            uint8_t* resp_data_ptr = packet->payload;
-            (*resp_data_ptr) = ALP_OP_RETURN_FILE_DATA; resp_data_ptr++;
-            (*resp_data_ptr) = operand.file_offset.file_id; resp_data_ptr++;
-            (*resp_data_ptr) = operand.file_offset.offset; resp_data_ptr++;
-            (*resp_data_ptr) = operand.requested_data_length; resp_data_ptr++;
-            fs_read_file(operand.file_offset.file_id, operand.file_offset.offset, resp_data_ptr, operand.requested_data_length);
-            packet->payload_length = resp_data_ptr - packet->payload + operand.requested_data_length;
-            break;
+            const alp_operand_file_data_request_t* request = &action.file_data_request;
+            payload_length += 1 + 1 + get_length_operand_size(request->file_offset.offset)
+                    + get_length_operand_size(request->requested_data_length) + request->requested_data_length;
         }
-        case ALP_OP_RETURN_FILE_DATA:
+        else
+            payload_length += action_length;
+
+        if(payload_length > UINT8_MAX)
+            return UINT8_MAX;
+
+        offset += action_length;
+    }
+
+    return payload_length;
+}
+
+void alp_process_command(const uint8_t* alp_command, uint8_t alp_command_length, packet_t* packet)
+{
+    uint8_t* payload_ptr = packet->payload + packet->payload_length;
+    uint8_t* payload_end = packet->payload + D7ASP_PAYLOAD_MAX_LENGTH;
+    bool is_query_found = false;
+    uint8_t offset = 0;
+    while(offset < alp_command_length)
+    {
+        alp_action_t action;
+        uint8_t action_length;
+        alp_status_code_t status = alp_parse_action(alp_command + offset, alp_command_length - offset, &action, &action_length);
+        assert(status == ALP_STATUS_OK); // validated when queued
+
+        // the data of the local file is sent for a read file data action, other actions are executed by the addressee.
+        // TODO a read of a local file which fails adds nothing to the payload, report this to the application?
+        is_query_found = is_query_found || is_query(action.ctrl.operation);
+        if(action.ctrl.operation == ALP_OP_READ_FILE_DATA && !is_query_found)
+            process_op_read_file_data(&action, FS_ROLE_ROOT, &payload_ptr, payload_end);
+        else if(action_length <= payload_end - payload_ptr)
         {
-            alp_operand_file_data_t operand;
-            operand.file_offset.file_id = (*alp_command_ptr); alp_command_ptr++;
-            operand.file_offset.offset = (*alp_command_ptr); alp_command_ptr++; // TODO can be 1-4 bytes, assume 1 for now
-            operand.provided_data_length = (*alp_command_ptr); alp_command_ptr++;
-
-            // fill response
-            uint8_t* resp_data_ptr = packet->payload;
-            (*resp_data_ptr) = ALP_OP_RETURN_FILE_DATA; resp_data_ptr++;
-            (*resp_data_ptr) = operand.file_offset.file_id; resp_data_ptr++;
-            (*resp_data_ptr) = operand.file_offset.offset; resp_data_ptr++;
-            (*resp_data_ptr) = operand.provided_data_length; resp_data_ptr++;
-            memcpy(resp_data_ptr, alp_command_ptr, operand.provided_data_length);
-            packet->payload_length = resp_data_ptr - packet->payload + operand.provided_data_length;
-            break;
+            memcpy(payload_ptr, alp_command + offset, action_length);
+            payload_ptr += action_length;
         }
-        default:
-            assert(false); // TODO implement other operations
+
+        offset += action_length;
     }
 
+    packet->payload_length = payload_ptr - packet->payload;
 }
 
 bool alp_process_received_request(d7asp_result_t d7asp_result, packet_t* packet)
 {
-    // TODO merge with alp_process_command() ?
-    // TODO split into actions
-
-    assert(get_operation(packet->payload) == ALP_OP_RETURN_FILE_DATA); // TODO other operations not supported yet
+    // the response has to fit in the frame with the headers of the lower layers, the data of a read is cut off otherwise
+    uint8_t* response_ptr = response_buffer;
+    uint8_t* response_end = response_buffer + D7ASP_PAYLOAD_MAX_LENGTH;
+    fs_role_t role = d7anp_is_authenticated(packet)? FS_ROLE_USER : FS_ROLE_GUEST;
+    bool is_query_satisfied = true; // the actions following a query are only executed when it is satisfied
+    uint8_t action_index = 0;
+    uint8_t offset = 0;
+    while(offset < packet->payload_length)
+    {
+        alp_action_t action;
+        uint8_t action_length;
+        uint8_t* action_ptr = packet->payload + offset;
+        alp_status_code_t status = alp_parse_action(action_ptr, packet->payload_length - offset, &action, &action_length);
+        if(status == ALP_STATUS_OK)
+        {
+            uint8_t* action_response_ptr = response_ptr;
+            action_handler_t handler = operations[action.ctrl.operation].handler;
+            if(is_query(action.ctrl.operation))
+            {
+                status = evaluate_query(&action.query, role, &is_query_satisfied);
+                if(status == ALP_STATUS_OK && !is_query_satisfied && action.ctrl.operation == ALP_OP_BREAK_QUERY)
+                {
+                    // nothing is returned, not even the results of the preceding actions
+                    packet->payload_length = 0;
+                    return false;
+                }
+            }
+            else if(is_query_satisfied)
+            {
+                if(handler != NULL)
+                    status = handler(&action, role, &response_ptr, response_end);
+                else if(unhandled_action_cb)
+                    unhandled_action_cb(d7asp_result, action_ptr, action_length);
+            }
 
-    if(unhandled_action_cb)
-        unhandled_action_cb(d7asp_result, packet->payload, packet->payload_length);
+            // an executed action without response data is confirmed using a return status action, when requested
+            if(status == ALP_STATUS_OK && is_query_satisfied && action.ctrl.response_requested
+                    && response_ptr == action_response_ptr)
+                append_status(action_index, ALP_STATUS_OK, &response_ptr, response_end);
+        }
 
+        if(status != ALP_STATUS_OK)
+        {
+            append_status(action_index, status, &response_ptr, response_end);
+            break;
+        }
 
-    packet->payload_length = 0;
+        offset += action_length;
+        action_index++;
+    }
 
+    packet->payload_length = response_ptr - response_buffer;
+    memcpy(packet->payload, response_buffer, packet->payload_length);
     return true;
 }
@@ -65,6 +65,44 @@ typedef enum {
     ALP_OP_LOGIC = 49,
 } alp_operation_t;
 
+#define ALP_OPERATION_COUNT 64 // the operation is encoded in 6 bits
+
+typedef enum {
+    ALP_STATUS_OK = 0x00,
+    ALP_STATUS_UNKNOWN_ERROR = 0x80,
+    ALP_STATUS_OPERAND_WRONG_FORMAT = 0xF4,
+    ALP_STATUS_OPERAND_INCOMPLETE = 0xF5,
+    ALP_STATUS_UNKNOWN_OPERATION = 0xF6,
+    ALP_STATUS_WRITE_STORAGE_UNAVAILABLE = 0xF7,
+    ALP_STATUS_WRITE_DATA_OVERFLOW = 0xF8,
+    ALP_STATUS_WRITE_OFFSET_OUT_OF_BOUNDS = 0xF9,
+    ALP_STATUS_CREATE_FILE_ALLOCATION_EXCEEDS_AVAILABILITY = 0xFA,
+    ALP_STATUS_CREATE_FILE_LENGTH_MISMATCH = 0xFB,
+    ALP_STATUS_INSUFFICIENT_PERMISSIONS = 0xFC,
+    ALP_STATUS_FILE_NOT_RESTORABLE = 0xFD,
+    ALP_STATUS_FILE_ID_ALREADY_EXISTS = 0xFE,
+    ALP_STATUS_FILE_ID_NOT_EXISTS = 0xFF
+} alp_status_code_t;
+
+typedef enum {
+    ALP_QUERY_TYPE_NON_VOID_CHECK = 0,
+    ALP_QUERY_TYPE_ARITH_COMP_WITH_ZERO = 1,
+    ALP_QUERY_TYPE_ARITH_COMP_WITH_VALUE = 2,
+    ALP_QUERY_TYPE_ARITH_COMP_BETWEEN_FILES = 3,
+    ALP_QUERY_TYPE_STRING_TOKEN_SEARCH = 7
+} alp_query_type_t;
+
+typedef enum {
+    ALP_QUERY_COMP_TYPE_INEQUALITY = 0,
+    ALP_QUERY_COMP_TYPE_EQUALITY = 1,
+    ALP_QUERY_COMP_TYPE_LESS_THAN = 2,
+    ALP_QUERY_COMP_TYPE_LESS_THAN_OR_EQUAL_TO = 3,
+    ALP_QUERY_COMP_TYPE_GREATER_THAN = 4,
+    ALP_QUERY_COMP_TYPE_GREATER_THAN_OR_EQUAL_TO = 5
+} alp_query_comp_type_t;
+
+#define ALP_LENGTH_OPERAND_MAX 0x3FFFFFFF // 2 bits for the number of additional bytes, up to 3, and 30 bits for the value
+
 
 /*! \brief The ALP CTRL header
  *
@@ -85,29 +123,112 @@ typedef struct {
 
 typedef struct {
     uint8_t file_id;
-    uint8_t offset; // TODO can be 1-4 bytes, assuming 1 byte for now
+    uint32_t offset; // encoded as a length operand of 1 to 4 bytes
 } alp_operand_file_offset_t;
 
 typedef struct {
     alp_operand_file_offset_t file_offset;
-    uint8_t requested_data_length;
+    uint32_t requested_data_length;
 } alp_operand_file_data_request_t;
 
 typedef struct {
     alp_operand_file_offset_t file_offset;
-    uint8_t provided_data_length;
-    // data
+    uint32_t provided_data_length;
+    const uint8_t* data; // points into the payload the action is parsed from, not copied
 } alp_operand_file_data_t;
 
+typedef struct {
+    uint8_t file_id;
+    uint8_t permissions;
+    uint8_t properties;
+    uint8_t action_file_id;
+    uint8_t interface_file_id;
+    uint32_t file_size;
+    uint32_t allocated_size;
+} alp_operand_file_header_t;
+
+typedef struct {
+    uint8_t source_file_id;
+    uint8_t destination_file_id;
+} alp_operand_file_copy_t;
+
+typedef struct {
+    uint8_t action_index;
+    uint8_t status_code;
+} alp_operand_status_t;
+
+/*! \brief The query operand, compares the data in a file at the given offset with a value, zero, data in another file or
+ *  searches a token in it. The mask, when present, and the value are compare_length bytes long.
+ *
+ * note: bit order is important here since this is send over the air. We explicitly reverse the order to ensure BE.
+ */
+typedef struct {
+    union {
+        uint8_t code_raw;
+        struct {
+            uint8_t params : 4;
+            bool mask_present : 1;
+            alp_query_type_t type : 3;
+        };
+        struct {
+            alp_query_comp_type_t comp_type : 3; // the params of arithmetic comparisons
+            bool signed_data_type : 1;
+            uint8_t : 4;
+        };
+        struct {
+            uint8_t max_errors : 3; // the params of string token searches, the number of bytes which may differ
+            uint8_t : 5;
+        };
+    };
+    uint32_t compare_length;
+    const uint8_t* mask; // NULL when not present, mask and value point into the payload the action is parsed from
+    const uint8_t* compare_value; // for comparisons with a value and token searches
+    alp_operand_file_offset_t file_offset;
+    alp_operand_file_offset_t compare_file_offset; // for comparisons between files
+} alp_operand_query_t;
+
+/*! \brief A decoded ALP action, the operand used depends on the operation of the ALP control */
+typedef struct {
+    alp_control_t ctrl;
+    union {
+        uint8_t file_id;
+        alp_operand_file_data_request_t file_data_request;
+        alp_operand_file_data_t file_data;
+        alp_operand_file_header_t file_header;
+        alp_operand_file_copy_t file_copy;
+        alp_operand_status_t status;
+        alp_operand_query_t query;
+    };
+} alp_action_t;
+
 typedef void (*alp_unhandled_action_callback)(d7asp_result_t d7asp_result, uint8_t *alp_command, uint8_t alp_command_size);
 
 void alp_init(alp_unhandled_action_callback cb);
 
-/*! \brief Process a received ALP command and fills the packet with the result */
-void alp_process_command(const uint8_t* alp_command, packet_t* packet);
+/*! \brief Parses the ALP action at the start of the buffer, without reading beyond length.
+ *  On success the number of bytes of the action is returned in action_length. The data of a file data operand is not
+ *  copied but points into the buffer.
+ */
+alp_status_code_t alp_parse_action(const uint8_t* buffer, uint8_t length, alp_action_t* action, uint8_t* action_length);
+
+/*! \brief Encodes the ALP action in the buffer and returns the number of bytes written, or 0 when it does not fit */
+uint8_t alp_encode_action(const alp_action_t* action, uint8_t* buffer, uint8_t max_length);
+
+/*! \brief Process the ALP actions of a queued command and appends the result to the payload of the packet.
+ *  The actions following a query are executed by the addressee when the query is satisfied, these are sent as is.
+ */
+void alp_process_command(const uint8_t* alp_command, uint8_t alp_command_length, packet_t* packet);
+
+/*! \brief Returns the number of bytes alp_process_command() appends to the payload for the ALP command, or 0 when
+ *  the command contains an incomplete or unknown action
+ */
+uint8_t alp_get_command_payload_length(const uint8_t* alp_command, uint8_t alp_command_length);
 
-/*! \brief Process a received request and replaces the packet's payload with the response payload.
- *  ALP commands which cannot be handled by the stack are vectored to the application layer
+/*! \brief Process the actions of a received request and replaces the packet's payload with the response payload.
+ *  Processing stops at the first action which fails, the failure is reported in a return status action.
+ *  The actions following an action query which is not satisfied are skipped, up to the next query. When a break query is
+ *  not satisfied the request is not to be answered at all and false is returned.
+ *  ALP actions which cannot be handled by the stack are vectored to the application layer
  */
 bool alp_process_received_request(d7asp_result_t d7asp_result, packet_t* packet);
 
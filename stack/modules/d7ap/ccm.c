@@ -0,0 +1,96 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "string.h"
+
+#include "ccm.h"
+#include "aes.h"
+
+#define CCM_LENGTH_SIZE (AES_BLOCK_SIZE - 1 - CCM_NONCE_SIZE)
+
+static void get_key_stream_block(uint8_t const* nonce, uint16_t counter, uint8_t* block)
+{
+    block[0] = CCM_LENGTH_SIZE - 1;
+    memcpy(block + 1, nonce, CCM_NONCE_SIZE);
+    block[14] = counter >> 8;
+    block[15] = counter & 0xFF;
+    aes_encrypt_block(block, block);
+}
+
+void ccm_ctr_crypt(uint8_t const* nonce, uint8_t* data, uint8_t size)
+{
+    // key stream block 0 is reserved for encrypting the MIC
+    uint8_t key_stream[AES_BLOCK_SIZE];
+    for(uint8_t i = 0; i < size; i++)
+    {
+        if(i % AES_BLOCK_SIZE == 0)
+            get_key_stream_block(nonce, 1 + i / AES_BLOCK_SIZE, key_stream);
+
+        data[i] ^= key_stream[i % AES_BLOCK_SIZE];
+    }
+}
+
+static void cbc_mac_absorb(uint8_t* x, uint8_t* x_idx, uint8_t const* data, uint8_t size)
+{
+    for(uint8_t i = 0; i < size; i++)
+    {
+        x[(*x_idx)++] ^= data[i];
+        if(*x_idx == AES_BLOCK_SIZE)
+        {
+            aes_encrypt_block(x, x);
+            *x_idx = 0;
+        }
+    }
+}
+
+static void cbc_mac_pad(uint8_t* x, uint8_t* x_idx)
+{
+    if(*x_idx != 0)
+    {
+        aes_encrypt_block(x, x);
+        *x_idx = 0;
+    }
+}
+
+void ccm_calculate_mic(uint8_t const* nonce, uint8_t const* aad, uint8_t aad_size, uint8_t const* data, uint8_t size,
+                       uint8_t mic_size, uint8_t* mic)
+{
+    uint8_t x[AES_BLOCK_SIZE];
+    uint8_t x_idx = 0;
+    x[0] = (aad_size > 0? 0x40 : 0) | (((mic_size - 2) / 2) << 3) | (CCM_LENGTH_SIZE - 1); // associated data present, M, L
+    memcpy(x + 1, nonce, CCM_NONCE_SIZE);
+    x[14] = 0;
+    x[15] = size;
+    aes_encrypt_block(x, x);
+
+    if(aad_size > 0)
+    {
+        uint8_t aad_length[2] = { 0, aad_size };
+        cbc_mac_absorb(x, &x_idx, aad_length, 2);
+        cbc_mac_absorb(x, &x_idx, aad, aad_size);
+        cbc_mac_pad(x, &x_idx);
+    }
+
+    cbc_mac_absorb(x, &x_idx, data, size);
+    cbc_mac_pad(x, &x_idx);
+
+    uint8_t key_stream[AES_BLOCK_SIZE];
+    get_key_stream_block(nonce, 0, key_stream);
+    for(uint8_t i = 0; i < mic_size; i++)
+        mic[i] = x[i] ^ key_stream[i];
+}
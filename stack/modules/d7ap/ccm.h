@@ -0,0 +1,47 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*! \file ccm.h
+ * \addtogroup ccm
+ * \ingroup D7AP
+ * @{
+ * \brief The CTR and CBC-MAC modes of AES-CCM (RFC 3610) used by the network layer security of D7ANP.
+ *
+ * The length field is 2 bytes, which leaves 13 bytes for the nonce. The key is the one set using aes_set_key().
+ * The AES-CTR and AES-CBC-MAC methods of D7ANP use one of both modes, the AES-CCM methods both.
+ */
+
+#ifndef OSS_7_CCM_H
+#define OSS_7_CCM_H
+
+#include "stdint.h"
+
+#define CCM_NONCE_SIZE 13
+#define CCM_MIC_MAX_SIZE 16
+
+/*! \brief Encrypts or decrypts the data in place using CTR mode, starting from key stream block 1 */
+void ccm_ctr_crypt(uint8_t const* nonce, uint8_t* data, uint8_t size);
+
+/*! \brief Calculates the MIC (4, 6, 8, 10, 12, 14 or 16 bytes) over the associated data and the plaintext, which is the
+ * CBC-MAC encrypted using key stream block 0 */
+void ccm_calculate_mic(uint8_t const* nonce, uint8_t const* aad, uint8_t aad_size, uint8_t const* data, uint8_t size,
+                       uint8_t mic_size, uint8_t* mic);
+
+#endif //OSS_7_CCM_H
+
+/** @}*/
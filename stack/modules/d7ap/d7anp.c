@@ -19,42 +19,427 @@
  *
  */
 
+#include "string.h"
+
 #include "debug.h"
 #include "d7anp.h"
 #include "packet.h"
+#include "packet_queue.h"
+#include "d7atp.h"
+#include "dll.h"
 #include "fs.h"
+#include "log.h"
+#include "ng.h"
+#include "crc.h"
+#include "timer.h"
+#include "aes.h"
+#include "ccm.h"
+#include "MODULE_D7AP_defs.h"
+
+// a route which is not confirmed by a received frame within this time is no longer used
+#define ROUTE_TIMEOUT (60 * (timer_tick_t)TIMER_TICKS_PER_SEC)
+
+// the number of relayed frames remembered to suppress duplicates, and for how long
+#define DUPLICATE_CACHE_SIZE 8
+#define DUPLICATE_CACHE_TIMEOUT (10 * (timer_tick_t)TIMER_TICKS_PER_SEC)
+
+// relaying adds at most the relay access ID, and a DLL target address of at most 8 bytes
+#define RELAY_MAX_HEADER_GROWTH 16
+
+// the CCM (RFC 3610) nonce consists of the frame counter, the origin access ID (padded to 8 bytes) and the key counter,
+// which are unique for every secured frame
+_Static_assert(CCM_NONCE_SIZE == 4 + 8 + 1, "the nonce does not match the CCM nonce size");
+
+// the associated data which is authenticated but not encrypted: the D7ANP CTRL header, the origin access ID and the
+// security header. The hopping header is excluded since it is modified by relays.
+#define NLS_AAD_MAX_SIZE (1 + 8 + NLS_SECURITY_HEADER_SIZE)
+
+// the number of frame counters below the highest one received from an origin which are still accepted once
+#define NLS_REPLAY_WINDOW_SIZE 32
+
+/*! The next hop to use for frames to a destination which is not a direct neighbor */
+typedef struct
+{
+    uint8_t destination_id[8];
+    bool destination_id_is_vid;
+    uint8_t next_hop_id[8];
+    bool next_hop_id_is_vid;
+    bool is_valid;
+    timer_tick_t last_updated;
+} route_t;
+
+static route_t NGDEF(_routes)[MODULE_D7AP_ROUTING_TABLE_SIZE];
+#define routes NG(_routes)
+
+/*! A frame which hopped, identified by a CRC over its origin and the part of the frame which is not modified by relays */
+typedef struct
+{
+    uint16_t key;
+    bool is_valid;
+    timer_tick_t timestamp;
+} seen_frame_t;
+
+static seen_frame_t NGDEF(_seen_frames)[DUPLICATE_CACHE_SIZE];
+#define seen_frames NG(_seen_frames)
+
+static uint8_t NGDEF(_seen_frames_next_index);
+#define seen_frames_next_index NG(_seen_frames_next_index)
+
+/*! The frame counters received from an origin, to reject replayed frames */
+typedef struct
+{
+    uint8_t origin_access_id[8];
+    bool origin_access_id_is_vid;
+    bool is_valid;
+    uint32_t frame_counter; // the highest frame counter received
+    uint32_t window; // bit i is set when frame_counter - i was received
+    timer_tick_t last_updated;
+} replay_state_t;
+
+static replay_state_t NGDEF(_replay_states)[MODULE_D7AP_NLS_REPLAY_TABLE_SIZE];
+#define replay_states NG(_replay_states)
+
+// the key counter of the current key, and the frame counter of the last secured frame we originated
+static uint8_t NGDEF(_current_key_counter);
+#define current_key_counter NG(_current_key_counter)
+
+static uint32_t NGDEF(_tx_frame_counter);
+#define tx_frame_counter NG(_tx_frame_counter)
+
+// the filesystem is not persistent, so after a reboot the frame counter restarts and the nonces of the frames
+// transmitted before would be reused with the same key. Secured frames are only transmitted once a new key has been
+// written after booting.
+static bool NGDEF(_is_key_written_since_boot);
+#define is_key_written_since_boot NG(_is_key_written_since_boot)
+
+// the received packet which is being relayed, NULL when not relaying
+static packet_t* NGDEF(_relayed_packet);
+#define relayed_packet NG(_relayed_packet)
+
+static inline uint8_t get_access_id_size(bool is_vid)
+{
+    return is_vid? 2 : 8;
+}
+
+static bool access_ids_equal(uint8_t const* a, bool a_is_vid, uint8_t const* b, bool b_is_vid)
+{
+    return a_is_vid == b_is_vid && memcmp(a, b, get_access_id_size(a_is_vid)) == 0;
+}
+
+// returns false when a VID is requested but none is assigned
+static bool read_own_access_id(uint8_t* access_id, bool is_vid)
+{
+    if(is_vid)
+        return fs_read_vid(access_id);
+
+    fs_read_uid(access_id);
+    return true;
+}
+
+static bool is_own_access_id(uint8_t const* access_id, bool is_vid)
+{
+    uint8_t own_access_id[8];
+    return read_own_access_id(own_access_id, is_vid) && memcmp(access_id, own_access_id, get_access_id_size(is_vid)) == 0;
+}
+
+static route_t* find_route(uint8_t const* destination_id, bool destination_id_is_vid)
+{
+    timer_tick_t now = timer_get_counter_value();
+    for(uint8_t i = 0; i < MODULE_D7AP_ROUTING_TABLE_SIZE; i++)
+    {
+        if(routes[i].is_valid && now - routes[i].last_updated <= ROUTE_TIMEOUT
+                && access_ids_equal(routes[i].destination_id, routes[i].destination_id_is_vid, destination_id, destination_id_is_vid))
+            return &routes[i];
+    }
+
+    return NULL;
+}
+
+static void update_route(uint8_t const* destination_id, bool destination_id_is_vid, uint8_t const* next_hop_id, bool next_hop_id_is_vid)
+{
+    timer_tick_t now = timer_get_counter_value();
+    route_t* route = NULL;
+    for(uint8_t i = 0; i < MODULE_D7AP_ROUTING_TABLE_SIZE; i++)
+    {
+        if(routes[i].is_valid && access_ids_equal(routes[i].destination_id, routes[i].destination_id_is_vid, destination_id, destination_id_is_vid))
+        {
+            route = &routes[i];
+            break;
+        }
+
+        // otherwise replace a free entry, or the one which was not updated for the longest time
+        if(route == NULL || (route->is_valid && (!routes[i].is_valid || now - routes[i].last_updated > now - route->last_updated)))
+            route = &routes[i];
+    }
+
+    route->is_valid = true;
+    route->last_updated = now;
+    memcpy(route->destination_id, destination_id, get_access_id_size(destination_id_is_vid));
+    route->destination_id_is_vid = destination_id_is_vid;
+    memcpy(route->next_hop_id, next_hop_id, get_access_id_size(next_hop_id_is_vid));
+    route->next_hop_id_is_vid = next_hop_id_is_vid;
+}
+
+static bool is_duplicate(packet_t* packet, uint8_t upper_layer_idx)
+{
+    // the upper layer part of the frame is not modified by relays, the dialog and transaction ID it contains make it
+    // unique for an origin
+    uint8_t upper_layer_size = packet->hw_radio_packet.length + 1 - 2 - upper_layer_idx;
+    uint16_t key = crc_calculate(packet->hw_radio_packet.data + upper_layer_idx, upper_layer_size)
+            ^ crc_calculate(packet->origin_access_id, get_access_id_size(packet->d7anp_ctrl.origin_access_id_is_vid));
+
+    timer_tick_t now = timer_get_counter_value();
+    for(uint8_t i = 0; i < DUPLICATE_CACHE_SIZE; i++)
+    {
+        if(seen_frames[i].is_valid && seen_frames[i].key == key && now - seen_frames[i].timestamp <= DUPLICATE_CACHE_TIMEOUT)
+            return true;
+    }
+
+    seen_frames[seen_frames_next_index] = (seen_frame_t){ .key = key, .is_valid = true, .timestamp = now };
+    seen_frames_next_index = (seen_frames_next_index + 1) % DUPLICATE_CACHE_SIZE;
+    return false;
+}
+
+static void set_next_hop(packet_t* packet, route_t const* route)
+{
+    // without a known route the frame is broadcast, so it can be relayed by any node in range of the destination
+    packet->dll_addressee.addressee_ctrl_has_id = route != NULL;
+    if(route != NULL)
+    {
+        packet->dll_addressee.addressee_ctrl_virtual_id = route->next_hop_id_is_vid;
+        memcpy(packet->dll_addressee.addressee_id, route->next_hop_id, get_access_id_size(route->next_hop_id_is_vid));
+    }
+}
+
+static uint8_t get_mic_size(nls_method_t nls_method)
+{
+    switch(nls_method)
+    {
+        case NLS_METHOD_AES_CBC_MAC_128:
+        case NLS_METHOD_AES_CCM_128:
+            return 16;
+        case NLS_METHOD_AES_CBC_MAC_64:
+        case NLS_METHOD_AES_CCM_64:
+            return 8;
+        case NLS_METHOD_AES_CBC_MAC_32:
+        case NLS_METHOD_AES_CCM_32:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static inline bool is_encrypted(nls_method_t nls_method)
+{
+    return nls_method == NLS_METHOD_AES_CTR || nls_method >= NLS_METHOD_AES_CCM_128;
+}
+
+static void load_security_key()
+{
+    uint8_t key[AES_KEY_SIZE];
+    fs_read_nwl_security_key(key);
+    aes_set_key(key);
+
+    // frame counters received using the previous key are no longer relevant
+    memset(replay_states, 0, sizeof(replay_states));
+}
+
+static void on_file_modified(uint8_t file_id)
+{
+    if(file_id == D7A_FILE_NWL_SECURITY_KEY_FILE_ID)
+    {
+        load_security_key();
+        is_key_written_since_boot = true;
+    }
+    else if(file_id == D7A_FILE_NWL_SECURITY_FILE_ID)
+        fs_read_nwl_security(&current_key_counter, &tx_frame_counter);
+}
+
+static uint8_t assemble_security_header(d7anp_security_t const* security, uint8_t* data_ptr)
+{
+    uint32_t frame_counter_be = __builtin_bswap32(security->frame_counter);
+    data_ptr[0] = security->nls_method;
+    data_ptr[1] = security->key_counter;
+    memcpy(data_ptr + 2, &frame_counter_be, 4);
+    return NLS_SECURITY_HEADER_SIZE;
+}
+
+static uint8_t build_aad(packet_t* packet, uint8_t const* origin_access_id, uint8_t* aad)
+{
+    uint8_t origin_access_id_size = get_access_id_size(packet->d7anp_ctrl.origin_access_id_is_vid);
+    aad[0] = packet->d7anp_ctrl.raw;
+    memcpy(aad + 1, origin_access_id, origin_access_id_size);
+    return 1 + origin_access_id_size + assemble_security_header(&(packet->d7anp_security), aad + 1 + origin_access_id_size);
+}
+
+static void build_nonce(packet_t* packet, uint8_t const* origin_access_id, uint8_t* nonce)
+{
+    uint32_t frame_counter_be = __builtin_bswap32(packet->d7anp_security.frame_counter);
+    memcpy(nonce, &frame_counter_be, 4);
+    memset(nonce + 4, 0, 8);
+    memcpy(nonce + 4, origin_access_id, get_access_id_size(packet->d7anp_ctrl.origin_access_id_is_vid));
+    nonce[12] = packet->d7anp_security.key_counter;
+}
+
+static replay_state_t* find_replay_state(uint8_t const* origin_access_id, bool origin_access_id_is_vid)
+{
+    for(uint8_t i = 0; i < MODULE_D7AP_NLS_REPLAY_TABLE_SIZE; i++)
+    {
+        if(replay_states[i].is_valid && access_ids_equal(replay_states[i].origin_access_id, replay_states[i].origin_access_id_is_vid,
+                                                         origin_access_id, origin_access_id_is_vid))
+            return &replay_states[i];
+    }
+
+    return NULL;
+}
+
+static bool is_replayed(replay_state_t const* state, uint32_t received_frame_counter)
+{
+    if(state == NULL || received_frame_counter > state->frame_counter)
+        return false;
+
+    uint32_t age = state->frame_counter - received_frame_counter;
+    return age >= NLS_REPLAY_WINDOW_SIZE || (state->window & ((uint32_t)1 << age));
+}
+
+static void update_replay_state(replay_state_t* state, uint8_t const* origin_access_id, bool origin_access_id_is_vid,
+                                uint32_t received_frame_counter)
+{
+    timer_tick_t now = timer_get_counter_value();
+    if(state == NULL)
+    {
+        // replace a free entry, or the one which was not updated for the longest time
+        state = &replay_states[0];
+        for(uint8_t i = 1; i < MODULE_D7AP_NLS_REPLAY_TABLE_SIZE && state->is_valid; i++)
+        {
+            if(!replay_states[i].is_valid || now - replay_states[i].last_updated > now - state->last_updated)
+                state = &replay_states[i];
+        }
 
-void d7anp_tx_foreground_frame(packet_t* packet, bool should_include_origin_template)
+        state->is_valid = true;
+        memcpy(state->origin_access_id, origin_access_id, get_access_id_size(origin_access_id_is_vid));
+        state->origin_access_id_is_vid = origin_access_id_is_vid;
+        state->frame_counter = received_frame_counter;
+        state->window = 1;
+    }
+    else if(received_frame_counter > state->frame_counter)
+    {
+        uint32_t shift = received_frame_counter - state->frame_counter;
+        state->window = shift >= NLS_REPLAY_WINDOW_SIZE? 1 : (state->window << shift) | 1;
+        state->frame_counter = received_frame_counter;
+    }
+    else
+        state->window |= (uint32_t)1 << (state->frame_counter - received_frame_counter);
+
+    state->last_updated = now;
+}
+
+void d7anp_init()
+{
+    memset(routes, 0, sizeof(routes));
+    memset(seen_frames, 0, sizeof(seen_frames));
+    seen_frames_next_index = 0;
+    relayed_packet = NULL;
+
+    load_security_key();
+    is_key_written_since_boot = false;
+    fs_read_nwl_security(&current_key_counter, &tx_frame_counter);
+    fs_register_file_modified_callback(&on_file_modified);
+}
+
+void d7anp_tx_foreground_frame(packet_t* packet, bool should_include_origin_template, bool is_response)
 {
-    packet->d7anp_ctrl.nls_enabled = false;
+    packet->is_relayed = false;
     packet->d7anp_ctrl.hop_enabled = false;
     packet->d7anp_ctrl.origin_access_id_present = should_include_origin_template;
-    packet->d7anp_ctrl.origin_access_id_is_vid = false;// TODO where to get this from? from DLL config file ?
+    // the VID is used as origin when assigned, it is 6 bytes shorter than the UID
+    uint8_t vid[2];
+    packet->d7anp_ctrl.origin_access_id_is_vid = fs_read_vid(vid);
     packet->d7anp_ctrl.origin_access_class = packet->d7atp_addressee->addressee_ctrl_access_class; // TODO validate
 
+    // a response is secured using the method of the request it answers, which is still in the packet
+    if(!is_response)
+        packet->d7anp_security.nls_method = MODULE_D7AP_NLS_METHOD;
+
+    packet->d7anp_ctrl.nls_enabled = packet->d7anp_security.nls_method != NLS_METHOD_NONE;
+    if(packet->d7anp_ctrl.nls_enabled)
+    {
+        if(!is_key_written_since_boot)
+        {
+            log_print_stack_string(LOG_STACK_NWL, "No key written since boot, not transmitting secured frame");
+            d7atp_signal_packet_csma_ca_insertion_completed(false);
+            return;
+        }
+
+        packet->d7anp_ctrl.origin_access_id_present = true; // part of the nonce
+    }
+
+    // the frame is sent to the addressee directly, unless it is not known as a direct neighbor
+    packet->dll_addressee = *(packet->d7atp_addressee);
+    if(MODULE_D7AP_HOP_LIMIT > 0 && packet->d7atp_addressee->addressee_ctrl_has_id)
+    {
+        uint8_t const* destination_id = packet->d7atp_addressee->addressee_id;
+        bool destination_id_is_vid = packet->d7atp_addressee->addressee_ctrl_virtual_id;
+        route_t* route = find_route(destination_id, destination_id_is_vid);
+        if(route == NULL || !access_ids_equal(route->next_hop_id, route->next_hop_id_is_vid, destination_id, destination_id_is_vid))
+        {
+            log_print_stack_string(LOG_STACK_NWL, "Destination is not a known neighbor, enabling hopping");
+            packet->d7anp_ctrl.hop_enabled = true;
+            packet->d7anp_hop_ctrl = (d7anp_hop_ctrl_t){
+                .hop_limit = MODULE_D7AP_HOP_LIMIT,
+                .destination_access_id_is_vid = destination_id_is_vid,
+                .relay_access_id_present = false
+            };
+
+            memcpy(packet->destination_access_id, destination_id, get_access_id_size(destination_id_is_vid));
+            packet->d7anp_ctrl.origin_access_id_present = true; // needed by the destination to respond and by relays to detect duplicates
+            set_next_hop(packet, route);
+        }
+    }
+
     dll_tx_frame(packet);
 }
 
 uint8_t d7anp_assemble_packet_header(packet_t *packet, uint8_t *data_ptr)
 {
-    assert(!packet->d7anp_ctrl.nls_enabled); // TODO NLS not yet supported
-    assert(!packet->d7anp_ctrl.hop_enabled); // TODO hopping not yet supported
-
     uint8_t* d7anp_header_start = data_ptr;
     (*data_ptr) = packet->d7anp_ctrl.raw; data_ptr++;
 
-    // TODO hopping ctrl
-    // TODO intermediary access ID
-    // TODO destination access ID
+    if(packet->d7anp_ctrl.hop_enabled)
+    {
+        (*data_ptr) = packet->d7anp_hop_ctrl.raw; data_ptr++;
+        if(packet->d7anp_hop_ctrl.relay_access_id_present)
+        {
+            memcpy(data_ptr, packet->relay_access_id, 8); data_ptr += 8;
+        }
+
+        uint8_t destination_access_id_size = get_access_id_size(packet->d7anp_hop_ctrl.destination_access_id_is_vid);
+        memcpy(data_ptr, packet->destination_access_id, destination_access_id_size); data_ptr += destination_access_id_size;
+    }
 
     if(packet->d7anp_ctrl.origin_access_id_present)
     {
-        if(!packet->d7anp_ctrl.origin_access_id_is_vid)
+        uint8_t origin_access_id_size = get_access_id_size(packet->d7anp_ctrl.origin_access_id_is_vid);
+        if(packet->is_relayed)
+            memcpy(data_ptr, packet->origin_access_id, origin_access_id_size);
+        else
+            read_own_access_id(data_ptr, packet->d7anp_ctrl.origin_access_id_is_vid);
+
+        data_ptr += origin_access_id_size;
+    }
+
+    if(packet->d7anp_ctrl.nls_enabled)
+    {
+        // every frame we transmit, including retransmissions, uses a new frame counter. Relayed frames are unmodified.
+        if(!packet->is_relayed)
         {
-            fs_read_uid(data_ptr); data_ptr += 8;
+            tx_frame_counter++;
+            packet->d7anp_security.key_counter = current_key_counter;
+            packet->d7anp_security.frame_counter = tx_frame_counter;
+            fs_write_nwl_security_frame_counter(tx_frame_counter);
         }
-        else
-            assert(false); // TODO read VID
+
+        data_ptr += assemble_security_header(&(packet->d7anp_security), data_ptr);
     }
 
     return data_ptr - d7anp_header_start;
@@ -62,21 +447,325 @@ uint8_t d7anp_assemble_packet_header(packet_t *packet, uint8_t *data_ptr)
 
 bool d7anp_disassemble_packet_header(packet_t* packet, uint8_t* data_idx)
 {
+    if(!packet_has_bytes_remaining(packet, *data_idx, 1))
+        return false;
+
     packet->d7anp_ctrl.raw = packet->hw_radio_packet.data[(*data_idx)]; (*data_idx)++;
-    assert(!packet->d7anp_ctrl.nls_enabled); // TODO NLS not yet supported
-    assert(!packet->d7anp_ctrl.hop_enabled); // TODO hopping not yet supported
+    if(!packet->d7anp_ctrl.nls_enabled && MODULE_D7AP_NLS_METHOD != NLS_METHOD_NONE)
+    {
+        log_print_stack_string(LOG_STACK_NWL, "Unsecured frame, skipping packet");
+        return false;
+    }
+
+    if(packet->d7anp_ctrl.hop_enabled)
+    {
+        if(!packet_has_bytes_remaining(packet, *data_idx, 1))
+            return false;
+
+        packet->d7anp_hop_ctrl.raw = packet->hw_radio_packet.data[(*data_idx)]; (*data_idx)++;
+        if(packet->d7anp_hop_ctrl.relay_access_id_present)
+        {
+            if(!packet_has_bytes_remaining(packet, *data_idx, 8))
+                return false;
+
+            memcpy(packet->relay_access_id, packet->hw_radio_packet.data + (*data_idx), 8); (*data_idx) += 8;
+        }
+
+        uint8_t destination_access_id_size = get_access_id_size(packet->d7anp_hop_ctrl.destination_access_id_is_vid);
+        if(!packet_has_bytes_remaining(packet, *data_idx, destination_access_id_size))
+            return false;
 
-    // TODO hopping ctrl
-    // TODO intermediary access ID
-    // TODO destination access ID
+        memcpy(packet->destination_access_id, packet->hw_radio_packet.data + (*data_idx), destination_access_id_size); (*data_idx) += destination_access_id_size;
+
+        if(!packet->d7anp_ctrl.origin_access_id_present)
+        {
+            log_print_stack_string(LOG_STACK_NWL, "Hopping frame without origin, skipping packet");
+            return false;
+        }
+    }
 
     if(packet->d7anp_ctrl.origin_access_id_present)
     {
-        uint8_t origin_access_id_size = packet->d7anp_ctrl.origin_access_id_is_vid? 2 : 8;
+        uint8_t origin_access_id_size = get_access_id_size(packet->d7anp_ctrl.origin_access_id_is_vid);
+        if(!packet_has_bytes_remaining(packet, *data_idx, origin_access_id_size))
+            return false;
+
         memcpy(packet->origin_access_id, packet->hw_radio_packet.data + (*data_idx), origin_access_id_size); (*data_idx) += origin_access_id_size;
     }
 
-    // TODO security
+    packet->d7anp_security.nls_method = NLS_METHOD_NONE;
+    if(packet->d7anp_ctrl.nls_enabled)
+    {
+        if(!packet->d7anp_ctrl.origin_access_id_present)
+        {
+            log_print_stack_string(LOG_STACK_NWL, "Secured frame without origin, skipping packet");
+            return false;
+        }
+
+        if(!packet_has_bytes_remaining(packet, *data_idx, NLS_SECURITY_HEADER_SIZE))
+            return false;
+
+        uint8_t* data_ptr = packet->hw_radio_packet.data + (*data_idx);
+        if(data_ptr[0] == NLS_METHOD_NONE || data_ptr[0] > NLS_METHOD_AES_CCM_32)
+        {
+            log_print_stack_string(LOG_STACK_NWL, "Unknown NLS method %i, skipping packet", data_ptr[0]);
+            return false;
+        }
+
+        uint32_t frame_counter_be;
+        memcpy(&frame_counter_be, data_ptr + 2, 4);
+        packet->d7anp_security = (d7anp_security_t){
+            .nls_method = data_ptr[0],
+            .key_counter = data_ptr[1],
+            .frame_counter = __builtin_bswap32(frame_counter_be)
+        };
+
+        (*data_idx) += NLS_SECURITY_HEADER_SIZE;
+    }
 
     return true;
 }
+
+uint8_t d7anp_secure_packet(packet_t* packet, uint8_t* upper_layer_data, uint8_t upper_layer_size)
+{
+    assert(packet->d7anp_ctrl.nls_enabled);
+
+    uint8_t origin_access_id[8];
+    read_own_access_id(origin_access_id, packet->d7anp_ctrl.origin_access_id_is_vid);
+
+    uint8_t nonce[CCM_NONCE_SIZE];
+    build_nonce(packet, origin_access_id, nonce);
+
+    // the MIC is calculated over the plaintext
+    uint8_t mic_size = get_mic_size(packet->d7anp_security.nls_method);
+    if(mic_size > 0)
+    {
+        uint8_t aad[NLS_AAD_MAX_SIZE];
+        uint8_t aad_size = build_aad(packet, origin_access_id, aad);
+        ccm_calculate_mic(nonce, aad, aad_size, upper_layer_data, upper_layer_size, mic_size, upper_layer_data + upper_layer_size);
+    }
+
+    if(is_encrypted(packet->d7anp_security.nls_method))
+        ccm_ctr_crypt(nonce, upper_layer_data, upper_layer_size);
+
+    return mic_size;
+}
+
+uint8_t d7anp_get_footer_size(packet_t* packet)
+{
+    // relayed frames already contain the MIC of the origin
+    if(!packet->d7anp_ctrl.nls_enabled || packet->is_relayed)
+        return 0;
+
+    return get_mic_size(packet->d7anp_security.nls_method);
+}
+
+// verifies a received frame and decrypts its D7ATP header and payload, in the frame or in a copy in buffer when the frame
+// has to stay as it is. The frame counter is recorded when the frame is accepted.
+static bool verify_packet(packet_t* packet, uint8_t upper_layer_idx, uint8_t* buffer)
+{
+    d7anp_security_t* security = &(packet->d7anp_security);
+    if(security->nls_method != MODULE_D7AP_NLS_METHOD)
+    {
+        // otherwise a frame could be forged using a weaker method, like AES-CTR which has no MIC
+        log_print_stack_string(LOG_STACK_NWL, "Frame secured using method %i instead of %i, skipping", security->nls_method, MODULE_D7AP_NLS_METHOD);
+        return false;
+    }
+
+    uint8_t mic_size = get_mic_size(security->nls_method);
+    if(!packet_has_bytes_remaining(packet, upper_layer_idx, mic_size + 1))
+        return false;
+
+    if(security->key_counter != current_key_counter)
+    {
+        log_print_stack_string(LOG_STACK_NWL, "Frame secured using key %i instead of %i, skipping", security->key_counter, current_key_counter);
+        return false;
+    }
+
+    replay_state_t* replay_state = find_replay_state(packet->origin_access_id, packet->d7anp_ctrl.origin_access_id_is_vid);
+    if(is_replayed(replay_state, security->frame_counter))
+    {
+        log_print_stack_string(LOG_STACK_NWL, "Replayed frame (frame counter %i), skipping", security->frame_counter);
+        return false;
+    }
+
+    uint8_t* upper_layer_data = packet->hw_radio_packet.data + upper_layer_idx;
+    uint8_t upper_layer_size = packet->hw_radio_packet.length + 1 - 2 - upper_layer_idx - mic_size;
+    if(buffer != NULL)
+    {
+        memcpy(buffer, upper_layer_data, upper_layer_size + mic_size);
+        upper_layer_data = buffer;
+    }
+
+    uint8_t nonce[CCM_NONCE_SIZE];
+    build_nonce(packet, packet->origin_access_id, nonce);
+
+    if(is_encrypted(security->nls_method))
+        ccm_ctr_crypt(nonce, upper_layer_data, upper_layer_size);
+
+    if(mic_size > 0)
+    {
+        uint8_t aad[NLS_AAD_MAX_SIZE];
+        uint8_t aad_size = build_aad(packet, packet->origin_access_id, aad);
+        uint8_t mic[CCM_MIC_MAX_SIZE];
+        ccm_calculate_mic(nonce, aad, aad_size, upper_layer_data, upper_layer_size, mic_size, mic);
+
+        // compare all bytes, so the time taken does not reveal how much of the MIC is correct
+        uint8_t difference = 0;
+        for(uint8_t i = 0; i < mic_size; i++)
+            difference |= mic[i] ^ upper_layer_data[upper_layer_size + i];
+
+        if(difference != 0)
+        {
+            log_print_stack_string(LOG_STACK_NWL, "Invalid MIC, skipping");
+            return false;
+        }
+    }
+
+    // without a MIC (AES-CTR) the frame counter is not authenticated, so a forged frame can block the frames of the
+    // origin. Not updating the frame counter would allow replaying any frame instead.
+    update_replay_state(replay_state, packet->origin_access_id, packet->d7anp_ctrl.origin_access_id_is_vid, security->frame_counter);
+    return true;
+}
+
+// learns the route to the origin of an accepted frame: through the relay which transmitted it, or directly
+static void update_route_to_origin(packet_t* packet)
+{
+    // in a secured network only authenticated frames are trusted, a forged frame could redirect the frames to any node
+    if(!packet->d7anp_ctrl.origin_access_id_present
+            || (MODULE_D7AP_NLS_METHOD != NLS_METHOD_NONE && !d7anp_is_authenticated(packet)))
+        return;
+
+    if(packet->d7anp_ctrl.hop_enabled && packet->d7anp_hop_ctrl.relay_access_id_present)
+        update_route(packet->origin_access_id, packet->d7anp_ctrl.origin_access_id_is_vid, packet->relay_access_id, false);
+    else
+        update_route(packet->origin_access_id, packet->d7anp_ctrl.origin_access_id_is_vid,
+                     packet->origin_access_id, packet->d7anp_ctrl.origin_access_id_is_vid);
+}
+
+bool d7anp_unsecure_packet(packet_t* packet, uint8_t upper_layer_idx)
+{
+    assert(packet->d7anp_ctrl.nls_enabled);
+    if(!verify_packet(packet, upper_layer_idx, NULL))
+        return false;
+
+    // the upper layers see the frame as if the MIC is not there
+    packet->hw_radio_packet.length -= get_mic_size(packet->d7anp_security.nls_method);
+    return true;
+}
+
+void d7anp_signal_packet_accepted(packet_t* packet)
+{
+    update_route_to_origin(packet);
+}
+
+bool d7anp_is_authenticated(packet_t const* packet)
+{
+    return packet->d7anp_ctrl.nls_enabled && get_mic_size(packet->d7anp_security.nls_method) > 0;
+}
+
+bool d7anp_process_hopping(packet_t* packet, uint8_t upper_layer_idx)
+{
+    assert(packet->d7anp_ctrl.hop_enabled);
+    d7anp_hop_ctrl_t* hop_ctrl = &(packet->d7anp_hop_ctrl);
+
+    // our own frames can be relayed back to us, and a frame can be received both directly and through relays
+    if(is_own_access_id(packet->origin_access_id, packet->d7anp_ctrl.origin_access_id_is_vid))
+    {
+        log_print_stack_string(LOG_STACK_NWL, "Relayed frame originated from us, skipping");
+        goto drop;
+    }
+
+    if(!packet_has_bytes_remaining(packet, upper_layer_idx, 1) || is_duplicate(packet, upper_layer_idx))
+    {
+        log_print_stack_string(LOG_STACK_NWL, "Duplicate frame, skipping");
+        goto drop;
+    }
+
+    // the destination learns the route once the upper layers accepted the frame
+    if(is_own_access_id(packet->destination_access_id, hop_ctrl->destination_access_id_is_vid))
+        return true;
+
+    // secured frames are relayed as they are, so they are verified using a copy
+    uint8_t buffer[sizeof(packet->__data)];
+    if(packet->d7anp_ctrl.nls_enabled && !verify_packet(packet, upper_layer_idx, buffer))
+        goto drop;
+
+    update_route_to_origin(packet);
+
+    if(hop_ctrl->hop_limit == 0)
+    {
+        log_print_stack_string(LOG_STACK_NWL, "Hop limit reached, skipping");
+        goto drop;
+    }
+
+    // relaying is only done when not involved in a transaction ourselves
+    if(relayed_packet != NULL || !d7atp_is_idle())
+    {
+        log_print_stack_string(LOG_STACK_NWL, "Busy, not relaying frame");
+        goto drop;
+    }
+
+    if(packet->hw_radio_packet.length > sizeof(packet->__data) - 1 - RELAY_MAX_HEADER_GROWTH)
+    {
+        log_print_stack_string(LOG_STACK_NWL, "Frame too long to relay, skipping");
+        goto drop;
+    }
+
+    log_print_stack_string(LOG_STACK_NWL, "Relaying frame, hop limit %i", hop_ctrl->hop_limit);
+    hop_ctrl->hop_limit--;
+    hop_ctrl->relay_access_id_present = true;
+    fs_read_uid(packet->relay_access_id);
+    packet->dll_addressee.addressee_ctrl_access_class = packet->d7anp_ctrl.origin_access_class;
+    set_next_hop(packet, find_route(packet->destination_access_id, hop_ctrl->destination_access_id_is_vid));
+
+    // the D7ATP header and payload are not parsed, they are sent again from where they are in the received frame.
+    // The DLL only needs to know if the frame starts a dialog.
+    packet->is_relayed = true;
+    packet->is_retransmission = false;
+    packet->upper_layer_data_idx = upper_layer_idx;
+    packet->d7atp_ctrl.ctrl_raw = packet->hw_radio_packet.data[upper_layer_idx];
+    relayed_packet = packet;
+    dll_tx_frame(packet);
+    return false;
+
+    drop:
+        packet_queue_free_packet(packet);
+        return false;
+}
+
+bool d7anp_signal_packet_transmitted(packet_t* packet)
+{
+    if(packet == relayed_packet)
+    {
+        log_print_stack_string(LOG_STACK_NWL, "Relayed frame transmitted");
+        relayed_packet = NULL;
+        packet_queue_free_packet(packet);
+        return false;
+    }
+
+    d7atp_signal_packet_transmitted(packet);
+    return true;
+}
+
+void d7anp_signal_packet_csma_ca_insertion_completed(bool succeeded)
+{
+    if(relayed_packet != NULL)
+    {
+        if(!succeeded)
+        {
+            log_print_stack_string(LOG_STACK_NWL, "CSMA-CA insertion of relayed frame failed");
+            packet_queue_free_packet(relayed_packet);
+            relayed_packet = NULL;
+        }
+
+        return;
+    }
+
+    d7atp_signal_packet_csma_ca_insertion_completed(succeeded);
+}
+
+bool d7anp_is_relaying()
+{
+    return relayed_packet != NULL;
+}
@@ -49,8 +49,109 @@ typedef struct {
     };
 } d7anp_ctrl_t;
 
-void d7anp_tx_foreground_frame(packet_t* packet, bool should_include_origin_template);
+/*! \brief The D7ANP hopping control header, present when hop_enabled is set in the D7ANP CTRL header
+ *
+ * Frames which hop are relayed by nodes which are not the destination, the header is followed by the relay
+ * access ID (the UID of the node which relayed the frame, if any) and the destination access ID.
+ */
+typedef struct {
+    union {
+        uint8_t raw;
+        struct {
+            uint8_t hop_limit : 4; /**< The number of times the frame may still be relayed */
+            bool destination_access_id_is_vid : 1;
+            bool relay_access_id_present : 1;
+            uint8_t _rfu : 2;
+        };
+    };
+} d7anp_hop_ctrl_t;
+
+/*! \brief The network layer security methods. The CBC-MAC methods only authenticate the frame, the CTR method only
+ * encrypts it and the CCM methods do both. The number is the size in bits of the message integrity code (MIC)
+ * appended to the frame.
+ */
+typedef enum
+{
+    NLS_METHOD_NONE = 0,
+    NLS_METHOD_AES_CTR = 1,
+    NLS_METHOD_AES_CBC_MAC_128 = 2,
+    NLS_METHOD_AES_CBC_MAC_64 = 3,
+    NLS_METHOD_AES_CBC_MAC_32 = 4,
+    NLS_METHOD_AES_CCM_128 = 5,
+    NLS_METHOD_AES_CCM_64 = 6,
+    NLS_METHOD_AES_CCM_32 = 7
+} nls_method_t;
+
+/*! The security header consists of the NLS method, the key counter and the frame counter */
+#define NLS_SECURITY_HEADER_SIZE 6
+
+/*! \brief The D7ANP security header, present after the origin access ID when nls_enabled is set in the D7ANP CTRL
+ * header. Sent as the method, the key counter and the big endian frame counter.
+ */
+typedef struct {
+    nls_method_t nls_method;
+    uint8_t key_counter; /**< Identifies the key which was used, incremented when the key is replaced */
+    uint32_t frame_counter; /**< Incremented for every secured frame an origin transmits, used to detect replays */
+} d7anp_security_t;
+
+void d7anp_init();
+/*! \brief Transmits a request or a response. A response is secured using the NLS method of the request it answers,
+ * requests use MODULE_D7AP_NLS_METHOD.
+ */
+void d7anp_tx_foreground_frame(packet_t* packet, bool should_include_origin_template, bool is_response);
 uint8_t d7anp_assemble_packet_header(packet_t* packet, uint8_t* data_ptr);
 bool d7anp_disassemble_packet_header(packet_t* packet, uint8_t* packet_idx);
 
+/*! \brief Encrypts and/or authenticates the D7ATP header and payload of a frame we originate, as specified by the
+ * security header assembled by d7anp_assemble_packet_header(). The data is encrypted in place and the MIC is appended.
+ *
+ * \param packet            The packet being assembled
+ * \param upper_layer_data  The assembled D7ATP header, followed by the payload
+ * \param upper_layer_size  The size of the D7ATP header and payload
+ * \return uint8_t          The size of the appended MIC
+ */
+uint8_t d7anp_secure_packet(packet_t* packet, uint8_t* upper_layer_data, uint8_t upper_layer_size);
+
+/*! \brief Returns the size of the network protocol footer (the MIC) d7anp_secure_packet() appends to the frame */
+uint8_t d7anp_get_footer_size(packet_t* packet);
+
+/*! \brief Verifies and decrypts the D7ATP header and payload of a received frame with nls_enabled, in place.
+ *
+ * The frame is rejected when it is not secured using MODULE_D7AP_NLS_METHOD, the MIC is invalid, the key counter does
+ * not match or the frame counter was already used by the origin. On success the MIC is removed from the frame by
+ * reducing its length.
+ *
+ * \param packet            The received packet
+ * \param upper_layer_idx   The index in the frame data at which the D7ATP header starts
+ * \return bool             false when the frame should be dropped
+ */
+bool d7anp_unsecure_packet(packet_t* packet, uint8_t upper_layer_idx);
+
+/*! \brief Called when the upper layers accepted a received frame, which passed d7anp_unsecure_packet() when secured.
+ * Learns the route to the origin of the frame.
+ */
+void d7anp_signal_packet_accepted(packet_t* packet);
+
+/*! \brief Returns true when the received frame was authenticated by D7ANP, which is only the case for the methods with
+ * a MIC. A frame secured using AES-CTR is encrypted, but could have been modified.
+ */
+bool d7anp_is_authenticated(packet_t const* packet);
+
+/*! \brief Handles a received frame with hopping enabled, after the D7ANP header is disassembled. Secured frames which
+ * are relayed are verified first, but are relayed as they are.
+ *
+ * \param packet            The received packet
+ * \param upper_layer_idx   The index in the frame data at which the D7ATP header starts
+ * \return bool             true when this node is the destination and the frame should be processed by the upper
+ *                          layers. Otherwise the frame is relayed or dropped, and freed by D7ANP.
+ */
+bool d7anp_process_hopping(packet_t* packet, uint8_t upper_layer_idx);
+
+/*! \brief Called by the DLL when a frame is transmitted, returns true when a response is expected */
+bool d7anp_signal_packet_transmitted(packet_t* packet);
+void d7anp_signal_packet_csma_ca_insertion_completed(bool succeeded);
+
+/*! \brief Returns true while a received frame is being relayed, no new dialogs can be started meanwhile */
+bool d7anp_is_relaying();
+
 #endif /* D7ANP_H_ */
@@ -17,6 +17,8 @@
  */
 
 #include "d7ap_stack.h"
+#include "neighbor_table.h"
+#include "d7anp.h"
 
 #include "debug.h"
 
@@ -29,6 +31,8 @@ void d7ap_stack_init(fs_init_args_t* fs_init_args, alp_unhandled_action_callback
     fs_init(fs_init_args);
     d7asp_init(d7asp_init_args);
     d7atp_init();
+    d7anp_init();
     packet_queue_init();
+    neighbor_table_init();
     dll_init();
 }
@@ -27,36 +27,49 @@
 #include "alp.h"
 #include "fs.h"
 #include "scheduler.h"
+#include "timer.h"
 #include "d7atp.h"
 #include "packet_queue.h"
 #include "packet.h"
 #include "hwdebug.h"
+#include "random.h"
+#include "phy.h"
 
-static d7asp_fifo_t NGDEF(_fifo); // TODO we only use 1 fifo for now, should be multiple later (1 per on unique addressee and QoS combination)
-#define fifo NG(_fifo)
+// a FIFO per unique addressee and QoS combination, a FIFO without requests is free
+static d7asp_fifo_t NGDEF(_fifos)[MODULE_D7AP_FIFO_COUNT];
+#define fifos NG(_fifos)
 
-static uint8_t NGDEF(_active_request_id); // TODO move ?
-#define active_request_id NG(_active_request_id)
+// the FIFO of the active request, or the FIFO of the last request when none is active
+static d7asp_fifo_t* NGDEF(_current_fifo);
+#define current_fifo NG(_current_fifo)
 
-#define NO_ACTIVE_REQUEST_ID 0xFF
+// the slot of the active request in the current FIFO
+static uint8_t NGDEF(_active_request_idx);
+#define active_request_idx NG(_active_request_idx)
+
+#define NO_ACTIVE_REQUEST_IDX 0xFF
+
+// the slots of the requests which are sent in the frame of the active request, the active request is the first one and
+// its ID is used as transaction ID
+static uint8_t NGDEF(_active_requests_bitmap)[REQUESTS_BITMAP_BYTE_COUNT];
+#define active_requests_bitmap NG(_active_requests_bitmap)
 
 static uint8_t NGDEF(_current_request_retry_count);
 #define current_request_retry_count NG(_current_request_retry_count)
 
+// the active request is not retried before the end of its backoff period, also when we were slave in the meantime
+static timer_tick_t NGDEF(_retry_deadline);
+#define retry_deadline NG(_retry_deadline)
+
 static packet_t* NGDEF(_current_request_packet);
 #define current_request_packet NG(_current_request_packet)
 
-static uint8_t NGDEF(_single_request_retry_limit);
-#define single_request_retry_limit NG(_single_request_retry_limit)
+static packet_t* NGDEF(_current_response_packet);
+#define current_response_packet NG(_current_response_packet)
 
 static dae_access_profile_t NGDEF(_current_access_profile);
 #define current_access_profile NG(_current_access_profile)
 
-static uint8_t NGDEF(_current_access_class);
-#define current_access_class NG(_current_access_class)
-
-#define ACCESS_CLASS_NOT_SET 0xFF
-
 static d7asp_init_args_t* NGDEF(_d7asp_init_args);
 #define d7asp_init_args NG(_d7asp_init_args)
 
@@ -71,83 +84,424 @@ static state_t NGDEF(_state);
 #define state NG(_state)
 
 static void switch_state(state_t new_state);
+static void flush_fifos();
+static void fail_current_request();
 
-static void init_fifo()
+static void init_fifo(d7asp_fifo_t* fifo)
 {
-    fifo = (d7asp_fifo_t){
+    *fifo = (d7asp_fifo_t){
+        .token = get_rnd(),
         .progress_bitmap = { 0x00 },
         .success_bitmap = { 0x00 },
-        .next_request_id = 0,
+        .first_request_id = 0,
+        .first_request_idx = 0,
+        .request_count = 0,
         .request_buffer_tail_idx = 0,
-        .requests_indices = { 0x00 },
+        .requests = { { 0 } },
         .request_buffer = { 0x00 }
     };
 }
 
-static void mark_current_request_done()
+// the slot of the i-th stored request
+static uint8_t get_request_idx(d7asp_fifo_t* fifo, uint8_t i)
+{
+    return (fifo->first_request_idx + i) % MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT;
+}
+
+// the position of the request in a slot among the stored requests
+static uint8_t get_stored_request_index(d7asp_fifo_t* fifo, uint8_t request_idx)
+{
+    return (request_idx + MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT - fifo->first_request_idx) % MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT;
+}
+
+static uint8_t get_request_id(d7asp_fifo_t* fifo, uint8_t request_idx)
+{
+    return fifo->first_request_id + get_stored_request_index(fifo, request_idx);
+}
+
+static void mark_current_request_done(bool succeeded)
 {
-    bitmap_set(fifo.progress_bitmap, active_request_id);
+    for(uint8_t i = 0; i < current_fifo->request_count; i++)
+    {
+        uint8_t request_idx = get_request_idx(current_fifo, i);
+        if(!bitmap_get(active_requests_bitmap, request_idx))
+            continue;
+
+        bitmap_set(current_fifo->progress_bitmap, request_idx);
+        if(succeeded)
+            bitmap_set(current_fifo->success_bitmap, request_idx);
+    }
+
     // current_request_packet will be free-ed in the packet_queue when the transaction is completed
 }
 
+// the dialog is stopped with the transaction of the last request which is not handled yet
+static bool is_last_pending_request()
+{
+    for(uint8_t i = 0; i < current_fifo->request_count; i++)
+    {
+        uint8_t request_idx = get_request_idx(current_fifo, i);
+        if(!bitmap_get(active_requests_bitmap, request_idx) && !bitmap_get(current_fifo->progress_bitmap, request_idx))
+            return false;
+    }
+
+    return true;
+}
+
+// marks all requests which are acknowledged in the ACK template as succeeded
+static void process_ack_template(d7atp_ack_template_t* ack_template)
+{
+    uint8_t ack_count = ack_template->ack_transaction_id_stop - ack_template->ack_transaction_id_start + 1;
+    for(uint8_t i = 0; i < ack_count && i < D7ATP_ACK_BITMAP_MAX_TRANSACTIONS; i++)
+    {
+        uint8_t request_id = ack_template->ack_transaction_id_start + i;
+        uint8_t stored_request_index = request_id - current_fifo->first_request_id;
+        if(!bitmap_get(ack_template->ack_bitmap, i) || stored_request_index >= current_fifo->request_count)
+            continue;
+
+        uint8_t request_idx = get_request_idx(current_fifo, stored_request_index);
+        if(bitmap_get(current_fifo->progress_bitmap, request_idx))
+            continue;
+
+        log_print_stack_string(LOG_STACK_SESSION, "Request %i acknowledged", request_id);
+        if(request_idx == active_request_idx)
+        {
+            // the transaction of the active request acknowledges all requests sent in its frame
+            mark_current_request_done(true);
+            continue;
+        }
+
+        bitmap_set(current_fifo->progress_bitmap, request_idx);
+        bitmap_set(current_fifo->success_bitmap, request_idx);
+    }
+}
+
+// returns the slot of the first request which is not acked or dropped yet, or NO_ACTIVE_REQUEST_IDX when all requests are
+// handled
+static uint8_t get_next_request_idx(d7asp_fifo_t* fifo)
+{
+    for(uint8_t i = 0; i < fifo->request_count; i++)
+    {
+        uint8_t request_idx = get_request_idx(fifo, i);
+        if(!bitmap_get(fifo->progress_bitmap, request_idx))
+            return request_idx;
+    }
+
+    return NO_ACTIVE_REQUEST_IDX;
+}
+
+// frees the slots of the handled requests at the front of the FIFO, so new requests can be queued while it is flushed.
+// Only called when no request of the FIFO is active, the slots of the active requests are still in use.
+static void complete_fifo_if_flushed(d7asp_fifo_t* fifo)
+{
+    while(fifo->request_count > 0 && bitmap_get(fifo->progress_bitmap, fifo->first_request_idx))
+    {
+        fifo->first_request_idx = get_request_idx(fifo, 1);
+        fifo->first_request_id++;
+        fifo->request_count--;
+    }
+
+    if(fifo->request_count > 0)
+        return;
+
+    log_print_stack_string(LOG_STACK_SESSION, "FIFO flush completed");
+    if(d7asp_init_args != NULL && d7asp_init_args->d7asp_fifo_flush_completed_cb != NULL)
+        d7asp_init_args->d7asp_fifo_flush_completed_cb(&fifo->config, fifo->progress_bitmap, fifo->success_bitmap, REQUESTS_BITMAP_BYTE_COUNT);
+
+    init_fifo(fifo);
+}
+
+// a dormant session is held until its addressee contacts us or until its dormant timeout expires
+static bool is_dormant(d7asp_fifo_t* fifo)
+{
+    if(fifo->config.fifo_ctrl_state != SESSION_STATE_DORMANT)
+        return false;
+
+    if((int32_t)(timer_get_counter_value() - fifo->dormant_deadline) < 0)
+        return true;
+
+    log_print_stack_string(LOG_STACK_SESSION, "Dormant session timed out");
+    fifo->config.fifo_ctrl_state = SESSION_STATE_PENDING;
+    return false;
+}
+
+// preferred FIFOs go first, the FIFOs take turns in round-robin order starting after the FIFO which was flushed last
+static d7asp_fifo_t* get_next_fifo_to_flush()
+{
+    uint8_t current_fifo_index = current_fifo - fifos;
+    d7asp_fifo_t* next_fifo = NULL;
+    for(uint8_t i = 1; i <= MODULE_D7AP_FIFO_COUNT; i++)
+    {
+        d7asp_fifo_t* fifo = &fifos[(current_fifo_index + i) % MODULE_D7AP_FIFO_COUNT];
+        if(get_next_request_idx(fifo) == NO_ACTIVE_REQUEST_IDX || is_dormant(fifo))
+            continue;
+
+        if(fifo->config.fifo_ctrl_preferred)
+            return fifo;
+
+        if(next_fifo == NULL)
+            next_fifo = fifo;
+    }
+
+    return next_fifo;
+}
+
+// finds room for a request in the ring buffer, a request is stored contiguously and wraps to the start when it does not
+// fit at the end of the buffer
+static bool allocate_request_storage(d7asp_fifo_t* fifo, uint8_t length, uint16_t* buffer_idx)
+{
+    // the storage of handled requests is not used anymore, even when their slots are not freed yet
+    uint8_t first_pending_request_idx = get_next_request_idx(fifo);
+    if(first_pending_request_idx == NO_ACTIVE_REQUEST_IDX)
+    {
+        // all stored requests are handled, the buffer is empty
+        *buffer_idx = 0;
+        return true;
+    }
+
+    uint16_t head_idx = fifo->requests[first_pending_request_idx].buffer_idx;
+    if(fifo->request_buffer_tail_idx >= head_idx)
+    {
+        if(fifo->request_buffer_tail_idx + length <= MODULE_D7AP_FIFO_COMMAND_BUFFER_SIZE)
+        {
+            *buffer_idx = fifo->request_buffer_tail_idx;
+            return true;
+        }
+
+        if(length < head_idx)
+        {
+            *buffer_idx = 0;
+            return true;
+        }
+
+        return false;
+    }
+
+    // the buffer already wrapped, the tail may not reach the head
+    if(fifo->request_buffer_tail_idx + length < head_idx)
+    {
+        *buffer_idx = fifo->request_buffer_tail_idx;
+        return true;
+    }
+
+    return false;
+}
+
+// while no FIFOs are flushed flush_fifos() is used to wake up when the first dormant session times out
+static void schedule_dormant_timeout()
+{
+    bool found = false;
+    int32_t first_timeout = 0;
+    for(uint8_t i = 0; i < MODULE_D7AP_FIFO_COUNT; i++)
+    {
+        if(fifos[i].request_count == 0 || fifos[i].config.fifo_ctrl_state != SESSION_STATE_DORMANT)
+            continue;
+
+        int32_t timeout = (int32_t)(fifos[i].dormant_deadline - timer_get_counter_value());
+        if(!found || timeout < first_timeout)
+            first_timeout = timeout;
+
+        found = true;
+    }
+
+    if(!found)
+        return;
+
+    timer_cancel_task(&flush_fifos);
+    if(first_timeout <= 0)
+        sched_post_task(&flush_fifos);
+    else
+        timer_post_task_delay(&flush_fifos, first_timeout);
+}
+
+// returns the dormant FIFO of which the addressee is the origin of the received packet
+static d7asp_fifo_t* get_dormant_fifo_of_origin(packet_t* packet)
+{
+    if(!packet->d7anp_ctrl.origin_access_id_present)
+        return NULL;
+
+    uint8_t address_size = packet->d7anp_ctrl.origin_access_id_is_vid? 2 : 8;
+    for(uint8_t i = 0; i < MODULE_D7AP_FIFO_COUNT; i++)
+    {
+        d7atp_addressee_t* addressee = &(fifos[i].config.addressee);
+        if(fifos[i].request_count > 0 && is_dormant(&fifos[i]) && addressee->addressee_ctrl_has_id
+                && addressee->addressee_ctrl_virtual_id == packet->d7anp_ctrl.origin_access_id_is_vid
+                && memcmp(addressee->addressee_id, packet->origin_access_id, address_size) == 0)
+            return &fifos[i];
+    }
+
+    return NULL;
+}
+
+// adds the pending requests of the current FIFO, starting with the active request, to the payload of the packet as long
+// as they fit in the frame
+static void add_pending_requests(packet_t* packet)
+{
+    memset(active_requests_bitmap, 0, sizeof(active_requests_bitmap));
+    for(uint8_t i = get_stored_request_index(current_fifo, active_request_idx); i < current_fifo->request_count; i++)
+    {
+        uint8_t request_idx = get_request_idx(current_fifo, i);
+        if(bitmap_get(current_fifo->progress_bitmap, request_idx))
+            continue;
+
+        const uint8_t* request = current_fifo->request_buffer + current_fifo->requests[request_idx].buffer_idx;
+        uint8_t request_length = current_fifo->requests[request_idx].length;
+        if(packet->payload_length > 0
+                && packet->payload_length + alp_get_command_payload_length(request, request_length) > D7ASP_PAYLOAD_MAX_LENGTH)
+            break;
+
+        alp_process_command(request, request_length, packet);
+        bitmap_set(active_requests_bitmap, request_idx);
+    }
+}
+
+static bool is_fifo_of_session(d7asp_fifo_t* fifo, d7asp_fifo_config_t* d7asp_fifo_config)
+{
+    return fifo->config.addressee.addressee_ctrl == d7asp_fifo_config->addressee.addressee_ctrl
+            && memcmp(fifo->config.addressee.addressee_id, d7asp_fifo_config->addressee.addressee_id, sizeof(fifo->config.addressee.addressee_id)) == 0
+            && memcmp(&(fifo->config.qos), &(d7asp_fifo_config->qos), sizeof(session_qos_t)) == 0;
+}
+
+// returns the FIFO of the addressee and QoS combination, or a free FIFO when there is none yet
+static d7asp_fifo_t* get_fifo(d7asp_fifo_config_t* d7asp_fifo_config)
+{
+    d7asp_fifo_t* free_fifo = NULL;
+    for(uint8_t i = 0; i < MODULE_D7AP_FIFO_COUNT; i++)
+    {
+        if(fifos[i].request_count == 0)
+        {
+            if(free_fifo == NULL)
+                free_fifo = &fifos[i];
+        }
+        else if(is_fifo_of_session(&fifos[i], d7asp_fifo_config))
+            return &fifos[i];
+    }
+
+    return free_fifo;
+}
+
+static d7asp_result_t get_result(packet_t* packet)
+{
+    d7asp_result_t result = {
+        .status = {
+            .session_state = SESSION_STATE_DONE, // TODO slave session state can be active as well, assuming done now
+            .nls = packet->d7anp_ctrl.nls_enabled,
+            .retry = false, // TODO
+            .missed = false, // TODO
+        },
+        .fifo_token = packet->d7atp_dialog_id,
+        .request_id = packet->d7atp_transaction_id,
+        .response_to = 0, // TODO
+        .addressee = {
+            .addressee_ctrl_has_id = packet->d7anp_ctrl.origin_access_id_present? true : false,
+            .addressee_ctrl_virtual_id = packet->d7anp_ctrl.origin_access_id_is_vid,
+            .addressee_ctrl_access_class = packet->d7anp_ctrl.origin_access_class,
+        },
+    };
+
+    memcpy(result.addressee.addressee_id, packet->origin_access_id, 8);
+    return result;
+}
+
 static void flush_fifos()
 {
-    assert(state == D7ASP_STATE_MASTER);
+    if(state != D7ASP_STATE_MASTER)
+    {
+        // a dormant session timed out, it is flushed unless we are busy as slave
+        if(state == D7ASP_STATE_IDLE)
+        {
+            if(get_next_fifo_to_flush() != NULL)
+                switch_state(D7ASP_STATE_MASTER);
+            else
+                schedule_dormant_timeout();
+        }
+
+        return;
+    }
+
+    if(d7anp_is_relaying())
+    {
+        // the DLL is busy transmitting a relayed frame, try again later
+        timer_post_task_delay(&flush_fifos, 1);
+        return;
+    }
+
     log_print_stack_string(LOG_STACK_SESSION, "Flushing FIFOs");
 
-    if(active_request_id == NO_ACTIVE_REQUEST_ID)
+    if(active_request_idx == NO_ACTIVE_REQUEST_IDX)
     {
-        // find first request which is not acked or dropped
-        uint8_t found_next_req_index = bitmap_search(fifo.progress_bitmap, false, MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT);
-        if(found_next_req_index == -1 || found_next_req_index == fifo.next_request_id)
+        // the FIFOs take turns, so a FIFO with many requests does not hold back the others
+        d7asp_fifo_t* next_fifo = get_next_fifo_to_flush();
+        if(next_fifo == NULL)
         {
             // we handled all requests ...
-            log_print_stack_string(LOG_STACK_SESSION, "FIFO flush completed");
-            if(d7asp_init_args != NULL && d7asp_init_args->d7asp_fifo_flush_completed_cb != NULL)
-                d7asp_init_args->d7asp_fifo_flush_completed_cb(&fifo.config, fifo.progress_bitmap, fifo.success_bitmap, REQUESTS_BITMAP_BYTE_COUNT);
-
-            init_fifo();
+            log_print_stack_string(LOG_STACK_SESSION, "Flushing FIFOs completed");
             switch_state(D7ASP_STATE_IDLE);
             return;
         }
 
-        active_request_id = found_next_req_index;
+        current_request_packet = packet_queue_alloc_packet();
+        if(current_request_packet == NULL)
+        {
+            // all packets are in use by received or relayed frames, try again when these are processed
+            log_print_stack_string(LOG_STACK_SESSION, "Packet queue full, postponing flush");
+            timer_post_task_delay(&flush_fifos, 1);
+            return;
+        }
+
+        current_fifo = next_fifo;
+
+        active_request_idx = get_next_request_idx(current_fifo);
         current_request_retry_count = 0;
 
-        current_request_packet = packet_queue_alloc_packet();
         packet_queue_mark_processing(current_request_packet);
-        current_request_packet->d7atp_addressee = &(fifo.config.addressee);
+        current_request_packet->d7atp_addressee = &(current_fifo->config.addressee);
 
-        alp_process_command(fifo.request_buffer + fifo.requests_indices[active_request_id], current_request_packet);
+        // the pending requests of the FIFO are sent together in a single frame, as long as their payloads fit
+        current_request_packet->payload_length = 0;
+        add_pending_requests(current_request_packet);
 
-        uint8_t access_class = fifo.config.addressee.addressee_ctrl_access_class;
-        if(access_class != current_access_class)
-            fs_read_access_class(access_class, &current_access_profile);
+        // the access profiles can be modified in the meantime, so they are read for every request
+        uint8_t access_class = current_fifo->config.addressee.addressee_ctrl_access_class;
+        if(!fs_read_access_class(access_class, &current_access_profile))
+        {
+            log_print_stack_string(LOG_STACK_SESSION, "Access class %i not defined or invalid, skipping request", access_class);
+            fail_current_request();
+            sched_post_task(&flush_fifos);
+            return;
+        }
     }
     else
     {
-        // retrying request ...
-        log_print_stack_string(LOG_STACK_SESSION, "Current request retry count: %i", current_request_retry_count);
-        if(current_request_retry_count == single_request_retry_limit)
+        int32_t remaining_backoff_period = (int32_t)(retry_deadline - timer_get_counter_value());
+        if(remaining_backoff_period > 0)
         {
-            // mark request as failed and pop
-            mark_current_request_done();
-            log_print_stack_string(LOG_STACK_SESSION, "Request reached single request retry limit (%i), skipping request", single_request_retry_limit);
-            packet_queue_free_packet(current_request_packet);
-            active_request_id = NO_ACTIVE_REQUEST_ID;
-            sched_post_task(&flush_fifos); // continue flushing until all request handled ...
+            timer_post_task_delay(&flush_fifos, remaining_backoff_period);
             return;
         }
 
-        // TODO retry total cnt
-        // TODO stop on error
+        // retrying request ...
+        log_print_stack_string(LOG_STACK_SESSION, "Current request retry count: %i, FIFO retry count: %i",
+                               current_request_retry_count, current_fifo->retry_total_count);
     }
 
-    d7atp_start_dialog(0, 0, current_request_packet, &fifo.config.qos, &current_access_profile); // TODO dialog_id and transaction_id
+    // retries are transmitted at full power, the lower transmission power might be the reason no ack was received
+    current_request_packet->is_retransmission = current_request_retry_count > 0;
+    // the FIFO is flushed in a single dialog identified by the FIFO token, each request is a transaction of it
+    d7atp_start_dialog(current_fifo->token, get_request_id(current_fifo, active_request_idx), is_last_pending_request(), current_request_packet, &current_fifo->config.qos, &current_access_profile);
 }
 
 
 
+// a pending master session starts as soon as the slave session ends
+static void end_slave_session()
+{
+    if(state == D7ASP_STATE_SLAVE_PENDING_MASTER)
+        switch_state(D7ASP_STATE_MASTER);
+    else
+        switch_state(D7ASP_STATE_IDLE);
+}
+
 // TODO document state diagram
 static void switch_state(state_t new_state)
 {
@@ -158,11 +512,13 @@ static void switch_state(state_t new_state)
             {
                 case D7ASP_STATE_IDLE:
                     state = new_state;
+                    timer_cancel_task(&flush_fifos); // a pending dormant timeout is handled by this flush
                     sched_post_task(&flush_fifos);
                     log_print_stack_string(LOG_STACK_SESSION, "Switching to state D7ASP_STATE_MASTER");
                     break;
                 case D7ASP_STATE_SLAVE_PENDING_MASTER:
                     state = new_state;
+                    timer_cancel_task(&flush_fifos);
                     sched_post_task(&flush_fifos);
                     log_print_stack_string(LOG_STACK_SESSION, "Switching to state D7ASP_STATE_MASTER");
                     break;
@@ -171,8 +527,7 @@ static void switch_state(state_t new_state)
                     log_print_stack_string(LOG_STACK_SESSION, "Switching to state D7ASP_STATE_SLAVE_PENDING_MASTER");
                     break;
                 case D7ASP_STATE_MASTER:
-                    // new requests in fifo, reschedule for later flushing
-                    // TODO sched_post_task(&flush_fifos);
+                    // new requests are picked up by the flush in progress, it only ends when all FIFOs are handled
                     break;
                 default:
                     assert(false);
@@ -184,7 +539,7 @@ static void switch_state(state_t new_state)
             {
                 case D7ASP_STATE_IDLE:
                     state = new_state;
-                    active_request_id = NO_ACTIVE_REQUEST_ID;
+                    active_request_idx = NO_ACTIVE_REQUEST_IDX;
                     log_print_stack_string(LOG_STACK_SESSION, "Switching to state D7ASP_STATE_SLAVE");
                     break;
                 default:
@@ -192,13 +547,15 @@ static void switch_state(state_t new_state)
             }
             break;
         case D7ASP_STATE_SLAVE_PENDING_MASTER:
-            assert(state == D7ASP_STATE_SLAVE);
+            assert(state == D7ASP_STATE_SLAVE || state == D7ASP_STATE_MASTER);
+            timer_cancel_task(&flush_fifos); // the master session continues when the slave session ends
             state = D7ASP_STATE_SLAVE_PENDING_MASTER;
             log_print_stack_string(LOG_STACK_SESSION, "Switching to state D7ASP_STATE_SLAVE_PENDING_MASTER");
             break;
         case D7ASP_STATE_IDLE:
             state = new_state;
             log_print_stack_string(LOG_STACK_SESSION, "Switching to state D7ASP_STATE_IDLE");
+            schedule_dormant_timeout();
             break;
         default:
             assert(false);
@@ -208,102 +565,172 @@ static void switch_state(state_t new_state)
 void d7asp_init(d7asp_init_args_t* init_args)
 {
     state = D7ASP_STATE_IDLE;
-    current_access_class = ACCESS_CLASS_NOT_SET;
     d7asp_init_args = init_args;
-    active_request_id = NO_ACTIVE_REQUEST_ID;
+    active_request_idx = NO_ACTIVE_REQUEST_IDX;
+
+    for(uint8_t i = 0; i < MODULE_D7AP_FIFO_COUNT; i++)
+        init_fifo(&fifos[i]);
 
-    init_fifo();
+    current_fifo = &fifos[MODULE_D7AP_FIFO_COUNT - 1]; // the round-robin order starts with the first FIFO
 
     sched_register_task(&flush_fifos);
 }
 
 // TODO we assume a fifo contains only ALP commands, but according to spec this can be any kind of "Request"
 // we will see later what this means. For instance how to add a request which starts D7AAdvP etc
-void d7asp_queue_alp_actions(d7asp_fifo_config_t* d7asp_fifo_config, uint8_t* alp_payload_buffer, uint8_t alp_payload_length)
+error_t d7asp_queue_alp_actions(d7asp_fifo_config_t* d7asp_fifo_config, uint8_t* alp_payload_buffer, uint8_t alp_payload_length)
 {
     log_print_stack_string(LOG_STACK_SESSION, "Queuing ALP actions");
 
-    assert(fifo.request_buffer_tail_idx + alp_payload_length < MODULE_D7AP_FIFO_COMMAND_BUFFER_SIZE);
-    assert(fifo.next_request_id < MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT); // TODO do not assert but let upper layer handle this
-
-    // TODO the actions should be queued in a fifo based on combination of addressee and Qos
-    // for now we use only 1 queue and overwrite the config
-    fifo.config.fifo_ctrl = d7asp_fifo_config->fifo_ctrl;
-    fifo.config.qos = d7asp_fifo_config->qos;
-    fifo.config.dormant_timeout = d7asp_fifo_config->dormant_timeout;
-    fifo.config.start_id = d7asp_fifo_config->start_id;
-    fifo.config.addressee.addressee_ctrl = d7asp_fifo_config->addressee.addressee_ctrl;
-    memcpy(fifo.config.addressee.addressee_id, d7asp_fifo_config->addressee.addressee_id, sizeof(fifo.config.addressee.addressee_id));
-    single_request_retry_limit = fifo.config.qos.qos_retry_single;
-
-    // add request to buffer
-    fifo.requests_indices[fifo.next_request_id] = fifo.request_buffer_tail_idx;
-    memcpy(fifo.request_buffer + fifo.request_buffer_tail_idx, alp_payload_buffer, alp_payload_length);
-    fifo.request_buffer_tail_idx += alp_payload_length + 1;
-    fifo.next_request_id++;
-
-    if(state == D7ASP_STATE_IDLE)
+    if(alp_payload_length == 0 || alp_payload_length > MODULE_D7AP_FIFO_COMMAND_BUFFER_SIZE)
+        return ESIZE;
+
+    // the payload the actions result in has to fit in a single frame
+    uint8_t request_payload_length = alp_get_command_payload_length(alp_payload_buffer, alp_payload_length);
+    if(request_payload_length == 0)
+    {
+        log_print_stack_string(LOG_STACK_SESSION, "Invalid ALP actions");
+        return EINVAL;
+    }
+
+    if(request_payload_length > D7ASP_PAYLOAD_MAX_LENGTH)
+        return ESIZE;
+
+    // the actions are queued in the FIFO of the combination of addressee and QoS
+    d7asp_fifo_t* fifo = get_fifo(d7asp_fifo_config);
+    if(fifo == NULL)
+    {
+        log_print_stack_string(LOG_STACK_SESSION, "No FIFO available");
+        return ENOMEM;
+    }
+
+    if(fifo->request_count == MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT)
+    {
+        log_print_stack_string(LOG_STACK_SESSION, "FIFO holds the max number of requests");
+        return EBUSY;
+    }
+
+    uint16_t buffer_idx;
+    if(!allocate_request_storage(fifo, alp_payload_length, &buffer_idx))
+    {
+        log_print_stack_string(LOG_STACK_SESSION, "FIFO request buffer full");
+        return ENOMEM;
+    }
+
+    // the FIFO keeps the config of the request which started the session
+    if(fifo->request_count == 0)
+    {
+        fifo->config.fifo_ctrl = d7asp_fifo_config->fifo_ctrl;
+        fifo->config.qos = d7asp_fifo_config->qos;
+        fifo->config.dormant_timeout = d7asp_fifo_config->dormant_timeout;
+        fifo->config.start_id = d7asp_fifo_config->start_id;
+        fifo->config.addressee.addressee_ctrl = d7asp_fifo_config->addressee.addressee_ctrl;
+        memcpy(fifo->config.addressee.addressee_id, d7asp_fifo_config->addressee.addressee_id, sizeof(fifo->config.addressee.addressee_id));
+        if(fifo->config.fifo_ctrl_state == SESSION_STATE_DORMANT)
+            fifo->dormant_deadline = timer_get_counter_value() + compressed_time_decode(fifo->config.dormant_timeout);
+    }
+
+    // add request to buffer, the slot may still report a request which was handled before
+    uint8_t request_idx = get_request_idx(fifo, fifo->request_count);
+    fifo->requests[request_idx] = (d7asp_request_t){
+        .buffer_idx = buffer_idx,
+        .length = alp_payload_length
+    };
+
+    bitmap_clear(fifo->progress_bitmap, request_idx);
+    bitmap_clear(fifo->success_bitmap, request_idx);
+    memcpy(fifo->request_buffer + buffer_idx, alp_payload_buffer, alp_payload_length);
+    fifo->request_buffer_tail_idx = buffer_idx + alp_payload_length;
+    fifo->request_count++;
+
+    if(fifo->config.fifo_ctrl_state == SESSION_STATE_DORMANT)
+    {
+        // held until the addressee contacts us or the dormant timeout expires
+        if(state == D7ASP_STATE_IDLE)
+            schedule_dormant_timeout();
+    }
+    else if(state == D7ASP_STATE_IDLE)
         switch_state(D7ASP_STATE_MASTER);
     else if(state == D7ASP_STATE_SLAVE)
         switch_state(D7ASP_STATE_SLAVE_PENDING_MASTER);
+
+    return SUCCESS;
 }
 
-void d7asp_process_received_packet(packet_t* packet)
+void d7asp_process_received_packet(packet_t* packet, bool is_response)
 {
-    if(state == D7ASP_STATE_MASTER)
+    if(is_response)
     {
-        assert(fifo.config.qos.qos_ctrl_resp_mode > SESSION_RESP_MODE_NONE);
+        assert(state == D7ASP_STATE_MASTER && active_request_idx != NO_ACTIVE_REQUEST_IDX);
+        if(current_fifo->config.qos.qos_ctrl_resp_mode == SESSION_RESP_MODE_NONE)
+        {
+            log_print_stack_string(LOG_STACK_SESSION, "Not expecting a response, skipping packet");
+            packet_queue_free_packet(packet);
+            return;
+        }
 
         // received ack
         log_print_stack_string(LOG_STACK_SESSION, "Received ACK");
-        bitmap_set(fifo.success_bitmap, active_request_id);
-        mark_current_request_done();
+        if(packet->d7atp_ctrl.ctrl_is_ack_template_present)
+            process_ack_template(&(packet->d7atp_ack_template));
+        else
+        {
+            mark_current_request_done(true);
+        }
+
         assert(packet != current_request_packet);
+
+        // the response period is not ended by a response to a broadcast request, every responder is reported
+        if(d7asp_init_args != NULL && d7asp_init_args->d7asp_response_received_cb != NULL)
+            d7asp_init_args->d7asp_response_received_cb(get_result(packet), packet->payload, packet->payload_length);
+
         packet_queue_free_packet(packet); // ACK can be cleaned
-        // TODO notify upper layer
     }
-    else if(state == D7ASP_STATE_IDLE || state == D7ASP_STATE_SLAVE)
+    else
     {
-        // received a request, start slave session, process and respond
+        // received a request, start slave session, process and respond. A master session, which can be waiting for the
+        // backoff period before a retry, continues when the slave session ends.
         if(state == D7ASP_STATE_IDLE)
-            switch_state(D7ASP_STATE_SLAVE); // don't switch when already in slave state
-
-        d7asp_result_t result = {
-            .status = {
-                .session_state = SESSION_STATE_DONE, // TODO slave session state can be active as well, assuming done now
-                .nls = packet->d7anp_ctrl.nls_enabled,
-                .retry = false, // TODO
-                .missed = false, // TODO
-            },
-            .fifo_token = packet->d7atp_dialog_id,
-            .request_id = packet->d7atp_transaction_id,
-            .response_to = 0, // TODO
-            .addressee = {
-                .addressee_ctrl_has_id = packet->d7anp_ctrl.origin_access_id_present? true : false,
-                .addressee_ctrl_virtual_id = packet->dll_header.control_vid_used,
-                .addressee_ctrl_access_class = packet->d7anp_ctrl.origin_access_class,
-            },
-        };
-
-        memcpy(result.addressee.addressee_id, packet->origin_access_id, 8);
+            switch_state(D7ASP_STATE_SLAVE);
+        else if(state == D7ASP_STATE_MASTER)
+            switch_state(D7ASP_STATE_SLAVE_PENDING_MASTER);
+
+        // the requests held for a dormant addressee are flushed as a master session when the slave session ends, the
+        // addressee is awake now. These requests are only done when acknowledged, like any other request.
+        d7asp_fifo_t* dormant_fifo = get_dormant_fifo_of_origin(packet);
+        if(dormant_fifo != NULL)
+        {
+            log_print_stack_string(LOG_STACK_SESSION, "Addressee of dormant session contacted us, session pending");
+            dormant_fifo->config.fifo_ctrl_state = SESSION_STATE_PENDING;
+            if(state == D7ASP_STATE_SLAVE)
+                switch_state(D7ASP_STATE_SLAVE_PENDING_MASTER);
+        }
+
+        d7asp_result_t result = get_result(packet);
 
         // build response, we will reuse the same packet for this
-        alp_process_received_request(result, packet);
+        if(!alp_process_received_request(result, packet))
+        {
+            // a break query is not satisfied, we are not the node the request is meant for
+            log_print_stack_string(LOG_STACK_SESSION, "Query not satisfied, not responding");
+            packet_queue_free_packet(packet);
+            end_slave_session();
+            return;
+        }
 
         // execute slave transaction
         if(packet->payload_length == 0 && !packet->d7atp_ctrl.ctrl_is_ack_requested)
         {
             // no need to respond, clean up
             packet_queue_free_packet(packet);
-            switch_state(D7ASP_STATE_IDLE);
+            end_slave_session();
             return;
         }
 
         log_print_stack_string(LOG_STACK_SESSION, "Sending response");
+        current_response_packet = packet;
         d7atp_respond_dialog(packet);
     }
-    else
-        assert(false);
 }
 
 // TODO should not trigger on packet transmitted but get event from TP after termination of dialog
@@ -311,7 +738,7 @@ void d7asp_signal_packet_transmitted(packet_t *packet)
 {
     log_print_stack_string(LOG_STACK_SESSION, "Packet transmitted");
 
-    if(state == D7ASP_STATE_SLAVE)
+    if(state == D7ASP_STATE_SLAVE || state == D7ASP_STATE_SLAVE_PENDING_MASTER)
     {
         packet_queue_free_packet(packet);
         //switch_state(D7ASP_STATE_IDLE); // TODO don't go to idle directly, wait for timeout or stop transaction
@@ -319,19 +746,71 @@ void d7asp_signal_packet_transmitted(packet_t *packet)
 }
 
 
+static timer_tick_t get_retry_backoff_period()
+{
+#ifdef MODULE_D7AP_RETRY_BACKOFF_EXPONENTIAL
+    // the period doubles for every retry, the jitter prevents nodes which failed together from retrying together
+    uint8_t exponent = current_request_retry_count - 1;
+    if(exponent > 8)
+        exponent = 8;
+
+    timer_tick_t backoff_period = (timer_tick_t)MODULE_D7AP_RETRY_BACKOFF_PERIOD << exponent;
+    if(backoff_period > 0)
+        backoff_period += get_rnd() % backoff_period;
+
+    return backoff_period;
+#else
+    return MODULE_D7AP_RETRY_BACKOFF_PERIOD;
+#endif
+}
+
+static void fail_current_request()
+{
+    log_print_stack_string(LOG_STACK_SESSION, "Request reached retry limit, skipping request");
+    mark_current_request_done(false);
+    if(current_fifo->config.fifo_ctrl_stop_on_error)
+    {
+        // the remaining requests of the FIFO are dropped as well
+        log_print_stack_string(LOG_STACK_SESSION, "Stop on error, dropping remaining requests");
+        for(uint8_t i = 0; i < current_fifo->request_count; i++)
+            bitmap_set(current_fifo->progress_bitmap, get_request_idx(current_fifo, i));
+    }
+
+    packet_queue_free_packet(current_request_packet);
+    active_request_idx = NO_ACTIVE_REQUEST_IDX;
+    complete_fifo_if_flushed(current_fifo);
+}
+
 static void on_request_completed()
 {
     assert(state == D7ASP_STATE_MASTER);
-    if(!bitmap_get(fifo.progress_bitmap, active_request_id))
+    if(!bitmap_get(current_fifo->progress_bitmap, active_request_idx))
     {
-        current_request_retry_count++;
-        // the request may be retransmitted, don't free yet (this will be done in flush_fifo() when failed)
+        session_qos_t* qos = &(current_fifo->config.qos);
+        if(current_request_retry_count < qos->qos_retry_single && current_fifo->retry_total_count < qos->qos_retry_total)
+        {
+            // retry after a backoff period, the packet is kept for the retransmission
+            current_request_retry_count++;
+            current_fifo->retry_total_count++;
+            timer_tick_t backoff_period = get_retry_backoff_period();
+            retry_deadline = timer_get_counter_value() + backoff_period;
+            log_print_stack_string(LOG_STACK_SESSION, "Retrying request in %i ticks", backoff_period);
+            if(backoff_period == 0)
+                sched_post_task(&flush_fifos);
+            else
+                timer_post_task_delay(&flush_fifos, backoff_period);
+
+            return;
+        }
+
+        fail_current_request();
     }
     else
     {
         // request completed, no retries needed so we can free the packet
-        active_request_id = NO_ACTIVE_REQUEST_ID;
+        active_request_idx = NO_ACTIVE_REQUEST_IDX;
         packet_queue_free_packet(current_request_packet);
+        complete_fifo_if_flushed(current_fifo);
     }
 
 
@@ -349,23 +828,23 @@ void d7asp_signal_packet_csma_ca_insertion_completed(bool succeeded)
         }
 
         // for the lowest QoS level the packet is ack-ed when CSMA/CA process succeeded
-        if(fifo.config.qos.qos_ctrl_resp_mode == SESSION_RESP_MODE_NONE)
+        if(current_fifo->config.qos.qos_ctrl_resp_mode == SESSION_RESP_MODE_NONE)
         {
-            mark_current_request_done();
-            bitmap_set(fifo.success_bitmap, active_request_id);
+            mark_current_request_done(true);
         }
     }
+    else if(!succeeded)
+    {
+        // the response could not be transmitted
+        packet_queue_free_packet(current_response_packet);
+        end_slave_session();
+    }
 }
 
 void d7asp_signal_transaction_response_period_elapsed()
 {
     if(state == D7ASP_STATE_MASTER)
         on_request_completed();
-    else if(state == D7ASP_STATE_SLAVE)
-        switch_state(D7ASP_STATE_IDLE);
-    else if(state == D7ASP_STATE_SLAVE_PENDING_MASTER)
-    {
-        switch_state(D7ASP_STATE_MASTER);
-        sched_post_task(&flush_fifos);
-    }
+    else
+        end_slave_session();
 }
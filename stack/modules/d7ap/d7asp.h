@@ -26,13 +26,22 @@
 #include "stdint.h"
 #include "stdbool.h"
 
+#include "errors.h"
+#include "timer.h"
+
 #include "d7atp.h"
+#include "phy.h"
 #include "MODULE_D7AP_defs.h"
 
 #include "session.h"
 
 #define D7ASP_FIFO_CONFIG_SIZE 16
 
+// the payload of a request or response frame may use the room which is left when the lower layers add their largest
+// headers: an 8 byte DLL target, D7ANP hopping to an 8 byte destination with our origin, the security header with a 16 byte
+// MIC, the D7ATP header with timeout template, the CRC and the length byte
+#define D7ASP_PAYLOAD_MAX_LENGTH (PHY_MAX_FRAME_SIZE - 1 - (2 + 8) - (2 + 8 + 8 + 6 + 16) - (3 + 1) - 2)
+
 typedef struct {
     union {
         uint8_t fifo_ctrl;
@@ -53,20 +62,38 @@ typedef struct {
 
 #define REQUESTS_BITMAP_BYTE_COUNT ((MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT + 7) / 8)
 
+/**
+ * /brief The location of a request in the request buffer of a session FIFO
+ */
+typedef struct {
+    uint16_t buffer_idx;
+    uint8_t length;
+} d7asp_request_t;
+
 /**
  * /brief The state of a session FIFO
+ *
+ * The requests are stored in a ring buffer and their descriptors in a ring of MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT slots.
+ * The storage and the slot of a request are freed as soon as it and all requests queued before it are handled, so
+ * requests can be queued while the FIFO is being flushed. The request IDs, used as D7ATP transaction IDs, increment with
+ * every queued request and restart from 0 when all requests of the FIFO are handled.
+ *
+ * Bit i of the progress and success bitmaps belongs to the request in slot i. The first request queued in an empty FIFO
+ * is stored in slot 0, so when the flush completes bit i reports the i-th request, unless more than
+ * MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT requests were queued during the flush. The slots then report their last request.
  */
 typedef struct {
     d7asp_fifo_config_t config;
-    // TODO uint8_t dorm_timer;
-    // TODO uint8_t token;
-    // TODO retry_single_cnt
-    // TODO retry_total_cnt
+    timer_tick_t dormant_deadline; /**< When a dormant session becomes pending, unless the addressee contacted us before */
+    uint8_t token; /**< Identifies the session, used as the D7ATP dialog ID */
+    uint8_t retry_total_count; /**< The number of retries of all requests of the FIFO, limited by qos_retry_total */
     uint8_t progress_bitmap[REQUESTS_BITMAP_BYTE_COUNT];
     uint8_t success_bitmap[REQUESTS_BITMAP_BYTE_COUNT];
-    uint8_t next_request_id;
-    uint8_t request_buffer_tail_idx;
-    uint8_t requests_indices[MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT]; /**< Contains for every request ID the index in command_buffer where the request begins */
+    uint8_t first_request_id; /**< The ID of the oldest stored request, the stored requests have consecutive IDs */
+    uint8_t first_request_idx; /**< The slot of the oldest stored request */
+    uint8_t request_count; /**< The number of stored requests, a FIFO without requests is free */
+    uint16_t request_buffer_tail_idx; /**< The index in request_buffer where the next request is stored */
+    d7asp_request_t requests[MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT]; /**< Contains for every slot where the request is stored */
     uint8_t request_buffer[MODULE_D7AP_FIFO_COMMAND_BUFFER_SIZE];
 } d7asp_fifo_t;
 
@@ -93,13 +120,33 @@ typedef struct {
 
 typedef void (*d7asp_fifo_flush_completed_callback)(d7asp_fifo_config_t* d7asp_fifo_config, uint8_t* progress_bitmap, uint8_t* success_bitmap, uint8_t bitmap_byte_count);
 
+/*! \brief Called for every response received while flushing a FIFO, the addressee of the result is the responder.
+ *
+ * All responses to a broadcast request which are received during the response period are reported, the ALP payload
+ * contains the response of that responder (which can be empty when it only acknowledges the request).
+ */
+typedef void (*d7asp_response_received_callback)(d7asp_result_t d7asp_result, uint8_t* alp_payload, uint8_t alp_payload_length);
+
 typedef struct {
     d7asp_fifo_flush_completed_callback d7asp_fifo_flush_completed_cb;
+    d7asp_response_received_callback d7asp_response_received_cb;
 } d7asp_init_args_t; // TODO workaround: NG does not support function pointer so store in struct (for now)
 
 void d7asp_init(d7asp_init_args_t* init_arfs);
-void d7asp_queue_alp_actions(d7asp_fifo_config_t* d7asp_fifo_config, uint8_t* alp_payload_buffer, uint8_t alp_payload_length); // TODO return status
-void d7asp_process_received_packet(packet_t* packet);
+
+/*! \brief Queues ALP actions as a request in the FIFO of the addressee and QoS of d7asp_fifo_config, and starts flushing.
+ *
+ * \returns SUCCESS when queued, EINVAL when the ALP actions are incomplete or unknown, ESIZE when the request can never
+ * be stored or sent, ENOMEM when no FIFO or request buffer space is available and EBUSY when the FIFO holds the maximum
+ * number of requests. Queuing can be retried as soon as earlier requests of the FIFO are handled in the latter cases.
+ */
+error_t d7asp_queue_alp_actions(d7asp_fifo_config_t* d7asp_fifo_config, uint8_t* alp_payload_buffer, uint8_t alp_payload_length);
+/*! \brief Processes a received response or request.
+ *
+ * A response is a frame of the transaction of the active request, which is received during its response period. All
+ * other frames are requests, which start a slave session, also while a master session waits to retry a request.
+ */
+void d7asp_process_received_packet(packet_t* packet, bool is_response);
 
 /**
  * @brief Called by DLL to signal the packet has been transmitted
@@ -28,10 +28,48 @@
 #include "dll.h"
 #include "ng.h"
 #include "log.h"
+#include "phy.h"
+#include "timer.h"
+#include "bitmap.h"
+#include "MODULE_D7AP_defs.h"
+
+// the time the responder needs to process a request before it starts accessing the channel
+#define TRANSACTION_RESPONSE_PROCESSING_TIME 50
 
 static d7atp_addressee_t NGDEF(_current_addressee);
 #define current_addressee NG(_current_addressee)
 
+// the period in which responses to the transmitted frame are expected, 0 when no response is expected
+static timer_tick_t NGDEF(_response_period);
+#define response_period NG(_response_period)
+
+// true when the response period can end as soon as a single response is received
+static bool NGDEF(_is_single_response_expected);
+#define is_single_response_expected NG(_is_single_response_expected)
+
+// master: the dialog and transaction of the last request, and whether the dialog can be continued without starting it
+static uint8_t NGDEF(_current_dialog_id);
+#define current_dialog_id NG(_current_dialog_id)
+
+static uint8_t NGDEF(_current_transaction_id);
+#define current_transaction_id NG(_current_transaction_id)
+
+static bool NGDEF(_is_dialog_active);
+#define is_dialog_active NG(_is_dialog_active)
+
+static bool NGDEF(_is_response_received);
+#define is_response_received NG(_is_response_received)
+
+// slave: the dialog which is being responded to and the transactions of it which were received
+static uint8_t NGDEF(_slave_dialog_id);
+#define slave_dialog_id NG(_slave_dialog_id)
+
+static d7atp_addressee_t NGDEF(_slave_dialog_origin);
+#define slave_dialog_origin NG(_slave_dialog_origin)
+
+static d7atp_ack_template_t NGDEF(_received_transactions);
+#define received_transactions NG(_received_transactions)
+
 typedef enum {
     D7ATP_STATE_IDLE,
     D7ATP_STATE_MASTER_TRANSACTION_REQUEST_PERIOD,
@@ -60,7 +98,7 @@ static void switch_state(state_t new_state)
         break;
     case D7ATP_STATE_SLAVE_TRANSACTION_SENDING_RESPONSE:
         log_print_stack_string(LOG_STACK_TRANS, "Switching to D7ATP_STATE_SLAVE_TRANSACTION_SENDING_RESPONSE");
-        assert(d7atp_state == D7ATP_STATE_IDLE || D7ATP_STATE_SLAVE_TRANSACTION_RESPONSE_PERIOD);
+        assert(d7atp_state == D7ATP_STATE_IDLE || d7atp_state == D7ATP_STATE_SLAVE_TRANSACTION_RESPONSE_PERIOD);
         d7atp_state = new_state;
         break;
     case D7ATP_STATE_SLAVE_TRANSACTION_RESPONSE_PERIOD:
@@ -87,6 +125,10 @@ static void transaction_response_period_expired()
     assert(d7atp_state == D7ATP_STATE_SLAVE_TRANSACTION_RESPONSE_PERIOD
            || d7atp_state == D7ATP_STATE_MASTER_TRANSACTION_RESPONSE_PERIOD);
 
+    // the responders only keep listening for a next request when they answered and the dialog was not stopped
+    if(d7atp_state == D7ATP_STATE_MASTER_TRANSACTION_RESPONSE_PERIOD)
+        is_dialog_active = is_dialog_active && is_response_received;
+
     switch_state(D7ATP_STATE_IDLE);
     dll_stop_foreground_scan();
     d7asp_signal_transaction_response_period_elapsed();
@@ -95,17 +137,96 @@ static void transaction_response_period_expired()
 void d7atp_init()
 {
     d7atp_state = D7ATP_STATE_IDLE;
+    is_dialog_active = false;
+    slave_dialog_origin.addressee_ctrl_has_id = false;
     sched_register_task(&transaction_response_period_expired);
 }
 
-void d7atp_start_dialog(uint8_t dialog_id, uint8_t transaction_id, packet_t* packet, session_qos_t* qos_settings, dae_access_profile_t* access_profile)
+static bool is_slave_dialog_origin(packet_t* packet)
+{
+    if(slave_dialog_origin.addressee_ctrl_has_id != packet->d7anp_ctrl.origin_access_id_present)
+        return false;
+
+    if(!packet->d7anp_ctrl.origin_access_id_present)
+        return true;
+
+    return slave_dialog_origin.addressee_ctrl_virtual_id == packet->d7anp_ctrl.origin_access_id_is_vid
+            && memcmp(slave_dialog_origin.addressee_id, packet->origin_access_id, packet->d7anp_ctrl.origin_access_id_is_vid? 2 : 8) == 0;
+}
+
+// records a received request, so the transactions of the dialog which were received can be acknowledged
+static void record_received_transaction(packet_t* packet)
+{
+    uint8_t offset = packet->d7atp_transaction_id - received_transactions.ack_transaction_id_start;
+    if(packet->d7atp_ctrl.ctrl_is_start || packet->d7atp_dialog_id != slave_dialog_id || !is_slave_dialog_origin(packet)
+            || offset >= D7ATP_ACK_BITMAP_MAX_TRANSACTIONS)
+    {
+        slave_dialog_id = packet->d7atp_dialog_id;
+        slave_dialog_origin.addressee_ctrl_has_id = packet->d7anp_ctrl.origin_access_id_present;
+        slave_dialog_origin.addressee_ctrl_virtual_id = packet->d7anp_ctrl.origin_access_id_is_vid;
+        memcpy(slave_dialog_origin.addressee_id, packet->origin_access_id, 8);
+        memset(&received_transactions, 0, sizeof(received_transactions));
+        received_transactions.ack_transaction_id_start = packet->d7atp_transaction_id;
+        received_transactions.ack_transaction_id_stop = packet->d7atp_transaction_id;
+        offset = 0;
+    }
+
+    bitmap_set(received_transactions.ack_bitmap, offset);
+    if(offset > (uint8_t)(received_transactions.ack_transaction_id_stop - received_transactions.ack_transaction_id_start))
+        received_transactions.ack_transaction_id_stop = packet->d7atp_transaction_id;
+}
+
+static inline uint8_t get_ack_bitmap_size(d7atp_ack_template_t const* ack_template)
+{
+    return (uint8_t)(ack_template->ack_transaction_id_stop - ack_template->ack_transaction_id_start) / 8 + 1;
+}
+
+static timer_tick_t get_default_response_period(phy_channel_header_t channel_header)
+{
+    return TRANSACTION_RESPONSE_PROCESSING_TIME + phy_calculate_tx_duration(channel_header, PHY_MAX_FRAME_SIZE);
+}
+
+void d7atp_start_dialog(uint8_t dialog_id, uint8_t transaction_id, bool is_last_transaction, packet_t* packet,
+                        session_qos_t* qos_settings, dae_access_profile_t* access_profile)
 {
-    // TODO only supports broadcasting data now, no ack, timeout, multiple transactions, ...
     switch_state(D7ATP_STATE_MASTER_TRANSACTION_REQUEST_PERIOD);
+
+    // the responders access the channel using CSMA-CA within the transmission timeout period of the access profile,
+    // which includes the airtime of the response. The responders are informed using the timeout template.
+    bool is_response_expected = qos_settings->qos_ctrl_resp_mode != SESSION_RESP_MODE_NONE;
+    response_period = 0;
+    if(is_response_expected)
+    {
+        // the responses can use any of the subbands, so allow for the slowest one
+        for(uint8_t i = 0; i < access_profile->control_number_of_subbands; i++)
+        {
+            timer_tick_t subband_response_period = get_default_response_period(access_profile->subbands[i].channel_header);
+            if(subband_response_period > response_period)
+                response_period = subband_response_period;
+        }
+
+        timer_tick_t access_profile_response_period = TRANSACTION_RESPONSE_PROCESSING_TIME + access_profile->transmission_timeout_period;
+        if(access_profile_response_period > response_period)
+            response_period = access_profile_response_period;
+
+        packet->d7atp_timeout_template = compressed_time_encode(response_period);
+        response_period = compressed_time_decode(packet->d7atp_timeout_template);
+    }
+
+    // a unicast request is answered by a single responder, an anycast request needs only one of the responses
+    is_single_response_expected = packet->d7atp_addressee->addressee_ctrl_has_id
+            || qos_settings->qos_ctrl_resp_mode == SESSION_RESP_MODE_ANYCAST;
+
+    bool is_start = !is_dialog_active || dialog_id != current_dialog_id;
+    current_dialog_id = dialog_id;
+    current_transaction_id = transaction_id;
+    is_dialog_active = !is_last_transaction;
+    is_response_received = false;
+
     packet->d7atp_ctrl = (d7atp_ctrl_t){
-        .ctrl_is_start = true,
-        .ctrl_is_stop = true,
-        .ctrl_is_timeout_template_present = false,
+        .ctrl_is_start = is_start,
+        .ctrl_is_stop = is_last_transaction,
+        .ctrl_is_timeout_template_present = is_response_expected,
         .ctrl_is_ack_requested = qos_settings->qos_ctrl_resp_mode == SESSION_RESP_MODE_NONE? false : true,
         .ctrl_ack_not_void = qos_settings->qos_ctrl_ack_not_void,
         .ctrl_ack_record = false,
@@ -115,22 +236,50 @@ void d7atp_start_dialog(uint8_t dialog_id, uint8_t transaction_id, packet_t* pac
     packet->d7atp_dialog_id = dialog_id;
     packet->d7atp_transaction_id = transaction_id;
 
-    bool should_include_origin_template = false;
-    if(packet->d7atp_ctrl.ctrl_is_start /*&& packet->d7atp_ctrl.ctrl_is_ack_requested*/) // TODO spec only requires this when both are true, however we MAY send origin when only first is true
-        should_include_origin_template = true;
-        // TODO also when responding to broadcast requests
-
-    d7anp_tx_foreground_frame(packet, should_include_origin_template);
+    // the origin is needed by the responders to address the responses and to identify the dialog
+    d7anp_tx_foreground_frame(packet, true, false);
 }
 
 void d7atp_respond_dialog(packet_t* packet)
 {
+    // a next request of the dialog can be received during the response period of the previous one
+    timer_cancel_task(&transaction_response_period_expired);
     switch_state(D7ATP_STATE_SLAVE_TRANSACTION_SENDING_RESPONSE);
 
+    packet->is_retransmission = false;
+
+    timer_tick_t request_response_period;
+    if(packet->d7atp_ctrl.ctrl_is_timeout_template_present)
+        request_response_period = compressed_time_decode(packet->d7atp_timeout_template);
+    else
+        request_response_period = get_default_response_period(packet->hw_radio_packet.rx_meta.rx_cfg.channel_id.channel_header);
+
+    // the timeout template is chosen by the requester, which should not be able to keep us listening for minutes
+    if(request_response_period > MODULE_D7AP_MAX_RESPONSE_PERIOD)
+    {
+        log_print_stack_string(LOG_STACK_TRANS, "Response period %i limited to %i", request_response_period, MODULE_D7AP_MAX_RESPONSE_PERIOD);
+        request_response_period = MODULE_D7AP_MAX_RESPONSE_PERIOD;
+    }
+
+    // all addressees of a broadcast request respond, these responses are spread over the response period of the
+    // requester instead of contending for the channel at the same time
+    packet->response_slot_window = 0;
+    if(!packet->dll_header.control_target_address_set && request_response_period > TRANSACTION_RESPONSE_PROCESSING_TIME)
+    {
+        timer_tick_t response_slot_window = request_response_period - TRANSACTION_RESPONSE_PROCESSING_TIME;
+        packet->response_slot_window = response_slot_window > INT16_MAX? INT16_MAX : response_slot_window;
+    }
+
+    // the requester can send a next request in the dialog until its response period ends, unless it stopped the dialog
+    response_period = packet->d7atp_ctrl.ctrl_is_stop? 0 : request_response_period;
+
+    is_single_response_expected = false;
+
     // modify the request headers and turn this into a response
     d7atp_ctrl_t* d7atp = &(packet->d7atp_ctrl);
     d7atp->ctrl_is_start = 0;
     d7atp->ctrl_is_ack_template_present = d7atp->ctrl_is_ack_requested? true : false;
+    packet->d7atp_ack_template = received_transactions;
     d7atp->ctrl_is_ack_requested = false;
     d7atp->ctrl_ack_not_void = false; // TODO validate
     d7atp->ctrl_ack_record = false; // TODO validate
@@ -145,7 +294,7 @@ void d7atp_respond_dialog(packet_t* packet)
     memcpy(current_addressee.addressee_id, packet->origin_access_id, 8);
     packet->d7atp_addressee = &current_addressee;
 
-    d7anp_tx_foreground_frame(packet, true);
+    d7anp_tx_foreground_frame(packet, true, true);
 }
 
 uint8_t d7atp_assemble_packet_header(packet_t* packet, uint8_t* data_ptr)
@@ -155,13 +304,17 @@ uint8_t d7atp_assemble_packet_header(packet_t* packet, uint8_t* data_ptr)
     (*data_ptr) = packet->d7atp_dialog_id; data_ptr++;
     (*data_ptr) = packet->d7atp_transaction_id; data_ptr++;
 
-    assert(!packet->d7atp_ctrl.ctrl_is_timeout_template_present); // TODO timeout template
+    if(packet->d7atp_ctrl.ctrl_is_timeout_template_present)
+    {
+        (*data_ptr) = packet->d7atp_timeout_template; data_ptr++;
+    }
 
     if(packet->d7atp_ctrl.ctrl_is_ack_template_present)
     {
-        // add ACK template
-        (*data_ptr) = packet->d7atp_transaction_id; data_ptr++; // transaction ID start
-        // TODO ACK bitmap, support for multiple segments to ack not implemented yet
+        uint8_t ack_bitmap_size = get_ack_bitmap_size(&(packet->d7atp_ack_template));
+        (*data_ptr) = packet->d7atp_ack_template.ack_transaction_id_start; data_ptr++;
+        (*data_ptr) = packet->d7atp_ack_template.ack_transaction_id_stop; data_ptr++;
+        memcpy(data_ptr, packet->d7atp_ack_template.ack_bitmap, ack_bitmap_size); data_ptr += ack_bitmap_size;
     }
 
     return data_ptr - d7atp_header_start;
@@ -169,16 +322,41 @@ uint8_t d7atp_assemble_packet_header(packet_t* packet, uint8_t* data_ptr)
 
 bool d7atp_disassemble_packet_header(packet_t *packet, uint8_t *data_idx)
 {
+    if(!packet_has_bytes_remaining(packet, *data_idx, 3))
+        return false;
+
     packet->d7atp_ctrl.ctrl_raw = packet->hw_radio_packet.data[(*data_idx)]; (*data_idx)++;
     packet->d7atp_dialog_id = packet->hw_radio_packet.data[(*data_idx)]; (*data_idx)++;
     packet->d7atp_transaction_id = packet->hw_radio_packet.data[(*data_idx)]; (*data_idx)++;
 
-    assert(!packet->d7atp_ctrl.ctrl_is_timeout_template_present); // TODO timeout template
+    if(packet->d7atp_ctrl.ctrl_is_timeout_template_present)
+    {
+        if(!packet_has_bytes_remaining(packet, *data_idx, 1))
+            return false;
+
+        packet->d7atp_timeout_template = packet->hw_radio_packet.data[(*data_idx)]; (*data_idx)++;
+    }
 
     if(packet->d7atp_ctrl.ctrl_is_ack_template_present)
     {
-        packet->d7atp_ack_template.ack_transaction_id_start = packet->hw_radio_packet.data[(*data_idx)]; (*data_idx)++;
-        // TODO ACK bitmap, support for multiple segments to ack not implemented yet
+        if(!packet_has_bytes_remaining(packet, *data_idx, 2))
+            return false;
+
+        d7atp_ack_template_t* ack_template = &(packet->d7atp_ack_template);
+        ack_template->ack_transaction_id_start = packet->hw_radio_packet.data[(*data_idx)]; (*data_idx)++;
+        ack_template->ack_transaction_id_stop = packet->hw_radio_packet.data[(*data_idx)]; (*data_idx)++;
+        uint8_t ack_bitmap_size = get_ack_bitmap_size(ack_template);
+        if(ack_bitmap_size > sizeof(ack_template->ack_bitmap))
+        {
+            log_print_stack_string(LOG_STACK_TRANS, "ACK bitmap too long, skipping packet");
+            return false;
+        }
+
+        if(!packet_has_bytes_remaining(packet, *data_idx, ack_bitmap_size))
+            return false;
+
+        memset(ack_template->ack_bitmap, 0, sizeof(ack_template->ack_bitmap));
+        memcpy(ack_template->ack_bitmap, packet->hw_radio_packet.data + (*data_idx), ack_bitmap_size); (*data_idx) += ack_bitmap_size;
     }
 
     return true;
@@ -193,11 +371,21 @@ void d7atp_signal_packet_transmitted(packet_t* packet)
     else
         assert(false);
 
-    int8_t transaction_response_period = 50; // TODO get from upper layer
+    // each relay forwards both the request and the response
+    timer_tick_t transaction_response_period = response_period;
+    if(packet->d7anp_ctrl.hop_enabled)
+        transaction_response_period *= 1 + 2 * packet->d7anp_hop_ctrl.hop_limit;
+
     log_print_stack_string(LOG_STACK_DLL, "Packet transmitted, starting response period timer (%i ticks)", transaction_response_period);
     // TODO find out difference between dialog timeout and transaction response period
-    error_t e = timer_post_task_delay(&transaction_response_period_expired, transaction_response_period); // TODO hardcoded period for now
-    assert(e == SUCCESS); // should not be scheduled already, something wrong..
+    if(transaction_response_period == 0)
+        sched_post_task(&transaction_response_period_expired);
+    else
+    {
+        error_t e = timer_post_task_delay(&transaction_response_period_expired, transaction_response_period);
+        assert(e == SUCCESS); // should not be scheduled already, something wrong..
+    }
+
     d7asp_signal_packet_transmitted(packet);
 }
 
@@ -218,17 +406,42 @@ void d7atp_process_received_packet(packet_t* packet)
            || d7atp_state == D7ATP_STATE_SLAVE_TRANSACTION_RESPONSE_PERIOD
            || d7atp_state == D7ATP_STATE_IDLE); // IDLE: when doing channel scanning outside of transaction
 
-    if(d7atp_state == D7ATP_STATE_MASTER_TRANSACTION_RESPONSE_PERIOD)
+    bool is_response = d7atp_state == D7ATP_STATE_MASTER_TRANSACTION_RESPONSE_PERIOD;
+    if(is_response)
     {
-        if(!packet->dll_header.control_target_address_set)
+        // a relayed response can be broadcast by the last relay, D7ANP already checked we are the destination
+        if(!packet->dll_header.control_target_address_set && !packet->d7anp_ctrl.hop_enabled)
         {
             // new transaction start while transaction already in progress!
-            log_print_stack_string(LOG_STACK_DLL, "Expecting ACK but received packet has not target address set, skipping");  // TODO assert later
+            log_print_stack_string(LOG_STACK_DLL, "Expecting ACK but received packet has not target address set, skipping");
+            packet_queue_free_packet(packet);
+            return;
+        }
+
+        if(packet->d7atp_dialog_id != current_dialog_id || packet->d7atp_transaction_id != current_transaction_id)
+        {
+            log_print_stack_string(LOG_STACK_TRANS, "Response to another transaction, skipping");
             packet_queue_free_packet(packet);
-            assert(false); // TODO switch state?
             return;
         }
+
+        is_response_received = true;
+
+        // no need to wait for the remainder of the response period when all expected responses are received
+        if(is_single_response_expected)
+        {
+            log_print_stack_string(LOG_STACK_TRANS, "Expected response received, ending response period");
+            timer_cancel_task(&transaction_response_period_expired);
+            sched_post_task(&transaction_response_period_expired);
+        }
     }
+    else
+        record_received_transaction(packet);
 
-    d7asp_process_received_packet(packet);
+    d7asp_process_received_packet(packet, is_response);
+}
+
+bool d7atp_is_idle()
+{
+    return d7atp_state == D7ATP_STATE_IDLE;
 }
@@ -67,17 +67,41 @@ typedef struct {
     uint8_t addressee_id[8]; // TODO assuming 8 byte id for now
 } d7atp_addressee_t;
 
+// the number of transactions of a dialog which can be acknowledged by a single ACK template
+#define D7ATP_ACK_BITMAP_MAX_TRANSACTIONS 32
+
+/*! \brief The D7ATP ACK template, which acknowledges the transactions of the dialog the responder received.
+ *
+ * Bit i of the bitmap is set when transaction ack_transaction_id_start + i was received. Only the bytes needed to cover
+ * the transactions from start to stop are sent.
+ */
 typedef struct {
     uint8_t ack_transaction_id_start;
-    // TODO ACK bitmap
+    uint8_t ack_transaction_id_stop;
+    uint8_t ack_bitmap[D7ATP_ACK_BITMAP_MAX_TRANSACTIONS / 8];
 } d7atp_ack_template_t;
 
 void d7atp_init();
-void d7atp_start_dialog(uint8_t dialog_id, uint8_t transaction_id, packet_t* packet, session_qos_t* qos_settings, dae_access_profile_t* access_profile);
+
+/*! \brief Sends a request in a dialog.
+ *
+ * The request starts the dialog, unless the previous request with the same dialog ID was answered and did not stop
+ * the dialog. Subsequent requests in a dialog are sent while the responders are still listening, without advertising.
+ *
+ * \param dialog_id             The dialog ID
+ * \param transaction_id        The transaction ID, unique within the dialog. This is acknowledged in the ACK template
+ *                              of the responses.
+ * \param is_last_transaction   Stops the dialog after this request, the responders stop listening after responding
+ */
+void d7atp_start_dialog(uint8_t dialog_id, uint8_t transaction_id, bool is_last_transaction, packet_t* packet,
+                        session_qos_t* qos_settings, dae_access_profile_t* access_profile);
 void d7atp_respond_dialog(packet_t* packet);
 uint8_t d7atp_assemble_packet_header(packet_t* packet, uint8_t* data_ptr);
 bool d7atp_disassemble_packet_header(packet_t* packet, uint8_t* data_idx);
 void d7atp_signal_packet_transmitted(packet_t* packet);
 void d7atp_signal_packet_csma_ca_insertion_completed(bool succeeded);
 void d7atp_process_received_packet(packet_t* packet);
+
+/*! \brief Returns true when no transaction is in progress */
+bool d7atp_is_idle();
 #endif /* D7ATP_H_ */
@@ -34,6 +34,8 @@ typedef enum
     CSMA_CA_MODE_RIGD = 3
 } csma_ca_mode_t; // TODO move
 
+#define SUBBANDS_MAX_COUNT 3 // limited by the 2 bits control_number_of_subbands field
+
 typedef struct
 {
     phy_channel_header_t channel_header;
@@ -59,7 +61,31 @@ typedef struct
     uint8_t scan_automation_period;
     uint8_t transmission_timeout_period;
     uint8_t _rfu;
-    subband_t subbands[1]; // TODO only support 1 subband for now
+    subband_t subbands[SUBBANDS_MAX_COUNT];
 } dae_access_profile_t;
 
+/*! \brief Converts a time in compressed time format (3 bits exponent, 5 bits mantissa) to timer ticks,
+ *  as used for instance for the scan automation period of the access profile: T = 4^exponent * mantissa
+ */
+static inline uint32_t compressed_time_decode(uint8_t ct)
+{
+    return ((uint32_t)1 << (2 * (ct >> 5))) * (ct & 0x1F);
+}
+
+/*! \brief Converts a number of timer ticks to the smallest time in compressed time format which is not shorter,
+ *  saturating at the maximum value
+ */
+static inline uint8_t compressed_time_encode(uint32_t ticks)
+{
+    for(uint8_t exponent = 0; exponent < 8; exponent++)
+    {
+        uint32_t unit = (uint32_t)1 << (2 * exponent);
+        uint32_t mantissa = (ticks + unit - 1) / unit;
+        if(mantissa <= 0x1F)
+            return (exponent << 5) | mantissa;
+    }
+
+    return 0xFF;
+}
+
 #endif /* DAE_H_ */
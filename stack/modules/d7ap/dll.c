@@ -28,6 +28,10 @@
 #include "ng.h"
 #include "hwdebug.h"
 #include "random.h"
+#include "phy.h"
+#include "neighbor_table.h"
+#include "d7anp.h"
+#include "MODULE_D7AP_defs.h"
 
 #ifdef FRAMEWORK_LOG_ENABLED
 #define DPRINT(...) log_print_stack_string(LOG_STACK_DLL, __VA_ARGS__)
@@ -48,19 +52,117 @@ typedef enum
     DLL_STATE_CCA_FAIL,
     DLL_STATE_FOREGROUND_SCAN,
     DLL_STATE_BACKGROUND_SCAN,
+    DLL_STATE_TX_BACKGROUND,
     DLL_STATE_TX_FOREGROUND,
     DLL_STATE_TX_FOREGROUND_COMPLETED
 } dll_state_t;
 
+// decoded copies of the access profile, UID and VID files, kept up to date using the fs file modified callback
 static dae_access_profile_t NGDEF(_current_access_class);
 #define current_access_class NG(_current_access_class)
 
+static uint8_t NGDEF(_active_access_class);
+#define active_access_class NG(_active_access_class)
+
+static uint8_t NGDEF(_uid)[8];
+#define uid NG(_uid)
+
+static uint8_t NGDEF(_vid)[2];
+#define vid NG(_vid)
+
 static dll_state_t NGDEF(_dll_state);
 #define dll_state NG(_dll_state)
 
 static hw_radio_packet_t* NGDEF(_current_packet);
 #define current_packet NG(_current_packet)
 
+/*! A channel of the current access profile, the channel header is defined by the subband */
+typedef struct
+{
+    uint8_t subband_index;
+    uint16_t center_freq_index;
+    int16_t noise_floor; // in 1/16 dBm, DLL_NOISE_FLOOR_UNKNOWN when no RSSI samples were taken yet
+} dll_channel_t;
+
+// the channels of the current access profile, in order of the subbands
+static dll_channel_t NGDEF(_channel_list)[MODULE_D7AP_CHANNEL_LIST_SIZE];
+#define channel_list NG(_channel_list)
+
+static uint8_t NGDEF(_channel_list_count);
+#define channel_list_count NG(_channel_list_count)
+
+// index in channel_list of the channel currently being scanned by scan automation
+static uint8_t NGDEF(_scan_channel_index);
+#define scan_channel_index NG(_scan_channel_index)
+
+// true when the access profile or the DLL configuration was modified during a dialog, the new access profile is loaded
+// when the dialog is done so the channels do not change in the middle of it
+static bool NGDEF(_is_access_class_reload_pending);
+#define is_access_class_reload_pending NG(_is_access_class_reload_pending)
+
+// true while a received frame is processed by the upper layers, which might start a dialog
+static bool NGDEF(_is_processing_received_frame);
+#define is_processing_received_frame NG(_is_processing_received_frame)
+
+// timer value at which the next background scan starts, the scans are a scan automation period apart regardless of
+// how long each scan takes
+static timer_tick_t NGDEF(_next_background_scan);
+#define next_background_scan NG(_next_background_scan)
+
+// the channel queue used for CSMA-CA, contains indices in channel_list
+static uint8_t NGDEF(_tx_channel_queue)[MODULE_D7AP_CHANNEL_LIST_SIZE];
+#define tx_channel_queue NG(_tx_channel_queue)
+
+// 0 when the frame is a response, which is sent on the dialog channel without using the channel queue
+static uint8_t NGDEF(_tx_channel_queue_count);
+#define tx_channel_queue_count NG(_tx_channel_queue_count)
+
+static uint8_t NGDEF(_tx_channel_queue_index);
+#define tx_channel_queue_index NG(_tx_channel_queue_index)
+
+// the channel used by the current dialog, responses are sent and expected on this channel
+static channel_id_t NGDEF(_dialog_channel);
+#define dialog_channel NG(_dialog_channel)
+
+// a background frame consists of the subnet, the ETA of the foreground frame in ticks (2 bytes) and the CRC, which
+// covers all bytes before it including the length byte
+#define BACKGROUND_FRAME_LENGTH 5
+
+// the time a background scan keeps listening for a background frame after detecting a carrier
+#define BACKGROUND_SCAN_RX_TIMEOUT 10
+
+// the time a foreground scan started after receiving a background frame waits for the advertised frame
+#define ADVERTISED_FOREGROUND_SCAN_TIMEOUT 50
+
+// the lowest EIRP used for transmissions, also used when the access class defines no subbands
+#define EIRP_MIN -39
+
+/*! A background frame, used for advertising an upcoming foreground frame to nodes doing a background scan */
+typedef struct
+{
+    hw_radio_packet_t hw_radio_packet;
+    uint8_t __data[BACKGROUND_FRAME_LENGTH + 1]; // reserves space for hw_radio_packet_t.data flexible array member
+} background_frame_t;
+
+static background_frame_t NGDEF(_background_frame);
+#define background_frame NG(_background_frame)
+
+// true when the current frame needs to be preceded by an advertising train of background frames
+static bool NGDEF(_advertising_required);
+#define advertising_required NG(_advertising_required)
+
+// timer value at which the advertising train ends and the foreground frame is transmitted
+static timer_tick_t NGDEF(_advertising_end);
+#define advertising_end NG(_advertising_end)
+
+// true when the foreground scan was started after receiving a background frame, instead of by the upper layer
+static bool NGDEF(_foreground_scan_after_advertising);
+#define foreground_scan_after_advertising NG(_foreground_scan_after_advertising)
+
+// true between receiving a background frame and the start of the foreground scan for the advertised frame
+static bool NGDEF(_is_advertised_frame_pending);
+#define is_advertised_frame_pending NG(_is_advertised_frame_pending)
+
 static dll_packet_received_callback dll_rx_callback = NULL;
 static dll_packet_transmitted_callback dll_tx_callback = NULL;
 
@@ -72,8 +174,9 @@ static int16_t NGDEF(_dll_tca);
 static int16_t NGDEF(_dll_tca0);
 #define dll_tca0 NG(_dll_tca0)
 
-static int16_t NGDEF(_dll_to);
-#define dll_to NG(_dll_to)
+// timer value after which no more CCA attempts are done for the current frame
+static timer_tick_t NGDEF(_dll_csma_ca_deadline);
+#define dll_csma_ca_deadline NG(_dll_csma_ca_deadline)
 
 static uint16_t NGDEF(_dll_slot_duration);
 #define dll_slot_duration NG(_dll_slot_duration)
@@ -84,11 +187,178 @@ static uint16_t NGDEF(_dll_rigd_n);
 // TODO defined somewhere?
 #define t_g	5
 
+// the time scan automation listens on a channel before switching to the next channel of the channel list
+#define SCAN_CHANNEL_DWELL_TIME 50
+
+#define NO_CHANNEL 0xFF
+
+// the noise floor tracks the lower envelope of the RSSI samples: it follows samples below the current estimate
+// quickly but samples above it (which may be transmissions instead of noise) only slowly, by 1/2^shift
+#define NOISE_FLOOR_FALL_SHIFT 1
+#define NOISE_FLOOR_RISE_SHIFT 4
+
+// the channel queue orders channels by noise floor in steps of this many dB, channels within the same step
+// are kept in random order
+#define NOISE_FLOOR_ORDER_STEP 3
+
+static channel_id_t get_channel_id(uint8_t channel_list_index)
+{
+    dll_channel_t* channel = &(channel_list[channel_list_index]);
+    return (channel_id_t){
+        .channel_header = current_access_class.subbands[channel->subband_index].channel_header,
+        .center_freq_index = channel->center_freq_index
+    };
+}
+
+static void build_channel_list()
+{
+    channel_list_count = 0;
+    for(uint8_t i = 0; i < current_access_class.control_number_of_subbands; i++)
+    {
+        subband_t* subband = &(current_access_class.subbands[i]);
+        // normal and hi rate channels are spaced 8 channel indices apart, lo rate channels use every index
+        uint8_t step = subband->channel_header.ch_class == PHY_CLASS_LO_RATE? 1 : 8;
+        for(uint32_t index = subband->channel_index_start; index <= subband->channel_index_end; index += step)
+        {
+            if(channel_list_count == MODULE_D7AP_CHANNEL_LIST_SIZE)
+            {
+                DPRINT("Channel list full, ignoring remaining channels");
+                return;
+            }
+
+            channel_list[channel_list_count].subband_index = i;
+            channel_list[channel_list_count].center_freq_index = index;
+            channel_list[channel_list_count].noise_floor = DLL_NOISE_FLOOR_UNKNOWN;
+            channel_list_count++;
+        }
+    }
+
+    scan_channel_index = 0;
+    tx_channel_queue_count = 0;
+    if(channel_list_count > 0)
+        dialog_channel = get_channel_id(0);
+}
+
+static uint8_t get_channel_list_index(channel_id_t const* channel_id)
+{
+    for(uint8_t i = 0; i < channel_list_count; i++)
+    {
+        // compared field by field, hw_radio_channel_ids_equal() also compares the padding, which differs between the
+        // compound literals the channel IDs are built from
+        channel_id_t list_channel_id = get_channel_id(i);
+        if(list_channel_id.channel_header_raw == channel_id->channel_header_raw
+                && list_channel_id.center_freq_index == channel_id->center_freq_index)
+            return i;
+    }
+
+    return NO_CHANNEL; // responses might be sent on a channel which is not part of our access class
+}
+
+static void update_noise_floor(uint8_t channel_list_index, int16_t rssi)
+{
+    if(channel_list_index == NO_CHANNEL)
+        return;
+
+    dll_channel_t* channel = &(channel_list[channel_list_index]);
+    int16_t sample = rssi * 16;
+    if(channel->noise_floor == DLL_NOISE_FLOOR_UNKNOWN)
+        channel->noise_floor = sample;
+    else if(sample < channel->noise_floor)
+        channel->noise_floor += (sample - channel->noise_floor) / (1 << NOISE_FLOOR_FALL_SHIFT);
+    else
+        channel->noise_floor += (sample - channel->noise_floor) / (1 << NOISE_FLOOR_RISE_SHIFT);
+}
+
+static int16_t get_cca_threshold(channel_id_t const* channel_id)
+{
+    // when the subband defines a CCA offset the threshold follows the noise floor of the channel, but is never
+    // higher than the fixed threshold so a jammed channel is considered busy and avoided instead
+    uint8_t channel_list_index = get_channel_list_index(channel_id);
+    if(channel_list_index == NO_CHANNEL)
+        return E_CCA;
+
+    dll_channel_t* channel = &(channel_list[channel_list_index]);
+    uint8_t ccao = current_access_class.subbands[channel->subband_index].ccao;
+    if(ccao == 0 || channel->noise_floor == DLL_NOISE_FLOOR_UNKNOWN)
+        return E_CCA;
+
+    int16_t threshold = channel->noise_floor / 16 + ccao;
+    return threshold < E_CCA? threshold : E_CCA;
+}
+
+// the channel order key, unknown channels come first so they get sampled
+static int16_t get_noise_floor_order_key(uint8_t channel_list_index)
+{
+    int16_t noise_floor = channel_list[channel_list_index].noise_floor;
+    if(noise_floor == DLL_NOISE_FLOOR_UNKNOWN)
+        return INT16_MIN;
+
+    // floor division, also for negative values
+    int16_t step = 16 * NOISE_FLOOR_ORDER_STEP;
+    return noise_floor >= 0? noise_floor / step : -((-noise_floor + step - 1) / step);
+}
+
+static void init_tx_channel_queue()
+{
+    tx_channel_queue_index = 0;
+    tx_channel_queue_count = 0;
+    if(channel_list_count == 0)
+        return;
+
+    // the channel queue contains all channels of the channel list in random order (Fisher-Yates shuffle),
+    // so nodes contending for the same channel are unlikely to keep colliding on the following channels
+    for(uint8_t i = 0; i < channel_list_count; i++)
+        tx_channel_queue[i] = i;
+
+    for(uint8_t i = channel_list_count; i > 1; i--)
+    {
+        uint8_t j = get_rnd() % i;
+        uint8_t tmp = tx_channel_queue[i - 1];
+        tx_channel_queue[i - 1] = tx_channel_queue[j];
+        tx_channel_queue[j] = tmp;
+    }
+
+    // the quietest channels are tried first, a stable insertion sort keeps the random order of channels with a
+    // similar noise floor
+    for(uint8_t i = 1; i < channel_list_count; i++)
+    {
+        uint8_t channel = tx_channel_queue[i];
+        int16_t key = get_noise_floor_order_key(channel);
+        uint8_t j = i;
+        while(j > 0 && get_noise_floor_order_key(tx_channel_queue[j - 1]) > key)
+        {
+            tx_channel_queue[j] = tx_channel_queue[j - 1];
+            j--;
+        }
+
+        tx_channel_queue[j] = channel;
+    }
+
+    tx_channel_queue_count = channel_list_count;
+    dialog_channel = get_channel_id(tx_channel_queue[0]);
+}
+
+static void next_tx_channel()
+{
+    // responses are sent on the channel of the dialog, the channel queue is only used for new dialogs
+    if(tx_channel_queue_count < 2)
+        return;
+
+    tx_channel_queue_index = (tx_channel_queue_index + 1) % tx_channel_queue_count;
+    dialog_channel = get_channel_id(tx_channel_queue[tx_channel_queue_index]);
+    current_packet->tx_meta.tx_cfg.channel_id = dialog_channel;
+    DPRINT("Switching to next channel in queue: %i", dialog_channel.center_freq_index);
+}
+
 static hw_radio_packet_t* alloc_new_packet(uint8_t length)
 {
     // note we don't use length because in the current implementation the packets in the queue are of
     // fixed (maximum) size
-    return &(packet_queue_alloc_packet()->hw_radio_packet);
+    packet_t* packet = packet_queue_alloc_packet();
+    if(packet == NULL)
+        return NULL; // queue full, the radio driver will drop the frame
+
+    return &(packet->hw_radio_packet);
 }
 
 static void release_packet(hw_radio_packet_t* hw_radio_packet)
@@ -102,7 +372,7 @@ static void switch_state(dll_state_t next_state)
     {
     case DLL_STATE_CSMA_CA_STARTED:
         assert(dll_state == DLL_STATE_IDLE || dll_state == DLL_STATE_SCAN_AUTOMATION
-               || dll_state == DLL_STATE_FOREGROUND_SCAN);
+               || dll_state == DLL_STATE_FOREGROUND_SCAN || dll_state == DLL_STATE_BACKGROUND_SCAN);
         dll_state = DLL_STATE_CSMA_CA_STARTED;
         DPRINT("Switched to DLL_STATE_CSMA_CA_STARTED");
         break;
@@ -128,17 +398,31 @@ static void switch_state(dll_state_t next_state)
         DPRINT("Switched to DLL_STATE_FOREGROUND_SCAN");
         break;
     case DLL_STATE_IDLE:
-        assert(dll_state == DLL_STATE_FOREGROUND_SCAN);
+        assert(dll_state == DLL_STATE_IDLE || dll_state == DLL_STATE_FOREGROUND_SCAN || dll_state == DLL_STATE_CCA_FAIL
+               || dll_state == DLL_STATE_TX_FOREGROUND_COMPLETED || dll_state == DLL_STATE_SCAN_AUTOMATION
+               || dll_state == DLL_STATE_BACKGROUND_SCAN);
         dll_state = DLL_STATE_IDLE;
         DPRINT("Switched to DLL_STATE_IDLE");
         break;
     case DLL_STATE_SCAN_AUTOMATION:
-        assert(dll_state == DLL_STATE_FOREGROUND_SCAN || dll_state == DLL_STATE_IDLE);
+        assert(dll_state == DLL_STATE_FOREGROUND_SCAN || dll_state == DLL_STATE_IDLE
+               || dll_state == DLL_STATE_SCAN_AUTOMATION || dll_state == DLL_STATE_BACKGROUND_SCAN
+               || dll_state == DLL_STATE_CCA_FAIL || dll_state == DLL_STATE_TX_FOREGROUND_COMPLETED);
         dll_state = DLL_STATE_SCAN_AUTOMATION;
         DPRINT("Switched to DLL_STATE_SCAN_AUTOMATION");
         break;
-    case DLL_STATE_TX_FOREGROUND:
+    case DLL_STATE_BACKGROUND_SCAN:
+        assert(dll_state == DLL_STATE_SCAN_AUTOMATION);
+        dll_state = DLL_STATE_BACKGROUND_SCAN;
+        DPRINT("Switched to DLL_STATE_BACKGROUND_SCAN");
+        break;
+    case DLL_STATE_TX_BACKGROUND:
         assert(dll_state == DLL_STATE_CCA2);
+        dll_state = DLL_STATE_TX_BACKGROUND;
+        DPRINT("Switched to DLL_STATE_TX_BACKGROUND");
+        break;
+    case DLL_STATE_TX_FOREGROUND:
+        assert(dll_state == DLL_STATE_CCA2 || dll_state == DLL_STATE_TX_BACKGROUND);
         dll_state = DLL_STATE_TX_FOREGROUND;
         DPRINT("Switched to DLL_STATE_TX_FOREGROUND");
         break;
@@ -150,14 +434,22 @@ static void switch_state(dll_state_t next_state)
     case DLL_STATE_CCA_FAIL:
         assert(dll_state == DLL_STATE_CCA1 || dll_state == DLL_STATE_CCA2
         		|| dll_state == DLL_STATE_CSMA_CA_STARTED || dll_state == DLL_STATE_CSMA_CA_RETRY);
-        dll_state = DLL_STATE_IDLE;
-        DPRINT("Switched to DLL_STATE_IDLE");
+        dll_state = DLL_STATE_CCA_FAIL;
+        DPRINT("Switched to DLL_STATE_CCA_FAIL");
         break;
     default:
         assert(false);
     }
 }
 
+static void start_scan_automation_rx();
+static void execute_scan_automation();
+static void restart_scan_automation();
+static void start_foreground_scan_rx();
+static void load_access_class();
+static void process_background_frame(packet_t* packet);
+static void scan_timeout();
+
 static void process_received_packets()
 {
     hw_radio_set_idle();
@@ -165,7 +457,32 @@ static void process_received_packets()
     assert(packet != NULL);
     DPRINT("Processing received packet");
     packet_queue_mark_processing(packet);
+    if(dll_state == DLL_STATE_BACKGROUND_SCAN)
+    {
+        process_background_frame(packet);
+        return;
+    }
+
+    bool advertised = foreground_scan_after_advertising;
+    if(advertised)
+    {
+        timer_cancel_task(&scan_timeout);
+        foreground_scan_after_advertising = false;
+    }
+
+    is_processing_received_frame = true;
     packet_disassemble(packet);
+    is_processing_received_frame = false;
+
+    // the packet was not for us or did not start a dialog, continue scanning
+    if(dll_state == DLL_STATE_SCAN_AUTOMATION && is_access_class_reload_pending)
+        restart_scan_automation();
+    else if(dll_state == DLL_STATE_SCAN_AUTOMATION)
+        start_scan_automation_rx();
+    else if(advertised && dll_state == DLL_STATE_FOREGROUND_SCAN)
+        execute_scan_automation();
+    else if(dll_state == DLL_STATE_FOREGROUND_SCAN)
+        start_foreground_scan_rx(); // more responses can follow within the response period
 
     return;
 
@@ -174,7 +491,8 @@ static void process_received_packets()
 
 void packet_received(hw_radio_packet_t* packet)
 {
-    assert(dll_state == DLL_STATE_FOREGROUND_SCAN || dll_state == DLL_STATE_SCAN_AUTOMATION);
+    assert(dll_state == DLL_STATE_FOREGROUND_SCAN || dll_state == DLL_STATE_SCAN_AUTOMATION
+           || dll_state == DLL_STATE_BACKGROUND_SCAN);
 
     // we are in interrupt context here, so mark packet for further processing,
     // schedule it and return
@@ -193,19 +511,82 @@ static void packet_transmitted(hw_radio_packet_t* hw_radio_packet)
     if(dll_tx_callback != NULL)
         dll_tx_callback();
 
-    d7atp_signal_packet_transmitted(packet);
-
-    dll_start_foreground_scan(); // we stay in foreground scan until TP signal transaction response period is over
+    // we stay in foreground scan until TP signal transaction response period is over, relayed frames don't expect a response
+    if(d7anp_signal_packet_transmitted(packet))
+        dll_start_foreground_scan();
+    else
+        execute_scan_automation();
 }
 
 static void execute_cca();
 static void execute_csma_ca();
+static void scan_next_channel();
+static void transmit_background_frame();
+static void start_advertised_foreground_scan();
+
+static uint32_t get_advertising_duration()
+{
+    // a node doing a background scan checks one channel of the channel list every scan automation period,
+    // the advertising train has to last until all channels have been checked. A scan which detects the carrier in the
+    // middle of a background frame needs the next one, which adds 2 frames to the train.
+    uint32_t frame_duration = phy_calculate_tx_duration(current_packet->tx_meta.tx_cfg.channel_id.channel_header, BACKGROUND_FRAME_LENGTH + 1);
+    return compressed_time_decode(current_access_class.scan_automation_period) * channel_list_count + 2 * frame_duration;
+}
+
+static void background_frame_transmitted(hw_radio_packet_t* hw_radio_packet);
+
+static void transmit_background_frame()
+{
+    assert(dll_state == DLL_STATE_TX_BACKGROUND);
+
+    timer_tick_t now = timer_get_counter_value();
+    int32_t tx_duration = phy_calculate_tx_duration(current_packet->tx_meta.tx_cfg.channel_id.channel_header, BACKGROUND_FRAME_LENGTH + 1);
+    int32_t eta = (int32_t)(advertising_end - now);
+    if(eta <= tx_duration)
+    {
+        // the advertising train is over, transmit the foreground frame
+        switch_state(DLL_STATE_TX_FOREGROUND);
+        error_t err = hw_radio_send_packet(current_packet, &packet_transmitted);
+        assert(err == SUCCESS);
+        return;
+    }
+
+    // the receivers only know the ETA once the background frame is received, so it is relative to its end
+    eta -= tx_duration;
+
+    if(eta > UINT16_MAX)
+        eta = UINT16_MAX;
+
+    uint8_t* data = background_frame.hw_radio_packet.data;
+    data[0] = BACKGROUND_FRAME_LENGTH;
+    data[1] = current_access_class.subnet;
+    data[2] = eta >> 8;
+    data[3] = eta & 0xFF;
+    uint16_t crc = __builtin_bswap16(crc_calculate(data, BACKGROUND_FRAME_LENGTH - 1));
+    memcpy(data + 4, &crc, 2);
+
+    background_frame.hw_radio_packet.tx_meta.tx_cfg = current_packet->tx_meta.tx_cfg;
+    background_frame.hw_radio_packet.tx_meta.tx_cfg.syncword_class = PHY_SYNCWORD_CLASS0;
+
+    error_t err = hw_radio_send_packet(&background_frame.hw_radio_packet, &background_frame_transmitted);
+    assert(err == SUCCESS);
+}
+
+static void background_frame_transmitted(hw_radio_packet_t* hw_radio_packet)
+{
+    // we are in interrupt context here, transmit the next frame of the train from a task
+    sched_post_task(&transmit_background_frame);
+}
 
 static void cca_rssi_valid(int16_t cur_rssi)
 {
-    assert(dll_state == DLL_STATE_CCA1 || dll_state == DLL_STATE_CCA2);
+    // the RSSI is reported asynchronously, and again when the radio returns to RX after transmitting
+    if(dll_state != DLL_STATE_CCA1 && dll_state != DLL_STATE_CCA2)
+        return;
 
-    if (cur_rssi <= E_CCA)
+    channel_id_t* channel_id = &(current_packet->tx_meta.tx_cfg.channel_id);
+    update_noise_floor(get_channel_list_index(channel_id), cur_rssi);
+    if (cur_rssi <= get_cca_threshold(channel_id))
     {
         if(dll_state == DLL_STATE_CCA1)
         {
@@ -219,20 +600,30 @@ static void cca_rssi_valid(int16_t cur_rssi)
             // OK, send packet
             log_print_stack_string(LOG_STACK_DLL, "CCA2 RSSI: %d", cur_rssi);
             log_print_stack_string(LOG_STACK_DLL, "CCA2 succeeded, transmitting ...");
-            log_print_data(current_packet->data, current_packet->length + 1); // TODO tmp
 
-            switch_state(DLL_STATE_TX_FOREGROUND);
-
-            error_t err = hw_radio_send_packet(current_packet, &packet_transmitted);
-            assert(err == SUCCESS);
+            // signalled before transmitting, since the transmission might complete before hw_radio_send_packet() returns
+            d7anp_signal_packet_csma_ca_insertion_completed(true);
+            if(advertising_required)
+            {
+                // nodes doing a background scan are woken up by an advertising train first
+                switch_state(DLL_STATE_TX_BACKGROUND);
+                advertising_end = timer_get_counter_value() + get_advertising_duration();
+                transmit_background_frame();
+            }
+            else
+            {
+                switch_state(DLL_STATE_TX_FOREGROUND);
+                error_t err = hw_radio_send_packet(current_packet, &packet_transmitted);
+                assert(err == SUCCESS);
+            }
 
-            d7atp_signal_packet_csma_ca_insertion_completed(true);
             return;
         }
     }
     else
     {
         DPRINT("Channel not clear, RSSI: %i", cur_rssi);
+        next_tx_channel();
         switch_state(DLL_STATE_CSMA_CA_RETRY);
         execute_csma_ca();
 
@@ -246,177 +637,310 @@ static void execute_cca()
     assert(dll_state == DLL_STATE_CCA1 || dll_state == DLL_STATE_CCA2);
 
     hw_rx_cfg_t rx_cfg =(hw_rx_cfg_t){
-        .channel_id.channel_header = current_access_class.subbands[0].channel_header,
-        .channel_id.center_freq_index = current_access_class.subbands[0].channel_index_start,
+        .channel_id = current_packet->tx_meta.tx_cfg.channel_id,
         .syncword_class = PHY_SYNCWORD_CLASS1,
     };
 
     hw_radio_set_rx(&rx_cfg, NULL, &cca_rssi_valid);
 }
 
-static uint16_t calculate_tx_duration()
+static uint16_t calculate_tx_duration(hw_radio_packet_t* packet)
 {
-	int data_rate = 6; // Normal rate: 6.9 bytes/tick
-	// TODO select correct subband
-	switch (current_access_class.subbands[0].channel_header.ch_class)
-	{
-	case PHY_CLASS_LO_RATE:
-		data_rate = 1; // Lo Rate: 1.2 bytes/tick
-		break;
-	case PHY_CLASS_HI_RATE:
-		data_rate = 20; // High rate: 20.83 byte/tick
-	}
+    return phy_calculate_tx_duration(packet->tx_meta.tx_cfg.channel_id.channel_header, packet->length + 1);
+}
+
+static uint16_t get_random_slot_offset(int32_t window, uint16_t slot_duration)
+{
+    // start of a random slot of slot_duration within the window
+    uint16_t nr_slots = window / slot_duration;
+    if(nr_slots == 0)
+        return 0;
 
-	uint16_t duration = (current_packet->length / data_rate) + 1;
-	return duration;
+    return (get_rnd() % nr_slots) * slot_duration;
+}
+
+static uint16_t get_response_slot_offset(int32_t window, uint16_t slot_duration)
+{
+    uint16_t nr_slots = window / slot_duration;
+    if(nr_slots == 0)
+        return 0;
+
+    // the slot is selected by a hash of the UID and the transaction, this spreads the responders to a broadcast request
+    // over the window while two responders which share a slot in one dialog most likely don't in the next
+    packet_t* packet = packet_queue_find_packet(current_packet);
+    uint8_t hash_input[10];
+    memcpy(hash_input, uid, 8);
+    hash_input[8] = packet->d7atp_dialog_id;
+    hash_input[9] = packet->d7atp_transaction_id;
+    return (crc_calculate(hash_input, sizeof(hash_input)) % nr_slots) * slot_duration;
 }
 
 static void execute_csma_ca()
 {
-	// TODO generate random channel queue
     hw_radio_set_rx(NULL, NULL, NULL); // put radio in RX but disable callbacks to make sure we don't receive packets when in this state
                                         // TODO use correct rx cfg + it might be interesting to switch to idle first depending on calculated offset
-    uint16_t tx_duration = calculate_tx_duration();
+    uint16_t tx_duration = calculate_tx_duration(current_packet);
+    uint16_t t_offset = 0;
     switch (dll_state)
     {
-		case DLL_STATE_CSMA_CA_STARTED:
-		{
-			dll_tca = current_access_class.transmission_timeout_period - tx_duration;
-			DPRINT("Tca= %i = %i - %i", dll_tca, current_access_class.transmission_timeout_period, tx_duration);
+        case DLL_STATE_CSMA_CA_STARTED:
+        {
+            // a response to a broadcast request can use the response period of the requester
+            uint16_t tc = current_access_class.transmission_timeout_period;
+            uint16_t response_slot_window = packet_queue_find_packet(current_packet)->response_slot_window;
+            if(response_slot_window > 0)
+                tc = response_slot_window;
+
+            dll_tca = tc - tx_duration;
+            DPRINT("Tca= %i = %i - %i", dll_tca, tc, tx_duration);
 
             if (dll_tca <= 0)
-			{
-                // TODO how to handle this? signal upper layer?
+            {
                 DPRINT("Tca negative, CCA failed");
-                assert(false);
-//				switch_state(DLL_STATE_CCA_FAIL);
-//				sched_post_task(&execute_csma_ca);
-				break;
-			}
-
-			uint16_t t_offset = 0;
-
-			switch(current_access_class.control_csma_ca_mode)
-			{
-				case CSMA_CA_MODE_UNC:
-					// no delay
+                switch_state(DLL_STATE_CCA_FAIL);
+                sched_post_task(&execute_csma_ca);
+                break;
+            }
+
+            dll_csma_ca_deadline = timer_get_counter_value() + dll_tca;
+
+            switch(current_access_class.control_csma_ca_mode)
+            {
+                case CSMA_CA_MODE_UNC:
+                    // no delay
                     dll_slot_duration = 0;
-					break;
-				case CSMA_CA_MODE_AIND: // TODO implement AIND
-				{
-					dll_slot_duration = tx_duration;
-					// no initial delay
-					break;
-				}
-				case CSMA_CA_MODE_RAIND: // TODO implement RAIND
-				{
-					dll_slot_duration = tx_duration;
-					uint16_t max_nr_slots = dll_tca / tx_duration;
-                    uint16_t slots_wait = get_rnd() % max_nr_slots;
-					t_offset = slots_wait * tx_duration;
-					break;
-				}
-				case CSMA_CA_MODE_RIGD: // TODO implement RAIND
-				{
-					dll_rigd_n = 0;
-					dll_tca0 = dll_tca;
-                    dll_slot_duration = (uint16_t) ((double)dll_tca0) / (2 << (dll_rigd_n));
-                    t_offset = get_rnd() % dll_slot_duration;
-					break;
-				}
-			}
-
-			DPRINT("slot duration: %i", dll_slot_duration);
-			DPRINT("t_offset: %i", t_offset);
-
-			dll_to = dll_tca - t_offset;
-
-			if (t_offset > 0)
-			{
-                switch_state(DLL_STATE_CCA1);
-                timer_post_task_delay(&execute_cca, t_offset);
+                    break;
+                case CSMA_CA_MODE_AIND:
+                    // no initial delay, retries are done in slots of the transmission duration
+                    dll_slot_duration = tx_duration;
+                    break;
+                case CSMA_CA_MODE_RAIND:
+                    // start in a random slot of the transmission duration
+                    dll_slot_duration = tx_duration;
+                    t_offset = get_random_slot_offset(dll_tca, dll_slot_duration);
+                    break;
+                case CSMA_CA_MODE_RIGD:
+                    // start at a random time in the first half of Tca, every retry halves the window again
+                    dll_rigd_n = 0;
+                    dll_tca0 = dll_tca;
+                    dll_slot_duration = dll_tca0 >> 1;
+                    if(dll_slot_duration > 0)
+                        t_offset = get_rnd() % dll_slot_duration;
+                    break;
             }
+
+            // the CCA of a slotted response starts in the slot of this responder, retries use the CSMA-CA mode
+            if(response_slot_window > 0)
+                t_offset = get_response_slot_offset(dll_tca, tx_duration + t_g);
+
+            DPRINT("slot duration: %i", dll_slot_duration);
+            DPRINT("t_offset: %i", t_offset);
+
+            switch_state(DLL_STATE_CCA1);
+            if (t_offset > 0)
+                timer_post_task_delay(&execute_cca, t_offset);
             else
-            {
-				switch_state(DLL_STATE_CCA1);
                 sched_post_task(&execute_cca);
-			}
-
-			break;
-		}
-		case DLL_STATE_CSMA_CA_RETRY:
-		{
-			if (dll_to < t_g)
-			{
-				switch_state(DLL_STATE_CCA_FAIL);
-				sched_post_task(&execute_csma_ca);
-				break;
-			}
-
-			dll_tca = dll_to;
-			uint16_t t_offset = 0;
-
-			switch(current_access_class.control_csma_ca_mode)
-			{
-				case CSMA_CA_MODE_AIND: // TODO implement AIND
-				case CSMA_CA_MODE_RAIND: // TODO implement RAIND
-				{
-					uint16_t max_nr_slots = dll_tca / tx_duration;
-                    uint16_t slots_wait = get_rnd() % max_nr_slots;
-					t_offset = slots_wait * tx_duration;
-					break;
-				}
-				case CSMA_CA_MODE_RIGD: // TODO implement RAIND
-				{
-					dll_rigd_n++;
-					dll_slot_duration = (uint16_t) ((double)dll_tca0) / (2 << (dll_rigd_n+1));
-                    t_offset = get_rnd() % dll_slot_duration;
-					DPRINT("slot duration: %i", dll_slot_duration);
-					break;
-				}
-			}
-
-			DPRINT("t_offset: %i", t_offset);
-
-			dll_to = dll_tca - t_offset;
-
-			if (t_offset > 0)
-			{
-                timer_post_task_delay(&execute_csma_ca, t_offset);
+
+            break;
+        }
+        case DLL_STATE_CSMA_CA_RETRY:
+        {
+            int32_t remaining = (int32_t)(dll_csma_ca_deadline - timer_get_counter_value());
+            if (remaining < t_g)
+            {
+                DPRINT("Tca expired, CCA failed");
+                switch_state(DLL_STATE_CCA_FAIL);
+                sched_post_task(&execute_csma_ca);
+                break;
             }
-            else
+
+            switch(current_access_class.control_csma_ca_mode)
             {
-				switch_state(DLL_STATE_CCA1);
+                case CSMA_CA_MODE_UNC:
+                    // retry immediately, on the next channel of the channel queue if any
+                    break;
+                case CSMA_CA_MODE_AIND:
+                case CSMA_CA_MODE_RAIND:
+                    t_offset = get_random_slot_offset(remaining, dll_slot_duration);
+                    break;
+                case CSMA_CA_MODE_RIGD:
+                {
+                    if(dll_slot_duration > 0)
+                        dll_rigd_n++; // once the window is down to 0 there is no point halving it further
+
+                    dll_slot_duration = dll_tca0 >> (dll_rigd_n + 1);
+                    if(dll_slot_duration > 0)
+                        t_offset = get_rnd() % dll_slot_duration;
+
+                    DPRINT("slot duration: %i", dll_slot_duration);
+                    break;
+                }
+            }
+
+            DPRINT("t_offset: %i", t_offset);
+
+            switch_state(DLL_STATE_CCA1);
+            if (t_offset > 0)
+                timer_post_task_delay(&execute_cca, t_offset);
+            else
                 sched_post_task(&execute_cca);
-			}
-
-			break;
-		}
-		case DLL_STATE_CCA_FAIL:
-		{
-			d7atp_signal_packet_csma_ca_insertion_completed(false);
-			break;
-		}
+
+            break;
+        }
+        case DLL_STATE_CCA_FAIL:
+        {
+            // resume scanning before informing the upper layer, which might retry immediately
+            execute_scan_automation();
+            d7anp_signal_packet_csma_ca_insertion_completed(false);
+            break;
+        }
     }
 }
 
-static void execute_scan_automation()
+static void scan_rssi_valid(int16_t cur_rssi)
+{
+    if(dll_state != DLL_STATE_SCAN_AUTOMATION)
+        return;
+
+    update_noise_floor(scan_channel_index, cur_rssi);
+}
+
+static void start_scan_automation_rx()
+{
+    if(current_access_class.scan_automation_period > 0)
+    {
+        // duty cycled: keep the radio idle until the next background scan
+        hw_radio_set_idle();
+        int32_t delay = (int32_t)(next_background_scan - timer_get_counter_value());
+        timer_post_task_delay(&scan_next_channel, delay > 0? delay : 0);
+        return;
+    }
+
+    hw_rx_cfg_t rx_cfg = {
+        .channel_id = get_channel_id(scan_channel_index),
+        .syncword_class = PHY_SYNCWORD_CLASS1
+    };
+
+    hw_radio_set_rx(&rx_cfg, &packet_received, &scan_rssi_valid);
+
+    if(channel_list_count > 1)
+        timer_post_task_delay(&scan_next_channel, SCAN_CHANNEL_DWELL_TIME);
+}
+
+static void background_scan_rssi_valid(int16_t cur_rssi)
+{
+    // we might have started a transmission in the meantime
+    if(dll_state != DLL_STATE_BACKGROUND_SCAN)
+        return;
+
+    update_noise_floor(scan_channel_index, cur_rssi);
+    if(cur_rssi <= E_CCA)
+    {
+        // nothing on the air, back to sleep until the next scan on the next channel
+        DPRINT("Background scan RSSI %i, no carrier detected", cur_rssi);
+        switch_state(DLL_STATE_SCAN_AUTOMATION);
+        start_scan_automation_rx();
+        return;
+    }
+
+    DPRINT("Background scan RSSI %i, carrier detected", cur_rssi);
+    timer_post_task_delay(&scan_timeout, BACKGROUND_SCAN_RX_TIMEOUT);
+}
+
+static void scan_next_channel()
+{
+    // scan automation might have been interrupted by a transmission or foreground scan in the meantime
+    if(dll_state != DLL_STATE_SCAN_AUTOMATION || channel_list_count == 0)
+        return;
+
+    scan_channel_index = (scan_channel_index + 1) % channel_list_count;
+    DPRINT("Scanning channel %i", channel_list[scan_channel_index].center_freq_index);
+    if(current_access_class.scan_automation_period == 0)
+    {
+        start_scan_automation_rx();
+        return;
+    }
+
+    // duty cycled: listen shortly for a carrier on the next channel
+    next_background_scan = timer_get_counter_value() + compressed_time_decode(current_access_class.scan_automation_period);
+    switch_state(DLL_STATE_BACKGROUND_SCAN);
+    hw_rx_cfg_t rx_cfg = {
+        .channel_id = get_channel_id(scan_channel_index),
+        .syncword_class = PHY_SYNCWORD_CLASS0
+    };
+
+    hw_radio_set_rx(&rx_cfg, &packet_received, &background_scan_rssi_valid);
+}
+
+static void scan_timeout()
 {
-    if(current_access_class.control_number_of_subbands > 0)
+    if(dll_state == DLL_STATE_BACKGROUND_SCAN)
     {
-        assert(current_access_class.control_number_of_subbands == 1); // TODO multiple not supported
+        DPRINT("No background frame received");
         switch_state(DLL_STATE_SCAN_AUTOMATION);
-        hw_rx_cfg_t rx_cfg = {
-            .channel_id = {
-                .channel_header = current_access_class.subbands[0].channel_header,
-                .center_freq_index = current_access_class.subbands[0].channel_index_start
-            },
-            .syncword_class = PHY_SYNCWORD_CLASS1
-        };
+        start_scan_automation_rx();
+    }
+    else if(foreground_scan_after_advertising)
+    {
+        DPRINT("Advertised foreground frame not received");
+        foreground_scan_after_advertising = false;
+        if(dll_state == DLL_STATE_FOREGROUND_SCAN)
+            execute_scan_automation();
+    }
+}
 
-        hw_radio_set_rx(&rx_cfg, &packet_received, NULL);
+static void process_background_frame(packet_t* packet)
+{
+    timer_cancel_task(&scan_timeout);
+    hw_radio_packet_t* frame = &(packet->hw_radio_packet);
+    bool valid = frame->length == BACKGROUND_FRAME_LENGTH;
+    if(valid)
+    {
+        uint16_t crc = __builtin_bswap16(crc_calculate(frame->data, BACKGROUND_FRAME_LENGTH - 1));
+        valid = memcmp(&crc, frame->data + 4, 2) == 0 && frame->data[1] == current_access_class.subnet;
+    }
 
-        assert(current_access_class.scan_automation_period == 0); // scan automation period, assuming 0 for now
+    uint16_t eta = (frame->data[2] << 8) | frame->data[3];
+    packet_queue_free_packet(packet);
+    switch_state(DLL_STATE_SCAN_AUTOMATION);
+    if(!valid)
+    {
+        DPRINT("Invalid background frame, skipping");
+        start_scan_automation_rx();
+        return;
+    }
+
+    // sleep until the advertised foreground frame, which is sent on the channel of the background frame
+    DPRINT("Received background frame, ETA %i", eta);
+    hw_radio_set_idle();
+    dialog_channel = get_channel_id(scan_channel_index);
+    is_advertised_frame_pending = true;
+    timer_post_task_delay(&start_advertised_foreground_scan, eta > t_g? eta - t_g : 0);
+}
+
+static void start_advertised_foreground_scan()
+{
+    is_advertised_frame_pending = false;
+
+    // a transmission might be ongoing
+    if(dll_state != DLL_STATE_SCAN_AUTOMATION)
+        return;
+
+    dll_start_foreground_scan();
+    foreground_scan_after_advertising = true;
+    timer_post_task_delay(&scan_timeout, ADVERTISED_FOREGROUND_SCAN_TIMEOUT);
+}
+
+static void execute_scan_automation()
+{
+    if(is_access_class_reload_pending)
+        load_access_class();
+
+    if(channel_list_count > 0)
+    {
+        switch_state(DLL_STATE_SCAN_AUTOMATION);
+        start_scan_automation_rx();
     }
     else
     {
@@ -425,6 +949,133 @@ static void execute_scan_automation()
     }
 }
 
+static void restart_scan_automation()
+{
+    // stop the scan on the channels of the previous access profile
+    timer_cancel_task(&scan_next_channel);
+    timer_cancel_task(&scan_timeout);
+    execute_scan_automation();
+}
+
+static bool is_own_address(uint8_t const* address, bool is_vid)
+{
+    // a VID of 0xFFFF means no VID is assigned, frames addressed to it are not for us
+    if(is_vid)
+        return (vid[0] != 0xFF || vid[1] != 0xFF) && memcmp(address, vid, 2) == 0;
+
+    return memcmp(address, uid, 8) == 0;
+}
+
+static bool filter_received_frame(uint8_t const* data, uint8_t data_length)
+{
+    // we are in interrupt context here, only do the cheap checks which allow us to drop frames not meant
+    // for us before a packet is allocated, the full checks are done in dll_disassemble_packet_header()
+    if(dll_state == DLL_STATE_BACKGROUND_SCAN)
+        return data[0] == BACKGROUND_FRAME_LENGTH && data[1] == current_access_class.subnet;
+
+    if(data[0] < 4 || data_length < 3) // subnet, control and CRC
+        return false;
+
+    if(data[1] != current_access_class.subnet)
+        return false;
+
+    dll_header_t dll_header = { .control = data[2] };
+    if(dll_header.control_target_address_set)
+    {
+        uint8_t address_len = dll_header.control_vid_used? 2 : 8;
+        if(data_length < 3 + address_len)
+            return true; // can't decide yet
+
+        if(!is_own_address(data + 3, dll_header.control_vid_used))
+            return false;
+    }
+
+    return true;
+}
+
+static void load_access_class()
+{
+    is_access_class_reload_pending = false;
+    uint8_t access_class_index = fs_read_dll_conf_active_access_class();
+    dae_access_profile_t access_class;
+    if(!fs_read_access_class(access_class_index, &access_class))
+    {
+        // the files can be written remotely, keep using the previous access profile
+        DPRINT("Access class %i not defined or invalid, keeping access class %i", access_class_index, active_access_class);
+        return;
+    }
+
+    active_access_class = access_class_index;
+    current_access_class = access_class;
+    build_channel_list();
+    next_background_scan = timer_get_counter_value();
+
+    // the subnet is the first byte of both foreground and background frames, which allows hardware filtering
+    hw_radio_set_rx_filter(&filter_received_frame, true, current_access_class.subnet);
+}
+
+static eirp_t get_max_eirp()
+{
+    // the channel is not known yet when the EIRP is chosen, so use the lowest maximum EIRP of all subbands
+    if(current_access_class.control_number_of_subbands == 0)
+        return EIRP_MIN;
+
+    eirp_t max_eirp = current_access_class.subbands[0].eirp;
+    for(uint8_t i = 1; i < current_access_class.control_number_of_subbands; i++)
+    {
+        if(current_access_class.subbands[i].eirp < max_eirp)
+            max_eirp = current_access_class.subbands[i].eirp;
+    }
+
+    return max_eirp;
+}
+
+static eirp_t get_tx_eirp(packet_t* packet)
+{
+    // broadcast frames should reach all nodes and retransmissions are not helped by the power control,
+    // so both are transmitted at the maximum EIRP allowed by the access class
+    eirp_t max_eirp = get_max_eirp();
+    if(!packet->dll_header.control_target_address_set || packet->is_retransmission)
+        return hw_radio_get_supported_eirp(max_eirp);
+
+    neighbor_t const* neighbor = neighbor_table_find(packet->dll_addressee.addressee_id,
+                                                     packet->dll_addressee.addressee_ctrl_virtual_id);
+    if(neighbor == NULL)
+        return hw_radio_get_supported_eirp(max_eirp);
+
+    // the lowest EIRP at which the frame still arrives at the link margin above the sensitivity, assuming the
+    // path loss is the same in both directions
+    int16_t eirp = phy_get_sensitivity(dialog_channel.channel_header) + MODULE_D7AP_TX_POWER_LINK_MARGIN
+            + (neighbor->path_loss / 16);
+    if(eirp > max_eirp)
+        eirp = max_eirp;
+    else if(eirp < EIRP_MIN)
+        eirp = EIRP_MIN;
+
+    DPRINT("Path loss to neighbor is %i dB, using EIRP %i dBm", neighbor->path_loss / 16, eirp);
+    return hw_radio_get_supported_eirp(eirp);
+}
+
+static void on_file_modified(uint8_t file_id)
+{
+    if(file_id == D7A_FILE_UID_FILE_ID)
+    {
+        fs_read_uid(uid);
+    }
+    else if(file_id == D7A_FILE_DLL_CONF_FILE_ID || file_id == D7A_FILE_ACCESS_PROFILE_ID + active_access_class)
+    {
+        if(file_id == D7A_FILE_DLL_CONF_FILE_ID)
+            fs_read_vid(vid);
+
+        // the channels are only changed outside of dialogs, otherwise when the dialog is done
+        is_access_class_reload_pending = true;
+        bool is_scanning = dll_state == DLL_STATE_IDLE || dll_state == DLL_STATE_SCAN_AUTOMATION
+                || dll_state == DLL_STATE_BACKGROUND_SCAN;
+        if(is_scanning && !is_processing_received_frame && !is_advertised_frame_pending)
+            restart_scan_automation();
+    }
+}
+
 void dll_init()
 {
     sched_register_task(&process_received_packets);
@@ -432,10 +1083,19 @@ void dll_init()
     sched_register_task(&execute_cca);
     sched_register_task(&execute_csma_ca);
     sched_register_task(&execute_scan_automation);
+    sched_register_task(&scan_next_channel);
+    sched_register_task(&transmit_background_frame);
+    sched_register_task(&scan_timeout);
+    sched_register_task(&start_advertised_foreground_scan);
 
     hw_radio_init(&alloc_new_packet, &release_packet);
 
-    fs_read_access_class(0, &current_access_class); // use first access class for now
+    fs_read_uid(uid);
+    fs_read_vid(vid);
+    is_processing_received_frame = false;
+    is_advertised_frame_pending = false;
+    load_access_class();
+    fs_register_file_modified_callback(&on_file_modified);
 
     dll_state = DLL_STATE_IDLE;
     sched_post_task(&execute_scan_automation);
@@ -443,29 +1103,44 @@ void dll_init()
 
 void dll_tx_frame(packet_t* packet)
 {
+    // the receivers filter on the subnet of their access class
     packet->dll_header = (dll_header_t){
-        .subnet = 0x05, // TODO hardcoded for now
-        .control_target_address_set = false, // TODO assuming broadcast for now
-        .control_vid_used = false, // TODO hardcoded for now
-        .control_eirp_index = 0, // TODO hardcoded for now
+        .subnet = current_access_class.subnet,
+        .control_target_address_set = packet->dll_addressee.addressee_ctrl_has_id,
+        .control_vid_used = packet->dll_addressee.addressee_ctrl_virtual_id
     };
 
     dll_header_t* dll_header = &(packet->dll_header);
-    dll_header->subnet = 0x05; // TODO hardcoded for now
-    dll_header->control_eirp_index = 0; // TODO hardcoded for now
-    if(packet->d7atp_addressee != NULL)
+
+    // the EIRP is advertised in the header so the receivers can determine the path loss
+    eirp_t eirp = get_tx_eirp(packet);
+    dll_header->control_eirp_index = eirp + 32;
+
+    packet_assemble(packet);
+
+    // a new dialog is started on the first channel of a new channel queue, responses use the channel of the dialog
+    if(packet->d7atp_ctrl.ctrl_is_start)
     {
-        dll_header->control_target_address_set = packet->d7atp_addressee->addressee_ctrl_has_id;
-        dll_header->control_vid_used = packet->d7atp_addressee->addressee_ctrl_virtual_id;
+        init_tx_channel_queue();
+        if(tx_channel_queue_count == 0)
+        {
+            // the access class defines no channels to start a dialog on
+            DPRINT("Channel list empty, dropping frame");
+            d7anp_signal_packet_csma_ca_insertion_completed(false);
+            return;
+        }
     }
+    else
+        tx_channel_queue_count = 0;
 
-    packet_assemble(packet);
+    // nodes using a duty cycled scan automation are in background scan and need to be woken up by an advertising
+    // train before starting a new dialog, responses are sent while the requester is still in foreground scan
+    advertising_required = packet->d7atp_ctrl.ctrl_is_start && current_access_class.scan_automation_period > 0;
 
     packet->hw_radio_packet.tx_meta.tx_cfg = (hw_tx_cfg_t){
-        .channel_id.channel_header = current_access_class.subbands[0].channel_header,
-        .channel_id.center_freq_index = current_access_class.subbands[0].channel_index_start,
+        .channel_id = dialog_channel,
         .syncword_class = PHY_SYNCWORD_CLASS1,
-        .eirp = 10
+        .eirp = eirp
     };
 
     current_packet = &(packet->hw_radio_packet);
@@ -474,24 +1149,25 @@ void dll_tx_frame(packet_t* packet)
     execute_csma_ca();
 }
 
-void dll_start_foreground_scan()
+static void start_foreground_scan_rx()
 {
-    switch_state(DLL_STATE_FOREGROUND_SCAN);
-    // TODO handle Tscan timeout
-
-    // TODO only access class using 1 subband which contains 1 channel index is supported for now
-
+    // the response of a dialog is expected on the channel used for the request
     hw_rx_cfg_t rx_cfg = {
-        .channel_id = {
-            .channel_header = current_access_class.subbands[0].channel_header,
-            .center_freq_index = current_access_class.subbands[0].channel_index_start
-        },
+        .channel_id = dialog_channel,
         .syncword_class = PHY_SYNCWORD_CLASS1
     };
 
     hw_radio_set_rx(&rx_cfg, &packet_received, NULL);
 }
 
+void dll_start_foreground_scan()
+{
+    switch_state(DLL_STATE_FOREGROUND_SCAN);
+    // TODO handle Tscan timeout
+
+    start_foreground_scan_rx();
+}
+
 void dll_stop_foreground_scan()
 {
     assert(dll_state == DLL_STATE_FOREGROUND_SCAN);
@@ -506,7 +1182,7 @@ uint8_t dll_assemble_packet_header(packet_t* packet, uint8_t* data_ptr)
     if(packet->dll_header.control_target_address_set)
     {
         uint8_t addr_len = packet->dll_header.control_vid_used? 2 : 8;
-        memcpy(data_ptr, packet->d7atp_addressee->addressee_id, addr_len); data_ptr += addr_len;
+        memcpy(data_ptr, packet->dll_addressee.addressee_id, addr_len); data_ptr += addr_len;
     }
 
     return data_ptr - dll_header_start;
@@ -514,6 +1190,12 @@ uint8_t dll_assemble_packet_header(packet_t* packet, uint8_t* data_ptr)
 
 bool dll_disassemble_packet_header(packet_t* packet, uint8_t* data_idx)
 {
+    if(!packet_has_bytes_remaining(packet, *data_idx, 2))
+    {
+        DPRINT("Packet too short for DLL header, skipping packet");
+        return false;
+    }
+
     packet->dll_header.subnet = packet->hw_radio_packet.data[(*data_idx)]; (*data_idx)++;
     if(packet->dll_header.subnet != current_access_class.subnet)
     {
@@ -528,9 +1210,13 @@ bool dll_disassemble_packet_header(packet_t* packet, uint8_t* data_idx)
         if(!packet->dll_header.control_vid_used)
             address_len = 8;
 
-        uint8_t uid[8];
-        fs_read_uid(uid); // TODO cache
-        if(memcmp(packet->hw_radio_packet.data + (*data_idx), uid, address_len) != 0)
+        if(!packet_has_bytes_remaining(packet, *data_idx, address_len))
+        {
+            DPRINT("Packet too short for target address, skipping packet");
+            return false;
+        }
+
+        if(!is_own_address(packet->hw_radio_packet.data + (*data_idx), packet->dll_header.control_vid_used))
         {
             DPRINT("Device ID filtering failed, skipping packet");
             return false;
@@ -538,6 +1224,9 @@ bool dll_disassemble_packet_header(packet_t* packet, uint8_t* data_idx)
 
         (*data_idx) += address_len;
     }
+    // responses to this frame are sent on the channel it was received on
+    dialog_channel = packet->hw_radio_packet.rx_meta.rx_cfg.channel_id;
+
     // TODO filter LQ
     // TODO pass to upper layer
     // TODO Tscan -= Trx
@@ -559,3 +1248,19 @@ void dll_register_tx_callback(dll_packet_transmitted_callback callback)
 {
 	dll_tx_callback = callback;
 }
+
+uint8_t dll_get_channel_count()
+{
+    return channel_list_count;
+}
+
+int16_t dll_get_channel_noise_floor(uint8_t index, channel_id_t* channel_id)
+{
+    assert(index < channel_list_count);
+    *channel_id = get_channel_id(index);
+    int16_t noise_floor = channel_list[index].noise_floor;
+    if(noise_floor == DLL_NOISE_FLOOR_UNKNOWN)
+        return DLL_NOISE_FLOOR_UNKNOWN;
+
+    return noise_floor / 16;
+}
@@ -33,6 +33,9 @@
 
 #define E_CCA	-86 //TODO: get from file
 
+/*! Returned as noise floor for channels on which no RSSI has been sampled yet */
+#define DLL_NOISE_FLOOR_UNKNOWN INT16_MIN
+
 typedef struct packet packet_t;
 
 typedef struct
@@ -43,7 +46,7 @@ typedef struct
         uint8_t control;
         struct
         {
-            int8_t control_eirp_index: 6;
+            uint8_t control_eirp_index: 6; /**< EIRP in dBm + 32 */
             bool control_vid_used: 1;
             bool control_target_address_set: 1;
         };
@@ -51,6 +54,12 @@ typedef struct
     //uint8_t target_address[8]; // TODO assuming 8B UID for now
 } dll_header_t;
 
+/*! \brief Returns the EIRP in dBm the frame was transmitted with, as encoded in the DLL header */
+static inline int8_t dll_get_eirp(dll_header_t const* dll_header)
+{
+    return (int8_t)dll_header->control_eirp_index - 32;
+}
+
 typedef void (*dll_packet_received_callback)();
 typedef void (*dll_packet_transmitted_callback)();
 
@@ -65,6 +74,16 @@ bool dll_disassemble_packet_header(packet_t* packet, uint8_t* data_idx);
 void dll_register_rx_callback(dll_packet_received_callback callback);
 void dll_register_tx_callback(dll_packet_transmitted_callback callback);
 
+/*! \brief Returns the number of channels of the active access class, which can be used as index for dll_get_channel_noise_floor() */
+uint8_t dll_get_channel_count();
+
+/*! \brief Returns the noise floor of a channel of the active access class, in dBm.
+ *
+ * The noise floor is estimated from the RSSI sampled during CCA and while scanning, or DLL_NOISE_FLOOR_UNKNOWN
+ * when no samples were taken yet.
+ */
+int16_t dll_get_channel_noise_floor(uint8_t index, channel_id_t* channel_id);
+
 #endif //OSS_7_DLL_H
 
 /** @}*/
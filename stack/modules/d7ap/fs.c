@@ -27,9 +27,10 @@
 #include "hwsystem.h"
 #include "alp.h"
 #include "d7asp.h"
+#include "neighbor_table.h"
 
 #define FILE_COUNT 0x42 // TODO define from cmake (D7AP module specific)
-#define FILE_DATA_SIZE 80 // TODO define from cmake (D7AP module specific)
+#define FILE_DATA_SIZE 104 // TODO define from cmake (D7AP module specific)
 
 static fs_file_header_t NGDEF(_file_headers)[FILE_COUNT] = { 0 };
 #define file_headers NG(_file_headers)
@@ -46,31 +47,70 @@ static uint16_t NGDEF(_file_offsets)[FILE_COUNT] = { 0 };
 static uint16_t NGDEF(_is_fs_init_completed);
 #define is_fs_init_completed NG(_is_fs_init_completed)
 
-#define D7A_FILE_UID_FILE_ID 0x00
 #define D7A_FILE_UID_SIZE 8
 
-#define D7A_FILE_DLL_CONF_FILE_ID	0x0A
 #define D7A_FILE_DLL_CONF_SIZE		6
+#define D7A_FILE_DLL_CONF_ACTIVE_ACCESS_CLASS_OFFSET 0
+#define D7A_FILE_DLL_CONF_VID_OFFSET 1
+#define D7A_FILE_DLL_CONF_VID_SIZE 2
 
-#define D7A_FILE_ACCESS_PROFILE_ID 0x20 // the first access class file
-#define D7A_FILE_ACCESS_PROFILE_SIZE 12 // TODO assuming 1 subband
+#define D7A_FILE_NWL_SECURITY_SIZE 5
+#define D7A_FILE_NWL_SECURITY_KEY_COUNTER_OFFSET 0
+#define D7A_FILE_NWL_SECURITY_FRAME_COUNTER_OFFSET 1
+
+#define D7A_FILE_NWL_SECURITY_KEY_SIZE 16
+
+#define D7A_FILE_ACCESS_PROFILE_HEADER_SIZE 5
+#define D7A_FILE_ACCESS_PROFILE_SUBBAND_SIZE 7
+#define D7A_FILE_ACCESS_PROFILE_SIZE(subbands_count) (D7A_FILE_ACCESS_PROFILE_HEADER_SIZE + (subbands_count) * D7A_FILE_ACCESS_PROFILE_SUBBAND_SIZE)
 
 #define ACTION_FILE_ID_BROADCAST_COUNTER 0x41
 
-static inline bool is_file_defined(uint8_t file_id)
+#define FILE_MODIFIED_CALLBACKS_COUNT 4 // TODO define from cmake (D7AP module specific)
+
+#define VIRTUAL_FILES_COUNT 1
+
+typedef struct
 {
-    return file_headers[file_id].length != 0;
+    uint8_t file_id;
+    fs_file_read_callback_t read_callback;
+} virtual_file_t;
+
+static virtual_file_t NGDEF(_virtual_files)[VIRTUAL_FILES_COUNT];
+#define virtual_files NG(_virtual_files)
+
+static uint8_t NGDEF(_virtual_files_count);
+#define virtual_files_count NG(_virtual_files_count)
+
+static fs_file_modified_callback_t NGDEF(_file_modified_callbacks)[FILE_MODIFIED_CALLBACKS_COUNT];
+#define file_modified_callbacks NG(_file_modified_callbacks)
+
+static uint8_t NGDEF(_file_modified_callbacks_count);
+#define file_modified_callbacks_count NG(_file_modified_callbacks_count)
+
+bool fs_is_file_defined(uint8_t file_id)
+{
+    return file_id < FILE_COUNT && file_headers[file_id].length != 0;
 }
 
-static void execute_alp_command(uint8_t command_file_id)
+// executes the D7AActP command in the action file: the D7ASP FIFO configuration followed by the ALP actions to queue.
+// The action file is validated when it is configured, but its data can be written afterwards.
+static alp_status_code_t execute_alp_command(uint8_t command_file_id)
 {
-    assert(is_file_defined(command_file_id));
+    if(!fs_is_file_defined(command_file_id) || fs_is_virtual_file(command_file_id))
+        return ALP_STATUS_FILE_ID_NOT_EXISTS;
+
     uint8_t* data_ptr = (uint8_t*)(data + file_offsets[command_file_id]);
     uint8_t* file_start = data_ptr;
 
     // parse ALP command
     d7asp_fifo_config_t fifo_config;
-    assert((*data_ptr) == ALP_ITF_ID_D7ASP); // only D7ASP supported for now
+    if(file_headers[command_file_id].length <= 1 + D7ASP_FIFO_CONFIG_SIZE)
+        return ALP_STATUS_OPERAND_INCOMPLETE;
+
+    if((*data_ptr) != ALP_ITF_ID_D7ASP) // only D7ASP supported for now
+        return ALP_STATUS_OPERAND_WRONG_FORMAT;
+
     data_ptr++;
     fifo_config.fifo_ctrl = (*data_ptr); data_ptr++;
     fifo_config.qos.qos_ctrl = (*data_ptr); data_ptr++;
@@ -82,24 +122,31 @@ static void execute_alp_command(uint8_t command_file_id)
     fifo_config.addressee.addressee_ctrl = (*data_ptr); data_ptr++;
     memcpy(&(fifo_config.addressee.addressee_id), data_ptr, 8); data_ptr += 8; // TODO assume 8 for now
 
-    d7asp_queue_alp_actions(&fifo_config, data_ptr, file_headers[command_file_id].length - (uint8_t)(data_ptr - file_start));
+    switch(d7asp_queue_alp_actions(&fifo_config, data_ptr, file_headers[command_file_id].length - (uint8_t)(data_ptr - file_start)))
+    {
+        case SUCCESS: return ALP_STATUS_OK;
+        case EINVAL: return ALP_STATUS_OPERAND_WRONG_FORMAT;
+        case ESIZE: return ALP_STATUS_WRITE_DATA_OVERFLOW;
+        default: return ALP_STATUS_UNKNOWN_ERROR; // the FIFOs are full
+    }
 }
 
 static void write_access_class(uint8_t access_class_index, dae_access_profile_t* access_class)
 {
     assert(access_class_index < 16);
-    assert(access_class->control_number_of_subbands == 1); // TODO only one supported for now
     data[current_data_offset] = access_class->control; current_data_offset++;
     data[current_data_offset] = access_class->subnet; current_data_offset++;
     data[current_data_offset] = access_class->scan_automation_period; current_data_offset++;
     data[current_data_offset] = access_class->transmission_timeout_period; current_data_offset++;
     data[current_data_offset] = 0x00; current_data_offset++; // RFU
-    // subbands, only 1 supported for now
-    memcpy(data + current_data_offset, &(access_class->subbands[0].channel_header), 1); current_data_offset++;
-    memcpy(data + current_data_offset, &(access_class->subbands[0].channel_index_start), 2); current_data_offset += 2;
-    memcpy(data + current_data_offset, &(access_class->subbands[0].channel_index_end), 2); current_data_offset += 2;
-    data[current_data_offset] = access_class->subbands[0].eirp; current_data_offset++;
-    data[current_data_offset] = access_class->subbands[0].ccao; current_data_offset++;
+    for(uint8_t i = 0; i < access_class->control_number_of_subbands; i++)
+    {
+        memcpy(data + current_data_offset, &(access_class->subbands[i].channel_header), 1); current_data_offset++;
+        memcpy(data + current_data_offset, &(access_class->subbands[i].channel_index_start), 2); current_data_offset += 2;
+        memcpy(data + current_data_offset, &(access_class->subbands[i].channel_index_end), 2); current_data_offset += 2;
+        data[current_data_offset] = access_class->subbands[i].eirp; current_data_offset++;
+        data[current_data_offset] = access_class->subbands[i].ccao; current_data_offset++;
+    }
 }
 
 void fs_init(fs_init_args_t* init_args)
@@ -107,13 +154,15 @@ void fs_init(fs_init_args_t* init_args)
     // TODO store as big endian!
     is_fs_init_completed = false;
     current_data_offset = 0;
+    file_modified_callbacks_count = 0;
+    virtual_files_count = 0;
 
     // UID
     file_offsets[D7A_FILE_UID_FILE_ID] = current_data_offset;
     file_headers[D7A_FILE_UID_FILE_ID] = (fs_file_header_t){
         .file_properties.action_protocol_enabled = 0,
         .file_properties.storage_class = FS_STORAGE_PERMANENT,
-        .file_properties.permissions = 0, // TODO
+        .file_properties.permissions = FS_PERMISSION_USER_READ | FS_PERMISSION_GUEST_READ,
         .length = D7A_FILE_UID_SIZE
     };
 
@@ -126,13 +175,38 @@ void fs_init(fs_init_args_t* init_args)
 	file_headers[D7A_FILE_DLL_CONF_FILE_ID] = (fs_file_header_t){
 		.file_properties.action_protocol_enabled = 0,
 		.file_properties.storage_class = FS_STORAGE_RESTORABLE,
-		.file_properties.permissions = 0, // TODO
-		.length = D7A_FILE_UID_SIZE
+		.file_properties.permissions = FS_PERMISSION_USER_READ | FS_PERMISSION_USER_WRITE | FS_PERMISSION_GUEST_READ,
+		.length = D7A_FILE_DLL_CONF_SIZE
 	};
 
 	memset(data + current_data_offset, 0, D7A_FILE_DLL_CONF_SIZE);
+	memset(data + current_data_offset + D7A_FILE_DLL_CONF_VID_OFFSET, 0xFF, D7A_FILE_DLL_CONF_VID_SIZE); // no VID assigned
 	current_data_offset += D7A_FILE_DLL_CONF_SIZE;
 
+    // NWL security, the key is all zeroes until it is provisioned by writing the key file. Both files are only accessed
+    // by the stack, the key is provisioned by the application.
+    file_offsets[D7A_FILE_NWL_SECURITY_FILE_ID] = current_data_offset;
+    file_headers[D7A_FILE_NWL_SECURITY_FILE_ID] = (fs_file_header_t){
+        .file_properties.action_protocol_enabled = 0,
+        .file_properties.storage_class = FS_STORAGE_RESTORABLE,
+        .file_properties.permissions = 0,
+        .length = D7A_FILE_NWL_SECURITY_SIZE
+    };
+
+    memset(data + current_data_offset, 0, D7A_FILE_NWL_SECURITY_SIZE);
+    current_data_offset += D7A_FILE_NWL_SECURITY_SIZE;
+
+    file_offsets[D7A_FILE_NWL_SECURITY_KEY_FILE_ID] = current_data_offset;
+    file_headers[D7A_FILE_NWL_SECURITY_KEY_FILE_ID] = (fs_file_header_t){
+        .file_properties.action_protocol_enabled = 0,
+        .file_properties.storage_class = FS_STORAGE_PERMANENT,
+        .file_properties.permissions = 0,
+        .length = D7A_FILE_NWL_SECURITY_KEY_SIZE
+    };
+
+    memset(data + current_data_offset, 0, D7A_FILE_NWL_SECURITY_KEY_SIZE);
+    current_data_offset += D7A_FILE_NWL_SECURITY_KEY_SIZE;
+
     // access profiles
     assert(init_args->access_profiles_count > 0 && init_args->access_profiles_count < 16);
     for(uint8_t i = 0; i < init_args->access_profiles_count; i++)
@@ -143,11 +217,13 @@ void fs_init(fs_init_args_t* init_args)
         file_headers[D7A_FILE_ACCESS_PROFILE_ID + i] = (fs_file_header_t){
             .file_properties.action_protocol_enabled = 0,
             .file_properties.storage_class = FS_STORAGE_PERMANENT,
-            .file_properties.permissions = 0, // TODO
-            .length = D7A_FILE_ACCESS_PROFILE_SIZE
+            .file_properties.permissions = FS_PERMISSION_USER_READ | FS_PERMISSION_USER_WRITE | FS_PERMISSION_GUEST_READ,
+            .length = D7A_FILE_ACCESS_PROFILE_SIZE(access_class->control_number_of_subbands)
         };
     }
 
+    fs_init_virtual_file(D7A_FILE_NEIGHBOR_TABLE_FILE_ID, NEIGHBOR_TABLE_FILE_SIZE, &neighbor_table_read_file);
+
     // init user files
     if(init_args->fs_user_files_init_cb)
         init_args->fs_user_files_init_cb();
@@ -167,7 +243,7 @@ void fs_init_file(uint8_t file_id, const fs_file_header_t* file_header, const ui
         fs_write_file(file_id, 0, initial_data, file_header->length);
 }
 
-void fs_init_file_with_D7AActP(uint8_t file_id, const d7asp_fifo_config_t* fifo_config, const alp_control_t* alp_ctrl, const uint8_t* alp_operand)
+void fs_init_file_with_D7AActP(uint8_t file_id, const d7asp_fifo_config_t* fifo_config, const alp_action_t* alp_action)
 {
     uint8_t alp_command_buffer[40] = { 0 };
     uint8_t* ptr = alp_command_buffer;
@@ -182,71 +258,225 @@ void fs_init_file_with_D7AActP(uint8_t file_id, const d7asp_fifo_config_t* fifo_
     (*ptr) = fifo_config->addressee.addressee_ctrl; ptr++;
     memcpy(ptr, &(fifo_config->addressee.addressee_id), 8); ptr += 8; // TODO assume 8 for now
 
-    (*ptr) = alp_ctrl->raw; ptr++;
-
-    uint8_t alp_operand_len = 0;
-    switch(alp_ctrl->operation)
-    {
-        case ALP_OP_READ_FILE_DATA:
-            alp_operand_len = 3; // File Offset Operand + requested Data Length
-                //TODO File Offset Operand can be 2-5 bytes actually, depending on File Offset Field Length, see spec
-            break;
-        default:
-            assert(false);
-    }
-
-    memcpy(ptr, alp_operand, alp_operand_len); ptr += alp_operand_len;
+    uint8_t alp_action_length = alp_encode_action(alp_action, ptr, sizeof(alp_command_buffer) - (ptr - alp_command_buffer));
+    assert(alp_action_length > 0);
+    ptr += alp_action_length;
 
     // TODO fixed header implemented here, or should this be configurable by app?
     fs_file_header_t action_file_header = (fs_file_header_t){
         .file_properties.action_protocol_enabled = 0,
         .file_properties.storage_class = FS_STORAGE_PERMANENT,
-        .file_properties.permissions = 0, // TODO
+        .file_properties.permissions = FS_PERMISSION_USER_READ | FS_PERMISSION_USER_WRITE,
         .length = ptr - alp_command_buffer
     };
 
     fs_init_file(file_id, &action_file_header, alp_command_buffer);
 }
 
+void fs_init_virtual_file(uint8_t file_id, uint32_t length, fs_file_read_callback_t read_callback)
+{
+    assert(!is_fs_init_completed);
+    assert(virtual_files_count < VIRTUAL_FILES_COUNT);
+    file_headers[file_id] = (fs_file_header_t){
+        .file_properties.action_protocol_enabled = 0,
+        .file_properties.storage_class = FS_STORAGE_VOLATILE,
+        .file_properties.permissions = FS_PERMISSION_USER_READ | FS_PERMISSION_GUEST_READ,
+        .length = length
+    };
+
+    virtual_files[virtual_files_count] = (virtual_file_t){
+        .file_id = file_id,
+        .read_callback = read_callback
+    };
+
+    virtual_files_count++;
+}
+
+static virtual_file_t* find_virtual_file(uint8_t file_id)
+{
+    for(uint8_t i = 0; i < virtual_files_count; i++)
+    {
+        if(virtual_files[i].file_id == file_id)
+            return &virtual_files[i];
+    }
+
+    return NULL;
+}
+
+bool fs_is_virtual_file(uint8_t file_id)
+{
+    return find_virtual_file(file_id) != NULL;
+}
+
+void fs_read_file_header(uint8_t file_id, fs_file_header_t* file_header)
+{
+    assert(fs_is_file_defined(file_id));
+    memcpy(file_header, file_headers + file_id, sizeof(fs_file_header_t));
+}
+
+void fs_write_file_properties(uint8_t file_id, const fs_file_properties_t* file_properties)
+{
+    assert(fs_is_file_defined(file_id));
+    file_headers[file_id].file_properties = *file_properties;
+}
+
 void fs_read_file(uint8_t file_id, uint8_t offset, uint8_t* buffer, uint8_t length)
 {
-    assert(is_file_defined(file_id));
+    assert(fs_is_file_defined(file_id));
     assert(file_headers[file_id].length >= offset + length);
+    virtual_file_t* virtual_file = find_virtual_file(file_id);
+    if(virtual_file != NULL)
+    {
+        virtual_file->read_callback(offset, buffer, length);
+        return;
+    }
+
     memcpy(buffer, data + file_offsets[file_id] + offset, length);
 }
 
-void fs_write_file(uint8_t file_id, uint8_t offset, const uint8_t* buffer, uint8_t length)
+alp_status_code_t fs_write_file(uint8_t file_id, uint8_t offset, const uint8_t* buffer, uint8_t length)
 {
-    assert(is_file_defined(file_id));
+    assert(fs_is_file_defined(file_id));
+    assert(find_virtual_file(file_id) == NULL); // virtual files are read only
     assert(file_headers[file_id].length >= offset + length);
     memcpy(data + file_offsets[file_id] + offset, buffer, length);
 
-    if(file_headers[file_id].file_properties.action_protocol_enabled == true
+    for(uint8_t i = 0; i < file_modified_callbacks_count; i++)
+        file_modified_callbacks[i](file_id);
+
+    // system files do not execute actions, the stack writes these itself. For instance the frame counter is written for
+    // every secured frame we send, an action on this file would send a frame for every frame.
+    if(file_id >= D7A_FILE_USER_FILE_ID_START
+            && file_headers[file_id].file_properties.action_protocol_enabled == true
             && file_headers[file_id].file_properties.action_condition == ALP_ACT_COND_WRITE) // TODO ALP_ACT_COND_WRITEFLUSH?
     {
-        execute_alp_command(file_headers[file_id].file_properties.action_file_id);
+        return execute_alp_command(file_headers[file_id].file_properties.action_file_id);
+    }
+
+    return ALP_STATUS_OK;
+}
+
+bool fs_is_read_allowed(uint8_t file_id, fs_role_t role)
+{
+    if(!fs_is_file_defined(file_id))
+        return false;
+
+    uint8_t permissions = file_headers[file_id].file_properties.permissions;
+    switch(role)
+    {
+        case FS_ROLE_ROOT: return true;
+        case FS_ROLE_USER: return permissions & FS_PERMISSION_USER_READ;
+        default: return permissions & FS_PERMISSION_GUEST_READ;
+    }
+}
+
+bool fs_is_write_allowed(uint8_t file_id, fs_role_t role)
+{
+    if(!fs_is_file_defined(file_id) || find_virtual_file(file_id) != NULL)
+        return false;
+
+    uint8_t permissions = file_headers[file_id].file_properties.permissions;
+    switch(role)
+    {
+        case FS_ROLE_ROOT: return true;
+        case FS_ROLE_USER: return permissions & FS_PERMISSION_USER_WRITE;
+        default: return permissions & FS_PERMISSION_GUEST_WRITE;
     }
 }
 
+bool fs_is_action_file_allowed(uint8_t file_id, uint8_t action_file_id, fs_role_t role)
+{
+    // system files do not execute actions, see fs_write_file()
+    if(file_id < D7A_FILE_USER_FILE_ID_START || action_file_id == file_id)
+        return false;
+
+    // the command in the action file is sent on behalf of the role which configures it
+    return fs_is_read_allowed(action_file_id, role) && find_virtual_file(action_file_id) == NULL
+            && file_headers[action_file_id].length > 1 + D7ASP_FIFO_CONFIG_SIZE;
+}
+
+void fs_register_file_modified_callback(fs_file_modified_callback_t callback)
+{
+    assert(file_modified_callbacks_count < FILE_MODIFIED_CALLBACKS_COUNT);
+    file_modified_callbacks[file_modified_callbacks_count] = callback;
+    file_modified_callbacks_count++;
+}
+
 void fs_read_uid(uint8_t *buffer)
 {
     fs_read_file(D7A_FILE_UID_FILE_ID, 0, buffer, D7A_FILE_UID_SIZE);
 }
 
-void fs_read_access_class(uint8_t access_class_index, dae_access_profile_t *access_class)
+bool fs_read_vid(uint8_t *buffer)
 {
-    assert(access_class_index < 16);
-    assert(is_file_defined(D7A_FILE_ACCESS_PROFILE_ID + access_class_index));
+    fs_read_file(D7A_FILE_DLL_CONF_FILE_ID, D7A_FILE_DLL_CONF_VID_OFFSET, buffer, D7A_FILE_DLL_CONF_VID_SIZE);
+    return buffer[0] != 0xFF || buffer[1] != 0xFF;
+}
+
+uint8_t fs_read_dll_conf_active_access_class()
+{
+    uint8_t access_class;
+    fs_read_file(D7A_FILE_DLL_CONF_FILE_ID, D7A_FILE_DLL_CONF_ACTIVE_ACCESS_CLASS_OFFSET, &access_class, 1);
+    return access_class;
+}
+
+void fs_read_nwl_security_key(uint8_t* key)
+{
+    fs_read_file(D7A_FILE_NWL_SECURITY_KEY_FILE_ID, 0, key, D7A_FILE_NWL_SECURITY_KEY_SIZE);
+}
+
+void fs_read_nwl_security(uint8_t* key_counter, uint32_t* frame_counter)
+{
+    uint32_t frame_counter_be;
+    fs_read_file(D7A_FILE_NWL_SECURITY_FILE_ID, D7A_FILE_NWL_SECURITY_KEY_COUNTER_OFFSET, key_counter, 1);
+    fs_read_file(D7A_FILE_NWL_SECURITY_FILE_ID, D7A_FILE_NWL_SECURITY_FRAME_COUNTER_OFFSET, (uint8_t*)&frame_counter_be, 4);
+    *frame_counter = __builtin_bswap32(frame_counter_be);
+}
+
+void fs_write_nwl_security_frame_counter(uint32_t frame_counter)
+{
+    uint32_t frame_counter_be = __builtin_bswap32(frame_counter);
+    fs_write_file(D7A_FILE_NWL_SECURITY_FILE_ID, D7A_FILE_NWL_SECURITY_FRAME_COUNTER_OFFSET, (uint8_t*)&frame_counter_be, 4);
+}
+
+static bool is_channel_header_valid(phy_channel_header_t channel_header)
+{
+    return channel_header.ch_class != 1 // RFU
+            && (channel_header.ch_coding == PHY_CODING_PN9 || channel_header.ch_coding == PHY_CODING_FEC_PN9)
+            && channel_header.ch_freq_band >= PHY_BAND_433 && channel_header.ch_freq_band <= PHY_BAND_915;
+}
+
+bool fs_read_access_class(uint8_t access_class_index, dae_access_profile_t *access_class)
+{
+    // the access class index can be received, and the files can be written remotely
+    if(access_class_index >= 16 || !fs_is_file_defined(D7A_FILE_ACCESS_PROFILE_ID + access_class_index)
+            || file_headers[D7A_FILE_ACCESS_PROFILE_ID + access_class_index].length < D7A_FILE_ACCESS_PROFILE_HEADER_SIZE)
+        return false;
+
     uint8_t* data_ptr = data + file_offsets[D7A_FILE_ACCESS_PROFILE_ID + access_class_index];
     access_class->control = (*data_ptr); data_ptr++;
     access_class->subnet = (*data_ptr); data_ptr++;
     access_class->scan_automation_period = (*data_ptr); data_ptr++;
     access_class->transmission_timeout_period = (*data_ptr); data_ptr++;
     data_ptr++; // RFU
-    // subbands, only 1 supported for now
-    memcpy(&(access_class->subbands[0].channel_header), data_ptr, 1); data_ptr++;
-    memcpy(&(access_class->subbands[0].channel_index_start), data_ptr, 2); data_ptr += 2;
-    memcpy(&(access_class->subbands[0].channel_index_end), data_ptr, 2); data_ptr += 2;
-    access_class->subbands[0].eirp = (*data_ptr); data_ptr++;
-    access_class->subbands[0].ccao = (*data_ptr); data_ptr++;
+
+    // the number of subbands can be changed by writing the file, but the file is not resized so only the subbands
+    // the file has room for are read
+    uint32_t file_length = file_headers[D7A_FILE_ACCESS_PROFILE_ID + access_class_index].length;
+    uint8_t max_subbands_count = (file_length - D7A_FILE_ACCESS_PROFILE_HEADER_SIZE) / D7A_FILE_ACCESS_PROFILE_SUBBAND_SIZE;
+    if(access_class->control_number_of_subbands > max_subbands_count)
+        access_class->control_number_of_subbands = max_subbands_count;
+    for(uint8_t i = 0; i < access_class->control_number_of_subbands; i++)
+    {
+        memcpy(&(access_class->subbands[i].channel_header), data_ptr, 1); data_ptr++;
+        memcpy(&(access_class->subbands[i].channel_index_start), data_ptr, 2); data_ptr += 2;
+        memcpy(&(access_class->subbands[i].channel_index_end), data_ptr, 2); data_ptr += 2;
+        access_class->subbands[i].eirp = (*data_ptr); data_ptr++;
+        access_class->subbands[i].ccao = (*data_ptr); data_ptr++;
+        if(!is_channel_header_valid(access_class->subbands[i].channel_header)
+                || access_class->subbands[i].channel_index_start > access_class->subbands[i].channel_index_end)
+            return false;
+    }
+
+    return true;
 }
@@ -24,6 +24,26 @@
 #define FS_H_
 
 #include "stdint.h"
+#include "stdbool.h"
+
+#define D7A_FILE_UID_FILE_ID 0x00
+#define D7A_FILE_DLL_CONF_FILE_ID 0x0A
+#define D7A_FILE_NWL_SECURITY_FILE_ID 0x0C // the key counter and the frame counter of the frames we originate
+#define D7A_FILE_NWL_SECURITY_KEY_FILE_ID 0x0D
+#define D7A_FILE_ACCESS_PROFILE_ID 0x20 // the first access class file
+#define D7A_FILE_NEIGHBOR_TABLE_FILE_ID 0x30 // proprietary, see neighbor_table.h
+#define D7A_FILE_USER_FILE_ID_START 0x40 // the files with a lower ID are system files
+
+// the permissions of a file apply to the requests we receive: these act in the user role when authenticated by D7ANP
+// (using a method with a MIC), in the guest role otherwise. The stack and the application access the files without restrictions.
+#define FS_PERMISSION_ENCRYPTED 0x80
+#define FS_PERMISSION_EXECUTABLE 0x40
+#define FS_PERMISSION_USER_READ 0x20
+#define FS_PERMISSION_USER_WRITE 0x10
+#define FS_PERMISSION_USER_EXECUTE 0x08
+#define FS_PERMISSION_GUEST_READ 0x04
+#define FS_PERMISSION_GUEST_WRITE 0x02
+#define FS_PERMISSION_GUEST_EXECUTE 0x01
 
 #include "dae.h"
 #include "alp.h"
@@ -36,6 +56,13 @@ typedef enum
     FS_STORAGE_PERMANENT = 3
 } fs_storage_class_t;
 
+typedef enum
+{
+    FS_ROLE_ROOT = 0, // the stack and the application
+    FS_ROLE_USER = 1,
+    FS_ROLE_GUEST = 2
+} fs_role_t;
+
 typedef struct
 {
     uint8_t action_file_id;
@@ -70,6 +97,20 @@ typedef struct
 typedef void (*fs_user_files_init_callback)(void);
 
 
+/**
+ * \brief Called after a file has been written using fs_write_file(), for every file.
+ *
+ * Used by the stack to keep decoded copies of system files (UID, DLL configuration, access profiles, ...)
+ * up to date, instead of reading and parsing the file every time the data is needed.
+ */
+typedef void (*fs_file_modified_callback_t)(uint8_t file_id);
+
+/**
+ * \brief Provides the contents of a virtual file, of which the data is not stored in the filesystem but
+ * generated by the stack when read.
+ */
+typedef void (*fs_file_read_callback_t)(uint8_t offset, uint8_t* buffer, uint8_t length);
+
 /**
  * \brief Arguments used by the stack for filesystem initialization
  */
@@ -81,9 +122,27 @@ typedef struct {
 
 void fs_init(fs_init_args_t* init_args);
 void fs_init_file(uint8_t file_id, const fs_file_header_t* file_header, const uint8_t* initial_data);
-void fs_init_file_with_D7AActP(uint8_t file_id, const d7asp_fifo_config_t* fifo_config, const alp_control_t* alp_control, const uint8_t* alp_operand);
+void fs_init_file_with_D7AActP(uint8_t file_id, const d7asp_fifo_config_t* fifo_config, const alp_action_t* alp_action);
+void fs_init_virtual_file(uint8_t file_id, uint32_t length, fs_file_read_callback_t read_callback);
+bool fs_is_file_defined(uint8_t file_id);
+bool fs_is_virtual_file(uint8_t file_id);
+void fs_read_file_header(uint8_t file_id, fs_file_header_t* file_header);
+void fs_write_file_properties(uint8_t file_id, const fs_file_properties_t* file_properties);
 void fs_read_file(uint8_t file_id, uint8_t offset, uint8_t* buffer, uint8_t length);
-void fs_write_file(uint8_t file_id, uint8_t offset, const uint8_t* buffer, uint8_t length);
-void fs_read_access_class(uint8_t access_class_index, dae_access_profile_t* access_class);
+/*! \brief Writes the file and executes its action when the action protocol is enabled, returns the status of the action */
+alp_status_code_t fs_write_file(uint8_t file_id, uint8_t offset, const uint8_t* buffer, uint8_t length);
+bool fs_is_read_allowed(uint8_t file_id, fs_role_t role);
+bool fs_is_write_allowed(uint8_t file_id, fs_role_t role);
+/*! \brief Returns true when the file can be used as action file of another file, by a request in the given role */
+bool fs_is_action_file_allowed(uint8_t file_id, uint8_t action_file_id, fs_role_t role);
+/*! \brief Reads an access profile, returns false when the profile is not defined or contains an invalid channel header */
+bool fs_read_access_class(uint8_t access_class_index, dae_access_profile_t* access_class);
 void fs_read_uid(uint8_t* buffer);
+/*! \brief Reads the VID from the DLL configuration file, returns false when no VID is assigned (VID 0xFFFF) */
+bool fs_read_vid(uint8_t* buffer);
+uint8_t fs_read_dll_conf_active_access_class();
+void fs_read_nwl_security_key(uint8_t* key);
+void fs_read_nwl_security(uint8_t* key_counter, uint32_t* frame_counter);
+void fs_write_nwl_security_frame_counter(uint32_t frame_counter);
+void fs_register_file_modified_callback(fs_file_modified_callback_t callback);
 #endif /* FS_H_ */
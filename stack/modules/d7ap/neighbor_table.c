@@ -0,0 +1,206 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "string.h"
+
+#include "neighbor_table.h"
+#include "debug.h"
+#include "ng.h"
+
+#define NO_ENTRY 0xFF
+
+// weight of a new sample in the moving averages is 1/2^EWMA_SHIFT
+#define EWMA_SHIFT 3
+
+// the averages are kept in 1/16 units to keep enough resolution
+#define FIXED_POINT_SHIFT 4
+
+static neighbor_t NGDEF(_neighbors)[MODULE_D7AP_NEIGHBOR_TABLE_SIZE];
+#define neighbors NG(_neighbors)
+
+static uint8_t NGDEF(_neighbors_count);
+#define neighbors_count NG(_neighbors_count)
+
+// the neighbors are hashed on their address, neighbors with the same hash are chained using next_neighbor
+static uint8_t NGDEF(_hash_buckets)[MODULE_D7AP_NEIGHBOR_TABLE_SIZE];
+#define hash_buckets NG(_hash_buckets)
+
+static uint8_t NGDEF(_next_neighbor)[MODULE_D7AP_NEIGHBOR_TABLE_SIZE];
+#define next_neighbor NG(_next_neighbor)
+
+static inline uint8_t get_address_size(bool address_is_vid)
+{
+    return address_is_vid? 2 : 8;
+}
+
+static uint8_t get_hash(uint8_t const* address, bool address_is_vid)
+{
+    uint8_t hash = address_is_vid;
+    for(uint8_t i = 0; i < get_address_size(address_is_vid); i++)
+        hash = (hash * 31) + address[i];
+
+    return hash % MODULE_D7AP_NEIGHBOR_TABLE_SIZE;
+}
+
+static uint8_t find_neighbor_index(uint8_t const* address, bool address_is_vid)
+{
+    uint8_t index = hash_buckets[get_hash(address, address_is_vid)];
+    while(index != NO_ENTRY)
+    {
+        if(neighbors[index].address_is_vid == address_is_vid
+                && memcmp(neighbors[index].address, address, get_address_size(address_is_vid)) == 0)
+            return index;
+
+        index = next_neighbor[index];
+    }
+
+    return NO_ENTRY;
+}
+
+static void unlink_neighbor(uint8_t index)
+{
+    uint8_t* link = &hash_buckets[get_hash(neighbors[index].address, neighbors[index].address_is_vid)];
+    while(*link != index)
+    {
+        assert(*link != NO_ENTRY);
+        link = &next_neighbor[*link];
+    }
+
+    *link = next_neighbor[index];
+}
+
+static uint8_t add_neighbor(uint8_t const* address, bool address_is_vid)
+{
+    uint8_t index;
+    if(neighbors_count < MODULE_D7AP_NEIGHBOR_TABLE_SIZE)
+    {
+        index = neighbors_count;
+        neighbors_count++;
+    }
+    else
+    {
+        // table full, replace the neighbor which was heard least recently
+        timer_tick_t now = timer_get_counter_value();
+        index = 0;
+        for(uint8_t i = 1; i < neighbors_count; i++)
+        {
+            if(now - neighbors[i].last_heard > now - neighbors[index].last_heard)
+                index = i;
+        }
+
+        unlink_neighbor(index);
+    }
+
+    neighbors[index] = (neighbor_t){ .address_is_vid = address_is_vid };
+    memcpy(neighbors[index].address, address, get_address_size(address_is_vid));
+
+    uint8_t hash = get_hash(address, address_is_vid);
+    next_neighbor[index] = hash_buckets[hash];
+    hash_buckets[hash] = index;
+    return index;
+}
+
+void neighbor_table_init()
+{
+    neighbors_count = 0;
+    memset(hash_buckets, NO_ENTRY, sizeof(hash_buckets));
+}
+
+void neighbor_table_update(uint8_t const* address, bool address_is_vid, int16_t rssi, uint8_t lqi, int8_t tx_eirp)
+{
+    uint8_t index = find_neighbor_index(address, address_is_vid);
+    bool is_new = index == NO_ENTRY;
+    if(is_new)
+        index = add_neighbor(address, address_is_vid);
+
+    neighbor_t* neighbor = &neighbors[index];
+    int16_t rssi_sample = rssi * (1 << FIXED_POINT_SHIFT);
+    uint16_t lqi_sample = lqi << FIXED_POINT_SHIFT;
+    int16_t path_loss_sample = (tx_eirp - rssi) * (1 << FIXED_POINT_SHIFT);
+    if(is_new)
+    {
+        neighbor->rssi = rssi_sample;
+        neighbor->lqi = lqi_sample;
+        neighbor->path_loss = path_loss_sample;
+    }
+    else
+    {
+        neighbor->rssi += (rssi_sample - neighbor->rssi) / (1 << EWMA_SHIFT);
+        neighbor->lqi += ((int16_t)lqi_sample - (int16_t)neighbor->lqi) / (1 << EWMA_SHIFT);
+        neighbor->path_loss += (path_loss_sample - neighbor->path_loss) / (1 << EWMA_SHIFT);
+    }
+
+    neighbor->last_heard = timer_get_counter_value();
+    if(neighbor->frame_count < UINT16_MAX)
+        neighbor->frame_count++;
+}
+
+neighbor_t const* neighbor_table_find(uint8_t const* address, bool address_is_vid)
+{
+    uint8_t index = find_neighbor_index(address, address_is_vid);
+    if(index == NO_ENTRY)
+        return NULL;
+
+    return &neighbors[index];
+}
+
+uint8_t neighbor_table_get_count()
+{
+    return neighbors_count;
+}
+
+neighbor_t const* neighbor_table_get(uint8_t index)
+{
+    assert(index < neighbors_count);
+    return &neighbors[index];
+}
+
+static void serialize_neighbor(uint8_t index, uint8_t* data)
+{
+    memset(data, 0, NEIGHBOR_TABLE_FILE_ENTRY_SIZE);
+    if(index >= neighbors_count)
+        return; // unused entries are all zeros
+
+    neighbor_t* neighbor = &neighbors[index];
+    memcpy(data, neighbor->address, 8); data += 8;
+    (*data) = neighbor->address_is_vid; data++;
+    (*data) = (uint8_t)(-(neighbor->rssi >> FIXED_POINT_SHIFT)); data++; // in -dBm, as the RSSI in D7A
+    (*data) = neighbor->lqi >> FIXED_POINT_SHIFT; data++;
+    (*data) = (uint8_t)(neighbor->path_loss >> FIXED_POINT_SHIFT); data++;
+    uint32_t last_heard = __builtin_bswap32(neighbor->last_heard);
+    memcpy(data, &last_heard, 4); data += 4;
+    uint16_t frame_count = __builtin_bswap16(neighbor->frame_count);
+    memcpy(data, &frame_count, 2);
+}
+
+void neighbor_table_read_file(uint8_t offset, uint8_t* buffer, uint8_t length)
+{
+    assert(offset + length <= NEIGHBOR_TABLE_FILE_SIZE);
+    uint8_t entry[NEIGHBOR_TABLE_FILE_ENTRY_SIZE];
+    while(length > 0)
+    {
+        uint8_t entry_offset = offset % NEIGHBOR_TABLE_FILE_ENTRY_SIZE;
+        uint8_t size = NEIGHBOR_TABLE_FILE_ENTRY_SIZE - entry_offset;
+        if(size > length)
+            size = length;
+
+        serialize_neighbor(offset / NEIGHBOR_TABLE_FILE_ENTRY_SIZE, entry);
+        memcpy(buffer, entry + entry_offset, size);
+        buffer += size; offset += size; length -= size;
+    }
+}
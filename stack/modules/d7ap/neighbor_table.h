@@ -0,0 +1,75 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*! \file neighbor_table.h
+ * \addtogroup neighbor_table
+ * \ingroup D7AP
+ * @{
+ * \brief Keeps track of the link quality of the nodes we have received frames from, identified by their origin UID or VID.
+ *
+ * The table has a fixed size (D7AP_NEIGHBOR_TABLE_SIZE), when full the neighbor which was heard least recently is replaced.
+ * The table can be read by the application using this API, or remotely by reading the neighbor table file using ALP.
+ */
+
+#ifndef OSS_7_NEIGHBOR_TABLE_H
+#define OSS_7_NEIGHBOR_TABLE_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#include "timer.h"
+#include "MODULE_D7AP_defs.h"
+
+/*! The size of a neighbor in the neighbor table file: address (8), address is VID (1), RSSI (1), LQI (1), path loss (1),
+ * last heard (4) and frame count (2) */
+#define NEIGHBOR_TABLE_FILE_ENTRY_SIZE 18
+#define NEIGHBOR_TABLE_FILE_SIZE (NEIGHBOR_TABLE_FILE_ENTRY_SIZE * MODULE_D7AP_NEIGHBOR_TABLE_SIZE)
+
+typedef struct
+{
+    uint8_t address[8]; /**< The UID, or the VID in the first 2 bytes */
+    bool address_is_vid;
+    int16_t rssi; /**< Exponentially weighted moving average of the RSSI, in 1/16 dBm */
+    uint16_t lqi; /**< Exponentially weighted moving average of the LQI, in 1/16 */
+    int16_t path_loss; /**< Exponentially weighted moving average of the path loss (EIRP of the neighbor - RSSI), in 1/16 dB */
+    timer_tick_t last_heard; /**< The timer value at which the last frame of this neighbor was received */
+    uint16_t frame_count; /**< The number of frames received from this neighbor, saturates at UINT16_MAX */
+} neighbor_t;
+
+void neighbor_table_init();
+
+/*! \brief Updates the link quality of the neighbor after receiving a frame, the neighbor is added when not known yet.
+ * The tx_eirp is the transmission power the neighbor advertised in the frame, used to calculate the path loss.
+ */
+void neighbor_table_update(uint8_t const* address, bool address_is_vid, int16_t rssi, uint8_t lqi, int8_t tx_eirp);
+
+/*! \brief Returns the neighbor with the specified address, or NULL when not known */
+neighbor_t const* neighbor_table_find(uint8_t const* address, bool address_is_vid);
+
+/*! \brief Returns the number of neighbors in the table, which can be retrieved using neighbor_table_get() */
+uint8_t neighbor_table_get_count();
+
+/*! \brief Returns the neighbor at index, with index < neighbor_table_get_count() */
+neighbor_t const* neighbor_table_get(uint8_t index);
+
+/*! \brief Reads the neighbor table in the neighbor table file format, used by fs for reads of the neighbor table file */
+void neighbor_table_read_file(uint8_t offset, uint8_t* buffer, uint8_t length);
+
+#endif //OSS_7_NEIGHBOR_TABLE_H
+
+/** @}*/
@@ -19,8 +19,10 @@
 #include "packet.h"
 #include "packet_queue.h"
 #include "crc.h"
+#include "debug.h"
 #include "log.h"
 #include "d7asp.h"
+#include "neighbor_table.h"
 
 #ifdef FRAMEWORK_LOG_ENABLED
 #define DPRINT(...) log_print_stack_string(__VA_ARGS__)
@@ -30,33 +32,86 @@
 
 void packet_init(packet_t* packet)
 {
-    // TODO
+    packet->response_slot_window = 0;
+}
+
+// a DLL header with an 8 byte target address, and a D7ANP header with a relay, destination and origin UID and the
+// security header
+#define LOWER_LAYER_HEADERS_MAX_SIZE 42
+_Static_assert(LOWER_LAYER_HEADERS_MAX_SIZE >= 2 + 8 + 2 + 8 + 8 + 8 + NLS_SECURITY_HEADER_SIZE,
+               "LOWER_LAYER_HEADERS_MAX_SIZE too small for the DLL and D7ANP headers");
+
+// the frame, including the length byte and the CRC, has to fit in the data of the packet
+#define FRAME_MAX_SIZE ((int)sizeof(((packet_t*)0)->__data))
+
+static uint8_t* assemble_relayed_packet(packet_t* packet)
+{
+    // only the DLL and D7ANP headers are assembled again, the remainder of the received frame is moved in
+    // place when the size of the headers changed
+    uint8_t headers[LOWER_LAYER_HEADERS_MAX_SIZE];
+    uint8_t headers_size = dll_assemble_packet_header(packet, headers);
+    headers_size += d7anp_assemble_packet_header(packet, headers + headers_size);
+
+    uint8_t* data = packet->hw_radio_packet.data;
+    uint8_t upper_layer_size = packet->hw_radio_packet.length + 1 - 2 - packet->upper_layer_data_idx;
+    assert(1 + headers_size + upper_layer_size + 2 <= FRAME_MAX_SIZE);
+    memmove(data + 1 + headers_size, data + packet->upper_layer_data_idx, upper_layer_size);
+    memcpy(data + 1, headers, headers_size);
+    packet->upper_layer_data_idx = 1 + headers_size;
+    return data + 1 + headers_size + upper_layer_size;
 }
 
 void packet_assemble(packet_t* packet)
 {
     uint8_t* data_ptr = packet->hw_radio_packet.data + 1; // skip length field for now, we fill this later
+    if(packet->is_relayed)
+    {
+        data_ptr = assemble_relayed_packet(packet);
+    }
+    else
+    {
+        data_ptr += dll_assemble_packet_header(packet, data_ptr);
 
-    data_ptr += dll_assemble_packet_header(packet, data_ptr);
+        data_ptr += d7anp_assemble_packet_header(packet, data_ptr);
 
-    data_ptr += d7anp_assemble_packet_header(packet, data_ptr);
+        uint8_t* upper_layer_data = data_ptr;
+        data_ptr += d7atp_assemble_packet_header(packet, data_ptr);
 
-    data_ptr += d7atp_assemble_packet_header(packet, data_ptr);
+        // add payload
+        assert(data_ptr - packet->hw_radio_packet.data + packet->payload_length + d7anp_get_footer_size(packet) + 2 <= FRAME_MAX_SIZE);
+        memcpy(data_ptr, packet->payload, packet->payload_length); data_ptr += packet->payload_length;
 
-    // add payload
-    memcpy(data_ptr, packet->payload, packet->payload_length); data_ptr += packet->payload_length;
-    packet->hw_radio_packet.length = data_ptr - packet->hw_radio_packet.data - 1 + 2; // exclude the length byte and add CRC bytes
+        // the network protocol footer contains the MIC, relayed frames keep the one of the origin
+        if(packet->d7anp_ctrl.nls_enabled)
+            data_ptr += d7anp_secure_packet(packet, upper_layer_data, data_ptr - upper_layer_data);
+    }
 
-    // TODO network protocol footer
+    packet->hw_radio_packet.length = data_ptr - packet->hw_radio_packet.data - 1 + 2; // exclude the length byte and add CRC bytes
 
     // add CRC
     uint16_t crc = __builtin_bswap16(crc_calculate(packet->hw_radio_packet.data, packet->hw_radio_packet.length - 2));
     memcpy(data_ptr, &crc, 2);
 }
 
+static void update_neighbor_table(packet_t* packet)
+{
+    // the origin of a relayed frame is not the node which transmitted it
+    if(packet->d7anp_ctrl.hop_enabled && packet->d7anp_hop_ctrl.relay_access_id_present)
+        neighbor_table_update(packet->relay_access_id, false, packet->hw_radio_packet.rx_meta.rssi,
+                              packet->hw_radio_packet.rx_meta.lqi, dll_get_eirp(&packet->dll_header));
+    else if(packet->d7anp_ctrl.origin_access_id_present)
+        neighbor_table_update(packet->origin_access_id, packet->d7anp_ctrl.origin_access_id_is_vid,
+                              packet->hw_radio_packet.rx_meta.rssi, packet->hw_radio_packet.rx_meta.lqi,
+                              dll_get_eirp(&packet->dll_header));
+}
+
 void packet_disassemble(packet_t* packet)
 {
-    log_print_data(packet->hw_radio_packet.data, packet->hw_radio_packet.length + 1); // TODO tmp
+    if(packet->hw_radio_packet.length < 2)
+    {
+        DPRINT(LOG_STACK_DLL, "Packet too short (%i), no room for CRC", packet->hw_radio_packet.length);
+        goto cleanup;
+    }
 
     uint16_t crc = __builtin_bswap16(crc_calculate(packet->hw_radio_packet.data, packet->hw_radio_packet.length - 2));
     if(memcmp(&crc, packet->hw_radio_packet.data + packet->hw_radio_packet.length + 1 - 2, 2) != 0)
@@ -80,16 +135,29 @@ void packet_disassemble(packet_t* packet)
         goto cleanup;
     }
 
+    // frames which hop are relayed or dropped by D7ANP when we are not the destination
+    if(packet->d7anp_ctrl.hop_enabled && !d7anp_process_hopping(packet, data_idx))
+        return;
+
+    // relays forward secured frames as they are, only the destination decrypts them
+    if(packet->d7anp_ctrl.nls_enabled && !d7anp_unsecure_packet(packet, data_idx))
+    {
+        DPRINT(LOG_STACK_NWL, "unsecuring frame failed");
+        goto cleanup;
+    }
+
     if(!d7atp_disassemble_packet_header(packet, &data_idx))
     {
         DPRINT(LOG_STACK_TRANS, "disassemble header failed");
         goto cleanup;
     }
 
-    // TODO footers
+    // only accepted frames count, a frame with a spoofed origin would otherwise change the link quality of that node
+    update_neighbor_table(packet);
+    d7anp_signal_packet_accepted(packet);
 
     // extract payload
-    packet->payload_length = packet->hw_radio_packet.length + 1 - data_idx - 2; // exclude the headers CRC bytes // TODO exclude footers
+    packet->payload_length = packet->hw_radio_packet.length + 1 - data_idx - 2; // exclude the headers CRC bytes, the MIC was already removed by D7ANP
     memcpy(packet->payload, packet->hw_radio_packet.data + data_idx, packet->payload_length);
 
     DPRINT(LOG_STACK_FWK, "Done disassembling packet");
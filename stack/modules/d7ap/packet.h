@@ -38,8 +38,13 @@
 struct packet
 {
     dll_header_t dll_header;
+    d7atp_addressee_t dll_addressee; // the addressee of the frame on the DLL, the next hop when the frame is relayed
     d7anp_ctrl_t d7anp_ctrl;
+    d7anp_hop_ctrl_t d7anp_hop_ctrl;
+    uint8_t relay_access_id[8];
+    uint8_t destination_access_id[8];
     uint8_t origin_access_id[8];
+    d7anp_security_t d7anp_security;
     d7atp_ctrl_t d7atp_ctrl;
     d7atp_addressee_t* d7atp_addressee;
     d7atp_ack_template_t d7atp_ack_template;
@@ -47,6 +52,10 @@ struct packet
     uint8_t d7atp_transaction_id;
     // TODO d7atp ack template
     uint8_t d7atp_timeout_template;
+    bool is_retransmission; // set by D7ASP when the request is retried because no acknowledgement was received
+    bool is_relayed; // set by D7ANP when relaying a received frame, the upper layer part of the frame is sent as received
+    uint16_t response_slot_window; // set by D7ATP when responding to a broadcast request: the response is sent in a slot within this time
+    uint8_t upper_layer_data_idx; // when relaying: the index in hw_radio_packet.data at which the D7ATP header starts
     uint8_t payload_length;
     uint8_t payload[239]; // TODO make max size configurable using cmake
                             // TODO store payload here or only pointer to file where we need to fetch it? can we assume data will not be changed in between
@@ -58,6 +67,16 @@ struct packet
 };
 
 
+/*! \brief Checks if at least 'length' header or payload bytes are left in the received frame, starting from data_idx.
+ *  The CRC bytes at the end of the frame are not taken into account. Used by the disassemble functions of all layers
+ *  so that truncated or malformed frames received over the air are dropped instead of being parsed beyond the frame.
+ */
+static inline bool packet_has_bytes_remaining(packet_t* packet, uint8_t data_idx, uint8_t length)
+{
+    // data[0] is the length byte, the last 2 bytes are the CRC
+    return (int16_t)data_idx + length <= (int16_t)packet->hw_radio_packet.length - 1;
+}
+
 void packet_init(packet_t*);
 void packet_assemble(packet_t*);
 void packet_disassemble(packet_t*);
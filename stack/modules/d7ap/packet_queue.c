@@ -57,7 +57,8 @@ packet_t* packet_queue_alloc_packet()
         }
     }
 
-    assert(false); // should not happen, possible to small PACKET_QUEUE_SIZE or not always free()-ed correctly?
+    log_print_stack_string(LOG_STACK_FWK, "Packet queue full"); // possible to small PACKET_QUEUE_SIZE or not always free()-ed correctly?
+    return NULL;
 }
 
 void packet_queue_free_packet(packet_t* packet)
@@ -31,7 +31,7 @@
 /*! Initializes the packet queue */
 void packet_queue_init();
 
-/*! Returns the first free packet buffer in the queue and marks this as used until this is free()-ed again */
+/*! Returns the first free packet buffer in the queue and marks this as used until this is free()-ed again. Returns NULL when the queue is full */
 packet_t* packet_queue_alloc_packet();
 
 /*! Marks the packet buffer as free again */
@@ -0,0 +1,68 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "phy.h"
+#include "debug.h"
+
+#define SYNCWORD_SIZE 2
+
+// time the radio needs to switch from RX or IDLE to TX, without calibration
+#define TURNAROUND_TIME_US 100
+
+/*! The PHY parameters of a channel class, indexed by phy_channel_class_t */
+typedef struct
+{
+    uint32_t bitrate; // bits per second
+    uint8_t preamble_size; // bytes
+    int8_t sensitivity; // dBm
+} channel_class_params_t;
+
+static const channel_class_params_t channel_class_params[] = {
+    [PHY_CLASS_LO_RATE] = { .bitrate = 9600, .preamble_size = 4, .sensitivity = -100 },
+    [PHY_CLASS_NORMAL_RATE] = { .bitrate = 55555, .preamble_size = 4, .sensitivity = -95 },
+    [PHY_CLASS_HI_RATE] = { .bitrate = 166667, .preamble_size = 6, .sensitivity = -90 },
+};
+
+// the turnaround time in timer ticks, rounded up
+#define TURNAROUND_TIME_TICKS ((TURNAROUND_TIME_US * (uint32_t)TIMER_TICKS_PER_SEC + 999999) / 1000000)
+
+static uint16_t get_encoded_size(phy_coding_t coding, uint16_t frame_size)
+{
+    if(coding != PHY_CODING_FEC_PN9)
+        return frame_size;
+
+    // rate 1/2 convolutional code, including trellis termination and padding to the 4 bytes interleaver blocks: 2N + 4
+    // bytes for an even frame size N, 2N + 6 bytes for an odd one
+    return ((frame_size + 3) / 2) * 4;
+}
+
+timer_tick_t phy_calculate_tx_duration(phy_channel_header_t channel_header, uint16_t frame_size)
+{
+    assert(channel_header.ch_class != 1); // RFU
+    const channel_class_params_t* params = &channel_class_params[channel_header.ch_class];
+    uint32_t bits = (params->preamble_size + SYNCWORD_SIZE + get_encoded_size(channel_header.ch_coding, frame_size)) * 8;
+
+    // integer division rounding up, bits * ticks per second fits in 32 bits for frames up to PHY_MAX_FRAME_SIZE
+    return (bits * TIMER_TICKS_PER_SEC + params->bitrate - 1) / params->bitrate + TURNAROUND_TIME_TICKS;
+}
+
+int8_t phy_get_sensitivity(phy_channel_header_t channel_header)
+{
+    assert(channel_header.ch_class != 1); // RFU
+    return channel_class_params[channel_header.ch_class].sensitivity;
+}
@@ -0,0 +1,56 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*! \file phy.h
+ * \addtogroup PHY
+ * \ingroup D7AP
+ * @{
+ * \brief Airtime model of the D7A PHY, used by the upper layers to calculate the time a frame occupies the channel.
+ *
+ */
+
+#ifndef OSS_7_PHY_H
+#define OSS_7_PHY_H
+
+#include "stdint.h"
+
+#include "hwradio.h"
+#include "timer.h"
+
+/*! The maximum size of a frame, including the length byte */
+#define PHY_MAX_FRAME_SIZE 256
+
+/*! \brief Calculates the time the transmission of a frame takes, including the preamble, sync word, FEC
+ * expansion and the turnaround time of the radio, rounded up to timer ticks.
+ *
+ * \param channel_header    The channel header of the channel the frame is transmitted on
+ * \param frame_size        The size of the frame, including the length byte and CRC
+ * \return timer_tick_t     The duration of the transmission in timer ticks
+ */
+timer_tick_t phy_calculate_tx_duration(phy_channel_header_t channel_header, uint16_t frame_size);
+
+/*! \brief Returns the minimum signal level at which frames on a channel of this class are typically received
+ *
+ * \param channel_header    The channel header of the channel
+ * \return int8_t           The receiver sensitivity in dBm
+ */
+int8_t phy_get_sensitivity(phy_channel_header_t channel_header);
+
+#endif //OSS_7_PHY_H
+
+/** @}*/
@@ -0,0 +1,380 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the ALP codec against test vectors: the expected action of every vector has to encode to the bytes of the
+ * vector, and the bytes have to parse to an action which encodes to the same bytes again. Every truncation of a vector
+ * has to be rejected by the parser and the encoder. Then requests are processed as if received, checking the responses,
+ * the file permissions of the guest and user roles, the action files and the size of the responses.
+ *
+ * Usage:
+ *   alp_codec_test                 runs the test vectors and the requests
+ *   alp_codec_test bench <count>   measures the actions per second which are parsed and encoded, and processed
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+
+#include "sim.h"
+#include "d7ap_stack.h"
+#include "neighbor_table.h"
+
+#define USER_FILE_ID 0x40 // written by guests, triggers the action in ACTION_FILE_ID when enabled
+#define ACTION_FILE_ID 0x41
+#define USER_FILE_SIZE 4
+
+#define VECTOR_SIZE_MAX 16
+
+typedef struct {
+    char const* name;
+    uint8_t bytes[VECTOR_SIZE_MAX];
+    uint8_t length;
+    alp_action_t action;
+} vector_t;
+
+static const uint8_t mask[] = { 0xFF, 0x0F };
+static const uint8_t value[] = { 0x12, 0x34 };
+static const uint8_t token[] = { 'a', 'b' };
+static const uint8_t file_data[] = { 0xAB, 0xCD };
+
+static const vector_t vectors[] = {
+    {
+        "nop", { 0x00 }, 1,
+        { .ctrl = { .operation = ALP_OP_NOP } }
+    },
+    {
+        "read file data", { 0x01, 0x40, 0x00, 0x04 }, 4,
+        { .ctrl = { .operation = ALP_OP_READ_FILE_DATA },
+          .file_data_request = { .file_offset = { .file_id = 0x40, .offset = 0 }, .requested_data_length = 4 } }
+    },
+    {
+        "read file data, 2 byte offset and length", { 0x41, 0x30, 0x41, 0x00, 0x40, 0x64 }, 6,
+        { .ctrl = { .operation = ALP_OP_READ_FILE_DATA, .response_requested = true },
+          .file_data_request = { .file_offset = { .file_id = 0x30, .offset = 0x100 }, .requested_data_length = 100 } }
+    },
+    {
+        "read file data, 4 byte offset and 3 byte length", { 0x01, 0x40, 0xC1, 0x00, 0x00, 0x00, 0xBF, 0xFF, 0xFF }, 9,
+        { .ctrl = { .operation = ALP_OP_READ_FILE_DATA },
+          .file_data_request = { .file_offset = { .file_id = 0x40, .offset = 0x1000000 }, .requested_data_length = 0x3FFFFF } }
+    },
+    {
+        "read file properties", { 0x02, 0x0A }, 2,
+        { .ctrl = { .operation = ALP_OP_READ_FILE_PROPERTIES }, .file_id = 0x0A }
+    },
+    {
+        "write file data", { 0x04, 0x40, 0x02, 0x02, 0xAB, 0xCD }, 6,
+        { .ctrl = { .operation = ALP_OP_WRITE_FILE_DATA },
+          .file_data = { .file_offset = { .file_id = 0x40, .offset = 2 }, .provided_data_length = 2, .data = file_data } }
+    },
+    {
+        "write file properties", { 0x06, 0x40, 0x36, 0x05, 0x41, 0xFF, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x04 }, 14,
+        { .ctrl = { .operation = ALP_OP_WRITE_FILE_PROPERTIES },
+          .file_header = { .file_id = 0x40, .permissions = 0x36, .properties = 0x05, .action_file_id = 0x41,
+                           .interface_file_id = 0xFF, .file_size = 4, .allocated_size = 4 } }
+    },
+    {
+        "action query, compare with masked value", { 0x08, 0x51, 0x02, 0xFF, 0x0F, 0x12, 0x34, 0x40, 0x00 }, 9,
+        { .ctrl = { .operation = ALP_OP_ACTION_QUERY },
+          .query = { .code_raw = 0x51, // compare with value, mask present, equality
+                     .compare_length = 2, .mask = mask, .compare_value = value, .file_offset = { .file_id = 0x40, .offset = 0 } } }
+    },
+    {
+        "break query, compare files", { 0x09, 0x64, 0x01, 0x40, 0x00, 0x41, 0x01 }, 7,
+        { .ctrl = { .operation = ALP_OP_BREAK_QUERY },
+          .query = { .code_raw = 0x64, // compare between files, greater than
+                     .compare_length = 1, .file_offset = { .file_id = 0x40, .offset = 0 },
+                     .compare_file_offset = { .file_id = 0x41, .offset = 1 } } }
+    },
+    {
+        "action query, token search with 1 error allowed", { 0x08, 0xE1, 0x02, 'a', 'b', 0x40, 0x00 }, 7,
+        { .ctrl = { .operation = ALP_OP_ACTION_QUERY },
+          .query = { .code_raw = 0xE1, .compare_length = 2, .compare_value = token,
+                     .file_offset = { .file_id = 0x40, .offset = 0 } } }
+    },
+    {
+        "exist file, group", { 0x90, 0x40 }, 2,
+        { .ctrl = { .operation = ALP_OP_EXIST_FILE, .group = true }, .file_id = 0x40 }
+    },
+    {
+        "create file", { 0x11, 0x42, 0x24, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00 }, 14,
+        { .ctrl = { .operation = ALP_OP_CREATE_FILE },
+          .file_header = { .file_id = 0x42, .permissions = 0x24, .properties = 0x00, .action_file_id = 0xFF,
+                           .interface_file_id = 0xFF, .file_size = 0x100, .allocated_size = 0x100 } }
+    },
+    {
+        "copy file", { 0x17, 0x40, 0x41 }, 3,
+        { .ctrl = { .operation = ALP_OP_COPY_FILE }, .file_copy = { .source_file_id = 0x40, .destination_file_id = 0x41 } }
+    },
+    {
+        "return file data", { 0x20, 0x40, 0x00, 0x02, 0xAB, 0xCD }, 6,
+        { .ctrl = { .operation = ALP_OP_RETURN_FILE_DATA },
+          .file_data = { .file_offset = { .file_id = 0x40, .offset = 0 }, .provided_data_length = 2, .data = file_data } }
+    },
+    {
+        "return status", { 0x22, 0x01, 0xFC }, 3,
+        { .ctrl = { .operation = ALP_OP_RETURN_STATUS },
+          .status = { .action_index = 1, .status_code = ALP_STATUS_INSUFFICIENT_PERMISSIONS } }
+    }
+};
+
+#define VECTORS_COUNT (sizeof(vectors) / sizeof(vectors[0]))
+
+static bool is_encoded_as(const alp_action_t* action, const uint8_t* bytes, uint8_t length)
+{
+    uint8_t buffer[VECTOR_SIZE_MAX];
+    return alp_encode_action(action, buffer, sizeof(buffer)) == length && memcmp(buffer, bytes, length) == 0;
+}
+
+static bool check_vector(const vector_t* vector)
+{
+    if(!is_encoded_as(&vector->action, vector->bytes, vector->length))
+        return false;
+
+    alp_action_t action;
+    uint8_t action_length;
+    if(alp_parse_action(vector->bytes, vector->length, &action, &action_length) != ALP_STATUS_OK
+            || action_length != vector->length || !is_encoded_as(&action, vector->bytes, vector->length))
+        return false;
+
+    // nothing fits in less room than the vector takes
+    uint8_t buffer[VECTOR_SIZE_MAX];
+    for(uint8_t length = 0; length < vector->length; length++)
+    {
+        if(alp_parse_action(vector->bytes, length, &action, &action_length) != ALP_STATUS_OPERAND_INCOMPLETE
+                || alp_encode_action(&vector->action, buffer, length) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+static int run_vectors()
+{
+    int result = EXIT_SUCCESS;
+    for(uint8_t i = 0; i < VECTORS_COUNT; i++)
+        result |= sim_check(check_vector(&vectors[i]), vectors[i].name);
+
+    alp_action_t action;
+    uint8_t action_length;
+    uint8_t permission_request[] = { ALP_OP_PERMISSION_REQUEST, 0x00, 0x00 };
+    result |= sim_check(alp_parse_action(permission_request, sizeof(permission_request), &action, &action_length)
+                        == ALP_STATUS_UNKNOWN_OPERATION, "unsupported operation rejected");
+
+    // the length of the operand of a query type which is not defined is not known
+    uint8_t query[] = { ALP_OP_ACTION_QUERY, 0x80, 0x01, 0x40, 0x00 };
+    result |= sim_check(alp_parse_action(query, sizeof(query), &action, &action_length) == ALP_STATUS_OPERAND_INCOMPLETE,
+                        "undefined query type rejected");
+
+    // the data length exceeds the payload
+    uint8_t write_file_data[] = { ALP_OP_WRITE_FILE_DATA, 0x40, 0x00, 0x40, 0x80, 0x00 };
+    result |= sim_check(alp_parse_action(write_file_data, sizeof(write_file_data), &action, &action_length)
+                        == ALP_STATUS_OPERAND_INCOMPLETE, "data beyond the payload rejected");
+
+    return result;
+}
+
+static void init_user_files()
+{
+    fs_file_header_t file_header = (fs_file_header_t){
+        .file_properties.action_protocol_enabled = 0,
+        .file_properties.storage_class = FS_STORAGE_VOLATILE,
+        .file_properties.permissions = FS_PERMISSION_USER_READ | FS_PERMISSION_USER_WRITE
+                                     | FS_PERMISSION_GUEST_READ | FS_PERMISSION_GUEST_WRITE,
+        .length = USER_FILE_SIZE
+    };
+
+    fs_init_file(USER_FILE_ID, &file_header, NULL);
+
+    // broadcasts the user file
+    alp_action_t alp_action = {
+        .ctrl = { .operation = ALP_OP_READ_FILE_DATA },
+        .file_data_request = {
+            .file_offset = { .file_id = USER_FILE_ID, .offset = 0 },
+            .requested_data_length = USER_FILE_SIZE
+        }
+    };
+
+    d7asp_fifo_config_t fifo_config = {
+        .fifo_ctrl_nls = false,
+        .qos = { .qos_ctrl_resp_mode = SESSION_RESP_MODE_NONE },
+        .addressee = { .addressee_ctrl_has_id = false, .addressee_ctrl_access_class = 0 }
+    };
+
+    fs_init_file_with_D7AActP(ACTION_FILE_ID, &fifo_config, &alp_action);
+}
+
+static void init_stack()
+{
+    dae_access_profile_t access_profile;
+    sim_get_default_access_profile(&access_profile);
+    sim_init(1, 1);
+    sim_init_node(0, &access_profile, &init_user_files, NULL, NULL);
+}
+
+static packet_t packet;
+
+// the NLS methods of requests acting as guest and as user
+#define GUEST NLS_METHOD_NONE
+#define USER NLS_METHOD_AES_CCM_128
+
+// processes the request as received secured using the NLS method, the response is left in the packet
+static bool process_request(const uint8_t* request, uint8_t length, nls_method_t nls_method)
+{
+    d7asp_result_t d7asp_result = { .status = { .nls = nls_method != NLS_METHOD_NONE } };
+    packet.d7anp_ctrl.nls_enabled = nls_method != NLS_METHOD_NONE;
+    packet.d7anp_security.nls_method = nls_method;
+    memcpy(packet.payload, request, length);
+    packet.payload_length = length;
+    return alp_process_received_request(d7asp_result, &packet);
+}
+
+static bool is_response(const uint8_t* response, uint8_t length)
+{
+
+    return packet.payload_length == length && memcmp(packet.payload, response, length) == 0;
+}
+
+// the response of a request for which only a status is returned
+static bool is_status_response(const uint8_t* request, uint8_t length, nls_method_t nls_method, alp_status_code_t status)
+{
+    uint8_t response[] = { ALP_OP_RETURN_STATUS, 0, status };
+    return process_request(request, length, nls_method) && is_response(response, sizeof(response));
+}
+
+static int run_requests()
+{
+    int result = EXIT_SUCCESS;
+    uint8_t read_uid[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8 };
+    result |= sim_check(process_request(read_uid, sizeof(read_uid), GUEST) && packet.payload_length == 4 + 8
+                        && packet.payload[0] == ALP_OP_RETURN_FILE_DATA, "guest reads the UID");
+
+    uint8_t read_key[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_NWL_SECURITY_KEY_FILE_ID, 0, 16 };
+    result |= sim_check(is_status_response(read_key, sizeof(read_key), GUEST, ALP_STATUS_INSUFFICIENT_PERMISSIONS)
+                        && is_status_response(read_key, sizeof(read_key), USER, ALP_STATUS_INSUFFICIENT_PERMISSIONS),
+                        "key not readable by guest and user");
+
+    uint8_t write_frame_counter[] = { ALP_OP_WRITE_FILE_DATA, D7A_FILE_NWL_SECURITY_FILE_ID, 1, 1, 0x00 };
+    result |= sim_check(is_status_response(write_frame_counter, sizeof(write_frame_counter), USER, ALP_STATUS_INSUFFICIENT_PERMISSIONS),
+                        "frame counter not writable by user");
+
+    // a query is not satisfied when the data can not be read, instead of revealing the data
+    uint8_t query_key[] = { ALP_OP_ACTION_QUERY, 0x00, 0x01, D7A_FILE_NWL_SECURITY_KEY_FILE_ID, 0,
+                            ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8 };
+    result |= sim_check(process_request(query_key, sizeof(query_key), USER) && packet.payload_length == 0,
+                        "query on the key not satisfied");
+
+    uint8_t write_dll_conf[] = { ALP_OP_WRITE_FILE_DATA | 0x40, D7A_FILE_DLL_CONF_FILE_ID, 0, 1, 0 };
+    result |= sim_check(is_status_response(write_dll_conf, sizeof(write_dll_conf), GUEST, ALP_STATUS_INSUFFICIENT_PERMISSIONS)
+                        && is_status_response(write_dll_conf, sizeof(write_dll_conf), USER, ALP_STATUS_OK),
+                        "DLL configuration only writable by user");
+
+    // AES-CTR encrypts, but does not authenticate the request
+    result |= sim_check(is_status_response(write_dll_conf, sizeof(write_dll_conf), NLS_METHOD_AES_CTR, ALP_STATUS_INSUFFICIENT_PERMISSIONS),
+                        "request secured using AES-CTR acts as guest");
+
+    // enables the action protocol on write, with the action in the given file
+    uint8_t write_properties[] = { ALP_OP_WRITE_FILE_PROPERTIES | 0x40, D7A_FILE_NWL_SECURITY_FILE_ID, 0x36, 0x05, ACTION_FILE_ID,
+                                   0xFF, 0, 0, 0, 5, 0, 0, 0, 5 };
+    result |= sim_check(is_status_response(write_properties, sizeof(write_properties), USER, ALP_STATUS_INSUFFICIENT_PERMISSIONS),
+                        "properties of the frame counter not writable by user");
+
+    write_properties[1] = USER_FILE_ID;
+    write_properties[9] = write_properties[13] = USER_FILE_SIZE;
+    write_properties[4] = USER_FILE_ID;
+    result |= sim_check(is_status_response(write_properties, sizeof(write_properties), USER, ALP_STATUS_INSUFFICIENT_PERMISSIONS),
+                        "file is not its own action file");
+
+    write_properties[4] = 0x50;
+    result |= sim_check(is_status_response(write_properties, sizeof(write_properties), USER, ALP_STATUS_FILE_ID_NOT_EXISTS),
+                        "action file which does not exist rejected");
+
+    write_properties[4] = ACTION_FILE_ID;
+    result |= sim_check(is_status_response(write_properties, sizeof(write_properties), GUEST, ALP_STATUS_INSUFFICIENT_PERMISSIONS)
+                        && is_status_response(write_properties, sizeof(write_properties), USER, ALP_STATUS_OK),
+                        "action file only configured by user, who can read it");
+
+    uint8_t write_user_file[] = { ALP_OP_WRITE_FILE_DATA | 0x40, USER_FILE_ID, 0, 1, 0x55 };
+    result |= sim_check(is_status_response(write_user_file, sizeof(write_user_file), GUEST, ALP_STATUS_OK),
+                        "guest write executes the action");
+
+    // the action file is overwritten with an interface which is not supported
+    uint8_t write_action_file[] = { ALP_OP_WRITE_FILE_DATA | 0x40, ACTION_FILE_ID, 0, 1, 0x00 };
+    result |= sim_check(is_status_response(write_action_file, sizeof(write_action_file), USER, ALP_STATUS_OK)
+                        && is_status_response(write_user_file, sizeof(write_user_file), GUEST, ALP_STATUS_OPERAND_WRONG_FORMAT),
+                        "invalid action file reported");
+
+    // the neighbor table is larger than a frame, the read is cut off at the room which is left in the frame
+    uint8_t read_neighbor_table[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_NEIGHBOR_TABLE_FILE_ID, 0,
+                                      0x40 | (NEIGHBOR_TABLE_FILE_SIZE >> 8), NEIGHBOR_TABLE_FILE_SIZE & 0xFF };
+    result |= sim_check(process_request(read_neighbor_table, sizeof(read_neighbor_table), GUEST)
+                        && packet.payload_length == D7ASP_PAYLOAD_MAX_LENGTH, "read cut off at the frame size");
+
+    return result;
+}
+
+// every vector is parsed and encoded again, and a request with a query, a read and a write is processed
+static int run_bench(long count)
+{
+    uint8_t buffer[VECTOR_SIZE_MAX];
+    clock_t start = clock();
+    for(long i = 0; i < count; i++)
+    {
+        for(uint8_t j = 0; j < VECTORS_COUNT; j++)
+        {
+            alp_action_t action;
+            uint8_t action_length;
+            alp_parse_action(vectors[j].bytes, vectors[j].length, &action, &action_length);
+            alp_encode_action(&action, buffer, sizeof(buffer));
+        }
+    }
+
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("parsed and encoded %li actions in %.3f s: %.0f actions/s\n", count * VECTORS_COUNT, seconds,
+           seconds > 0? count * VECTORS_COUNT / seconds : 0);
+
+    uint8_t request[] = {
+        ALP_OP_ACTION_QUERY, 0x20, 0x01, D7A_FILE_UID_FILE_ID, 0,
+        ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8,
+        ALP_OP_WRITE_FILE_DATA | 0x40, USER_FILE_ID, 0, 1, 0
+    };
+
+    start = clock();
+    for(long i = 0; i < count; i++)
+        process_request(request, sizeof(request), USER);
+
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("processed %li actions in %.3f s: %.0f actions/s\n", count * 3, seconds, seconds > 0? count * 3 / seconds : 0);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    init_stack();
+    if(argc == 3 && strcmp(argv[1], "bench") == 0)
+        return run_bench(atol(argv[2]));
+
+    if(argc != 1)
+    {
+        printf("usage: %s [bench <count>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    return run_vectors() | run_requests();
+}
@@ -0,0 +1,186 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the evaluation of queries in received requests: arithmetic comparisons with a value, signed and unsigned,
+ * masked and between files, token searches allowing errors, the actions skipped after an action query which is not
+ * satisfied and the request which is not answered when a break query is not satisfied.
+ *
+ * Usage: alp_query_test
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "sim.h"
+#include "d7ap_stack.h"
+
+#define VALUE_FILE_ID 0x40 // holds -2 as a signed 16 bit value, 0xFFFE unsigned
+#define COMPARE_FILE_ID 0x41 // holds 1, followed by the data token searches are done in
+#define TOKEN_OFFSET 2
+
+#define QUERY_CODE(type, mask_present, params) (((type) << 5) | ((mask_present) << 4) | (params))
+#define SIGNED 0x08 // in the params of arithmetic comparisons
+
+#define READ_UID_RESPONSE_LENGTH (4 + 8)
+
+static const uint8_t value_file[] = { 0xFF, 0xFE };
+static const uint8_t compare_file[] = { 0x00, 0x01, 's', 'e', 'n', 's', 'o', 'r', '4', '2' };
+
+static void init_file(uint8_t file_id, const uint8_t* data, uint8_t length)
+{
+    fs_file_header_t file_header = (fs_file_header_t){
+        .file_properties.action_protocol_enabled = 0,
+        .file_properties.storage_class = FS_STORAGE_VOLATILE,
+        .file_properties.permissions = FS_PERMISSION_USER_READ | FS_PERMISSION_GUEST_READ,
+        .length = length
+    };
+
+    fs_init_file(file_id, &file_header, data);
+}
+
+static void init_user_files()
+{
+    init_file(VALUE_FILE_ID, value_file, sizeof(value_file));
+    init_file(COMPARE_FILE_ID, compare_file, sizeof(compare_file));
+}
+
+static void init_stack()
+{
+    dae_access_profile_t access_profile;
+    sim_get_default_access_profile(&access_profile);
+    sim_init(1, 1);
+    sim_init_node(0, &access_profile, &init_user_files, NULL, NULL);
+}
+
+static packet_t packet;
+
+// processes the request as received from a guest, the response is left in the packet
+static bool process_request(const uint8_t* request, uint8_t length)
+{
+    d7asp_result_t d7asp_result = { .status = { .nls = false } };
+    memcpy(packet.payload, request, length);
+    packet.payload_length = length;
+    return alp_process_received_request(d7asp_result, &packet);
+}
+
+// the query is followed by a read of the UID, which is only returned when the query is satisfied
+static bool is_query_satisfied(const uint8_t* query, uint8_t length)
+{
+    uint8_t request[32];
+    uint8_t read_uid[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8 };
+    memcpy(request, query, length);
+    memcpy(request + length, read_uid, sizeof(read_uid));
+    return process_request(request, length + sizeof(read_uid)) && packet.payload_length == READ_UID_RESPONSE_LENGTH;
+}
+
+static int run_comparisons()
+{
+    int result = EXIT_SUCCESS;
+
+    // 0xFFFE < 1 only when the values are signed
+    uint8_t less_than_one[] = { ALP_OP_ACTION_QUERY, QUERY_CODE(ALP_QUERY_TYPE_ARITH_COMP_WITH_VALUE, 0, ALP_QUERY_COMP_TYPE_LESS_THAN),
+                                2, 0x00, 0x01, VALUE_FILE_ID, 0 };
+    result |= sim_check(!is_query_satisfied(less_than_one, sizeof(less_than_one)), "unsigned comparison with value");
+
+    less_than_one[1] |= SIGNED;
+    result |= sim_check(is_query_satisfied(less_than_one, sizeof(less_than_one)), "signed comparison with value");
+
+    uint8_t greater_than_zero[] = { ALP_OP_ACTION_QUERY, QUERY_CODE(ALP_QUERY_TYPE_ARITH_COMP_WITH_ZERO, 0, ALP_QUERY_COMP_TYPE_GREATER_THAN | SIGNED),
+                                    2, VALUE_FILE_ID, 0 };
+    result |= sim_check(!is_query_satisfied(greater_than_zero, sizeof(greater_than_zero)), "signed comparison with zero");
+
+    // only the high nibble of the second byte is compared
+    uint8_t masked_equality[] = { ALP_OP_ACTION_QUERY, QUERY_CODE(ALP_QUERY_TYPE_ARITH_COMP_WITH_VALUE, 1, ALP_QUERY_COMP_TYPE_EQUALITY),
+                                  2, 0xFF, 0xF0, 0xFF, 0xF3, VALUE_FILE_ID, 0 };
+    result |= sim_check(is_query_satisfied(masked_equality, sizeof(masked_equality)), "masked comparison with value");
+
+    masked_equality[4] = 0xFF;
+    result |= sim_check(!is_query_satisfied(masked_equality, sizeof(masked_equality)), "comparison with value using a full mask");
+
+    uint8_t greater_than_file[] = { ALP_OP_ACTION_QUERY, QUERY_CODE(ALP_QUERY_TYPE_ARITH_COMP_BETWEEN_FILES, 0, ALP_QUERY_COMP_TYPE_GREATER_THAN),
+                                    2, VALUE_FILE_ID, 0, COMPARE_FILE_ID, 0 };
+    result |= sim_check(is_query_satisfied(greater_than_file, sizeof(greater_than_file)), "unsigned comparison between files");
+
+    greater_than_file[1] |= SIGNED;
+    result |= sim_check(!is_query_satisfied(greater_than_file, sizeof(greater_than_file)), "signed comparison between files");
+
+    // the compared data ends beyond the file
+    uint8_t beyond_file[] = { ALP_OP_ACTION_QUERY, QUERY_CODE(ALP_QUERY_TYPE_ARITH_COMP_BETWEEN_FILES, 0, ALP_QUERY_COMP_TYPE_INEQUALITY),
+                              2, VALUE_FILE_ID, 1, COMPARE_FILE_ID, 0 };
+    result |= sim_check(!is_query_satisfied(beyond_file, sizeof(beyond_file)), "comparison beyond the file not satisfied");
+
+    return result;
+}
+
+static int run_token_searches()
+{
+    int result = EXIT_SUCCESS;
+    uint8_t search[] = { ALP_OP_ACTION_QUERY, QUERY_CODE(ALP_QUERY_TYPE_STRING_TOKEN_SEARCH, 0, 0), 3, 'o', 'r', '4', COMPARE_FILE_ID, TOKEN_OFFSET };
+    result |= sim_check(is_query_satisfied(search, sizeof(search)), "token found");
+
+    search[4] = 'x';
+    result |= sim_check(!is_query_satisfied(search, sizeof(search)), "token with an error not found without errors allowed");
+
+    search[1] = QUERY_CODE(ALP_QUERY_TYPE_STRING_TOKEN_SEARCH, 0, 1);
+    result |= sim_check(is_query_satisfied(search, sizeof(search)), "token with an error found with 1 error allowed");
+
+    search[3] = 'x';
+    result |= sim_check(!is_query_satisfied(search, sizeof(search)), "token with 2 errors not found with 1 error allowed");
+
+    // the search starts at the offset, "sen" only occurs before it
+    uint8_t search_from_offset[] = { ALP_OP_ACTION_QUERY, QUERY_CODE(ALP_QUERY_TYPE_STRING_TOKEN_SEARCH, 0, 0), 3, 's', 'e', 'n',
+                                     COMPARE_FILE_ID, TOKEN_OFFSET + 1 };
+    result |= sim_check(!is_query_satisfied(search_from_offset, sizeof(search_from_offset)), "token search starts at the offset");
+
+    return result;
+}
+
+static int run_query_flow()
+{
+    int result = EXIT_SUCCESS;
+
+    // the read following the first query is skipped, the one following the second query is executed
+    uint8_t action_queries[] = {
+        ALP_OP_ACTION_QUERY, QUERY_CODE(ALP_QUERY_TYPE_ARITH_COMP_WITH_ZERO, 0, ALP_QUERY_COMP_TYPE_EQUALITY), 2, VALUE_FILE_ID, 0,
+        ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8,
+        ALP_OP_ACTION_QUERY, QUERY_CODE(ALP_QUERY_TYPE_ARITH_COMP_WITH_ZERO, 0, ALP_QUERY_COMP_TYPE_INEQUALITY), 2, VALUE_FILE_ID, 0,
+        ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8
+    };
+    result |= sim_check(process_request(action_queries, sizeof(action_queries)) && packet.payload_length == READ_UID_RESPONSE_LENGTH,
+                        "actions skipped up to the next query");
+
+    uint8_t break_query[] = {
+        ALP_OP_BREAK_QUERY, QUERY_CODE(ALP_QUERY_TYPE_ARITH_COMP_WITH_ZERO, 0, ALP_QUERY_COMP_TYPE_EQUALITY), 2, VALUE_FILE_ID, 0,
+        ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8
+    };
+    result |= sim_check(!process_request(break_query, sizeof(break_query)), "break query not satisfied suppresses the response");
+
+    break_query[1] = QUERY_CODE(ALP_QUERY_TYPE_ARITH_COMP_WITH_ZERO, 0, ALP_QUERY_COMP_TYPE_INEQUALITY);
+    result |= sim_check(process_request(break_query, sizeof(break_query)) && packet.payload_length == READ_UID_RESPONSE_LENGTH,
+                        "break query satisfied answered");
+
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    init_stack();
+    return run_comparisons() | run_token_searches() | run_query_flow();
+}
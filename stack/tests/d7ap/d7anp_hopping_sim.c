@@ -0,0 +1,149 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulates a requester which reaches a responder only through a relay, in a network secured using
+ * MODULE_D7AP_NLS_METHOD. Checks that:
+ * - the request is relayed to the responder, and its response back to the requester
+ * - a request of which the MIC was modified is not relayed, as it fails the verification by the relay
+ *
+ * Built with and without network layer security, see CMakeLists.txt.
+ *
+ * Usage: d7anp_hopping_sim
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "sim.h"
+#include "aes.h"
+#include "crc.h"
+#include "d7ap_stack.h"
+
+#define REQUESTER 0
+#define RELAY 1
+#define RESPONDER 2
+#define NODES_COUNT 3
+
+#define REQUEST_TIMEOUT (10 * TIMER_TICKS_PER_SEC)
+
+static uint8_t request_frame[256];
+
+static void on_frame_transmitted(uint8_t node, hw_radio_packet_t const* packet)
+{
+    if(node == REQUESTER)
+        memcpy(request_frame, packet->data, packet->length + 1);
+}
+
+static void get_uid(uint8_t node, uint8_t* uid)
+{
+    uint64_t uid_value = sim_get_uid(node);
+    for(uint8_t i = 0; i < 8; i++)
+        uid[i] = uid_value >> (56 - 8 * i);
+}
+
+static void init_nodes()
+{
+    sim_init(NODES_COUNT, 1);
+    sim_set_tx_callback(&on_frame_transmitted);
+    sim_set_path_loss(REQUESTER, RESPONDER, 255);
+    for(uint8_t node = 0; node < NODES_COUNT; node++)
+    {
+        sim_init_default_node(node, NULL, NULL);
+
+        uint8_t key[AES_KEY_SIZE];
+        for(uint8_t i = 0; i < sizeof(key); i++)
+            key[i] = 0x40 + i;
+
+        fs_write_file(D7A_FILE_NWL_SECURITY_KEY_FILE_ID, 0, key, sizeof(key));
+    }
+
+    sim_run(TIMER_TICKS_PER_SEC);
+}
+
+// reads the UID of the responder, which is not a known neighbor of the requester
+static bool send_request()
+{
+    d7asp_fifo_config_t fifo_config = {
+        .fifo_ctrl_nls = false,
+        .qos = {
+            .qos_ctrl_resp_mode = SESSION_RESP_MODE_ANYCAST
+        },
+        .addressee = {
+            .addressee_ctrl_has_id = true,
+            .addressee_ctrl_virtual_id = false,
+            .addressee_ctrl_access_class = 0
+        }
+    };
+
+    get_uid(RESPONDER, fifo_config.addressee.addressee_id);
+    uint8_t alp_command[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8 };
+
+    sim_node_stats_t const* stats = sim_get_node_stats(REQUESTER);
+    uint32_t requests_succeeded = stats->requests_succeeded;
+    uint32_t flushes_completed = stats->flushes_completed;
+    timer_tick_t start = sim_get_time();
+    sim_set_node(REQUESTER);
+    if(d7asp_queue_alp_actions(&fifo_config, alp_command, sizeof(alp_command)) != SUCCESS)
+        return false;
+
+    while(stats->flushes_completed == flushes_completed && sim_get_time() - start < REQUEST_TIMEOUT)
+        sim_run(1);
+
+    return stats->requests_succeeded != requests_succeeded;
+}
+
+// injects the frame into the relay, returns true when the relay transmitted a frame
+static bool is_relayed(uint8_t* frame)
+{
+    uint16_t crc = crc_calculate(frame, frame[0] - 2);
+    frame[frame[0] - 1] = crc >> 8;
+    frame[frame[0]] = crc & 0xFF;
+
+    sim_run_until_idle(REQUEST_TIMEOUT);
+    uint32_t frames_transmitted = sim_get_node_stats(RELAY)->frames_transmitted;
+    sim_set_node(RELAY);
+    if(!sim_inject_frame(frame, -60))
+    {
+        printf("relay not in RX\n");
+        exit(EXIT_FAILURE);
+    }
+
+    sim_run_until_idle(REQUEST_TIMEOUT);
+    return sim_get_node_stats(RELAY)->frames_transmitted != frames_transmitted;
+}
+
+int main(int argc, char** argv)
+{
+    int result = EXIT_SUCCESS;
+    init_nodes();
+    result |= sim_check(send_request(), "request relayed and answered");
+    result |= sim_check(sim_get_node_stats(RELAY)->frames_transmitted >= 2, "request and response relayed");
+
+    if(MODULE_D7AP_NLS_METHOD != NLS_METHOD_NONE)
+    {
+        // the MIC is part of the upper layer data, so the relay does not see the frame as a duplicate
+        uint8_t frame[256];
+        memcpy(frame, request_frame, sizeof(frame));
+        frame[frame[0] - 2] ^= 0x01;
+        result |= sim_check(!is_relayed(frame), "request with a modified MIC not relayed");
+    }
+
+    return result;
+}
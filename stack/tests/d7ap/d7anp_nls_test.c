@@ -0,0 +1,300 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Tests the network layer security of D7ANP:
+ * - the CCM implementation against packet vector #1 of RFC 3610
+ * - a dialog secured using MODULE_D7AP_NLS_METHOD, which is only possible after a key is written since boot
+ * - replayed requests are not answered
+ * - for the methods with a MIC, modified and downgraded (AES-CTR instead) requests are not answered, and modified
+ *   requests do not count in the neighbor table
+ *
+ * Built for AES-CCM-128 and AES-CTR, see CMakeLists.txt.
+ *
+ * Usage:
+ *   d7anp_nls_test                 runs the tests
+ *   d7anp_nls_test bench <count>   measures the throughput of securing and verifying maximum size frames
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+
+#include "sim.h"
+#include "aes.h"
+#include "ccm.h"
+#include "crc.h"
+#include "d7ap_stack.h"
+#include "neighbor_table.h"
+
+#define REQUESTER 0
+#define RESPONDER 1
+
+#define REQUEST_TIMEOUT (10 * TIMER_TICKS_PER_SEC)
+
+static uint8_t request_frame[256];
+
+static bool test_ccm_vector()
+{
+    uint8_t key[AES_KEY_SIZE];
+    uint8_t nonce[CCM_NONCE_SIZE] = { 0x00, 0x00, 0x00, 0x03, 0x02, 0x01, 0x00, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5 };
+    uint8_t aad[8];
+    uint8_t data[23 + 8];
+    static const uint8_t expected[23 + 8] = {
+        0x58, 0x8C, 0x97, 0x9A, 0x61, 0xC6, 0x63, 0xD2, 0xF0, 0x66, 0xD0, 0xC2, 0xC0, 0xF9, 0x89, 0x80,
+        0x6D, 0x5F, 0x6B, 0x61, 0xDA, 0xC3, 0x84, 0x17, 0xE8, 0xD1, 0x2C, 0xFD, 0xF9, 0x26, 0xE0
+    };
+
+    for(uint8_t i = 0; i < sizeof(key); i++)
+        key[i] = 0xC0 + i;
+
+    for(uint8_t i = 0; i < sizeof(aad); i++)
+        aad[i] = i;
+
+    for(uint8_t i = 0; i < 23; i++)
+        data[i] = sizeof(aad) + i;
+
+    aes_set_key(key);
+    ccm_calculate_mic(nonce, aad, sizeof(aad), data, 23, 8, data + 23);
+    ccm_ctr_crypt(nonce, data, 23);
+    if(memcmp(data, expected, sizeof(expected)) != 0)
+    {
+        printf("CCM output does not match RFC 3610 packet vector #1\n");
+        return false;
+    }
+
+    // decrypting gives the plaintext again
+    ccm_ctr_crypt(nonce, data, 23);
+    for(uint8_t i = 0; i < 23; i++)
+    {
+        if(data[i] != sizeof(aad) + i)
+        {
+            printf("CCM decryption does not return the plaintext\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void on_frame_transmitted(uint8_t node, hw_radio_packet_t const* packet)
+{
+    if(node == REQUESTER)
+        memcpy(request_frame, packet->data, packet->length + 1);
+}
+
+static void write_key(uint8_t node)
+{
+    uint8_t key[AES_KEY_SIZE];
+    for(uint8_t i = 0; i < sizeof(key); i++)
+        key[i] = 0x40 + i;
+
+    sim_set_node(node);
+    fs_write_file(D7A_FILE_NWL_SECURITY_KEY_FILE_ID, 0, key, sizeof(key));
+}
+
+static bool send_request()
+{
+    d7asp_fifo_config_t fifo_config = {
+        .fifo_ctrl_nls = false,
+        .qos = {
+            .qos_ctrl_resp_mode = SESSION_RESP_MODE_ANYCAST
+        },
+        .addressee = {
+            .addressee_ctrl_has_id = false,
+            .addressee_ctrl_access_class = 0
+        }
+    };
+
+    uint8_t alp_command[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8 };
+
+    sim_node_stats_t const* stats = sim_get_node_stats(REQUESTER);
+    uint32_t requests_succeeded = stats->requests_succeeded;
+    uint32_t flushes_completed = stats->flushes_completed;
+    timer_tick_t start = sim_get_time();
+    sim_set_node(REQUESTER);
+    if(d7asp_queue_alp_actions(&fifo_config, alp_command, sizeof(alp_command)) != SUCCESS)
+        return false;
+
+    while(stats->flushes_completed == flushes_completed && sim_get_time() - start < REQUEST_TIMEOUT)
+        sim_run(1);
+
+    return stats->requests_succeeded != requests_succeeded;
+}
+
+// injects the frame into the responder, returns true when the responder answered it
+static bool is_answered(uint8_t* frame)
+{
+    uint16_t crc = crc_calculate(frame, frame[0] - 2);
+    frame[frame[0] - 1] = crc >> 8;
+    frame[frame[0]] = crc & 0xFF;
+
+    uint32_t frames_transmitted = sim_get_node_stats(RESPONDER)->frames_transmitted;
+    sim_set_node(RESPONDER);
+    if(!sim_inject_frame(frame, -60))
+    {
+        printf("responder not in RX\n");
+        exit(EXIT_FAILURE);
+    }
+
+    sim_run_until_idle(REQUEST_TIMEOUT);
+    return sim_get_node_stats(RESPONDER)->frames_transmitted != frames_transmitted;
+}
+
+static void get_requester_uid(uint8_t* uid)
+{
+    uint64_t uid_value = sim_get_uid(REQUESTER);
+    for(uint8_t i = 0; i < 8; i++)
+        uid[i] = uid_value >> (56 - 8 * i);
+}
+
+// the number of frames of the requester the responder counted in its neighbor table
+static uint16_t get_requester_frame_count()
+{
+    uint8_t uid[8];
+    get_requester_uid(uid);
+    sim_set_node(RESPONDER);
+    neighbor_t const* neighbor = neighbor_table_find(uid, false);
+    return neighbor != NULL? neighbor->frame_count : 0;
+}
+
+// the security header follows the origin UID of the requester
+static uint8_t get_security_header_idx(uint8_t const* frame)
+{
+    uint8_t uid[8];
+    get_requester_uid(uid);
+
+    for(uint8_t i = 1; i + 8 < frame[0]; i++)
+    {
+        if(memcmp(frame + i, uid, 8) == 0)
+            return i + 8;
+    }
+
+    printf("origin not found in request\n");
+    exit(EXIT_FAILURE);
+}
+
+static bool test_secured_dialog()
+{
+    bool result = true;
+    sim_init(2, 1);
+    sim_set_tx_callback(&on_frame_transmitted);
+    sim_init_default_node(REQUESTER, NULL, NULL);
+    sim_init_default_node(RESPONDER, NULL, NULL);
+    sim_run(TIMER_TICKS_PER_SEC);
+
+    if(send_request())
+    {
+        printf("secured request transmitted before a key was written\n");
+        result = false;
+    }
+
+    write_key(REQUESTER);
+    write_key(RESPONDER);
+    if(!send_request())
+    {
+        printf("secured request failed\n");
+        return false;
+    }
+
+    uint8_t frame[256];
+    memcpy(frame, request_frame, sizeof(frame));
+    if(is_answered(frame))
+    {
+        printf("replayed request answered\n");
+        result = false;
+    }
+
+    // AES-CTR has no MIC, so modified requests are not detected
+    if(MODULE_D7AP_NLS_METHOD == NLS_METHOD_AES_CTR)
+        return result;
+
+    // a request with a new frame counter, but of which the last byte of the MIC was modified
+    if(!send_request())
+    {
+        printf("secured request failed\n");
+        return false;
+    }
+
+    memcpy(frame, request_frame, sizeof(frame));
+    frame[frame[0] - 2] ^= 0x01;
+    uint16_t frame_count = get_requester_frame_count();
+    if(is_answered(frame))
+    {
+        printf("modified request answered\n");
+        result = false;
+    }
+
+    if(get_requester_frame_count() != frame_count)
+    {
+        printf("modified request counted in the neighbor table\n");
+        result = false;
+    }
+
+    // the same request, using AES-CTR which has no MIC
+    memcpy(frame, request_frame, sizeof(frame));
+    frame[get_security_header_idx(frame)] = NLS_METHOD_AES_CTR;
+    if(is_answered(frame))
+    {
+        printf("request secured using AES-CTR answered\n");
+        result = false;
+    }
+
+    return result;
+}
+
+static int run_bench(long count)
+{
+    uint8_t key[AES_KEY_SIZE] = { 0 };
+    uint8_t nonce[CCM_NONCE_SIZE] = { 0 };
+    uint8_t aad[1 + 8 + NLS_SECURITY_HEADER_SIZE] = { 0 };
+    uint8_t data[200 + CCM_MIC_MAX_SIZE] = { 0 };
+    uint8_t mic[CCM_MIC_MAX_SIZE];
+    uint8_t size = sizeof(data) - CCM_MIC_MAX_SIZE;
+
+    aes_set_key(key);
+    clock_t start = clock();
+    for(long i = 0; i < count; i++)
+    {
+        nonce[3] = i;
+        ccm_calculate_mic(nonce, aad, sizeof(aad), data, size, CCM_MIC_MAX_SIZE, data + size);
+        ccm_ctr_crypt(nonce, data, size);
+
+        ccm_ctr_crypt(nonce, data, size);
+        ccm_calculate_mic(nonce, aad, sizeof(aad), data, size, CCM_MIC_MAX_SIZE, mic);
+        if(memcmp(mic, data + size, CCM_MIC_MAX_SIZE) != 0)
+            return EXIT_FAILURE;
+    }
+
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("secured and verified %li frames of %i bytes in %.3f s: %.0f frames/s\n", count, size, seconds,
+           seconds > 0? count / seconds : 0);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc == 3 && strcmp(argv[1], "bench") == 0)
+        return run_bench(atol(argv[2]));
+
+    bool result = test_ccm_vector();
+    result = test_secured_dialog() && result;
+    printf("%s\n", result? "passed" : "failed");
+    return result? EXIT_SUCCESS : EXIT_FAILURE;
+}
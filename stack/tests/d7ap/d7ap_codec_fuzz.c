@@ -0,0 +1,189 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Feeds frames through the RX path of the stack: the RX filter, the frame parsing of all layers and the ALP
+ * processing, including the responses this triggers.
+ *
+ * Usage:
+ *   d7ap_codec_fuzz <file>           processes the content of the file as 1 frame, for AFL-style fuzzers
+ *   d7ap_codec_fuzz random <count>   processes count random frames with a valid CRC
+ *   d7ap_codec_fuzz bench <count>    measures the frames per second the RX path processes
+ *
+ * When built with D7AP_TESTS_LIBFUZZER the file is a libFuzzer target instead. The CRC of every frame is
+ * recalculated, otherwise almost no input gets beyond the DLL.
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+
+#include "sim.h"
+#include "crc.h"
+#include "d7ap_stack.h"
+#include "dll.h"
+#include "packet_queue.h"
+
+#define SUBNET 0x05 // of the default access profile of the sim
+
+// longer than any dialog a single frame can start
+#define MAX_DIALOG_DURATION (600 * TIMER_TICKS_PER_SEC)
+
+static bool is_initialized = false;
+
+static void init_stack()
+{
+    sim_init(1, 1);
+    sim_set_log_enabled(getenv("SIMLOG") != NULL);
+    sim_init_default_node(0, NULL, NULL);
+    dll_start_foreground_scan();
+    sim_run(1);
+    is_initialized = true;
+}
+
+// the frame is data prefixed with its length byte and followed by its CRC
+static void process_frame(uint8_t const* data, uint8_t length)
+{
+    uint8_t frame[256];
+    if(length > 253)
+        length = 253;
+
+    frame[0] = length + 2;
+    memcpy(frame + 1, data, length);
+    uint16_t crc = crc_calculate(frame, frame[0] - 2); // covering the same bytes as packet_disassemble() does
+    frame[length + 1] = crc >> 8;
+    frame[length + 2] = crc & 0xFF;
+
+    // the stack returns to the foreground scan after every dialog
+    if(!sim_inject_frame(frame, -60))
+    {
+        printf("radio not in RX\n");
+        abort();
+    }
+
+    if(!sim_run_until_idle(MAX_DIALOG_DURATION))
+    {
+        printf("dialog not completed\n");
+        abort();
+    }
+}
+
+// all packets return to the queue when the stack is done with a frame
+static bool is_packet_queue_empty()
+{
+    packet_t* packets[MODULE_D7AP_PACKET_QUEUE_SIZE];
+    uint8_t count = 0;
+    while(count < MODULE_D7AP_PACKET_QUEUE_SIZE && (packets[count] = packet_queue_alloc_packet()) != NULL)
+        count++;
+
+    for(uint8_t i = 0; i < count; i++)
+        packet_queue_free_packet(packets[i]);
+
+    return count == MODULE_D7AP_PACKET_QUEUE_SIZE;
+}
+
+int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size)
+{
+    if(!is_initialized)
+        init_stack();
+
+    process_frame(data, size > 253? 253 : size);
+    if(!is_packet_queue_empty())
+        abort();
+
+    return 0;
+}
+
+static uint8_t generate_frame(uint8_t* data)
+{
+    uint8_t length = rand() % 64;
+    for(uint8_t i = 0; i < length; i++)
+        data[i] = rand();
+
+    // half of the frames pass the subnet filter
+    if(length > 0 && rand() % 2)
+        data[0] = SUBNET;
+
+    return length;
+}
+
+static int run_random(long count)
+{
+    uint8_t data[64];
+    srand(1);
+    for(long i = 0; i < count; i++)
+    {
+        uint8_t length = generate_frame(data);
+        process_frame(data, length);
+        if(!is_packet_queue_empty())
+        {
+            printf("packet not freed after frame %li\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("processed %li random frames\n", count);
+    return EXIT_SUCCESS;
+}
+
+static int run_bench(long count)
+{
+    uint8_t data[64];
+    srand(1);
+    clock_t start = clock();
+    for(long i = 0; i < count; i++)
+    {
+        uint8_t length = generate_frame(data);
+        process_frame(data, length);
+    }
+
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("processed %li frames in %.3f s: %.0f frames/s\n", count, seconds, seconds > 0? count / seconds : 0);
+    return EXIT_SUCCESS;
+}
+
+#ifndef D7AP_TESTS_LIBFUZZER
+int main(int argc, char** argv)
+{
+    init_stack();
+    if(argc == 3 && strcmp(argv[1], "random") == 0)
+        return run_random(atol(argv[2]));
+
+    if(argc == 3 && strcmp(argv[1], "bench") == 0)
+        return run_bench(atol(argv[2]));
+
+    if(argc != 2)
+    {
+        printf("usage: %s <file> | random <count> | bench <count>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if(file == NULL)
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    uint8_t data[253];
+    size_t size = fread(data, 1, sizeof(data), file);
+    fclose(file);
+    return LLVMFuzzerTestOneInput(data, size);
+}
+#endif
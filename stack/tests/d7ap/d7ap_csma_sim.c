@@ -0,0 +1,194 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulates a number of nodes in range of each other and of a sink, which send broadcast requests without response
+ * at random moments. For every CSMA-CA mode and a range of offered loads it reports:
+ * - the channel access success rate: the requests transmitted, possibly after retries, of all requests
+ * - the mean and maximum channel access delay: the time between queuing a request and the start of its transmission
+ * - the delivery rate: the requests received by the sink, of all requests transmitted
+ *
+ * Usage: d7ap_csma_sim [<duration in seconds>]
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "math.h"
+
+#include "sim.h"
+#include "random.h"
+#include "d7ap_stack.h"
+
+#define SINK 0
+#define SENDERS_COUNT 8
+#define NO_REQUEST 0xFFFFFFFF
+
+static const char* mode_names[] = { "UNC", "AIND", "RAIND", "RIGD" };
+
+// the mean time between the requests of a sender, in ticks
+static const uint32_t mean_intervals[] = { 4096, 1024, 512, 256, 128 };
+
+typedef struct
+{
+    timer_tick_t next_request_time;
+    timer_tick_t request_time; // NO_REQUEST when no request is pending
+    bool is_transmitted;
+} sender_t;
+
+typedef struct
+{
+    uint32_t requests;
+    uint32_t requests_transmitted;
+    uint32_t frames_transmitted;
+    uint64_t total_delay;
+    uint32_t max_delay;
+} results_t;
+
+static sender_t senders[SENDERS_COUNT + 1];
+static results_t results;
+static d7asp_init_args_t d7asp_init_args;
+
+static void on_flush_completed(d7asp_fifo_config_t* fifo_config, uint8_t* progress_bitmap, uint8_t* success_bitmap, uint8_t bitmap_byte_count)
+{
+    senders[sim_get_node()].request_time = NO_REQUEST;
+}
+
+static void on_frame_transmitted(uint8_t node, hw_radio_packet_t const* packet)
+{
+    sender_t* sender = &senders[node];
+    if(node == SINK)
+        return;
+
+    results.frames_transmitted++;
+    if(sender->request_time == NO_REQUEST || sender->is_transmitted)
+        return;
+
+    // the first transmission of a request ends its channel access
+    uint32_t delay = sim_get_time() - sender->request_time;
+    sender->is_transmitted = true;
+    results.requests_transmitted++;
+    results.total_delay += delay;
+    if(delay > results.max_delay)
+        results.max_delay = delay;
+}
+
+static void init_node(uint8_t node, csma_ca_mode_t csma_ca_mode)
+{
+    dae_access_profile_t access_profile;
+    sim_get_default_access_profile(&access_profile);
+    access_profile.control_csma_ca_mode = csma_ca_mode;
+    access_profile.transmission_timeout_period = compressed_time_encode(100);
+    sim_init_node(node, &access_profile, NULL, NULL, &d7asp_init_args);
+}
+
+// exponentially distributed, so the requests of a sender form a Poisson process
+static uint32_t get_random_interval(uint32_t mean_interval)
+{
+    double uniform = ((get_rnd() & 0xFFFF) + 1) / 65536.0;
+    return -log(uniform) * mean_interval;
+}
+
+static void queue_request(uint8_t node)
+{
+    d7asp_fifo_config_t fifo_config = {
+        .fifo_ctrl_nls = false,
+        .qos = {
+            .qos_ctrl_resp_mode = SESSION_RESP_MODE_NONE
+        },
+        .addressee = {
+            .addressee_ctrl_has_id = false,
+            .addressee_ctrl_access_class = 0
+        }
+    };
+
+    // a request which reads the UID of the receivers
+    uint8_t alp_command[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8 };
+
+    sender_t* sender = &senders[node];
+    sim_set_node(node);
+    if(d7asp_queue_alp_actions(&fifo_config, alp_command, sizeof(alp_command)) != SUCCESS)
+        return;
+
+    sender->request_time = sim_get_time();
+    sender->is_transmitted = false;
+    results.requests++;
+}
+
+static void run(csma_ca_mode_t csma_ca_mode, uint32_t mean_interval, timer_tick_t duration)
+{
+    memset(&results, 0, sizeof(results));
+    sim_init(SENDERS_COUNT + 1, csma_ca_mode * 100 + mean_interval);
+    sim_set_tx_callback(&on_frame_transmitted);
+    for(uint8_t node = 0; node <= SENDERS_COUNT; node++)
+    {
+        init_node(node, csma_ca_mode);
+        senders[node].request_time = NO_REQUEST;
+        senders[node].next_request_time = get_random_interval(mean_interval);
+    }
+
+    sim_run(1);
+    while(sim_get_time() < duration)
+    {
+        for(uint8_t node = 1; node <= SENDERS_COUNT; node++)
+        {
+            sender_t* sender = &senders[node];
+            if(sim_get_time() < sender->next_request_time || sender->request_time != NO_REQUEST)
+                continue;
+
+            // a request which arrives while the previous one is pending waits until it is done
+            queue_request(node);
+            sender->next_request_time = sim_get_time() + get_random_interval(mean_interval);
+        }
+
+        sim_run(1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    timer_tick_t duration = (argc > 1? atoi(argv[1]) : 60) * TIMER_TICKS_PER_SEC;
+    d7asp_init_args.d7asp_fifo_flush_completed_cb = &on_flush_completed;
+
+    int result = EXIT_SUCCESS;
+    printf("%6s %10s %10s %10s %10s %10s %10s\n", "mode", "load (/s)", "requests", "access", "mean delay",
+           "max delay", "delivered");
+    for(csma_ca_mode_t mode = CSMA_CA_MODE_UNC; mode <= CSMA_CA_MODE_RIGD; mode++)
+    {
+        for(uint8_t i = 0; i < sizeof(mean_intervals) / sizeof(mean_intervals[0]); i++)
+        {
+            run(mode, mean_intervals[i], duration);
+            const sim_node_stats_t* sink_stats = sim_get_node_stats(SINK);
+            double offered_load = (double)SENDERS_COUNT * TIMER_TICKS_PER_SEC / mean_intervals[i];
+            double access_rate = results.requests? 100.0 * results.requests_transmitted / results.requests : 0;
+            double delivery_rate = results.frames_transmitted? 100.0 * sink_stats->frames_received / results.frames_transmitted : 0;
+            uint32_t mean_delay = results.requests_transmitted? results.total_delay / results.requests_transmitted : 0;
+            printf("%6s %10.1f %10u %9.1f%% %10u %10u %9.1f%%\n", mode_names[mode], offered_load, results.requests,
+                   access_rate, mean_delay, results.max_delay, delivery_rate);
+
+            // at the lowest load the channel is almost always free
+            if(i == 0 && (access_rate < 95 || delivery_rate < 90))
+            {
+                printf("channel access or delivery failing at low load\n");
+                result = EXIT_FAILURE;
+            }
+        }
+    }
+
+    return result;
+}
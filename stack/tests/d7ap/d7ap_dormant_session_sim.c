@@ -0,0 +1,159 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulates a gateway which holds a request for a sensor in a dormant session, and checks that:
+ * - nothing is transmitted while the sensor does not contact the gateway
+ * - the request is flushed after the sensor sent a request to the gateway, and is only reported as succeeded when the
+ *   sensor acknowledged it
+ * - the request is flushed when the dormant timeout expires without contact
+ * - the request fails when the sensor does not acknowledge it
+ *
+ * Usage: d7ap_dormant_session_sim
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "sim.h"
+#include "d7ap_stack.h"
+
+#define GATEWAY 0
+#define SENSOR 1
+
+#define DORMANT_TIMEOUT (60 * TIMER_TICKS_PER_SEC)
+#define HOLD_DURATION (10 * TIMER_TICKS_PER_SEC)
+
+static uint32_t gateway_frames_count;
+static uint32_t sensor_received_count;
+
+// the gateway completed the flush of the dormant request
+static bool is_request_completed(bool is_succeeded)
+{
+    sim_node_stats_t const* stats = sim_get_node_stats(GATEWAY);
+    return stats->flushes_completed == 1 && stats->requests_succeeded == (is_succeeded? 1 : 0);
+}
+
+static void on_unhandled_action(d7asp_result_t d7asp_result, uint8_t* alp_command, uint8_t alp_command_size)
+{
+    if(sim_get_node() == SENSOR && alp_command[0] == ALP_OP_RETURN_FILE_DATA)
+        sensor_received_count++;
+}
+
+static void on_frame_transmitted(uint8_t node, hw_radio_packet_t const* packet)
+{
+    if(node == GATEWAY)
+        gateway_frames_count++;
+}
+
+static void init_sim(uint32_t seed)
+{
+    sim_init(2, seed);
+    sim_set_tx_callback(&on_frame_transmitted);
+    sim_init_default_node(GATEWAY, &on_unhandled_action, NULL);
+    sim_init_default_node(SENSOR, &on_unhandled_action, NULL);
+    sim_run(TIMER_TICKS_PER_SEC);
+
+    gateway_frames_count = 0;
+    sensor_received_count = 0;
+}
+
+// the gateway sends its UID to the sensor, in a dormant session addressed to the UID of the sensor
+static bool queue_dormant_request()
+{
+    d7asp_fifo_config_t fifo_config = {
+        .fifo_ctrl_nls = false,
+        .fifo_ctrl_state = SESSION_STATE_DORMANT,
+        .dormant_timeout = compressed_time_encode(DORMANT_TIMEOUT),
+        .qos = {
+            .qos_ctrl_resp_mode = SESSION_RESP_MODE_ANYCAST
+        },
+        .addressee = {
+            .addressee_ctrl_has_id = true,
+            .addressee_ctrl_virtual_id = false,
+            .addressee_ctrl_access_class = 0
+        }
+    };
+
+    uint64_t sensor_uid = sim_get_uid(SENSOR);
+    for(uint8_t i = 0; i < 8; i++)
+        fifo_config.addressee.addressee_id[i] = sensor_uid >> (56 - 8 * i);
+
+    uint8_t alp_command[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8 };
+    sim_set_node(GATEWAY);
+    return d7asp_queue_alp_actions(&fifo_config, alp_command, sizeof(alp_command)) == SUCCESS;
+}
+
+// the sensor sends its UID to all nodes in range, which contacts the gateway
+static bool queue_sensor_request()
+{
+    d7asp_fifo_config_t fifo_config = {
+        .fifo_ctrl_nls = false,
+        .qos = {
+            .qos_ctrl_resp_mode = SESSION_RESP_MODE_ANYCAST
+        },
+        .addressee = {
+            .addressee_ctrl_has_id = false,
+            .addressee_ctrl_access_class = 0
+        }
+    };
+
+    uint8_t alp_command[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8 };
+    sim_set_node(SENSOR);
+    return d7asp_queue_alp_actions(&fifo_config, alp_command, sizeof(alp_command)) == SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    int result = EXIT_SUCCESS;
+
+    // contact by the sensor
+    init_sim(1);
+    result |= sim_check(queue_dormant_request(), "dormant request queued");
+    sim_run(HOLD_DURATION);
+    result |= sim_check(gateway_frames_count == 0 && sim_get_node_stats(GATEWAY)->flushes_completed == 0,
+                        "dormant request held");
+    result |= sim_check(queue_sensor_request(), "sensor request queued");
+    sim_run(HOLD_DURATION);
+    result |= sim_check(is_request_completed(true) && sensor_received_count == 1,
+                        "dormant request delivered after contact and acknowledged");
+
+    // no contact
+    init_sim(2);
+    queue_dormant_request();
+    sim_run(DORMANT_TIMEOUT - TIMER_TICKS_PER_SEC);
+    result |= sim_check(gateway_frames_count == 0, "dormant request held until the dormant timeout");
+    sim_run(2 * TIMER_TICKS_PER_SEC);
+    result |= sim_check(is_request_completed(true) && sensor_received_count == 1,
+                        "dormant request delivered after the dormant timeout");
+
+    // contact, but the sensor goes out of range before the request is flushed
+    init_sim(3);
+    queue_dormant_request();
+    queue_sensor_request();
+    while(gateway_frames_count == 0)
+        sim_run(1);
+
+    sim_set_path_loss(GATEWAY, SENSOR, 255);
+    sim_run(HOLD_DURATION);
+    result |= sim_check(is_request_completed(false) && sensor_received_count == 0,
+                        "dormant request fails when not acknowledged");
+
+    return result;
+}
@@ -0,0 +1,138 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulates a requester and a responder using the same access profile for a number of scan automation periods, and
+ * reports the radio-on time of the idle responder and the time it takes to complete a request to it. This shows the
+ * battery life gained by a longer period against the latency added by the advertising train the requester then
+ * needs to wake up the responder.
+ *
+ * Usage: d7ap_duty_cycle_sim [<idle duration in seconds>]
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+
+#include "sim.h"
+#include "d7ap_stack.h"
+
+#define REQUESTER 0
+#define RESPONDER 1
+
+#define REQUEST_TIMEOUT (30 * TIMER_TICKS_PER_SEC)
+
+typedef struct
+{
+    uint32_t scan_automation_period; // in ticks, 0 for a continuous scan
+    uint32_t channels_count;
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    { 0, 1 },
+    { 16, 1 },
+    { 64, 1 },
+    { 256, 1 },
+    { 1024, 1 },
+    { 4096, 1 },
+    { 256, 3 },
+};
+
+static void init_node(uint8_t node, scenario_t const* scenario)
+{
+    dae_access_profile_t access_profile;
+    sim_get_default_access_profile(&access_profile);
+    access_profile.control_scan_type_is_foreground = false;
+    access_profile.scan_automation_period = compressed_time_encode(scenario->scan_automation_period);
+    access_profile.subbands[0].channel_index_end = 8 * (scenario->channels_count - 1);
+    sim_init_node(node, &access_profile, NULL, NULL, NULL);
+}
+
+// returns the time it took to complete the request, or 0 when it failed
+static timer_tick_t send_request()
+{
+    d7asp_fifo_config_t fifo_config = {
+        .fifo_ctrl_nls = false,
+        .qos = {
+            .qos_ctrl_resp_mode = SESSION_RESP_MODE_ANYCAST
+        },
+        .addressee = {
+            .addressee_ctrl_has_id = false,
+            .addressee_ctrl_access_class = 0
+        }
+    };
+
+    // read the first byte of the UID file
+    uint8_t alp_command[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 1 };
+
+    sim_node_stats_t const* stats = sim_get_node_stats(REQUESTER);
+    uint32_t requests_succeeded = stats->requests_succeeded;
+    uint32_t flushes_completed = stats->flushes_completed;
+    timer_tick_t start = sim_get_time();
+    sim_set_node(REQUESTER);
+    if(d7asp_queue_alp_actions(&fifo_config, alp_command, sizeof(alp_command)) != SUCCESS)
+        return 0;
+
+    while(stats->flushes_completed == flushes_completed && sim_get_time() - start < REQUEST_TIMEOUT)
+        sim_run(1);
+
+    return stats->requests_succeeded != requests_succeeded? sim_get_time() - start : 0;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t idle_duration = (argc > 1? atoi(argv[1]) : 60) * TIMER_TICKS_PER_SEC;
+
+    printf("%10s %8s %14s %14s %12s\n", "period", "channels", "idle on time", "idle duty", "latency");
+    int result = EXIT_SUCCESS;
+    double previous_duty_cycle = 100;
+    for(uint8_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        scenario_t const* scenario = &scenarios[i];
+        sim_init(2, i + 1);
+        init_node(REQUESTER, scenario);
+        init_node(RESPONDER, scenario);
+
+        sim_run(TIMER_TICKS_PER_SEC); // settle
+        uint32_t radio_on_start = sim_get_node_stats(RESPONDER)->radio_on_time;
+        sim_run(idle_duration);
+        uint32_t radio_on_time = sim_get_node_stats(RESPONDER)->radio_on_time - radio_on_start;
+        double duty_cycle = 100.0 * radio_on_time / idle_duration;
+
+        timer_tick_t latency = send_request();
+        printf("%10u %8u %14u %13.2f%% %12u\n", scenario->scan_automation_period, scenario->channels_count,
+               radio_on_time, duty_cycle, latency);
+
+        if(latency == 0)
+        {
+            printf("request failed\n");
+            result = EXIT_FAILURE;
+        }
+
+        // a longer period on the same channels should not use more energy
+        if(scenario->channels_count == 1 && duty_cycle > previous_duty_cycle)
+        {
+            printf("duty cycle did not decrease\n");
+            result = EXIT_FAILURE;
+        }
+
+        if(scenario->channels_count == 1)
+            previous_duty_cycle = duty_cycle;
+    }
+
+    return result;
+}
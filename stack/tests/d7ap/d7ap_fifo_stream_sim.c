@@ -0,0 +1,126 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulates a gateway which streams requests to a responder: it queues a new request in the same FIFO as soon as
+ * d7asp_queue_alp_actions() accepts it, so the FIFO is rarely flushed completely. The requests of the FIFO are stored
+ * in MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT slots, which are freed as the requests are handled.
+ *
+ * Every request sends a part of the neighbor table of the gateway to the responder, which is too large to send more
+ * than 1 request per frame. The slot of a request is freed when it is acknowledged, so the FIFO is streamed in a single
+ * flush. Reports the time to stream the requests and the throughput. The test fails when a request can not be queued
+ * within QUEUE_TIMEOUT, when not every request is received by the responder or when the FIFO had to be flushed
+ * completely before more requests could be queued.
+ *
+ * Usage: d7ap_fifo_stream_sim [<requests count>]
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+
+#include "sim.h"
+#include "d7ap_stack.h"
+
+#define GATEWAY 0
+#define RESPONDER 1
+
+#define QUEUE_TIMEOUT (5 * TIMER_TICKS_PER_SEC)
+
+#define REQUEST_DATA_LENGTH 100
+
+static uint32_t received_count;
+
+// the requests which are sent together in a frame result in a return file data action each
+static void on_unhandled_action(d7asp_result_t d7asp_result, uint8_t* alp_command, uint8_t alp_command_size)
+{
+    if(sim_get_node() == RESPONDER && alp_command[0] == ALP_OP_RETURN_FILE_DATA)
+        received_count++;
+}
+
+// returns false when the FIFO does not accept the request in time
+static bool queue_request()
+{
+    d7asp_fifo_config_t fifo_config = {
+        .fifo_ctrl_nls = false,
+        .qos = {
+            .qos_ctrl_resp_mode = SESSION_RESP_MODE_ANYCAST
+        },
+        .addressee = {
+            .addressee_ctrl_has_id = false,
+            .addressee_ctrl_access_class = 0
+        }
+    };
+
+    // the length does not fit in 6 bits and takes a 2 byte length operand
+    uint8_t alp_command[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_NEIGHBOR_TABLE_FILE_ID, 0, 0x40, REQUEST_DATA_LENGTH };
+
+    timer_tick_t start = sim_get_time();
+    while(sim_get_time() - start < QUEUE_TIMEOUT)
+    {
+        sim_set_node(GATEWAY);
+        error_t err = d7asp_queue_alp_actions(&fifo_config, alp_command, sizeof(alp_command));
+        if(err == SUCCESS)
+            return true;
+
+        if(err != EBUSY && err != ENOMEM)
+            return false;
+
+        sim_run(1);
+    }
+
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t requests_count = argc > 1? atoi(argv[1]) : 10 * MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT;
+    sim_init(2, 1);
+    sim_init_default_node(GATEWAY, &on_unhandled_action, NULL);
+    sim_init_default_node(RESPONDER, &on_unhandled_action, NULL);
+    sim_run(TIMER_TICKS_PER_SEC);
+
+    timer_tick_t start = sim_get_time();
+    for(uint32_t request = 0; request < requests_count; request++)
+    {
+        if(!queue_request())
+        {
+            printf("request %u not queued\n", request);
+            return EXIT_FAILURE;
+        }
+    }
+
+    sim_run_until_idle(QUEUE_TIMEOUT);
+    timer_tick_t duration = sim_get_time() - start;
+    uint32_t flush_completed_count = sim_get_node_stats(GATEWAY)->flushes_completed;
+    printf("%u requests, %u received, %u FIFO flushes in %u ticks: %.1f requests/s\n", requests_count, received_count,
+           flush_completed_count, duration, (double)requests_count * TIMER_TICKS_PER_SEC / duration);
+
+    if(received_count != requests_count)
+    {
+        printf("requests missing\n");
+        return EXIT_FAILURE;
+    }
+
+    if(flush_completed_count > 1)
+    {
+        printf("FIFO not streamed\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
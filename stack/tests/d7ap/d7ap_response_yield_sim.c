@@ -0,0 +1,159 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulates a gateway which broadcasts requests to a number of responders in range of each other, which all respond.
+ * For a range of responder counts it reports the response yield (the responses received by the gateway of all
+ * responses expected) and the latest response, relative to the end of the request.
+ *
+ * The responders spread their responses over the response period of the gateway, which they limit to
+ * MODULE_D7AP_MAX_RESPONSE_PERIOD. The test fails when a response arrives after that, or when not all responses of a
+ * few responders are received.
+ *
+ * Usage: d7ap_response_yield_sim [<requests per responder count>]
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "sim.h"
+#include "d7ap_stack.h"
+
+#define GATEWAY 0
+#define RESPONDERS_MAX_COUNT (NODE_GLOBALS_MAX_NODES - 1)
+
+#define REQUEST_TIMEOUT (10 * TIMER_TICKS_PER_SEC)
+
+// the gateway requests a response period which is longer than a limit of 150 ticks, see CMakeLists.txt
+#define GATEWAY_TRANSMISSION_TIMEOUT_PERIOD 250
+
+static const uint8_t responder_counts[] = { 1, 2, 4, 8, RESPONDERS_MAX_COUNT };
+
+static d7asp_init_args_t d7asp_init_args;
+static bool is_responded[RESPONDERS_MAX_COUNT + 1];
+static timer_tick_t request_end_time;
+static timer_tick_t max_response_delay;
+
+static void on_response_received(d7asp_result_t result, uint8_t* alp_payload, uint8_t alp_payload_length)
+{
+    // the responder is identified by the last byte of its UID, see sim_get_uid()
+    uint8_t node = result.addressee.addressee_id[7] - 1;
+    if(node == GATEWAY || node > RESPONDERS_MAX_COUNT)
+        return;
+
+    is_responded[node] = true;
+    timer_tick_t delay = sim_get_time() - request_end_time;
+    if(delay > max_response_delay)
+        max_response_delay = delay;
+}
+
+static void on_frame_transmitted(uint8_t node, hw_radio_packet_t const* packet)
+{
+    if(node == GATEWAY)
+        request_end_time = sim_get_time();
+}
+
+static void init_node(uint8_t node)
+{
+    dae_access_profile_t access_profile;
+    sim_get_default_access_profile(&access_profile);
+    access_profile.control_csma_ca_mode = CSMA_CA_MODE_RAIND;
+    if(node == GATEWAY)
+        access_profile.transmission_timeout_period = GATEWAY_TRANSMISSION_TIMEOUT_PERIOD;
+
+    sim_init_node(node, &access_profile, NULL, NULL, &d7asp_init_args);
+}
+
+// returns the number of responses received
+static uint8_t send_request(uint8_t responders_count)
+{
+    d7asp_fifo_config_t fifo_config = {
+        .fifo_ctrl_nls = false,
+        .qos = {
+            .qos_ctrl_resp_mode = SESSION_RESP_MODE_ALLCAST
+        },
+        .addressee = {
+            .addressee_ctrl_has_id = false,
+            .addressee_ctrl_access_class = 0
+        }
+    };
+
+    // read the UID of all responders
+    uint8_t alp_command[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8 };
+
+    memset(is_responded, 0, sizeof(is_responded));
+    uint32_t flushes_completed = sim_get_node_stats(GATEWAY)->flushes_completed;
+    timer_tick_t start = sim_get_time();
+    sim_set_node(GATEWAY);
+    if(d7asp_queue_alp_actions(&fifo_config, alp_command, sizeof(alp_command)) != SUCCESS)
+        return 0;
+
+    while(sim_get_node_stats(GATEWAY)->flushes_completed == flushes_completed && sim_get_time() - start < REQUEST_TIMEOUT)
+        sim_run(1);
+
+    // let the responders finish before the next request
+    sim_run(MODULE_D7AP_MAX_RESPONSE_PERIOD);
+
+    uint8_t responses_count = 0;
+    for(uint8_t node = 1; node <= responders_count; node++)
+        responses_count += is_responded[node];
+
+    return responses_count;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t requests_count = argc > 1? atoi(argv[1]) : 20;
+    d7asp_init_args.d7asp_response_received_cb = &on_response_received;
+
+    int result = EXIT_SUCCESS;
+    printf("%10s %10s %10s %10s\n", "responders", "expected", "yield", "latest");
+    for(uint8_t i = 0; i < sizeof(responder_counts) / sizeof(responder_counts[0]); i++)
+    {
+        uint8_t responders_count = responder_counts[i];
+        sim_init(responders_count + 1, i + 1);
+        sim_set_tx_callback(&on_frame_transmitted);
+        for(uint8_t node = 0; node <= responders_count; node++)
+            init_node(node);
+
+        sim_run(TIMER_TICKS_PER_SEC);
+        max_response_delay = 0;
+        uint32_t responses_count = 0;
+        for(uint32_t request = 0; request < requests_count; request++)
+            responses_count += send_request(responders_count);
+
+        uint32_t expected_count = requests_count * responders_count;
+        double yield = 100.0 * responses_count / expected_count;
+        printf("%10u %10u %9.1f%% %10u\n", responders_count, expected_count, yield, max_response_delay);
+
+        if(max_response_delay > MODULE_D7AP_MAX_RESPONSE_PERIOD)
+        {
+            printf("response received after the maximum response period\n");
+            result = EXIT_FAILURE;
+        }
+
+        if(responders_count <= 2 && responses_count != expected_count)
+        {
+            printf("responses missing\n");
+            result = EXIT_FAILURE;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,105 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulates a requester which sends a unicast request to a node which does not exist, and a neighbor which sends a request to
+ * the requester while it waits for the backoff period before the retry. Checks that:
+ * - the request of the neighbor is answered, instead of being taken as an ACK of the unicast request
+ * - the unicast request is retried after the full backoff period, and fails
+ *
+ * Built with a long MODULE_D7AP_RETRY_BACKOFF_PERIOD, see CMakeLists.txt.
+ *
+ * Usage: d7ap_retry_backoff_sim
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+
+#include "sim.h"
+#include "d7ap_stack.h"
+
+#define REQUESTER 0
+#define NEIGHBOR 1
+#define NODES_COUNT 2
+
+#define MAX_FRAMES 8
+
+static timer_tick_t requester_frame_times[MAX_FRAMES];
+static uint8_t requester_frames_count;
+
+static void on_frame_transmitted(uint8_t node, hw_radio_packet_t const* packet)
+{
+    if(node == REQUESTER && requester_frames_count < MAX_FRAMES)
+        requester_frame_times[requester_frames_count++] = sim_get_time();
+}
+
+static bool queue_request(uint8_t node, d7atp_addressee_t addressee)
+{
+    d7asp_fifo_config_t fifo_config = {
+        .fifo_ctrl_nls = false,
+        .qos = {
+            .qos_ctrl_resp_mode = SESSION_RESP_MODE_ANYCAST,
+            .qos_retry_single = 1,
+            .qos_retry_total = 1
+        },
+        .addressee = addressee
+    };
+
+    uint8_t alp_command[] = { ALP_OP_READ_FILE_DATA, D7A_FILE_UID_FILE_ID, 0, 8 };
+    sim_set_node(node);
+    return d7asp_queue_alp_actions(&fifo_config, alp_command, sizeof(alp_command)) == SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    sim_init(NODES_COUNT, 1);
+    sim_set_tx_callback(&on_frame_transmitted);
+    for(uint8_t node = 0; node < NODES_COUNT; node++)
+        sim_init_default_node(node, NULL, NULL);
+
+    sim_run(TIMER_TICKS_PER_SEC);
+
+    d7atp_addressee_t unicast = { .addressee_ctrl_has_id = true, .addressee_ctrl_virtual_id = false };
+    uint64_t uid = sim_get_uid(NODES_COUNT);
+    for(uint8_t i = 0; i < 8; i++)
+        unicast.addressee_id[i] = uid >> (56 - 8 * i);
+
+    int result = EXIT_SUCCESS;
+    result |= sim_check(queue_request(REQUESTER, unicast), "unicast request queued");
+
+    // the neighbor sends its request halfway the backoff period of the requester
+    while(requester_frames_count == 0)
+        sim_run(1);
+
+    sim_run(MODULE_D7AP_RETRY_BACKOFF_PERIOD / 2);
+    result |= sim_check(sim_get_node_stats(REQUESTER)->flushes_completed == 0, "unicast request waiting for its retry");
+    d7atp_addressee_t broadcast = { .addressee_ctrl_has_id = false };
+    result |= sim_check(queue_request(NEIGHBOR, broadcast), "neighbor request queued");
+
+    sim_run(3 * MODULE_D7AP_RETRY_BACKOFF_PERIOD);
+    result |= sim_check(sim_get_node_stats(NEIGHBOR)->requests_succeeded == 1, "neighbor request answered");
+    result |= sim_check(sim_get_node_stats(REQUESTER)->flushes_completed == 1
+                        && sim_get_node_stats(REQUESTER)->requests_succeeded == 0, "unicast request failed");
+
+    // the request, the response to the neighbor and the retry
+    result |= sim_check(requester_frames_count == 3, "requester transmitted 3 frames");
+    result |= sim_check(requester_frame_times[2] - requester_frame_times[0] >= MODULE_D7AP_RETRY_BACKOFF_PERIOD,
+                        "retry after the full backoff period");
+
+    return result;
+}
@@ -0,0 +1,67 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the airtime model of the PHY: a frame using FEC takes as long as a frame without FEC of its encoded size,
+ * which is twice the frame size plus the trellis termination, padded to the 4 bytes interleaver blocks.
+ *
+ * Usage: phy_airtime_test
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+
+#include "sim.h"
+#include "phy.h"
+
+static phy_channel_header_t get_channel_header(phy_coding_t coding)
+{
+    return (phy_channel_header_t){
+        .ch_coding = coding,
+        .ch_class = PHY_CLASS_LO_RATE,
+        .ch_freq_band = PHY_BAND_433
+    };
+}
+
+// an even frame size is encoded in 2 * size + 4 bytes, an odd one in 2 * size + 6 bytes
+static bool is_fec_airtime_valid(uint16_t frame_size)
+{
+    uint16_t encoded_size = 2 * frame_size + (frame_size % 2? 6 : 4);
+    return phy_calculate_tx_duration(get_channel_header(PHY_CODING_FEC_PN9), frame_size)
+        == phy_calculate_tx_duration(get_channel_header(PHY_CODING_PN9), encoded_size);
+}
+
+int main(int argc, char** argv)
+{
+    int result = EXIT_SUCCESS;
+    result |= sim_check(is_fec_airtime_valid(10), "FEC airtime of an even frame size");
+    result |= sim_check(is_fec_airtime_valid(11), "FEC airtime of an odd frame size");
+
+    bool is_valid = true;
+    for(uint16_t frame_size = 1; frame_size <= PHY_MAX_FRAME_SIZE; frame_size++)
+        is_valid = is_valid && is_fec_airtime_valid(frame_size);
+
+    result |= sim_check(is_valid, "FEC airtime of all frame sizes");
+
+    // at 9.6 kbps the 4 extra bytes of an odd frame size take more than 3 ticks
+    result |= sim_check(phy_calculate_tx_duration(get_channel_header(PHY_CODING_FEC_PN9), 11)
+                        > phy_calculate_tx_duration(get_channel_header(PHY_CODING_FEC_PN9), 10),
+                        "odd frame size padded to the next interleaver block");
+
+    return result;
+}
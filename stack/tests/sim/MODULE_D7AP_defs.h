@@ -0,0 +1,60 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// replaces the file generated by the module build settings for the host tests, a test can override a setting by
+// defining it on the command line
+
+#ifndef MODULE_D7AP_PACKET_QUEUE_SIZE
+#define MODULE_D7AP_PACKET_QUEUE_SIZE 2
+#endif
+#ifndef MODULE_D7AP_FIFO_COMMAND_BUFFER_SIZE
+#define MODULE_D7AP_FIFO_COMMAND_BUFFER_SIZE 100
+#endif
+#ifndef MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT
+#define MODULE_D7AP_FIFO_MAX_REQUESTS_COUNT 8
+#endif
+#ifndef MODULE_D7AP_FIFO_COUNT
+#define MODULE_D7AP_FIFO_COUNT 2
+#endif
+#ifndef MODULE_D7AP_CHANNEL_LIST_SIZE
+#define MODULE_D7AP_CHANNEL_LIST_SIZE 8
+#endif
+#ifndef MODULE_D7AP_NEIGHBOR_TABLE_SIZE
+#define MODULE_D7AP_NEIGHBOR_TABLE_SIZE 8
+#endif
+#ifndef MODULE_D7AP_TX_POWER_LINK_MARGIN
+#define MODULE_D7AP_TX_POWER_LINK_MARGIN 15
+#endif
+#ifndef MODULE_D7AP_HOP_LIMIT
+#define MODULE_D7AP_HOP_LIMIT 2
+#endif
+#ifndef MODULE_D7AP_ROUTING_TABLE_SIZE
+#define MODULE_D7AP_ROUTING_TABLE_SIZE 4
+#endif
+#ifndef MODULE_D7AP_NLS_METHOD
+#define MODULE_D7AP_NLS_METHOD 0
+#endif
+#ifndef MODULE_D7AP_NLS_REPLAY_TABLE_SIZE
+#define MODULE_D7AP_NLS_REPLAY_TABLE_SIZE 4
+#endif
+#ifndef MODULE_D7AP_RETRY_BACKOFF_PERIOD
+#define MODULE_D7AP_RETRY_BACKOFF_PERIOD 100
+#endif
+#ifndef MODULE_D7AP_MAX_RESPONSE_PERIOD
+#define MODULE_D7AP_MAX_RESPONSE_PERIOD 4096
+#endif
@@ -0,0 +1,759 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "stdarg.h"
+#include "string.h"
+
+#include "sim.h"
+#include "ng.h"
+#include "log.h"
+#include "random.h"
+#include "scheduler.h"
+#include "hwsystem.h"
+#include "phy.h"
+
+// the time it takes for the RSSI to become valid after entering RX
+#define RSSI_SETTLING_TIME 1
+
+// a receiver entering RX within the preamble of a frame still locks on it
+#define PREAMBLE_TIME 1
+
+#define EVENTS_MAX_COUNT 256
+#define TASKS_MAX_COUNT 256
+
+#define NO_NODE 0xFF
+
+typedef enum
+{
+    EVENT_TIMER,
+    EVENT_RSSI_VALID,
+    EVENT_TX_COMPLETED
+} event_type_t;
+
+typedef struct
+{
+    timer_tick_t time;
+    uint32_t sequence_nr; // events at the same time are handled in the order they were added
+    uint8_t node;
+    event_type_t type;
+    task_t task;
+    uint32_t radio_generation;
+} event_t;
+
+typedef struct
+{
+    uint8_t node;
+    task_t task;
+} posted_task_t;
+
+typedef enum
+{
+    RADIO_IDLE,
+    RADIO_RX,
+    RADIO_TX
+} radio_state_t;
+
+typedef struct
+{
+    alloc_packet_callback_t alloc_packet_cb;
+    release_packet_callback_t release_packet_cb;
+    rx_filter_callback_t rx_filter_cb;
+    radio_state_t state;
+    radio_state_t state_after_tx;
+    timer_tick_t state_since;
+    uint32_t radio_generation; // changes with every radio reconfiguration, pending RSSI events of a previous one are dropped
+    hw_rx_cfg_t rx_cfg;
+    rx_packet_callback_t rx_cb;
+    rssi_valid_callback_t rssi_cb;
+    hw_radio_packet_t* tx_packet;
+    tx_packet_callback_t tx_cb;
+    timer_tick_t tx_start;
+    uint8_t receiving_from; // the node of which a frame is being received
+    uint32_t receiving_generation;
+    bool is_reception_corrupted;
+    sim_node_stats_t stats;
+} sim_node_t;
+
+size_t __ng_node_id__;
+
+static sim_node_t nodes[SIM_MAX_NODES];
+static uint8_t node_count;
+static uint8_t path_loss[SIM_MAX_NODES][SIM_MAX_NODES];
+static timer_tick_t now;
+static event_t events[EVENTS_MAX_COUNT];
+static uint16_t events_count;
+static uint32_t next_sequence_nr;
+static posted_task_t tasks[TASKS_MAX_COUNT];
+static uint16_t tasks_head;
+static uint16_t tasks_count;
+static uint32_t rng_state;
+static sim_tx_callback_t tx_callback;
+static bool is_log_enabled;
+static d7asp_init_args_t d7asp_init_args[SIM_MAX_NODES]; // the stack calls the sim, which calls the callbacks of the test
+static d7asp_init_args_t test_d7asp_init_args[SIM_MAX_NODES];
+
+void set_node_global_id(size_t node_id)
+{
+    __ng_node_id__ = node_id;
+}
+
+void sim_init(uint8_t count, uint32_t seed)
+{
+    assert(count > 0 && count <= SIM_MAX_NODES);
+    memset(nodes, 0, sizeof(nodes));
+    memset(path_loss, SIM_DEFAULT_PATH_LOSS, sizeof(path_loss));
+    for(uint8_t i = 0; i < SIM_MAX_NODES; i++)
+        nodes[i].receiving_from = NO_NODE;
+
+    node_count = count;
+    now = 0;
+    events_count = 0;
+    next_sequence_nr = 0;
+    tasks_head = 0;
+    tasks_count = 0;
+    tx_callback = NULL;
+    set_rng_seed(seed);
+    set_node_global_id(0);
+    sim_set_log_enabled(false);
+}
+
+void sim_set_node(uint8_t node)
+{
+    assert(node < node_count);
+    set_node_global_id(node);
+}
+
+uint8_t sim_get_node()
+{
+    return __ng_node_id__;
+}
+
+timer_tick_t sim_get_time()
+{
+    return now;
+}
+
+uint64_t sim_get_uid(uint8_t node)
+{
+    return 0xD7A0000000000000ULL | (node + 1);
+}
+
+void sim_set_path_loss(uint8_t node_a, uint8_t node_b, uint8_t loss)
+{
+    path_loss[node_a][node_b] = loss;
+    path_loss[node_b][node_a] = loss;
+}
+
+void sim_set_tx_callback(sim_tx_callback_t callback)
+{
+    tx_callback = callback;
+}
+
+sim_node_stats_t const* sim_get_node_stats(uint8_t node)
+{
+    // account the time spent in the current state
+    sim_node_t* n = &nodes[node];
+    if(n->state != RADIO_IDLE)
+        n->stats.radio_on_time += now - n->state_since;
+
+    if(n->state == RADIO_TX)
+        n->stats.tx_time += now - n->state_since;
+
+    n->state_since = now;
+    return &n->stats;
+}
+
+void sim_set_log_enabled(bool enabled)
+{
+    is_log_enabled = enabled;
+}
+
+void sim_get_default_access_profile(dae_access_profile_t* access_profile)
+{
+    *access_profile = (dae_access_profile_t){
+        .control_scan_type_is_foreground = true,
+        .control_csma_ca_mode = CSMA_CA_MODE_UNC,
+        .control_number_of_subbands = 1,
+        .subnet = 0x05,
+        .scan_automation_period = 0,
+        .transmission_timeout_period = 50,
+        .subbands[0] = (subband_t){
+            .channel_header = {
+                .ch_coding = PHY_CODING_PN9,
+                .ch_class = PHY_CLASS_NORMAL_RATE,
+                .ch_freq_band = PHY_BAND_433
+            },
+            .channel_index_start = 0,
+            .channel_index_end = 0,
+            .eirp = 10,
+            .ccao = 0
+        }
+    };
+}
+
+static void on_flush_completed(d7asp_fifo_config_t* fifo_config, uint8_t* progress_bitmap, uint8_t* success_bitmap, uint8_t bitmap_byte_count)
+{
+    uint8_t node = sim_get_node();
+    nodes[node].stats.flushes_completed++;
+    for(uint8_t i = 0; i < bitmap_byte_count; i++)
+        nodes[node].stats.requests_succeeded += __builtin_popcount(success_bitmap[i]);
+
+    if(test_d7asp_init_args[node].d7asp_fifo_flush_completed_cb != NULL)
+        test_d7asp_init_args[node].d7asp_fifo_flush_completed_cb(fifo_config, progress_bitmap, success_bitmap, bitmap_byte_count);
+}
+
+void sim_init_node(uint8_t node, dae_access_profile_t const* access_profile, fs_user_files_init_callback fs_user_files_init_cb,
+                   alp_unhandled_action_callback alp_unhandled_action_cb, d7asp_init_args_t const* init_args)
+{
+    dae_access_profile_t access_profiles[1] = { *access_profile };
+    fs_init_args_t fs_init_args = (fs_init_args_t){
+        .fs_user_files_init_cb = fs_user_files_init_cb,
+        .access_profiles_count = 1,
+        .access_profiles = access_profiles
+    };
+
+    test_d7asp_init_args[node] = init_args != NULL? *init_args : (d7asp_init_args_t){ 0 };
+    d7asp_init_args[node] = test_d7asp_init_args[node];
+    d7asp_init_args[node].d7asp_fifo_flush_completed_cb = &on_flush_completed;
+
+    sim_set_node(node);
+    d7ap_stack_init(&fs_init_args, alp_unhandled_action_cb, &d7asp_init_args[node]);
+}
+
+void sim_init_default_node(uint8_t node, alp_unhandled_action_callback alp_unhandled_action_cb, d7asp_init_args_t const* init_args)
+{
+    dae_access_profile_t access_profile;
+    sim_get_default_access_profile(&access_profile);
+    sim_init_node(node, &access_profile, NULL, alp_unhandled_action_cb, init_args);
+}
+
+int sim_check(bool condition, char const* description)
+{
+    printf("%-70s %s\n", description, condition? "ok" : "FAILED");
+    return condition? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void add_event(timer_tick_t time, uint8_t node, event_type_t type, task_t task)
+{
+    assert(events_count < EVENTS_MAX_COUNT);
+    events[events_count] = (event_t){
+        .time = time,
+        .sequence_nr = next_sequence_nr++,
+        .node = node,
+        .type = type,
+        .task = task,
+        .radio_generation = nodes[node].radio_generation
+    };
+
+    events_count++;
+}
+
+static void remove_event(uint16_t index)
+{
+    events_count--;
+    events[index] = events[events_count];
+}
+
+static int find_timer_event(uint8_t node, task_t task)
+{
+    for(uint16_t i = 0; i < events_count; i++)
+    {
+        if(events[i].type == EVENT_TIMER && events[i].node == node && events[i].task == task)
+            return i;
+    }
+
+    return -1;
+}
+
+static int find_posted_task(uint8_t node, task_t task)
+{
+    for(uint16_t i = 0; i < tasks_count; i++)
+    {
+        posted_task_t* posted = &tasks[(tasks_head + i) % TASKS_MAX_COUNT];
+        if(posted->node == node && posted->task == task)
+            return (tasks_head + i) % TASKS_MAX_COUNT;
+    }
+
+    return -1;
+}
+
+static bool is_same_channel(channel_id_t const* a, channel_id_t const* b)
+{
+    // not using hw_radio_channel_ids_equal(), the padding of channel_id_t is not initialized
+    return a->channel_header_raw == b->channel_header_raw && a->center_freq_index == b->center_freq_index;
+}
+
+static void switch_radio_state(sim_node_t* node, radio_state_t state)
+{
+    if(node->state != RADIO_IDLE)
+        node->stats.radio_on_time += now - node->state_since;
+
+    if(node->state == RADIO_TX)
+        node->stats.tx_time += now - node->state_since;
+
+    node->state = state;
+    node->state_since = now;
+    node->radio_generation++;
+    node->receiving_from = NO_NODE; // any reception in progress is aborted
+}
+
+static int16_t get_rssi(uint8_t node_index)
+{
+    // the strongest of the transmissions on the channel
+    sim_node_t* node = &nodes[node_index];
+    int16_t rssi = SIM_NOISE_FLOOR;
+    for(uint8_t i = 0; i < node_count; i++)
+    {
+        if(i == node_index || nodes[i].state != RADIO_TX)
+            continue;
+
+        hw_tx_cfg_t const* tx_cfg = &(nodes[i].tx_packet->tx_meta.tx_cfg);
+        int16_t signal = tx_cfg->eirp - path_loss[i][node_index];
+        if(is_same_channel(&tx_cfg->channel_id, &node->rx_cfg.channel_id) && signal > rssi)
+            rssi = signal;
+    }
+
+    return rssi;
+}
+
+// a receiver locks on a frame when it is strong enough, another frame on the same channel overlapping with it
+// corrupts the reception
+static void lock_on_frame(uint8_t receiver_index, uint8_t transmitter_index)
+{
+    sim_node_t* receiver = &nodes[receiver_index];
+    hw_tx_cfg_t const* tx_cfg = &(nodes[transmitter_index].tx_packet->tx_meta.tx_cfg);
+    if(!is_same_channel(&receiver->rx_cfg.channel_id, &tx_cfg->channel_id))
+        return;
+
+    if(receiver->receiving_from != NO_NODE)
+    {
+        receiver->is_reception_corrupted = true;
+        return;
+    }
+
+    int8_t sensitivity = phy_get_sensitivity(tx_cfg->channel_id.channel_header);
+    if(receiver->rx_cfg.syncword_class != tx_cfg->syncword_class
+            || tx_cfg->eirp - path_loss[transmitter_index][receiver_index] < sensitivity)
+        return;
+
+    receiver->receiving_from = transmitter_index;
+    receiver->receiving_generation = receiver->radio_generation;
+    receiver->is_reception_corrupted = false;
+}
+
+static void start_rx(sim_node_t* node)
+{
+    uint8_t node_index = node - nodes;
+    switch_radio_state(node, RADIO_RX);
+    if(node->rssi_cb != NULL)
+        add_event(now + RSSI_SETTLING_TIME, node_index, EVENT_RSSI_VALID, NULL);
+
+    for(uint8_t i = 0; i < node_count; i++)
+    {
+        if(i != node_index && nodes[i].state == RADIO_TX && now - nodes[i].tx_start < PREAMBLE_TIME)
+            lock_on_frame(node_index, i);
+    }
+}
+
+// passes a received frame through the RX filter to the DLL, as the radio driver does
+static bool receive_frame(uint8_t node_index, uint8_t const* data, int16_t rssi)
+{
+    sim_node_t* node = &nodes[node_index];
+    if(node->state != RADIO_RX || node->rx_cb == NULL)
+        return false;
+
+    uint8_t filter_data_length = data[0] + 1 < HW_RADIO_RX_FILTER_DATA_SIZE? data[0] + 1 : HW_RADIO_RX_FILTER_DATA_SIZE;
+    if(node->rx_filter_cb != NULL && !node->rx_filter_cb(data, filter_data_length))
+    {
+        node->stats.frames_filtered++;
+        return true;
+    }
+
+    hw_radio_packet_t* packet = node->alloc_packet_cb(data[0]);
+    if(packet == NULL)
+        return true;
+
+    memcpy(packet->data, data, data[0] + 1);
+    packet->rx_meta.rx_cfg = node->rx_cfg;
+    packet->rx_meta.rssi = rssi;
+    packet->rx_meta.lqi = 0;
+    packet->rx_meta.crc_status = HW_CRC_UNAVAILABLE;
+    packet->rx_meta.timestamp = now;
+    node->stats.frames_received++;
+    node->rx_cb(packet);
+    return true;
+}
+
+static void complete_tx(uint8_t node_index)
+{
+    sim_node_t* node = &nodes[node_index];
+    hw_radio_packet_t* packet = node->tx_packet;
+    hw_tx_cfg_t tx_cfg = packet->tx_meta.tx_cfg;
+    uint8_t frame[256];
+    memcpy(frame, packet->data, packet->data[0] + 1);
+
+    if(node->state_after_tx == RADIO_RX)
+        start_rx(node);
+    else
+        switch_radio_state(node, RADIO_IDLE);
+
+    if(node->tx_cb != NULL)
+        node->tx_cb(packet);
+
+    for(uint8_t i = 0; i < node_count; i++)
+    {
+        sim_node_t* receiver = &nodes[i];
+        if(receiver->receiving_from != node_index || receiver->receiving_generation != receiver->radio_generation)
+            continue;
+
+        receiver->receiving_from = NO_NODE;
+        if(receiver->is_reception_corrupted)
+        {
+            receiver->stats.frames_collided++;
+            continue;
+        }
+
+        set_node_global_id(i);
+        receive_frame(i, frame, tx_cfg.eirp - path_loss[node_index][i]);
+    }
+}
+
+static void handle_event(event_t* event)
+{
+    set_node_global_id(event->node);
+    sim_node_t* node = &nodes[event->node];
+    switch(event->type)
+    {
+        case EVENT_TIMER:
+            sched_post_task(event->task);
+            break;
+        case EVENT_RSSI_VALID:
+            if(event->radio_generation == node->radio_generation && node->state == RADIO_RX && node->rssi_cb != NULL)
+                node->rssi_cb(get_rssi(event->node));
+
+            break;
+        case EVENT_TX_COMPLETED:
+            complete_tx(event->node);
+            break;
+    }
+}
+
+static void run_posted_tasks()
+{
+    while(tasks_count > 0)
+    {
+        posted_task_t posted = tasks[tasks_head];
+        tasks_head = (tasks_head + 1) % TASKS_MAX_COUNT;
+        tasks_count--;
+        set_node_global_id(posted.node);
+        posted.task();
+    }
+}
+
+void sim_run_until(timer_tick_t time)
+{
+    uint8_t selected_node = sim_get_node();
+    for(;;)
+    {
+        run_posted_tasks();
+
+        int next = -1;
+        for(uint16_t i = 0; i < events_count; i++)
+        {
+            if(next == -1 || (int32_t)(events[i].time - events[next].time) < 0
+                    || (events[i].time == events[next].time && events[i].sequence_nr < events[next].sequence_nr))
+                next = i;
+        }
+
+        if(next == -1 || (int32_t)(events[next].time - time) > 0)
+            break;
+
+        event_t event = events[next];
+        remove_event(next);
+        if((int32_t)(event.time - now) > 0)
+            now = event.time;
+
+        handle_event(&event);
+    }
+
+    if((int32_t)(time - now) > 0)
+        now = time;
+
+    set_node_global_id(selected_node);
+}
+
+void sim_run(timer_tick_t duration)
+{
+    sim_run_until(now + duration);
+}
+
+bool sim_run_until_idle(timer_tick_t max_duration)
+{
+    timer_tick_t deadline = now + max_duration;
+    for(;;)
+    {
+        run_posted_tasks();
+        if(events_count == 0)
+            return true;
+
+        timer_tick_t next_time = events[0].time;
+        for(uint16_t i = 1; i < events_count; i++)
+        {
+            if((int32_t)(events[i].time - next_time) < 0)
+                next_time = events[i].time;
+        }
+
+        if((int32_t)(next_time - deadline) > 0)
+        {
+            sim_run_until(deadline);
+            return false;
+        }
+
+        sim_run_until(next_time);
+    }
+}
+
+bool sim_inject_frame(uint8_t const* data, int16_t rssi)
+{
+    return receive_frame(sim_get_node(), data, rssi);
+}
+
+// framework
+
+void __assert_func(const char* file, int line, const char* func, const char* expression)
+{
+    fprintf(stderr, "node %i @%u: assertion \"%s\" failed: file \"%s\", line %i\n", (int)sim_get_node(), now,
+            expression, file, line);
+    abort();
+}
+
+void log_print_string(char* format, ...)
+{
+    if(!is_log_enabled)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    printf("%u node %i ", now, (int)sim_get_node());
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    fflush(stdout);
+}
+
+void log_print_stack_string(log_stack_layer_t type, char* format, ...)
+{
+    if(!is_log_enabled)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    printf("%u node %i L%i ", now, (int)sim_get_node(), type);
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    fflush(stdout);
+}
+
+void log_print_data(uint8_t* message, uint32_t length)
+{
+    if(!is_log_enabled)
+        return;
+
+    for(uint32_t i = 0; i < length; i++)
+        printf(" %02X", message[i]);
+
+    printf("\n");
+}
+
+void log_print_raw_phy_packet(hw_radio_packet_t* packet, bool is_tx)
+{
+}
+
+void set_rng_seed(unsigned int seed)
+{
+    rng_state = seed? seed : 1;
+}
+
+uint32_t get_rnd()
+{
+    // xorshift32, the same sequence on every host so simulations are repeatable
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+error_t sched_register_task(task_t task)
+{
+    return SUCCESS;
+}
+
+error_t sched_post_task_prio(task_t task, uint8_t priority)
+{
+    if(find_posted_task(sim_get_node(), task) != -1)
+        return EALREADY;
+
+    assert(tasks_count < TASKS_MAX_COUNT);
+    tasks[(tasks_head + tasks_count) % TASKS_MAX_COUNT] = (posted_task_t){ .node = sim_get_node(), .task = task };
+    tasks_count++;
+    return SUCCESS;
+}
+
+error_t sched_cancel_task(task_t task)
+{
+    int index = find_posted_task(sim_get_node(), task);
+    if(index == -1)
+        return EALREADY;
+
+    // keep the order of the remaining tasks
+    for(uint16_t i = (index - tasks_head + TASKS_MAX_COUNT) % TASKS_MAX_COUNT; i + 1 < tasks_count; i++)
+        tasks[(tasks_head + i) % TASKS_MAX_COUNT] = tasks[(tasks_head + i + 1) % TASKS_MAX_COUNT];
+
+    tasks_count--;
+    return SUCCESS;
+}
+
+bool sched_is_scheduled(task_t task)
+{
+    return find_posted_task(sim_get_node(), task) != -1;
+}
+
+timer_tick_t timer_get_counter_value()
+{
+    return now;
+}
+
+error_t timer_post_task_prio(task_t task, timer_tick_t delay, uint8_t priority)
+{
+    // FRAMEWORK_TIMER_RESET_COUNTER: the time is relative to now
+    if(find_timer_event(sim_get_node(), task) != -1)
+        return EALREADY;
+
+    add_event(now + delay, sim_get_node(), EVENT_TIMER, task);
+    return SUCCESS;
+}
+
+error_t timer_cancel_task(task_t task)
+{
+    int index = find_timer_event(sim_get_node(), task);
+    if(index == -1)
+        return FAIL;
+
+    remove_event(index);
+    return SUCCESS;
+}
+
+// HAL
+
+uint64_t hw_get_unique_id()
+{
+    return sim_get_uid(sim_get_node());
+}
+
+error_t hw_radio_init(alloc_packet_callback_t alloc_packet_cb, release_packet_callback_t release_packet_cb)
+{
+    sim_node_t* node = &nodes[sim_get_node()];
+    node->alloc_packet_cb = alloc_packet_cb;
+    node->release_packet_cb = release_packet_cb;
+    node->state = RADIO_IDLE;
+    node->state_since = now;
+    return SUCCESS;
+}
+
+error_t hw_radio_set_rx_filter(rx_filter_callback_t rx_filter_cb, bool first_byte_filter_enabled, uint8_t first_byte)
+{
+    nodes[sim_get_node()].rx_filter_cb = rx_filter_cb;
+    return SUCCESS;
+}
+
+eirp_t hw_radio_get_supported_eirp(eirp_t eirp)
+{
+    // the power levels of the CC1101 PA table
+    static const eirp_t levels[] = { -30, -20, -15, -10, 0, 5, 7, 10 };
+    uint8_t i = 0;
+    while(i < sizeof(levels) - 1 && levels[i] < eirp)
+        i++;
+
+    return levels[i];
+}
+
+error_t hw_radio_set_idle()
+{
+    sim_node_t* node = &nodes[sim_get_node()];
+    if(node->state == RADIO_TX)
+    {
+        node->state_after_tx = RADIO_IDLE;
+        return SUCCESS;
+    }
+
+    if(node->state == RADIO_IDLE)
+        return EALREADY;
+
+    switch_radio_state(node, RADIO_IDLE);
+    return SUCCESS;
+}
+
+error_t hw_radio_set_rx(hw_rx_cfg_t const* rx_cfg, rx_packet_callback_t rx_cb, rssi_valid_callback_t rssi_cb)
+{
+    sim_node_t* node = &nodes[sim_get_node()];
+    if(rx_cfg != NULL)
+        node->rx_cfg = *rx_cfg;
+
+    node->rx_cb = rx_cb;
+    node->rssi_cb = rssi_cb;
+    if(node->state == RADIO_TX)
+    {
+        node->state_after_tx = RADIO_RX;
+        return SUCCESS;
+    }
+
+    start_rx(node);
+    return SUCCESS;
+}
+
+error_t hw_radio_send_packet(hw_radio_packet_t* packet, tx_packet_callback_t tx_cb)
+{
+    uint8_t node_index = sim_get_node();
+    sim_node_t* node = &nodes[node_index];
+    if(node->state == RADIO_TX)
+        return EBUSY;
+
+    node->state_after_tx = node->state;
+    switch_radio_state(node, RADIO_TX);
+    node->tx_packet = packet;
+    node->tx_cb = tx_cb;
+    node->tx_start = now;
+    node->stats.frames_transmitted++;
+    if(tx_callback != NULL)
+        tx_callback(node_index, packet);
+
+    hw_tx_cfg_t const* tx_cfg = &(packet->tx_meta.tx_cfg);
+    timer_tick_t duration = phy_calculate_tx_duration(tx_cfg->channel_id.channel_header, packet->length + 1);
+    add_event(now + duration, node_index, EVENT_TX_COMPLETED, NULL);
+
+    for(uint8_t i = 0; i < node_count; i++)
+    {
+        if(i != node_index && nodes[i].state == RADIO_RX)
+            lock_on_frame(i, node_index);
+    }
+
+    return SUCCESS;
+}
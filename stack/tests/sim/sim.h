@@ -0,0 +1,121 @@
+/* * OSS-7 - An opensource implementation of the DASH7 Alliance Protocol for ultra
+ * lowpower wireless sensor communication
+ *
+ * Copyright 2015 University of Antwerp
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*! \file sim.h
+ *
+ * \brief Discrete event simulation of the HAL, the scheduler and the timer, used to run the D7AP stack on the host.
+ *
+ * The stack is built with NODE_GLOBALS so every simulated node has its own copy of the stack state. All nodes share
+ * the simulated time and the radio medium: a frame is received by the nodes listening on the channel of the frame
+ * when the path loss allows it and no other frame on the same channel overlapped with it. The sim selects the node
+ * before calling into the stack, tests select the node they call the stack for using sim_set_node().
+ *
+ * The nodes of most tests share the access profile of sim_get_default_access_profile(), the sim records the completed
+ * FIFO flushes of the nodes it initialized in their stats.
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#include "timer.h"
+#include "hwradio.h"
+#include "d7ap_stack.h"
+
+#define SIM_MAX_NODES NODE_GLOBALS_MAX_NODES
+
+#define SIM_DEFAULT_PATH_LOSS 70
+#define SIM_NOISE_FLOOR -110
+
+typedef void (*sim_tx_callback_t)(uint8_t node, hw_radio_packet_t const* packet);
+
+typedef struct
+{
+    uint32_t radio_on_time; // the ticks the radio spent in RX or TX
+    uint32_t tx_time;
+    uint32_t frames_transmitted;
+    uint32_t frames_received;
+    uint32_t frames_collided; // frames of which the reception was corrupted by another frame on the same channel
+    uint32_t frames_filtered; // frames dropped by the RX filter of the DLL before allocation
+    uint32_t flushes_completed; // D7ASP FIFO flushes completed
+    uint32_t requests_succeeded; // requests reported as succeeded by the completed flushes
+} sim_node_stats_t;
+
+/*! \brief Resets the simulation to node_count nodes with idle radios, the random generator is seeded with seed */
+void sim_init(uint8_t node_count, uint32_t seed);
+
+/*! \brief Selects the node of which the stack is called, and of which the HAL is used */
+void sim_set_node(uint8_t node);
+uint8_t sim_get_node();
+
+/*! \brief Runs all tasks and timers up to the given time, which becomes the current time */
+void sim_run_until(timer_tick_t time);
+
+/*! \brief Runs all tasks and timers for the given number of ticks */
+void sim_run(timer_tick_t duration);
+
+/*! \brief Runs until no tasks or timers are left, but not longer than max_duration ticks.
+ *  \returns true when no tasks or timers are left */
+bool sim_run_until_idle(timer_tick_t max_duration);
+
+timer_tick_t sim_get_time();
+
+uint64_t sim_get_uid(uint8_t node);
+
+/*! \brief Sets the path loss between 2 nodes in both directions, nodes do not receive frames arriving below the
+ *  sensitivity of the channel */
+void sim_set_path_loss(uint8_t node_a, uint8_t node_b, uint8_t path_loss);
+
+/*! \brief Called for every frame a node starts transmitting */
+void sim_set_tx_callback(sim_tx_callback_t tx_callback);
+
+/*! \brief Passes a frame to the selected node as if it was received, as long as its radio is in RX.
+ *
+ * data contains the frame starting with the length byte, the frame passes the RX filter of the node first.
+ * \returns false when the radio was not receiving, frames which are filtered or can not be allocated are dropped as
+ *          they are by the radio driver
+ */
+bool sim_inject_frame(uint8_t const* data, int16_t rssi);
+
+sim_node_stats_t const* sim_get_node_stats(uint8_t node);
+
+/*! \brief Fills the access profile the tests use unless they need another one: a continuous foreground scan without
+ *  CSMA-CA in subnet 0x05, on channel 0 of the 433 MHz band (normal rate, PN9) at 10 dBm, with a transmission timeout
+ *  period of 50 */
+void sim_get_default_access_profile(dae_access_profile_t* access_profile);
+
+/*! \brief Initializes the stack of the node with access_profile as its only access profile.
+ *
+ * fs_user_files_init_cb, alp_unhandled_action_cb and d7asp_init_args may be NULL, the D7ASP callbacks are called after
+ * the sim recorded the completed flush in the stats of the node.
+ */
+void sim_init_node(uint8_t node, dae_access_profile_t const* access_profile, fs_user_files_init_callback fs_user_files_init_cb,
+                   alp_unhandled_action_callback alp_unhandled_action_cb, d7asp_init_args_t const* d7asp_init_args);
+
+/*! \brief Initializes the stack of the node with the default access profile and without user files */
+void sim_init_default_node(uint8_t node, alp_unhandled_action_callback alp_unhandled_action_cb, d7asp_init_args_t const* d7asp_init_args);
+
+/*! \brief Prints the result of a check of a test.
+ *  \returns EXIT_SUCCESS when the condition holds, EXIT_FAILURE otherwise, so the results can be or'ed */
+int sim_check(bool condition, char const* description);
+
+void sim_set_log_enabled(bool enabled);
+
+#endif /* SIM_H_ */
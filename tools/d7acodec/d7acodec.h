@@ -0,0 +1,596 @@
+#ifndef D7ACODEC_H
+#define D7ACODEC_H
+
+// Header-only decoder for the frames transmitted by the OSS-7 stack and the ALP payloads they carry, for use in host
+// tools. Decoded frames and actions are views on the captured bytes: nothing is copied or allocated, so the buffer
+// passed to the decoder has to outlive the result.
+//
+// The layout of the headers follows stack/modules/d7ap (dll.c, d7anp.c, d7atp.c and alp.c), keep both in sync.
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace d7a {
+
+class ByteView
+{
+public:
+    ByteView() : _data(0), _size(0) {}
+    ByteView(const uint8_t* data, size_t size) : _data(data), _size(size) {}
+
+    const uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool isEmpty() const { return _size == 0; }
+    const uint8_t* begin() const { return _data; }
+    const uint8_t* end() const { return _data + _size; }
+    uint8_t operator[](size_t index) const { return _data[index]; }
+
+    ByteView mid(size_t offset, size_t size) const { return ByteView(_data + offset, size); }
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+};
+
+enum DecodeStatus
+{
+    DecodeOk = 0,
+    DecodeTruncated, // the frame or action ends before the field
+    DecodeCrcInvalid,
+    DecodeInvalidField, // a field has a value which is not supported
+    DecodeUnknownOperation
+};
+
+// reads the fields of a frame or payload, failing once the end is reached instead of reading beyond it
+class ByteReader
+{
+public:
+    explicit ByteReader(ByteView bytes) : _ptr(bytes.begin()), _end(bytes.end()) {}
+
+    const uint8_t* position() const { return _ptr; }
+    size_t remaining() const { return _end - _ptr; }
+
+    bool readByte(uint8_t& value)
+    {
+        if(_ptr >= _end)
+            return false;
+
+        value = *_ptr; _ptr++;
+        return true;
+    }
+
+    bool readBytes(size_t size, ByteView& view)
+    {
+        if(remaining() < size)
+            return false;
+
+        view = ByteView(_ptr, size); _ptr += size;
+        return true;
+    }
+
+    bool readUint16(uint16_t& value)
+    {
+        if(remaining() < 2)
+            return false;
+
+        value = (uint16_t)((_ptr[0] << 8) | _ptr[1]); _ptr += 2;
+        return true;
+    }
+
+    bool readUint32(uint32_t& value)
+    {
+        if(remaining() < 4)
+            return false;
+
+        value = ((uint32_t)_ptr[0] << 24) | ((uint32_t)_ptr[1] << 16) | ((uint32_t)_ptr[2] << 8) | _ptr[3]; _ptr += 4;
+        return true;
+    }
+
+    // the ALP length operand: the 2 MSBs of the first byte hold the number of bytes following it, the value is stored
+    // in the remaining bits (BE)
+    bool readLength(uint32_t& length)
+    {
+        if(_ptr >= _end)
+            return false;
+
+        size_t size = ((*_ptr) >> 6) + 1;
+        if(remaining() < size)
+            return false;
+
+        length = (*_ptr) & 0x3F; _ptr++;
+        for(size_t i = 1; i < size; i++)
+        {
+            length = (length << 8) | (*_ptr); _ptr++;
+        }
+
+        return true;
+    }
+
+private:
+    const uint8_t* _ptr;
+    const uint8_t* _end;
+};
+
+// the CRC16 of framework/components/crc
+inline uint16_t calculateCrc(const uint8_t* data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for(size_t i = 0; i < length; i++)
+    {
+        uint16_t crcNew = (uint8_t)(crc >> 8) | (uint16_t)(crc << 8);
+        crcNew ^= data[i];
+        crcNew ^= (uint8_t)(crcNew & 0xFF) >> 4;
+        crcNew ^= (uint16_t)(crcNew << 12);
+        crcNew ^= (uint16_t)((crcNew & 0xFF) << 5);
+        crc = crcNew;
+    }
+
+    return crc;
+}
+
+// the frame starts with the length byte, which holds the number of bytes following it including the CRC. The CRC is
+// calculated in the same way as packet.c does.
+inline bool isFrameCrcValid(ByteView frame)
+{
+    size_t length = frame[0];
+    uint16_t crc = calculateCrc(frame.data(), length - 2);
+    return frame[length - 1] == (crc >> 8) && frame[length] == (crc & 0xFF);
+}
+
+enum NlsMethod
+{
+    NlsMethodNone = 0,
+    NlsMethodAesCtr = 1,
+    NlsMethodAesCbcMac128 = 2,
+    NlsMethodAesCbcMac64 = 3,
+    NlsMethodAesCbcMac32 = 4,
+    NlsMethodAesCcm128 = 5,
+    NlsMethodAesCcm64 = 6,
+    NlsMethodAesCcm32 = 7
+};
+
+inline size_t getMicSize(uint8_t nlsMethod)
+{
+    switch(nlsMethod)
+    {
+        case NlsMethodAesCbcMac128:
+        case NlsMethodAesCcm128:
+            return 16;
+        case NlsMethodAesCbcMac64:
+        case NlsMethodAesCcm64:
+            return 8;
+        case NlsMethodAesCbcMac32:
+        case NlsMethodAesCcm32:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+struct DllHeader
+{
+    uint8_t subnet;
+    uint8_t control;
+    ByteView targetAddress; // empty for broadcast frames
+
+    bool isTargetAddressSet() const { return control & 0x80; }
+    bool isVidUsed() const { return control & 0x40; }
+    int eirp() const { return (int)(control & 0x3F) - 32; }
+};
+
+struct NetworkHeader
+{
+    uint8_t control;
+    uint8_t hopControl; // only valid when hopping
+    ByteView relayAccessId;
+    ByteView destinationAccessId;
+    ByteView originAccessId;
+    uint8_t nlsMethod;
+    uint8_t keyCounter;
+    uint32_t frameCounter;
+
+    bool isNlsEnabled() const { return control & 0x80; }
+    bool isHopEnabled() const { return control & 0x40; }
+    bool isOriginAccessIdPresent() const { return control & 0x20; }
+    bool isOriginAccessIdVid() const { return control & 0x10; }
+    uint8_t originAccessClass() const { return control & 0x0F; }
+    bool isRelayAccessIdPresent() const { return hopControl & 0x20; }
+    bool isDestinationAccessIdVid() const { return hopControl & 0x10; }
+    uint8_t hopLimit() const { return hopControl & 0x0F; }
+    // the transport header and payload are encrypted, these can only be decoded after decrypting them
+    bool isEncrypted() const { return isNlsEnabled() && nlsMethod != NlsMethodAesCbcMac128 && nlsMethod != NlsMethodAesCbcMac64
+                                      && nlsMethod != NlsMethodAesCbcMac32; }
+};
+
+struct TransportHeader
+{
+    uint8_t control;
+    uint8_t dialogId;
+    uint8_t transactionId;
+    uint8_t timeoutTemplate; // only valid when present
+    uint8_t ackTransactionIdStart; // only valid when the ACK template is present
+    uint8_t ackTransactionIdStop;
+    ByteView ackBitmap;
+
+    bool isStart() const { return control & 0x80; }
+    bool isStop() const { return control & 0x40; }
+    bool isTimeoutTemplatePresent() const { return control & 0x20; }
+    bool isAckRequested() const { return control & 0x08; }
+    bool isAckNotVoid() const { return control & 0x04; }
+    bool isAckRecord() const { return control & 0x02; }
+    bool isAckTemplatePresent() const { return control & 0x01; }
+};
+
+struct ForegroundFrame
+{
+    ByteView raw; // including the length byte and the CRC
+    DllHeader dll;
+    NetworkHeader network;
+    TransportHeader transport; // not decoded when the frame is encrypted
+    ByteView securedData; // the transport header and payload as transmitted, when the frame is encrypted
+    ByteView payload; // the ALP payload, empty when the frame is encrypted
+    ByteView mic;
+};
+
+struct BackgroundFrame
+{
+    uint8_t subnet;
+    uint16_t eta; // the time in ticks until the foreground frame is transmitted
+};
+
+inline DecodeStatus decodeDllHeader(ByteReader& reader, DllHeader& header)
+{
+    if(!reader.readByte(header.subnet) || !reader.readByte(header.control))
+        return DecodeTruncated;
+
+    header.targetAddress = ByteView();
+    if(header.isTargetAddressSet() && !reader.readBytes(header.isVidUsed()? 2 : 8, header.targetAddress))
+        return DecodeTruncated;
+
+    return DecodeOk;
+}
+
+inline DecodeStatus decodeNetworkHeader(ByteReader& reader, NetworkHeader& header)
+{
+    header = NetworkHeader();
+    if(!reader.readByte(header.control))
+        return DecodeTruncated;
+
+    if(header.isHopEnabled())
+    {
+        if(!reader.readByte(header.hopControl))
+            return DecodeTruncated;
+
+        if(header.isRelayAccessIdPresent() && !reader.readBytes(8, header.relayAccessId))
+            return DecodeTruncated;
+
+        if(!reader.readBytes(header.isDestinationAccessIdVid()? 2 : 8, header.destinationAccessId))
+            return DecodeTruncated;
+    }
+
+    if(header.isOriginAccessIdPresent() && !reader.readBytes(header.isOriginAccessIdVid()? 2 : 8, header.originAccessId))
+        return DecodeTruncated;
+
+    if(header.isNlsEnabled())
+    {
+        if(!reader.readByte(header.nlsMethod) || !reader.readByte(header.keyCounter) || !reader.readUint32(header.frameCounter))
+            return DecodeTruncated;
+
+        if(header.nlsMethod == NlsMethodNone || header.nlsMethod > NlsMethodAesCcm32)
+            return DecodeInvalidField;
+    }
+
+    return DecodeOk;
+}
+
+inline DecodeStatus decodeTransportHeader(ByteReader& reader, TransportHeader& header)
+{
+    header = TransportHeader();
+    if(!reader.readByte(header.control) || !reader.readByte(header.dialogId) || !reader.readByte(header.transactionId))
+        return DecodeTruncated;
+
+    if(header.isTimeoutTemplatePresent() && !reader.readByte(header.timeoutTemplate))
+        return DecodeTruncated;
+
+    if(header.isAckTemplatePresent())
+    {
+        if(!reader.readByte(header.ackTransactionIdStart) || !reader.readByte(header.ackTransactionIdStop))
+            return DecodeTruncated;
+
+        size_t ackBitmapSize = (uint8_t)(header.ackTransactionIdStop - header.ackTransactionIdStart) / 8 + 1;
+        if(!reader.readBytes(ackBitmapSize, header.ackBitmap))
+            return DecodeTruncated;
+    }
+
+    return DecodeOk;
+}
+
+// decodes a frame received with the foreground syncword, starting with the length byte
+inline DecodeStatus decodeForegroundFrame(ByteView frame, ForegroundFrame& decoded)
+{
+    if(frame.isEmpty() || frame[0] < 2 || frame.size() < (size_t)frame[0] + 1)
+        return DecodeTruncated;
+
+    decoded.raw = frame.mid(0, frame[0] + 1);
+    if(!isFrameCrcValid(decoded.raw))
+        return DecodeCrcInvalid;
+
+    ByteReader reader(decoded.raw.mid(1, decoded.raw.size() - 1 - 2));
+    DecodeStatus status = decodeDllHeader(reader, decoded.dll);
+    if(status == DecodeOk)
+        status = decodeNetworkHeader(reader, decoded.network);
+
+    if(status != DecodeOk)
+        return status;
+
+    size_t micSize = decoded.network.isNlsEnabled()? getMicSize(decoded.network.nlsMethod) : 0;
+    if(reader.remaining() < micSize)
+        return DecodeTruncated;
+
+    ByteView upperLayerData(reader.position(), reader.remaining() - micSize);
+    decoded.mic = ByteView(upperLayerData.end(), micSize);
+    decoded.transport = TransportHeader();
+    decoded.payload = ByteView();
+    decoded.securedData = ByteView();
+    if(decoded.network.isEncrypted())
+    {
+        decoded.securedData = upperLayerData;
+        return DecodeOk;
+    }
+
+    ByteReader upperLayerReader(upperLayerData);
+    status = decodeTransportHeader(upperLayerReader, decoded.transport);
+    if(status != DecodeOk)
+        return status;
+
+    decoded.payload = ByteView(upperLayerReader.position(), upperLayerReader.remaining());
+    return DecodeOk;
+}
+
+// decodes a frame received with the background syncword, starting with the length byte
+inline DecodeStatus decodeBackgroundFrame(ByteView frame, BackgroundFrame& decoded)
+{
+    const size_t backgroundFrameLength = 5;
+    if(frame.size() < backgroundFrameLength + 1)
+        return DecodeTruncated;
+
+    if(frame[0] != backgroundFrameLength)
+        return DecodeInvalidField;
+
+    // unlike the CRC of a foreground frame, this one covers all bytes before it
+    uint16_t crc = calculateCrc(frame.data(), backgroundFrameLength - 1);
+    if(frame[4] != (crc >> 8) || frame[5] != (crc & 0xFF))
+        return DecodeCrcInvalid;
+
+    decoded.subnet = frame[1];
+    decoded.eta = (uint16_t)((frame[2] << 8) | frame[3]);
+    return DecodeOk;
+}
+
+enum AlpOperation
+{
+    AlpOpNop = 0,
+    AlpOpReadFileData = 1,
+    AlpOpReadFileProperties = 2,
+    AlpOpWriteFileData = 4,
+    AlpOpWriteFileDataFlush = 5,
+    AlpOpWriteFileProperties = 6,
+    AlpOpActionQuery = 8,
+    AlpOpBreakQuery = 9,
+    AlpOpPermissionRequest = 10,
+    AlpOpVerifyChecksum = 11,
+    AlpOpExistFile = 16,
+    AlpOpCreateFile = 17,
+    AlpOpDeleteFile = 18,
+    AlpOpRestoreFile = 19,
+    AlpOpFlushFile = 20,
+    AlpOpOpenFile = 21,
+    AlpOpCloseFile = 22,
+    AlpOpCopyFile = 23,
+    AlpOpExecuteFile = 31,
+    AlpOpReturnFileData = 32,
+    AlpOpReturnFileProperties = 33,
+    AlpOpReturnStatus = 34,
+    AlpOpChunk = 48,
+    AlpOpLogic = 49
+};
+
+enum AlpOperandType
+{
+    AlpOperandUnknown = 0,
+    AlpOperandNone,
+    AlpOperandFileId,
+    AlpOperandFileDataRequest,
+    AlpOperandFileData,
+    AlpOperandFileHeader,
+    AlpOperandFileCopy,
+    AlpOperandStatus,
+    AlpOperandQuery
+};
+
+enum AlpQueryType
+{
+    AlpQueryNonVoidCheck = 0,
+    AlpQueryArithCompWithZero = 1,
+    AlpQueryArithCompWithValue = 2,
+    AlpQueryArithCompBetweenFiles = 3,
+    AlpQueryStringTokenSearch = 7
+};
+
+// the operand of each operation, as in the operations table of alp.c
+inline AlpOperandType getAlpOperandType(uint8_t operation)
+{
+    switch(operation)
+    {
+        case AlpOpNop:
+        case AlpOpChunk:
+        case AlpOpLogic:
+            return AlpOperandNone;
+        case AlpOpReadFileData:
+            return AlpOperandFileDataRequest;
+        case AlpOpReadFileProperties:
+        case AlpOpExistFile:
+        case AlpOpDeleteFile:
+        case AlpOpRestoreFile:
+        case AlpOpFlushFile:
+        case AlpOpOpenFile:
+        case AlpOpCloseFile:
+            return AlpOperandFileId;
+        case AlpOpWriteFileData:
+        case AlpOpWriteFileDataFlush:
+        case AlpOpReturnFileData:
+            return AlpOperandFileData;
+        case AlpOpWriteFileProperties:
+        case AlpOpCreateFile:
+        case AlpOpReturnFileProperties:
+            return AlpOperandFileHeader;
+        case AlpOpCopyFile:
+            return AlpOperandFileCopy;
+        case AlpOpReturnStatus:
+            return AlpOperandStatus;
+        case AlpOpActionQuery:
+        case AlpOpBreakQuery:
+            return AlpOperandQuery;
+        default:
+            return AlpOperandUnknown;
+    }
+}
+
+// a decoded ALP action, only the fields of the operand of the operation are valid
+struct AlpAction
+{
+    ByteView raw;
+    uint8_t control;
+    uint8_t fileId;
+    uint32_t offset;
+    uint32_t length; // the requested or provided data length, or the compare length of a query
+    ByteView data; // the file data, or the value a query compares with
+    uint8_t destinationFileId; // file copy
+    uint8_t permissions; // file header
+    uint8_t properties;
+    uint8_t actionFileId;
+    uint8_t interfaceFileId;
+    uint32_t fileSize;
+    uint32_t allocatedSize;
+    uint8_t actionIndex; // status
+    uint8_t statusCode;
+    uint8_t queryCode; // query
+    ByteView mask;
+    uint8_t compareFileId;
+    uint32_t compareOffset;
+
+    AlpOperation operation() const { return (AlpOperation)(control & 0x3F); }
+    bool isResponseRequested() const { return control & 0x40; }
+    bool isGroup() const { return control & 0x80; }
+    AlpQueryType queryType() const { return (AlpQueryType)(queryCode >> 5); }
+    bool isQueryMaskPresent() const { return queryCode & 0x10; }
+    uint8_t queryParams() const { return queryCode & 0x0F; }
+};
+
+inline DecodeStatus decodeAlpQueryOperand(ByteReader& reader, AlpAction& action)
+{
+    if(!reader.readByte(action.queryCode) || !reader.readLength(action.length))
+        return DecodeTruncated;
+
+    AlpQueryType type = action.queryType();
+    if(type != AlpQueryNonVoidCheck && type != AlpQueryArithCompWithZero && type != AlpQueryArithCompWithValue
+            && type != AlpQueryArithCompBetweenFiles && type != AlpQueryStringTokenSearch)
+        return DecodeInvalidField;
+
+    if(action.isQueryMaskPresent() && !reader.readBytes(action.length, action.mask))
+        return DecodeTruncated;
+
+    if((type == AlpQueryArithCompWithValue || type == AlpQueryStringTokenSearch) && !reader.readBytes(action.length, action.data))
+        return DecodeTruncated;
+
+    if(!reader.readByte(action.fileId) || !reader.readLength(action.offset))
+        return DecodeTruncated;
+
+    if(type == AlpQueryArithCompBetweenFiles && (!reader.readByte(action.compareFileId) || !reader.readLength(action.compareOffset)))
+        return DecodeTruncated;
+
+    return DecodeOk;
+}
+
+inline DecodeStatus decodeAlpAction(ByteReader& reader, AlpAction& action)
+{
+    action = AlpAction();
+    const uint8_t* start = reader.position();
+    if(!reader.readByte(action.control))
+        return DecodeTruncated;
+
+    bool isComplete = true;
+    switch(getAlpOperandType(action.operation()))
+    {
+        case AlpOperandNone:
+            break;
+        case AlpOperandFileId:
+            isComplete = reader.readByte(action.fileId);
+            break;
+        case AlpOperandFileDataRequest:
+            isComplete = reader.readByte(action.fileId) && reader.readLength(action.offset) && reader.readLength(action.length);
+            break;
+        case AlpOperandFileData:
+            isComplete = reader.readByte(action.fileId) && reader.readLength(action.offset) && reader.readLength(action.length)
+                    && reader.readBytes(action.length, action.data);
+            break;
+        case AlpOperandFileHeader:
+            isComplete = reader.readByte(action.fileId) && reader.readByte(action.permissions) && reader.readByte(action.properties)
+                    && reader.readByte(action.actionFileId) && reader.readByte(action.interfaceFileId)
+                    && reader.readUint32(action.fileSize) && reader.readUint32(action.allocatedSize);
+            break;
+        case AlpOperandFileCopy:
+            isComplete = reader.readByte(action.fileId) && reader.readByte(action.destinationFileId);
+            break;
+        case AlpOperandStatus:
+            isComplete = reader.readByte(action.actionIndex) && reader.readByte(action.statusCode);
+            break;
+        case AlpOperandQuery:
+        {
+            DecodeStatus status = decodeAlpQueryOperand(reader, action);
+            if(status != DecodeOk)
+                return status;
+
+            break;
+        }
+        default:
+            return DecodeUnknownOperation;
+    }
+
+    if(!isComplete)
+        return DecodeTruncated;
+
+    action.raw = ByteView(start, reader.position() - start);
+    return DecodeOk;
+}
+
+// iterates over the actions of an ALP payload:
+//     AlpPayloadReader reader(frame.payload);
+//     AlpAction action;
+//     while(reader.next(action)) { ... }
+//     if(reader.status() != DecodeOk) { ... }
+class AlpPayloadReader
+{
+public:
+    explicit AlpPayloadReader(ByteView payload) : _reader(payload), _status(DecodeOk) {}
+
+    bool next(AlpAction& action)
+    {
+        if(_status != DecodeOk || _reader.remaining() == 0)
+            return false;
+
+        _status = decodeAlpAction(_reader, action);
+        return _status == DecodeOk;
+    }
+
+    // the status of the last action decoded, decoding stops at the first action which fails
+    DecodeStatus status() const { return _status; }
+
+private:
+    ByteReader _reader;
+    DecodeStatus _status;
+};
+
+} // namespace d7a
+
+#endif // D7ACODEC_H
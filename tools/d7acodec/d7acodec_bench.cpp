@@ -0,0 +1,216 @@
+// Measures the frames and ALP actions per second d7acodec.h decodes from a capture file.
+//
+// The capture contains foreground frames as transmitted by the stack, back to back, each starting with its length byte.
+// A capture with synthetic frames can be generated: broadcast requests, unicast responses acknowledging a request and
+// requests authenticated with NLS (AES-CBC-MAC-128).
+//
+// Usage:
+//     d7acodec_bench generate <capture file> <frames count>
+//     d7acodec_bench <capture file> [<passes>]
+//
+// Decoding fails when a frame of the capture can not be decoded.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "d7acodec.h"
+
+namespace {
+
+const uint8_t subnet = 0x05;
+const uint8_t eirp = 10 + 32;
+const uint8_t requesterUid[8] = { 0xD7, 0xA0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 };
+const uint8_t responderUid[8] = { 0xD7, 0xA0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02 };
+
+class FrameBuilder
+{
+public:
+    explicit FrameBuilder(std::vector<uint8_t>& capture) : _capture(capture), _start(capture.size())
+    {
+        _capture.push_back(0); // length
+    }
+
+    void add(uint8_t byte) { _capture.push_back(byte); }
+    void add(const uint8_t* bytes, size_t size) { _capture.insert(_capture.end(), bytes, bytes + size); }
+
+    // the length byte holds the number of bytes following it, including the CRC
+    void finish()
+    {
+        uint8_t* frame = &_capture[_start];
+        frame[0] = (uint8_t)(_capture.size() - _start - 1 + 2);
+        uint16_t crc = d7a::calculateCrc(&_capture[_start], frame[0] - 2);
+        _capture.push_back(crc >> 8);
+        _capture.push_back(crc & 0xFF);
+    }
+
+private:
+    std::vector<uint8_t>& _capture;
+    size_t _start;
+};
+
+// a broadcast request with an action query and the UID of the requester
+void addRequest(std::vector<uint8_t>& capture, uint8_t dialogId, bool isAuthenticated)
+{
+    FrameBuilder frame(capture);
+    frame.add(subnet);
+    frame.add(eirp);
+    frame.add(isAuthenticated? 0xA0 : 0x20); // origin UID present, access class 0
+    frame.add(requesterUid, sizeof(requesterUid));
+    if(isAuthenticated)
+    {
+        const uint8_t securityHeader[] = { d7a::NlsMethodAesCbcMac128, 0x00, 0x00, 0x00, 0x01, dialogId };
+        frame.add(securityHeader, sizeof(securityHeader));
+    }
+
+    const uint8_t transportHeader[] = { 0xA8, dialogId, 0x00, 0x02 }; // start, timeout template, ACK requested
+    frame.add(transportHeader, sizeof(transportHeader));
+
+    const uint8_t actions[] = {
+        d7a::AlpOpActionQuery, 0x51, 0x02, 0xFF, 0x0F, 0x12, 0x34, 0x40, 0x00,
+        d7a::AlpOpReturnFileData, 0x00, 0x00, 0x08, 0xD7, 0xA0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01
+    };
+    frame.add(actions, sizeof(actions));
+
+    if(isAuthenticated)
+    {
+        const uint8_t mic[16] = { 0 };
+        frame.add(mic, sizeof(mic));
+    }
+
+    frame.finish();
+}
+
+// a unicast response acknowledging the request, with the data of a sensor file
+void addResponse(std::vector<uint8_t>& capture, uint8_t dialogId)
+{
+    FrameBuilder frame(capture);
+    frame.add(subnet);
+    frame.add(0x80 | eirp); // target UID present
+    frame.add(requesterUid, sizeof(requesterUid));
+    frame.add(0x20);
+    frame.add(responderUid, sizeof(responderUid));
+
+    const uint8_t transportHeader[] = { 0x41, dialogId, 0x00, 0x00, 0x00, 0x01 }; // stop, ACK template
+    frame.add(transportHeader, sizeof(transportHeader));
+
+    const uint8_t actions[] = {
+        d7a::AlpOpReturnFileData, 0x40, 0x00, 0x04, 0x01, 0x02, 0x03, 0x04,
+        d7a::AlpOpReturnStatus, 0x01, 0x00
+    };
+    frame.add(actions, sizeof(actions));
+    frame.finish();
+}
+
+int generate(const char* fileName, long framesCount)
+{
+    std::vector<uint8_t> capture;
+    for(long i = 0; i < framesCount; i++)
+    {
+        uint8_t dialogId = (uint8_t)i;
+        switch(i % 3)
+        {
+            case 0: addRequest(capture, dialogId, false); break;
+            case 1: addResponse(capture, dialogId); break;
+            default: addRequest(capture, dialogId, true); break;
+        }
+    }
+
+    FILE* file = fopen(fileName, "wb");
+    if(file == NULL || fwrite(capture.data(), 1, capture.size(), file) != capture.size())
+    {
+        perror(fileName);
+        return EXIT_FAILURE;
+    }
+
+    fclose(file);
+    printf("generated %li frames, %zu bytes\n", framesCount, capture.size());
+    return EXIT_SUCCESS;
+}
+
+bool readCapture(const char* fileName, std::vector<uint8_t>& capture)
+{
+    FILE* file = fopen(fileName, "rb");
+    if(file == NULL)
+    {
+        perror(fileName);
+        return false;
+    }
+
+    uint8_t buffer[4096];
+    size_t size;
+    while((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        capture.insert(capture.end(), buffer, buffer + size);
+
+    fclose(file);
+    return true;
+}
+
+int decode(const char* fileName, long passes)
+{
+    std::vector<uint8_t> capture;
+    if(!readCapture(fileName, capture) || capture.empty())
+        return EXIT_FAILURE;
+
+    long framesCount = 0;
+    long actionsCount = 0;
+    long failedCount = 0;
+    uint32_t checksum = 0; // keeps the decoded fields from being optimized away
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(long pass = 0; pass < passes; pass++)
+    {
+        size_t offset = 0;
+        while(offset < capture.size())
+        {
+            d7a::ForegroundFrame frame;
+            d7a::ByteView bytes(capture.data() + offset, capture.size() - offset);
+            offset += bytes[0] + 1;
+            framesCount++;
+            if(d7a::decodeForegroundFrame(bytes, frame) != d7a::DecodeOk)
+            {
+                failedCount++;
+                continue;
+            }
+
+            checksum += frame.transport.dialogId;
+            d7a::AlpPayloadReader reader(frame.payload);
+            d7a::AlpAction action;
+            while(reader.next(action))
+            {
+                actionsCount++;
+                checksum += action.fileId + action.length;
+            }
+
+            if(reader.status() != d7a::DecodeOk)
+                failedCount++;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("decoded %li frames and %li actions in %.3f s: %.0f frames/s, %.0f actions/s (checksum %u)\n", framesCount,
+           actionsCount, seconds, seconds > 0? framesCount / seconds : 0, seconds > 0? actionsCount / seconds : 0, checksum);
+
+    if(failedCount > 0)
+    {
+        printf("%li frames not decoded\n", failedCount);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if(argc == 4 && strcmp(argv[1], "generate") == 0)
+        return generate(argv[2], atol(argv[3]));
+
+    if(argc == 2 || argc == 3)
+        return decode(argv[1], argc == 3? atol(argv[2]) : 1);
+
+    printf("usage: %s generate <capture file> <frames count> | <capture file> [<passes>]\n", argv[0]);
+    return EXIT_FAILURE;
+}
@@ -24,3 +24,7 @@ HEADERS  += \
     bytearrayutils.h
 
 INCLUDEPATH += ../../../d7aoss/
+
+# the frames are decoded using the header-only decoder in tools/d7acodec
+INCLUDEPATH += $$PWD/../../d7acodec
+HEADERS += $$PWD/../../d7acodec/d7acodec.h
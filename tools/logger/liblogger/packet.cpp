@@ -1,6 +1,5 @@
 #include "packet.h"
 
-#include "phy/phy.h"
 #include "framework/log.h"
 
 #include "bytearrayutils.h"
@@ -10,6 +9,11 @@ Packet::Packet()
 {
     _timestamp = QDateTime::currentDateTime();
     _hasDllInformation = false;
+    _decodeStatus = d7a::DecodeTruncated;
+    _subnet = 0;
+    _dialogId = 0;
+    _transactionId = 0;
+    _nlsEnabled = false;
 }
 
 QByteArray Packet::rawPacket() const
@@ -29,69 +33,34 @@ void Packet::parsePhyRx(QByteArray packetData)
     _rawPacket = QByteArray(&data[5], _length);
 }
 
+// the raw packet is the frame as transmitted, starting with the length byte. The decoded frame refers to the raw packet,
+// only the fields shown are copied.
 void Packet::parseRawPacket()
 {
     Q_ASSERT_X(_hasDllInformation, "parseRawPacket", "Cannot parse when no DLL RX log received");
 
-    const char* data = _rawPacket.constData();
-
+    d7a::ByteView frame((const uint8_t*)_rawPacket.constData(), _rawPacket.size());
     if(_frameType == FrameTypeBackgroundFrame)
     {
-        // TODO
-        qCritical("not implemented yet");
+        d7a::BackgroundFrame backgroundFrame;
+        _decodeStatus = d7a::decodeBackgroundFrame(frame, backgroundFrame);
+        if(_decodeStatus == d7a::DecodeOk)
+            _subnet = backgroundFrame.subnet;
+
         return;
     }
-    else if(_frameType == FrameTypeForegroundFrame)
-    {
-        data += 2;
-        _subnet = *data; data++;
-        uint8_t frame_ctl = *data; data++;
-
-        if(frame_ctl & FRAME_CTL_DLLS)
-        {
-            // TODO
-            qCritical("not implemented yet");
-            return;
-        }
-
-        if(frame_ctl & FRAME_CTL_EN_ADDR)
-        {
-            _dialogId = *data; data++;
-            uint8_t flags = *data; data++;
-            uint8_t addressingOptions = (flags & 0xC0) >> 6;
-            bool vidEnabled = (flags & 0x20);
-            bool nlsEnabled = (flags & 0x10);
-            // TODO frame continuity
-            // TODO CRC32
-            // TODO NM2
-            // TODO frame type
-
-            if(vidEnabled)
-            {
-                _sourceId = QByteArray(data, 2);
-                data += 2;
-            }
-            else
-            {
-                _sourceId = QByteArray(data, 8);
-                data += 8;
-            }
-
-            if(nlsEnabled && addressingOptions == 0)
-            {
-                // TODO parse target ID header
-                qCritical("not implemented yet");
-                return;
-            }
-
-            data++; // TODO what is this?
-            data++; // isfid
-            data++; // isfoffset
-            uint8_t payloadLength = *data; data++;
-            _payload = QByteArray(data, payloadLength);
-        }
-    }
 
+    d7a::ForegroundFrame foregroundFrame;
+    _decodeStatus = d7a::decodeForegroundFrame(frame, foregroundFrame);
+    if(_decodeStatus != d7a::DecodeOk)
+        return;
+
+    _subnet = foregroundFrame.dll.subnet;
+    _nlsEnabled = foregroundFrame.network.isNlsEnabled();
+    _dialogId = foregroundFrame.transport.dialogId;
+    _transactionId = foregroundFrame.transport.transactionId;
+    _sourceId = QByteArray((const char*)foregroundFrame.network.originAccessId.data(), foregroundFrame.network.originAccessId.size());
+    _payload = QByteArray((const char*)foregroundFrame.payload.data(), foregroundFrame.payload.size());
 }
 
 void Packet::parseDllRx(QByteArray data)
@@ -116,6 +85,40 @@ QDateTime Packet::timestamp() const
     return _timestamp;
 }
 
+static QString decodeStatusToString(d7a::DecodeStatus status)
+{
+    switch(status)
+    {
+        case d7a::DecodeOk: return "ok";
+        case d7a::DecodeTruncated: return "truncated";
+        case d7a::DecodeCrcInvalid: return "CRC invalid";
+        case d7a::DecodeInvalidField: return "invalid field";
+        case d7a::DecodeUnknownOperation: return "unknown ALP operation";
+        default: return "unknown error";
+    }
+}
+
+// the actions are decoded from the payload when shown, the payload of an encrypted frame is empty
+QString Packet::alpActionsToString() const
+{
+    QString description = "ALP:\n";
+    d7a::AlpPayloadReader reader(d7a::ByteView((const uint8_t*)_payload.constData(), _payload.size()));
+    d7a::AlpAction action;
+    while(reader.next(action))
+    {
+        description.append(QString("\tOperation: %1, file ID: %2, offset: %3, length: %4\n")
+                           .arg(action.operation())
+                           .arg(QString().sprintf("0x%02x", action.fileId))
+                           .arg(action.offset)
+                           .arg(action.length));
+    }
+
+    if(reader.status() != d7a::DecodeOk)
+        description.append(QString("\tNot decoded: %1\n").arg(decodeStatusToString(reader.status())));
+
+    return description;
+}
+
 QString Packet::toString() const
 {
     char buffer[1000]; // TODO max size?
@@ -134,21 +137,32 @@ QString Packet::toString() const
             .arg(_eirp)
             .arg(_lqi);
 
+    if(_decodeStatus != d7a::DecodeOk)
+    {
+        packetDescription.append(QString("Not decoded: %1\n").arg(decodeStatusToString(_decodeStatus)));
+        return hex.append(packetDescription);
+    }
+
     packetDescription.append(QString("DLL:\n" \
                "\tFrame type: %1\n" \
                "\tSpectrum ID: %2\n" \
                "\tSubnet: %3\n" \
-               "\tDialog ID: %4\n" \
-               "\tSource ID: %5\n" \
-               "\tPayload: %6\n")
+               "\tNLS: %4\n" \
+               "\tDialog ID: %5\n" \
+               "\tTransaction ID: %6\n" \
+               "\tSource ID: %7\n" \
+               "\tPayload: %8\n")
             .arg(_frameType == FrameTypeForegroundFrame? "foreground" : "background")
             .arg(QString().sprintf("0x%02x", _spectrumId))
             .arg(_subnet)
+            .arg(_nlsEnabled? "enabled" : "disabled")
             .arg(_dialogId)
+            .arg(_transactionId)
             .arg(ByteArrayUtils::toString(_sourceId))
             .arg(ByteArrayUtils::toString(_payload))
             );
 
+    packetDescription.append(alpActionsToString());
     return hex.append(packetDescription);
 }
 
@@ -166,3 +180,8 @@ QByteArray Packet::sourceId() const
 {
     return _sourceId;
 }
+
+d7a::DecodeStatus Packet::decodeStatus() const
+{
+    return _decodeStatus;
+}
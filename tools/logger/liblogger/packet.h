@@ -5,6 +5,8 @@
 
 #include "dll/dll.h"
 
+#include "d7acodec.h"
+
 class Packet
 {
 public:
@@ -21,8 +23,11 @@ public:
     bool isCrcValid() const;
     signed int rss() const;
     QByteArray sourceId() const;
+    d7a::DecodeStatus decodeStatus() const;
 
 private:
+    QString alpActionsToString() const;
+
     QDateTime _timestamp;
     QByteArray _rawPacket;
     uint _length;
@@ -33,8 +38,11 @@ private:
 
     bool _hasDllInformation;
     Frame_Type _frameType;
+    d7a::DecodeStatus _decodeStatus;
     uint8_t _subnet;
     uint8_t _dialogId;
+    uint8_t _transactionId;
+    bool _nlsEnabled;
     QByteArray _sourceId;
     QByteArray _payload;
     uint8_t _spectrumId;
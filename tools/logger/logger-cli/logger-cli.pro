@@ -27,6 +27,9 @@ else:unix: LIBS += -L$$OUT_PWD/../liblogger/ -llogger
 INCLUDEPATH += $$PWD/../liblogger
 DEPENDPATH += $$PWD/../liblogger
 
+# packet.h uses the decoder in tools/d7acodec
+INCLUDEPATH += $$PWD/../../d7acodec
+
 HEADERS += \
     clilogger.h
 